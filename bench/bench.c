@@ -0,0 +1,114 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Entrypoint for netlib microbenchmarks
+ *
+ * Usage: netlib_bench [benchmark...]
+ * Runs all benchmarks if none are named.
+ */
+
+#include <sys/types.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <data_util.h>
+
+#include "bench.h"
+
+static const bench_case benchmarks[] = {
+    { "csum",  bench_csum },
+    { "hdr",   bench_hdr },
+    { "slip",  bench_slip },
+    { "udp",   bench_udp },
+    { "graph", bench_graph },
+    { "route", bench_route },
+};
+
+#define BENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// How long to watch the TSC tick to find out its rate
+#define BENCH_TSC_CALIBRATE_NS 20000000
+
+/* Get amount of TSC cycles per nanosecond, measured on first call
+ *
+ * @return double cycles per nanosecond
+ */
+static double bench_tsc_per_ns(void) {
+    static double rate;
+
+    if (!rate) {
+        uint64_t start = monotonic_ns();
+        uint64_t tsc = __builtin_ia32_rdtsc();
+        uint64_t now;
+        do {
+            now = monotonic_ns();
+        } while ((now - start) < BENCH_TSC_CALIBRATE_NS);
+        rate = (double)(__builtin_ia32_rdtsc() - tsc) / (double)(now - start);
+    }
+    return rate;
+}
+
+/* Report result of a benchmark. Every operation is taken to be a packet
+ * for pps and cycles, which is what they are in most benchmarks.
+ *
+ * @param const char *name -- Name of the measurement
+ * @param uint64_t ops     -- Amount of operations done
+ * @param uint64_t ns      -- Time it took in nanoseconds
+ */
+void bench_report(const char *name, uint64_t ops, uint64_t ns) {
+    double ns_per_op = ops ? ((double)ns / (double)ops) : 0.0;
+    double mops = ns ? (((double)ops * 1000.0) / (double)ns) : 0.0;
+
+    printf("{\"bench\": \"%s\", \"ops\": %" PRIu64 ", \"ns\": %" PRIu64
+            ", \"ns_per_op\": %.2f, \"mops\": %.3f, \"pps\": %.0f"
+            ", \"cycles_per_op\": %.1f}\n",
+            name, ops, ns, ns_per_op, mops, mops * 1000000.0,
+            ns_per_op * bench_tsc_per_ns());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        int selected = (argc < 2);
+        for (int j = 1; j < argc; j++) {
+            if (!strcmp(argv[j], benchmarks[i].name)) {
+                selected = 1;
+            }
+        }
+        if (selected) {
+            benchmarks[i].run();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Minimal benchmark harness for netlib_bench. Each benchmark reports its
+ * results as one JSON object per line on stdout.
+ */
+#ifndef __NETLIB_BENCH_H__
+#define __NETLIB_BENCH_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/* Single benchmark
+ *
+ * @member const char *name -- Name used to select benchmark from command line
+ * @member void (*run)(void) -- Function running the benchmark
+ */
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} bench_case;
+
+/* Report result of a benchmark, with throughput and TSC cycles per
+ * operation worked out from ops and ns
+ *
+ * @param const char *name -- Name of the measurement
+ * @param uint64_t ops     -- Amount of operations done
+ * @param uint64_t ns      -- Time it took in nanoseconds
+ */
+void bench_report(const char *name, uint64_t ops, uint64_t ns);
+
+/* Deterministic pseudo random numbers (xorshift64*), so that runs
+ * are repeatable.
+ *
+ * @param uint64_t *state -- Pointer to generator state, must not be 0
+ * @return uint64_t next random number
+ */
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Keep compiler from optimizing away a value nobody reads
+ *
+ * @param uint64_t v -- Value to keep
+ */
+static inline void bench_keep(uint64_t v) {
+    __asm__ volatile("" : : "r"(v) : "memory");
+}
+
+// Benchmarks
+void bench_csum(void);
+void bench_hdr(void);
+void bench_slip(void);
+void bench_udp(void);
+void bench_graph(void);
+void bench_route(void);
+
+#endif // __NETLIB_BENCH_H__
@@ -0,0 +1,88 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Checksum benchmark across packet sizes and buffer alignments */
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <csum.h>
+#include <data_util.h>
+
+#include "bench.h"
+
+// Bytes summed per size, so that every size runs for about as long
+#define CSUM_BENCH_BYTES (1ULL << 31)
+
+static const size_t csum_bench_sizes[] = { 20, 64, 576, 1500, 9000 };
+static const size_t csum_bench_aligns[] = { 0, 1, 2, 4 };
+
+void bench_csum(void) {
+    uint64_t rng = 0x6373756d;
+    uint8_t *buf = malloc(9000 + 64);
+    char name[64];
+
+    if (!buf) {
+        fprintf(stderr, "csum: out of memory\n");
+        return;
+    }
+    for (size_t i = 0; i < 9000 + 64; i++) {
+        buf[i] = (uint8_t)bench_rand(&rng);
+    }
+
+    for (size_t s = 0; s < sizeof(csum_bench_sizes) / sizeof(csum_bench_sizes[0]); s++) {
+        size_t size = csum_bench_sizes[s];
+        uint64_t ops = CSUM_BENCH_BYTES / size;
+
+        // Header checksum as used on the transmit path
+        uint64_t start = monotonic_ns();
+        for (uint64_t i = 0; i < ops; i++) {
+            bench_keep(csum((uint16_t *)buf, size));
+        }
+        snprintf(name, sizeof(name), "csum_%zu", size);
+        bench_report(name, ops, monotonic_ns() - start);
+
+        for (size_t a = 0; a < sizeof(csum_bench_aligns) / sizeof(csum_bench_aligns[0]); a++) {
+            const uint8_t *data = buf + csum_bench_aligns[a];
+            start = monotonic_ns();
+            for (uint64_t i = 0; i < ops; i++) {
+                bench_keep(csum_fold(csum_partial(data, size, 0)));
+            }
+            snprintf(name, sizeof(name), "csum_partial_%zu_align%zu", size, csum_bench_aligns[a]);
+            bench_report(name, ops, monotonic_ns() - start);
+        }
+    }
+    free(buf);
+}
@@ -0,0 +1,107 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Vector graph against scalar UDP TX path.
+ *
+ * Needs CAP_NET_RAW, as frames really get sent out over loopback.
+ * Broadcast destination keeps address resolution out of the picture.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <graph.h>
+#include <ip.h>
+#include <link.h>
+#include <socket.h>
+#include <udp.h>
+
+#include "bench.h"
+
+#define GRAPH_BENCH_PACKETS (1 << 20)
+#define GRAPH_BENCH_PAYLOAD 64
+
+void bench_graph(void) {
+    uint8_t mac[6] = { 0x02, 0, 0, 0, 0, 1 };
+    uint8_t payload[GRAPH_BENCH_PAYLOAD] = { 0 };
+    uint32_t src = htonl(0x7f000001);
+    uint32_t dst = 0xffffffff;
+
+    netlib_ctx *ctx = netlib_ctx_create(NETLIB_CPU_ANY);
+    if (!ctx) {
+        perror("graph: netlib_ctx_create");
+        return;
+    }
+    net_socket *sock = new_socket(ctx, AF_INET, IPV4_PTCL_UDP, ETH, mac, "lo");
+    if (!sock) {
+        perror("graph: new_socket");
+        netlib_ctx_destroy(ctx);
+        return;
+    }
+    link_set_ipv4(sock, src, htonl(0xff000000), 0);
+    // Both paths batch their syscalls, so what's left is the stack itself
+    socket_set_tx_queue(sock, GRAPH_VECTOR_MAX);
+
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < GRAPH_BENCH_PACKETS; i++) {
+        udp_send(sock, src, dst, 1000, 2000, payload, sizeof(payload));
+    }
+    transmit_flush(sock);
+    bench_report("graph_tx_scalar", GRAPH_BENCH_PACKETS, monotonic_ns() - start);
+
+    pkt_vector *v = pkt_vector_create(GRAPH_BENCH_PAYLOAD);
+    if (!v) {
+        perror("graph: pkt_vector_create");
+        close_socket(sock);
+        netlib_ctx_destroy(ctx);
+        return;
+    }
+    start = monotonic_ns();
+    for (int i = 0; i < GRAPH_BENCH_PACKETS; i += GRAPH_VECTOR_MAX) {
+        for (int j = 0; j < GRAPH_VECTOR_MAX; j++) {
+            void *p = pkt_vector_add(v, src, dst, 1000, 2000, sizeof(payload));
+            memcpy(p, payload, sizeof(payload));
+        }
+        graph_tx(sock, v);
+    }
+    bench_report("graph_tx_vector", GRAPH_BENCH_PACKETS, monotonic_ns() - start);
+
+    pkt_vector_destroy(v);
+    close_socket(sock);
+    netlib_ctx_destroy(ctx);
+}
@@ -0,0 +1,140 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Header construction, IPv4 ID allocation and address parsing benchmarks */
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <eth.h>
+#include <ip.h>
+#include <udp.h>
+
+#include "bench.h"
+
+#define HDR_BENCH_OPS (1 << 22)
+
+// ID allocation slows down a lot as the space fills up, keep runs short
+#define HDR_BENCH_ID_OPS (1 << 14)
+
+// Share of the IPv4 ID space in use, per mille. A full space would never
+// give out another ID, so we stop short of it.
+static const unsigned hdr_bench_occupancy[] = { 0, 250, 500, 750, 900, 990 };
+
+static const char *const hdr_bench_addrs[] = {
+    "10.0.0.1", "192.168.100.200", "255.255.255.255", "1.2.3.4",
+    "172.16.254.3", "8.8.8.8", "127.0.0.1", "100.64.12.1"
+};
+
+/* Allocation and release of IPv4 IDs, with given share of the ID space
+ * held by headers that stay alive during the measurement
+ *
+ * @param netlib_ctx *ctx -- Stack instance to allocate IDs from
+ */
+static void bench_ipv4_id(netlib_ctx *ctx) {
+    ipv4_hdr **held = malloc(65536 * sizeof(ipv4_hdr *));
+    unsigned count = 0;
+    char name[64];
+
+    if (!held) {
+        fprintf(stderr, "hdr: out of memory\n");
+        return;
+    }
+    for (size_t o = 0; o < sizeof(hdr_bench_occupancy) / sizeof(hdr_bench_occupancy[0]); o++) {
+        unsigned want = (65535 * hdr_bench_occupancy[o]) / 1000;
+        while (count < want) {
+            held[count] = create_std_ipv4_hdr(ctx, 1, 2, IPV4_PTCL_UDP, 64);
+            if (!held[count]) {
+                break;
+            }
+            count++;
+        }
+
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < HDR_BENCH_ID_OPS; i++) {
+            destroy_ipv4_hdr(ctx, create_std_ipv4_hdr(ctx, 1, 2, IPV4_PTCL_UDP, 64));
+        }
+        snprintf(name, sizeof(name), "ipv4_id_occupancy_%u", hdr_bench_occupancy[o]);
+        bench_report(name, HDR_BENCH_ID_OPS, monotonic_ns() - start);
+    }
+    while (count) {
+        destroy_ipv4_hdr(ctx, held[--count]);
+    }
+    free(held);
+}
+
+void bench_hdr(void) {
+    uint8_t src_mac[6] = { 0x02, 0, 0, 0, 0, 1 };
+    uint8_t dst_mac[6] = { 0x02, 0, 0, 0, 0, 2 };
+    uint8_t payload[64] = { 0 };
+
+    netlib_ctx *ctx = netlib_ctx_create(NETLIB_CPU_ANY);
+    if (!ctx) {
+        perror("hdr: netlib_ctx_create");
+        return;
+    }
+
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < HDR_BENCH_OPS; i++) {
+        free(create_eth_hdr(src_mac, dst_mac, ETH_PTCL_IPV4));
+    }
+    bench_report("create_eth_hdr", HDR_BENCH_OPS, monotonic_ns() - start);
+
+    start = monotonic_ns();
+    for (int i = 0; i < HDR_BENCH_OPS; i++) {
+        destroy_ipv4_hdr(ctx, create_ipv4_hdr(ctx, htonl(0x0a000001), htonl(0x0a000002),
+                    0x10, 0, 64, IPV4_PTCL_UDP, 0, 0, 0, sizeof(udp_hdr) + sizeof(payload)));
+    }
+    bench_report("create_ipv4_hdr", HDR_BENCH_OPS, monotonic_ns() - start);
+
+    start = monotonic_ns();
+    for (int i = 0; i < HDR_BENCH_OPS; i++) {
+        free(create_udp_hdr(1000, 2000, payload, sizeof(payload)));
+    }
+    bench_report("create_udp_hdr", HDR_BENCH_OPS, monotonic_ns() - start);
+
+    bench_ipv4_id(ctx);
+
+    size_t naddrs = sizeof(hdr_bench_addrs) / sizeof(hdr_bench_addrs[0]);
+    start = monotonic_ns();
+    for (int i = 0; i < HDR_BENCH_OPS; i++) {
+        bench_keep(inet_addr(hdr_bench_addrs[i % naddrs]));
+    }
+    bench_report("inet_addr", HDR_BENCH_OPS, monotonic_ns() - start);
+
+    netlib_ctx_destroy(ctx);
+}
@@ -0,0 +1,138 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Routing table benchmark over an Internet-sized table */
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <data_util.h>
+#include <route.h>
+
+#include "bench.h"
+
+#define ROUTE_BENCH_PREFIXES 1000000
+#define ROUTE_BENCH_NEXTHOPS 64
+#define ROUTE_BENCH_ADDRS    (1 << 20)
+#define ROUTE_BENCH_LOOKUPS  (32 * ROUTE_BENCH_ADDRS)
+
+/* Rough prefix length distribution of the IPv4 default-free zone,
+ * cumulative per mille.
+ */
+static const struct {
+    uint8_t depth;
+    uint16_t cumulative;
+} route_bench_depths[] = {
+    { 8, 1 }, { 12, 2 }, { 14, 3 }, { 15, 5 }, { 16, 18 }, { 17, 26 },
+    { 18, 39 }, { 19, 64 }, { 20, 104 }, { 21, 149 }, { 22, 279 },
+    { 23, 379 }, { 24, 980 }, { 25, 985 }, { 26, 990 }, { 27, 993 },
+    { 28, 996 }, { 29, 998 }, { 30, 999 }, { 32, 1000 }
+};
+
+static uint8_t route_bench_depth(uint64_t *rng) {
+    uint16_t r = bench_rand(rng) % 1000;
+    for (size_t i = 0; i < sizeof(route_bench_depths) / sizeof(route_bench_depths[0]); i++) {
+        if (r < route_bench_depths[i].cumulative) {
+            return route_bench_depths[i].depth;
+        }
+    }
+    return 24;
+}
+
+void bench_route(void) {
+    uint64_t rng = 0x6e65746c6962ULL;
+    uint32_t *prefixes = malloc(ROUTE_BENCH_PREFIXES * sizeof(uint32_t));
+    uint8_t *depths = malloc(ROUTE_BENCH_PREFIXES);
+    uint32_t *addrs = malloc(ROUTE_BENCH_ADDRS * sizeof(uint32_t));
+    route_nexthop hops[ROUTE_BENCH_NEXTHOPS] = { 0 };
+
+    route_table *rt = route_table_create(1 << 16, ROUTE_BENCH_NEXTHOPS);
+    if (!prefixes || !depths || !addrs || !rt) {
+        fprintf(stderr, "route: out of memory\n");
+        return;
+    }
+    for (int i = 0; i < ROUTE_BENCH_NEXTHOPS; i++) {
+        hops[i].gateway = htonl(0x0a000001 + i);
+        hops[i].src = htonl(0x0a000000 + 0x100);
+        hops[i].mtu = 1500;
+    }
+    for (int i = 0; i < ROUTE_BENCH_PREFIXES; i++) {
+        prefixes[i] = (uint32_t)bench_rand(&rng);
+        depths[i] = route_bench_depth(&rng);
+    }
+
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < ROUTE_BENCH_PREFIXES; i++) {
+        route_add(rt, prefixes[i], depths[i], &hops[i % ROUTE_BENCH_NEXTHOPS]);
+    }
+    bench_report("route_add", ROUTE_BENCH_PREFIXES, monotonic_ns() - start);
+
+    // Uniformly random destinations, most of which hit tbl24 only
+    for (int i = 0; i < ROUTE_BENCH_ADDRS; i++) {
+        addrs[i] = (uint32_t)bench_rand(&rng);
+    }
+    uintptr_t sink = 0;
+    start = monotonic_ns();
+    for (int i = 0; i < ROUTE_BENCH_LOOKUPS; i++) {
+        sink += (uintptr_t)route_lookup(rt, addrs[i & (ROUTE_BENCH_ADDRS - 1)]);
+    }
+    bench_report("route_lookup_random", ROUTE_BENCH_LOOKUPS, monotonic_ns() - start);
+
+    // Destinations inside the prefixes we added, including the long ones
+    for (int i = 0; i < ROUTE_BENCH_ADDRS; i++) {
+        int p = bench_rand(&rng) % ROUTE_BENCH_PREFIXES;
+        uint32_t host = depths[p] == 32 ? 0 : ((uint32_t)bench_rand(&rng) >> depths[p]);
+        addrs[i] = prefixes[p] ^ htonl(host);
+    }
+    start = monotonic_ns();
+    for (int i = 0; i < ROUTE_BENCH_LOOKUPS; i++) {
+        sink += (uintptr_t)route_lookup(rt, addrs[i & (ROUTE_BENCH_ADDRS - 1)]);
+    }
+    bench_report("route_lookup_hit", ROUTE_BENCH_LOOKUPS, monotonic_ns() - start);
+
+    start = monotonic_ns();
+    for (int i = 0; i < ROUTE_BENCH_PREFIXES; i += 2) {
+        route_del(rt, prefixes[i], depths[i]);
+    }
+    bench_report("route_del", ROUTE_BENCH_PREFIXES / 2, monotonic_ns() - start);
+
+    if (sink == 1) {
+        printf("\n");
+    }
+    route_table_destroy(rt);
+    free(prefixes);
+    free(depths);
+    free(addrs);
+}
@@ -0,0 +1,110 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* SLIP encoder benchmark.
+ *
+ * slip_encode() is measured on its own with payloads that need no, some
+ * and only escaping. slip_transmit() writes straight to the UART, so it
+ * needs port I/O permission (CAP_SYS_RAWIO) and is skipped without it.
+ * Without a UART at the port reads come back as all ones, so it never
+ * waits and we measure the encoder plus port writes.
+ */
+
+#include <sys/types.h>
+#include <sys/io.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <data_util.h>
+#include <slip.h>
+
+#include "bench.h"
+
+#define SLIP_BENCH_PORT 0x02f8
+#define SLIP_BENCH_OPS  (1 << 16)
+
+static const size_t slip_bench_sizes[] = { 64, 576, 1006 };
+
+/* Measure encoding of a payload at every size
+ *
+ * @param const char *kind     -- Name of the payload
+ * @param const uint8_t *frame -- Payload of 1006 bytes
+ */
+static void bench_slip_encode(const char *kind, const uint8_t *frame) {
+    static uint8_t out[SLIP_ENCODED_MAX(1006)];
+    char name[64];
+
+    for (size_t s = 0; s < sizeof(slip_bench_sizes) / sizeof(slip_bench_sizes[0]); s++) {
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < SLIP_BENCH_OPS; i++) {
+            bench_keep(slip_encode(out, frame, slip_bench_sizes[s]));
+        }
+        snprintf(name, sizeof(name), "slip_encode_%s_%zu", kind, slip_bench_sizes[s]);
+        bench_report(name, SLIP_BENCH_OPS, monotonic_ns() - start);
+    }
+}
+
+void bench_slip(void) {
+    uint8_t frame[1006];
+    uint64_t rng = 0x736c6970;
+    char name[64];
+
+    memset(frame, 0x45, sizeof(frame));
+    bench_slip_encode("clean", frame);
+    memset(frame, SLIP_FRAME_END, sizeof(frame));
+    bench_slip_encode("escaped", frame);
+    // Random payload, about one in 128 bytes needs escaping
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = (uint8_t)bench_rand(&rng);
+    }
+    bench_slip_encode("random", frame);
+
+    if (ioperm(SLIP_BENCH_PORT, 8, 1) == -1) {
+        perror("slip: ioperm");
+        return;
+    }
+    if (slip_uart_init(SLIP_BENCH_PORT) == -1) {
+        perror("slip: FIFO, sending a byte per wait");
+    }
+
+    for (size_t s = 0; s < sizeof(slip_bench_sizes) / sizeof(slip_bench_sizes[0]); s++) {
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < SLIP_BENCH_OPS; i++) {
+            slip_transmit(SLIP_BENCH_PORT, frame, slip_bench_sizes[s]);
+        }
+        snprintf(name, sizeof(name), "slip_transmit_%zu", slip_bench_sizes[s]);
+        bench_report(name, SLIP_BENCH_OPS, monotonic_ns() - start);
+    }
+    ioperm(SLIP_BENCH_PORT, 8, 0);
+}
@@ -0,0 +1,117 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Full UDP send path over an in-memory link.
+ *
+ * The socket is cut off from the kernel and given a transmit queue, so
+ * frames are built, checksummed and copied into the queue as usual, and
+ * the queue is then thrown away instead of being sent. What's measured
+ * is the stack alone, without syscalls or privileges.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <ip.h>
+#include <link.h>
+#include <socket.h>
+#include <udp.h>
+
+#include "bench.h"
+
+#define UDP_BENCH_PACKETS (1 << 21)
+#define UDP_BENCH_QUEUE   256
+
+static const size_t udp_bench_sizes[] = { 18, 64, 512, 1472 };
+
+void bench_udp(void) {
+    uint8_t mac[6] = { 0x02, 0, 0, 0, 0, 1 };
+    uint8_t payload[1472] = { 0 };
+    uint32_t src = htonl(0x0a000001);
+    uint32_t dst = 0xffffffff;
+    char name[64];
+
+    netlib_ctx *ctx = netlib_ctx_create(NETLIB_CPU_ANY);
+    if (!ctx) {
+        perror("udp: netlib_ctx_create");
+        return;
+    }
+    net_socket *sock = new_socket(ctx, AF_INET, IPV4_PTCL_UDP, ETH, mac, "lo");
+    if (!sock) {
+        perror("udp: new_socket");
+        netlib_ctx_destroy(ctx);
+        return;
+    }
+    if (sock->raw_sockfd != -1) {
+        close(sock->raw_sockfd);
+        sock->raw_sockfd = -1;
+    }
+    link_set_ipv4(sock, src, htonl(0xff000000), 0);
+    if (socket_set_tx_queue(sock, UDP_BENCH_QUEUE) == -1) {
+        perror("udp: socket_set_tx_queue");
+        close_socket(sock);
+        netlib_ctx_destroy(ctx);
+        return;
+    }
+
+    for (size_t s = 0; s < sizeof(udp_bench_sizes) / sizeof(udp_bench_sizes[0]); s++) {
+        size_t size = udp_bench_sizes[s];
+
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < UDP_BENCH_PACKETS; i++) {
+            udp_send(sock, src, dst, 1000, 2000, payload, size);
+        }
+        snprintf(name, sizeof(name), "udp_send_%zu", size);
+        bench_report(name, UDP_BENCH_PACKETS, monotonic_ns() - start);
+
+        struct iovec iov[2] = {
+            { .iov_base = payload, .iov_len = size / 2 },
+            { .iov_base = payload + (size / 2), .iov_len = size - (size / 2) }
+        };
+        start = monotonic_ns();
+        for (int i = 0; i < UDP_BENCH_PACKETS; i++) {
+            udp_sendv(sock, src, dst, 1000, 2000, iov, 2);
+        }
+        snprintf(name, sizeof(name), "udp_sendv_%zu", size);
+        bench_report(name, UDP_BENCH_PACKETS, monotonic_ns() - start);
+    }
+
+    close_socket(sock);
+    netlib_ctx_destroy(ctx);
+}
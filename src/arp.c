@@ -0,0 +1,561 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Address Resolution Protocol and neighbor cache */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <arp.h>
+#include <ctx.h>
+#include <data_util.h>
+#include <eth.h>
+#include <link.h>
+
+#define ARP_CACHE_BITS 8
+#define ARP_CACHE_SIZE (1 << ARP_CACHE_BITS)
+
+// How many slots we look at for one address
+#define ARP_PROBE_LEN 8
+
+static const uint8_t ETH_BROADCAST[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+/* Neighbor entry states
+ *
+ * @member NEIGH_FREE       -- Slot is unused
+ * @member NEIGH_INCOMPLETE -- Request sent, waiting for reply
+ * @member NEIGH_REACHABLE  -- MAC address is known
+ */
+enum NEIGH_STATE {
+    NEIGH_FREE,
+    NEIGH_INCOMPLETE,
+    NEIGH_REACHABLE
+};
+
+/* Frame waiting for neighbor to be resolved
+ *
+ * @member void *frame -- Pointer to ethernet frame
+ * @member size_t len  -- Size of the frame
+ */
+typedef struct {
+    void *frame;
+    size_t len;
+} neigh_pending;
+
+/* Single neighbor cache entry. Fields up to and including state are
+ * read locklessly and must only be modified between neigh_write_begin()
+ * and neigh_write_end(). Rest of the fields are protected by arp_state lock.
+ *
+ * @member atomic_uint seq      -- Sequence counter, odd while entry is being written
+ * @member uint32_t addr        -- IPv4 address of the neighbor
+ * @member uint8_t mac          -- MAC address of the neighbor
+ * @member uint8_t state        -- Refer to enum NEIGH_STATE
+ * @member uint8_t probes       -- Requests sent since last confirmation
+ * @member uint64_t expires     -- Monotonic time when mapping expires
+ * @member uint64_t next_probe  -- Monotonic time when next request is due
+ * @member uint8_t q_head       -- Index of oldest queued frame
+ * @member uint8_t q_len        -- Amount of queued frames
+ * @member neigh_pending queue  -- Frames waiting for resolution
+ */
+typedef struct {
+    atomic_uint seq;
+    uint32_t addr;
+    uint8_t mac[6];
+    uint8_t state;
+    uint8_t probes;
+    uint64_t expires;
+    uint64_t next_probe;
+    uint8_t q_head;
+    uint8_t q_len;
+    neigh_pending queue[ARP_QUEUE_LEN];
+} neigh_entry;
+
+/* Neighbor cache of one stack instance
+ *
+ * @member neigh_entry table -- Open addressed table of neighbors
+ * @member mtx_t lock        -- Serialises all writers of the table
+ */
+struct arp_state {
+    neigh_entry table[ARP_CACHE_SIZE];
+    mtx_t lock;
+};
+
+static inline unsigned neigh_read_begin(neigh_entry *e) {
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+    } while (seq & 1);
+    return seq;
+}
+
+static inline bool neigh_read_retry(neigh_entry *e, unsigned seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&e->seq, memory_order_relaxed) != seq;
+}
+
+static inline void neigh_write_begin(neigh_entry *e) {
+    unsigned seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void neigh_write_end(neigh_entry *e) {
+    unsigned seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq + 1, memory_order_release);
+}
+
+/* Drop all frames queued for a neighbor. Called with arp->lock held.
+ *
+ * @param neigh_entry *e -- Pointer to neighbor entry
+ */
+static void neigh_drop_queue(neigh_entry *e) {
+    for (uint8_t i = 0; i < e->q_len; i++) {
+        free(e->queue[(e->q_head + i) % ARP_QUEUE_LEN].frame);
+    }
+    e->q_head = 0;
+    e->q_len = 0;
+}
+
+/* Release neighbor entry. Called with arp->lock held.
+ *
+ * @param neigh_entry *e -- Pointer to neighbor entry
+ */
+static void neigh_release(neigh_entry *e) {
+    neigh_drop_queue(e);
+    neigh_write_begin(e);
+    e->state = NEIGH_FREE;
+    e->addr = 0;
+    neigh_write_end(e);
+}
+
+/* Find neighbor entry for given address. Called with arp->lock held.
+ *
+ * @param struct arp_state *arp -- Neighbor cache to look in
+ * @param uint32_t addr         -- IPv4 address of the neighbor
+ * @return pointer to entry or 0 if there's none
+ */
+static neigh_entry *neigh_find(struct arp_state *arp, uint32_t addr) {
+    uint32_t idx = addr_hash(addr, ARP_CACHE_BITS);
+
+    for (int i = 0; i < ARP_PROBE_LEN; i++) {
+        neigh_entry *e = &arp->table[(idx + i) % ARP_CACHE_SIZE];
+        if (e->state != NEIGH_FREE && e->addr == addr) {
+            return e;
+        }
+    }
+    return 0;
+}
+
+/* Create incomplete neighbor entry for given address, evicting the entry
+ * closest to expiry if there's no room. Called with arp->lock held.
+ *
+ * @param struct arp_state *arp -- Neighbor cache to add to
+ * @param uint32_t addr         -- IPv4 address of the neighbor
+ * @return pointer to new entry
+ */
+static neigh_entry *neigh_create(struct arp_state *arp, uint32_t addr) {
+    uint32_t idx = addr_hash(addr, ARP_CACHE_BITS);
+    neigh_entry *e = &arp->table[idx];
+
+    for (int i = 0; i < ARP_PROBE_LEN; i++) {
+        neigh_entry *cand = &arp->table[(idx + i) % ARP_CACHE_SIZE];
+        if (cand->state == NEIGH_FREE) {
+            e = cand;
+            break;
+        }
+        if (cand->expires < e->expires) {
+            e = cand;
+        }
+    }
+    if (e->state != NEIGH_FREE) {
+        neigh_release(e);
+    }
+
+    neigh_write_begin(e);
+    e->addr = addr;
+    memset(e->mac, 0, 6);
+    e->state = NEIGH_INCOMPLETE;
+    neigh_write_end(e);
+
+    e->probes = 0;
+    e->expires = 0;
+    e->next_probe = 0;
+    return e;
+}
+
+/* Send frames queued for a neighbor that just got resolved
+ *
+ * @param net_socket *sock     -- Pointer to socket to send on
+ * @param const uint8_t *mac   -- MAC address of the neighbor
+ * @param neigh_pending *queue -- Frames to send
+ * @param uint8_t count        -- Amount of frames
+ */
+static void neigh_flush(net_socket *sock, const uint8_t *mac,
+        neigh_pending *queue, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        eth_hdr *hdr = (eth_hdr *)queue[i].frame;
+        memcpy(hdr->mac_dst, mac, 6);
+        transmit(sock, queue[i].frame, queue[i].len);
+        free(queue[i].frame);
+    }
+}
+
+/* Mark neighbor as reachable at given MAC address, and hand its queued
+ * frames over to the caller. Called with arp->lock held.
+ *
+ * @param neigh_entry *e       -- Pointer to neighbor entry
+ * @param const uint8_t *mac   -- MAC address of the neighbor
+ * @param neigh_pending *queue -- Pointer to where queued frames are moved to
+ * @return uint8_t amount of frames moved to queue
+ */
+static uint8_t neigh_confirm(neigh_entry *e, const uint8_t *mac,
+        neigh_pending *queue)
+{
+    uint8_t count = e->q_len;
+
+    if (e->state != NEIGH_REACHABLE || memcmp(e->mac, mac, 6) != 0) {
+        neigh_write_begin(e);
+        memcpy(e->mac, mac, 6);
+        e->state = NEIGH_REACHABLE;
+        neigh_write_end(e);
+    }
+    e->probes = 0;
+    e->expires = monotonic_ns() + ARP_REACHABLE_NS;
+    e->next_probe = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        queue[i] = e->queue[(e->q_head + i) % ARP_QUEUE_LEN];
+    }
+    e->q_head = 0;
+    e->q_len = 0;
+    return count;
+}
+
+/* Send ARP packet from our address
+ *
+ * @param net_socket *sock   -- Pointer to socket to send on
+ * @param uint16_t oper      -- Operation, refer to enum ARP_OP
+ * @param uint32_t tpa       -- Target protocol address
+ * @param const uint8_t *tha -- Target hardware address, or 0 to broadcast
+ * @return size_t amount of bytes sent or -1 on error.
+ */
+static size_t arp_send(net_socket *sock, uint16_t oper, uint32_t tpa,
+        const uint8_t *tha)
+{
+    link_options *link = (link_options *)sock->link_options;
+    const uint8_t *ours = link->proto.eth_header->mac_src;
+
+    // Pad to minimum ethernet frame size
+    uint8_t frame[60] = { 0 };
+    eth_hdr *eh = (eth_hdr *)frame;
+    arp_hdr *ah = POINTER_ADD(arp_hdr *, frame, sizeof(eth_hdr));
+
+    memcpy(eh->mac_dst, tha ? tha : ETH_BROADCAST, 6);
+    memcpy(eh->mac_src, ours, 6);
+    eth_set_ptcl(eh, ETH_PTCL_ARP);
+
+    ah->htype = htons(1);
+    ah->ptype = htons(ETH_PTCL_IPV4);
+    ah->hlen = 6;
+    ah->plen = 4;
+    ah->oper = htons(oper);
+    memcpy(ah->sha, ours, 6);
+    ah->spa = link->addr;
+    if (tha) {
+        memcpy(ah->tha, tha, 6);
+    }
+    ah->tpa = tpa;
+
+    return transmit(sock, frame, sizeof(frame));
+}
+
+/* Initialise neighbor cache of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int arp_initialise(netlib_ctx *ctx) {
+    struct arp_state *arp = netlib_ctx_alloc(sizeof(struct arp_state));
+    if (!arp) {
+        return -1;
+    }
+    if (mtx_init(&arp->lock, mtx_plain) != thrd_success) {
+        free(arp);
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx->arp = arp;
+    return 0;
+}
+
+/* Finalise neighbor cache of a stack instance, drops all queued packets
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void arp_finalise(netlib_ctx *ctx) {
+    struct arp_state *arp = ctx->arp;
+
+    if (!arp || ctx->arp_shared) {
+        ctx->arp = 0;
+        ctx->arp_shared = 0;
+        return;
+    }
+    mtx_lock(&arp->lock);
+    for (size_t i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp->table[i].state != NEIGH_FREE) {
+            neigh_release(&arp->table[i]);
+        }
+    }
+    mtx_unlock(&arp->lock);
+    mtx_destroy(&arp->lock);
+    free(arp);
+    ctx->arp = 0;
+}
+
+/* Look up link layer address of a neighbor without blocking.
+ *
+ * @param net_socket *sock -- Pointer to socket whose stack instance to look in
+ * @param uint32_t addr    -- IPv4 address of the neighbor
+ * @param uint8_t *mac     -- Pointer to where MAC address is written to
+ * @return bool true if neighbor is known, false otherwise
+ */
+bool arp_lookup(net_socket *sock, uint32_t addr, uint8_t *mac) {
+    struct arp_state *arp = sock->ctx->arp;
+    uint32_t idx = addr_hash(addr, ARP_CACHE_BITS);
+
+    for (int i = 0; i < ARP_PROBE_LEN; i++) {
+        neigh_entry *e = &arp->table[(idx + i) % ARP_CACHE_SIZE];
+        unsigned seq;
+        bool hit;
+        uint8_t state;
+
+        do {
+            seq = neigh_read_begin(e);
+            hit = (e->addr == addr);
+            state = e->state;
+            memcpy(mac, e->mac, 6);
+        } while (neigh_read_retry(e, seq));
+
+        if (hit && state != NEIGH_FREE) {
+            return (state == NEIGH_REACHABLE);
+        }
+    }
+    return false;
+}
+
+/* Queue a frame for a neighbor we don't know the address of yet, and start
+ * resolving it.
+ *
+ * @param net_socket *sock -- Pointer to socket to send on
+ * @param uint32_t addr    -- IPv4 address of the neighbor
+ * @param void *frame      -- Pointer to complete ethernet frame, with
+ *                            destination MAC left for us to fill in.
+ *                            Ownership of the frame moves to neighbor cache.
+ * @param size_t len       -- Size of the frame
+ * @return size_t len on success or -1 on error.
+ *         Set errno on error.
+ */
+size_t arp_queue(net_socket *sock, uint32_t addr, void *frame, size_t len) {
+    struct arp_state *arp = sock->ctx->arp;
+    bool resolve = false;
+    uint8_t mac[6];
+
+    mtx_lock(&arp->lock);
+    neigh_entry *e = neigh_find(arp, addr);
+    if (e && e->state == NEIGH_REACHABLE) {
+        // Got resolved while we weren't looking
+        memcpy(mac, e->mac, 6);
+        mtx_unlock(&arp->lock);
+
+        memcpy(((eth_hdr *)frame)->mac_dst, mac, 6);
+        size_t sent = transmit(sock, frame, len);
+        free(frame);
+        return sent;
+    }
+    if (!e) {
+        e = neigh_create(arp, addr);
+        e->probes = 1;
+        e->next_probe = monotonic_ns() + ARP_RETRANS_NS;
+        resolve = true;
+    }
+    if (e->q_len == ARP_QUEUE_LEN) {
+        free(e->queue[e->q_head].frame);
+        e->q_head = (e->q_head + 1) % ARP_QUEUE_LEN;
+        e->q_len--;
+    }
+    neigh_pending *slot = &e->queue[(e->q_head + e->q_len) % ARP_QUEUE_LEN];
+    slot->frame = frame;
+    slot->len = len;
+    e->q_len++;
+    mtx_unlock(&arp->lock);
+
+    if (resolve) {
+        arp_send(sock, ARP_OP_REQUEST, addr, 0);
+    }
+    return len;
+}
+
+/* Handle ARP packet we've received.
+ *
+ * @param net_socket *sock -- Pointer to socket the packet was received on
+ * @param void *frame      -- Pointer to received frame, including ethernet header
+ * @param size_t len       -- Size of the received frame
+ * @return size_t amount of bytes consumed on success or -1 if packet was dropped.
+ *         Set errno on error.
+ */
+size_t arp_rx(net_socket *sock, void *frame, size_t len) {
+    struct arp_state *arp = sock->ctx->arp;
+    link_options *link = (link_options *)sock->link_options;
+    const uint8_t *ours = link->proto.eth_header->mac_src;
+    eth_hdr *eh = (eth_hdr *)frame;
+    arp_hdr *ah = POINTER_ADD(arp_hdr *, frame, sizeof(eth_hdr));
+
+    if (len < (sizeof(eth_hdr) + sizeof(arp_hdr))) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ah->htype != htons(1) || ah->ptype != htons(ETH_PTCL_IPV4) ||
+            ah->hlen != 6 || ah->plen != 4) {
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+
+    uint32_t spa = ah->spa;
+    bool for_us = (link->addr && ah->tpa == link->addr);
+    neigh_pending queue[ARP_QUEUE_LEN];
+    uint8_t count = 0;
+
+    /* As per RFC 826, update mapping of any sender we already know about
+     * (this is also how gratuitous ARP gets handled), and learn the sender
+     * if the packet was meant for us. Probes with sender address of 0
+     * don't tell us anything.
+     */
+    if (spa) {
+        mtx_lock(&arp->lock);
+        neigh_entry *e = neigh_find(arp, spa);
+        if (!e && for_us) {
+            e = neigh_create(arp, spa);
+        }
+        if (e) {
+            count = neigh_confirm(e, ah->sha, queue);
+        }
+        mtx_unlock(&arp->lock);
+        neigh_flush(sock, ah->sha, queue, count);
+    }
+
+    if (for_us && ah->oper == htons(ARP_OP_REQUEST)) {
+        // Answer in place
+        ah->oper = htons(ARP_OP_REPLY);
+        memcpy(ah->tha, ah->sha, 6);
+        ah->tpa = spa;
+        memcpy(ah->sha, ours, 6);
+        ah->spa = link->addr;
+        memcpy(eh->mac_dst, eh->mac_src, 6);
+        memcpy(eh->mac_src, ours, 6);
+        transmit(sock, frame, len);
+    }
+    return len;
+}
+
+/* Broadcast gratuitous ARP announcing our address
+ *
+ * @param net_socket *sock -- Pointer to socket to send on
+ * @return size_t amount of bytes sent or -1 on error.
+ *         Set errno on error.
+ */
+size_t arp_announce(net_socket *sock) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (link->type != ETH || !link->addr) {
+        errno = EINVAL;
+        return -1;
+    }
+    return arp_send(sock, ARP_OP_REQUEST, link->addr, 0);
+}
+
+/* Run neighbor cache timers.
+ *
+ * @param net_socket *sock -- Pointer to socket to send on
+ */
+void arp_tick(net_socket *sock) {
+    struct arp_state *arp = sock->ctx->arp;
+    link_options *link = (link_options *)sock->link_options;
+    uint64_t now = monotonic_ns();
+
+    if (link->type != ETH) {
+        return;
+    }
+
+    mtx_lock(&arp->lock);
+    for (size_t i = 0; i < ARP_CACHE_SIZE; i++) {
+        neigh_entry *e = &arp->table[i];
+
+        switch (e->state) {
+        case (NEIGH_INCOMPLETE):
+            if (now < e->next_probe) {
+                break;
+            }
+            if (e->probes >= ARP_MAX_PROBES) {
+                neigh_release(e);
+                break;
+            }
+            e->probes++;
+            e->next_probe = now + ARP_RETRANS_NS;
+            arp_send(sock, ARP_OP_REQUEST, e->addr, 0);
+            break;
+        case (NEIGH_REACHABLE):
+            if (now >= e->expires) {
+                neigh_release(e);
+                break;
+            }
+            // Refresh with unicast requests while mapping is still usable,
+            // so senders never see it disappear under them.
+            if ((now + ARP_REFRESH_NS) >= e->expires && now >= e->next_probe) {
+                e->probes++;
+                e->next_probe = now + ARP_RETRANS_NS;
+                arp_send(sock, ARP_OP_REQUEST, e->addr, e->mac);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    mtx_unlock(&arp->lock);
+}
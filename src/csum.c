@@ -37,8 +37,10 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <csum.h>
+#include <data_util.h>
 
 /* Craft a ipv4 pseudo header from source/destination sockaddr_in structures
  *
@@ -57,11 +59,11 @@ ipv4_psd_hdr *craft_ipv4_psd_hdr(uint32_t src,
     ipv4_psd_hdr *ret = calloc(1, sizeof(ipv4_psd_hdr));
     assert(ret && "Unable to allocate memory for pseudo header\n");
 
-    ret->src  = src;
-    ret->dst  = dst;
+    store_u32(ret->src, src);
+    store_u32(ret->dst, dst);
     ret->zero = (uint8_t)0;
     ret->ptcl = ptcl;
-    ret->len = (uint16_t)(len & 0x0000FFFF);
+    store_be16(ret->len, (uint16_t)(len & 0x0000FFFF));
     return ret;
 }
 
@@ -72,22 +74,111 @@ ipv4_psd_hdr *craft_ipv4_psd_hdr(uint32_t src,
  * @param size_t size -- Size of data in bytes
  */
 uint16_t csum(uint16_t *data, size_t size) {
-    unsigned long sum = 0;
+    return csum_fold(csum_partial(data, size, 0));
+}
+
+/* Add data to a running, unfolded, ones' complement sum.
+ *
+ * The ones' complement sum is byte order independent, so we can just add
+ * up native 32-bit words into a wide accumulator and fold at the end.
+ *
+ * @param const void *data -- Pointer to data to sum
+ * @param size_t size      -- Size of data in bytes
+ * @param uint32_t sum     -- Sum so far, 0 to start a new one
+ * @return uint32_t updated partial sum
+ */
+uint32_t csum_partial(const void *data, size_t size, uint32_t sum) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t acc = sum;
 
-    while (size > 1) {
-        sum += *data++;
+    while (size >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        acc += (w & 0xffffffff) + (w >> 32);
+        p += 8;
+        size -= 8;
+    }
+    if (size >= 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        acc += w;
+        p += 4;
+        size -= 4;
+    }
+    if (size >= 2) {
+        uint16_t w;
+        memcpy(&w, p, 2);
+        acc += w;
+        p += 2;
         size -= 2;
     }
-    if (size > 0) {
+    if (size) {
         // pad with 0 to match 16 bit boundaries
-        uint16_t t = (*(uint8_t*)data) << 8;
-        sum += t;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        acc += *p;
+#else
+        acc += (uint16_t)(*p << 8);
+#endif
     }
 
-    while (sum >> 16) {
-        sum = (sum & 0x0000ffff) + (sum >> 16);
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    return (uint32_t)acc;
+}
+
+/* Add data described by an iovec array to a running, unfolded, ones'
+ * complement sum.
+ *
+ * An entry that starts at odd offset has its bytes in the opposite halves
+ * of the 16-bit words compared to summing it on its own, so its sum gets
+ * byte swapped before adding it in.
+ *
+ * @param const struct iovec *iov -- Pointer to iovec array
+ * @param int iovcnt              -- Amount of entries in iov
+ * @param uint32_t sum            -- Sum so far, 0 to start a new one
+ * @return uint32_t updated partial sum
+ */
+uint32_t csum_partial_iov(const struct iovec *iov, int iovcnt, uint32_t sum) {
+    int odd = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        uint32_t s = csum_partial(iov[i].iov_base, iov[i].iov_len, 0);
+        if (odd) {
+            s = (s & 0x0000ffff) + (s >> 16);
+            s = (s & 0x0000ffff) + (s >> 16);
+            s = ((s & 0xff) << 8) | (s >> 8);
+        }
+        sum = csum_add(sum, s);
+        odd ^= iov[i].iov_len & 1;
     }
-    sum = (uint16_t)~sum;
-    return (uint16_t)sum;
+    return sum;
+}
+
+/* Fold partial sum into a final 16-bit checksum
+ *
+ * @param uint32_t sum -- Partial sum from csum_partial()
+ * @return uint16_t checksum, ready to be stored in a header
+ */
+uint16_t csum_fold(uint32_t sum) {
+    sum = (sum & 0x0000ffff) + (sum >> 16);
+    sum = (sum & 0x0000ffff) + (sum >> 16);
+    return (uint16_t)~sum;
 }
 
+/* Incrementally update a checksum after one 16-bit word it covers has
+ * changed, as per RFC 1624 (eqn. 3): HC' = ~(~HC + ~m + m')
+ *
+ * @param uint16_t sum  -- Checksum as currently stored in the header
+ * @param uint16_t from -- Old value of the modified 16-bit word
+ * @param uint16_t to   -- New value of the modified 16-bit word
+ * @return uint16_t updated checksum
+ */
+uint16_t csum_replace16(uint16_t sum, uint16_t from, uint16_t to) {
+    uint32_t acc = (uint16_t)~sum;
+
+    acc += (uint16_t)~from;
+    acc += to;
+    acc = (acc & 0x0000ffff) + (acc >> 16);
+    acc = (acc & 0x0000ffff) + (acc >> 16);
+    return (uint16_t)~acc;
+}
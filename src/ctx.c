@@ -0,0 +1,114 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-core stack instances */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <arp.h>
+#include <ctx.h>
+#include <icmp.h>
+#include <ip.h>
+#include <pmtu.h>
+#include <stats.h>
+
+/* Allocate zeroed, cache line aligned memory for instance state
+ *
+ * @param size_t size -- Amount of bytes to allocate
+ * @return pointer to memory on success or 0 on error.
+ *         Errno is set for us by aligned_alloc()
+ */
+void *netlib_ctx_alloc(size_t size) {
+    // Round up so that nothing else ends up sharing our last cache line
+    size = (size + NETLIB_CACHELINE - 1) & ~(size_t)(NETLIB_CACHELINE - 1);
+
+    void *ret = aligned_alloc(NETLIB_CACHELINE, size);
+    if (ret) {
+        memset(ret, 0, size);
+    }
+    return ret;
+}
+
+/* Create a stack instance. Pins the calling thread to given CPU first,
+ * so that all state gets allocated from memory local to that CPU.
+ *
+ * @param int cpu -- CPU to pin calling thread to, or NETLIB_CPU_ANY
+ * @return pointer to new instance on success or 0 on error.
+ *         Set errno on error.
+ */
+netlib_ctx *netlib_ctx_create(int cpu) {
+    if (cpu != NETLIB_CPU_ANY && netlib_pin_cpu(cpu) == -1) {
+        return 0;
+    }
+
+    netlib_ctx *ctx = netlib_ctx_alloc(sizeof(netlib_ctx));
+    if (!ctx) {
+        return 0;
+    }
+    ctx->cpu = cpu;
+
+    if (stats_initialise(ctx) == -1 || ip_initialise(ctx) == -1 ||
+            icmp_initialise(ctx) == -1 || pmtu_initialise(ctx) == -1 ||
+            arp_initialise(ctx) == -1) {
+        netlib_ctx_destroy(ctx);
+        return 0;
+    }
+    return ctx;
+}
+
+/* Make instance use neighbor cache of another instance. Owner has to be
+ * destroyed last.
+ *
+ * @param netlib_ctx *ctx   -- Instance giving up its own cache
+ * @param netlib_ctx *owner -- Instance whose cache to use
+ */
+void netlib_ctx_share_neighbors(netlib_ctx *ctx, netlib_ctx *owner) {
+    arp_finalise(ctx);
+    ctx->arp = owner->arp;
+    ctx->arp_shared = 1;
+}
+
+/* Destroy a stack instance. Sockets bound to it must be closed first.
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance to destroy
+ */
+void netlib_ctx_destroy(netlib_ctx *ctx) {
+    arp_finalise(ctx);
+    pmtu_finalise(ctx);
+    icmp_finalise(ctx);
+    ip_finalise(ctx);
+    stats_finalise(ctx);
+    free(ctx);
+}
@@ -37,6 +37,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <data_util.h>
 
@@ -48,21 +49,107 @@
  */
 uint32_t inet_addr(const char *ip) {
     uint32_t ret = 0;
-    char *tmp = strdup(ip);
-    char *tok = strtok(tmp, ".");
-    if (!tok) {
-        return 0;
-    }
 
-    for (int i = 0; i < 4; i++) {
-        uint8_t val = atoi(tok);
-        ret |= (val << (i * 8));
-        tok = strtok(NULL, ".");
+    // Parse in place, strtok() would share its state between threads
+    for (int i = 0; i < 4 && *ip; i++) {
+        uint8_t val = 0;
+        while (*ip >= '0' && *ip <= '9') {
+            val = (val * 10) + (*ip++ - '0');
+        }
+        ret |= ((uint32_t)val << (i * 8));
+        if (*ip == '.') {
+            ip++;
+        }
     }
-    free(tmp);
     return ret;
 }
 
+/* Parse single hex digit
+ *
+ * @param char c -- Character to parse
+ * @return int value of the digit or -1 if c isn't a hex digit
+ */
+static inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Create IPv6 address from string representation, ie. "fe80::1"
+ *
+ * @param const char *ip -- Pointer to IPv6 address string
+ * @param ipv6_addr *out -- Pointer to where address is written to
+ * @return int 0 on success or -1 if string isn't a valid address
+ */
+int inet6_addr(const char *ip, ipv6_addr *out) {
+    uint16_t groups[8];
+    int count = 0;
+    int gap = -1;
+
+    if (ip[0] == ':') {
+        if (ip[1] != ':') {
+            return -1;
+        }
+        ip++;
+    }
+    while (*ip) {
+        if (*ip == ':') {
+            // "::" stands for one or more groups of zeroes
+            if (gap != -1) {
+                return -1;
+            }
+            gap = count;
+            ip++;
+            continue;
+        }
+        if (count == 8) {
+            return -1;
+        }
+
+        uint32_t val = 0;
+        int digits = 0;
+        int d;
+        while ((d = hex_digit(*ip)) != -1) {
+            val = (val << 4) | d;
+            digits++;
+            ip++;
+        }
+        if (!digits || digits > 4) {
+            return -1;
+        }
+        groups[count++] = (uint16_t)val;
+
+        if (*ip == ':') {
+            ip++;
+            if (!*ip) {
+                return -1;
+            }
+        } else if (*ip) {
+            return -1;
+        }
+    }
+
+    if ((gap == -1 && count != 8) || (gap != -1 && count == 8)) {
+        return -1;
+    }
+
+    memset(out, 0, sizeof(ipv6_addr));
+    int tail = (gap == -1) ? 0 : count - gap;
+    for (int i = 0; i < count; i++) {
+        int pos = (gap != -1 && i >= gap) ? (8 - tail + (i - gap)) : i;
+        out->octets[pos * 2] = groups[i] >> 8;
+        out->octets[(pos * 2) + 1] = groups[i] & 0xff;
+    }
+    return 0;
+}
+
 /* Helper to create continuous packet from various protocol header structures
  * and user-provided payload.
  *
@@ -96,3 +183,35 @@ size_t build_packet(void **pkt, void *iphdr, size_t iplen,
     return total;
 }
 
+/* Copy data described by an iovec array into a single buffer.
+ *
+ * @param const struct iovec *iov -- Pointer to iovec array
+ * @param int iovcnt              -- Amount of entries in iov
+ * @param size_t *len             -- Pointer to where size of the buffer is written to
+ * @return pointer to allocated buffer on success or 0 on error.
+ *         Errno is set for us by malloc()
+ */
+void *iov_gather(const struct iovec *iov, int iovcnt, size_t *len) {
+    size_t total = iov_length(iov, iovcnt);
+    uint8_t *ret = malloc(total ? total : 1);
+    if (!ret) {
+        return ret;
+    }
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(ret + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    *len = total;
+    return ret;
+}
+
+/* Read monotonic clock
+ *
+ * @return uint64_t current monotonic time in nanoseconds
+ */
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
@@ -35,19 +35,25 @@
  */
 #include <sys/types.h>
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <arp.h>
 #include <data_util.h>
 #include <eth.h>
+#include <ip.h>
 #include <link.h>
+#include <stats.h>
 
 
 /* Create ethernet header with given source and destination MAC addresses
  * and protocol type
  *
  * @param uint8_t *src      -- Pointer to source mac address
- * @param uint8_t *dst      -- Pointer to destination mac address
+ * @param uint8_t *dst      -- Pointer to destination mac address, or 0 to
+ *                             leave it for eth_transmit() to fill in
  * @param uint16_t proto    -- Protocol to use
  * @return pointer to populated ethernet header
  */
@@ -57,11 +63,94 @@ eth_hdr *create_eth_hdr(uint8_t *src, uint8_t *dst, uint16_t proto) {
         return ret;
     }
     memcpy(ret->mac_src, src, 6);
-    memcpy(ret->mac_dst, dst, 6);
-    ret->ptcl = htons(proto);
+    if (dst) {
+        memcpy(ret->mac_dst, dst, 6);
+    }
+    eth_set_ptcl(ret, proto);
     return ret;
 }
 
+/* Pick the host we need to hand a datagram to on the local link
+ *
+ * @param link_options *link -- Pointer to link we're sending on
+ * @param uint32_t dst       -- Final destination of the datagram
+ * @return uint32_t address of next hop
+ */
+static inline uint32_t eth_nexthop(link_options *link, uint32_t dst) {
+    if (link->routes) {
+        const route_nexthop *nh = route_lookup(link->routes, dst);
+        if (nh && nh->gateway) {
+            return nh->gateway;
+        }
+        return dst;
+    }
+    if (link->gateway && ((dst ^ link->addr) & link->netmask)) {
+        return link->gateway;
+    }
+    return dst;
+}
+
+/* Map addresses that don't need resolving (broadcast, multicast) straight
+ * to their MAC addresses.
+ *
+ * @param link_options *link -- Pointer to link we're sending on
+ * @param uint32_t addr      -- Next hop address
+ * @param uint8_t *mac       -- Pointer to where MAC address is written to
+ * @return bool true if address was mapped
+ */
+static inline bool eth_map_addr(link_options *link, uint32_t addr, uint8_t *mac) {
+    const uint8_t *octets = (const uint8_t *)&addr;
+
+    if (addr == 0xffffffff ||
+            (link->netmask && (addr | link->netmask) == 0xffffffff)) {
+        memset(mac, 0xff, 6);
+        return true;
+    }
+    if ((octets[0] & 0xf0) == 0xe0) {
+        // 01:00:5e + low 23 bits of group address (RFC 1112)
+        mac[0] = 0x01;
+        mac[1] = 0x00;
+        mac[2] = 0x5e;
+        mac[3] = octets[1] & 0x7f;
+        mac[4] = octets[2];
+        mac[5] = octets[3];
+        return true;
+    }
+    return false;
+}
+
+/* Pick destination MAC address for IPv6 datagram. Multicast groups map
+ * to 33:33 + low 32 bits of the group (RFC 2464), anything else goes
+ * through the configured router.
+ *
+ * @param link_options *link  -- Pointer to link we're sending on
+ * @param const ipv6_addr *dst -- Destination address
+ * @param uint8_t *mac        -- Pointer to where MAC address is written to
+ */
+static inline void eth_map_addr6(link_options *link, const ipv6_addr *dst,
+        uint8_t *mac)
+{
+    if (dst->octets[0] == 0xff) {
+        mac[0] = 0x33;
+        mac[1] = 0x33;
+        memcpy(&mac[2], &dst->octets[12], 4);
+        return;
+    }
+    memcpy(mac, link->router6_mac, 6);
+}
+
+/* Count frame handed to the socket
+ *
+ * @param netlib_ctx *ctx -- Stack instance the frame was sent on
+ * @param size_t sent     -- What the socket returned
+ */
+static inline void eth_count_tx(netlib_ctx *ctx, size_t sent) {
+    if (sent != (size_t)-1) {
+        NETLIB_STAT_INC(ctx, eth_tx_packets);
+        NETLIB_STAT_ADD(ctx, eth_tx_bytes, sent);
+    }
+}
+
 /* Transmit datagram over ethernet.
  *
  * @param net_socket *sock -- Pointer to socket we're working with
@@ -71,20 +160,267 @@ eth_hdr *create_eth_hdr(uint8_t *src, uint8_t *dst, uint16_t proto) {
  *         Set errno on error.
  */
 size_t eth_transmit(net_socket *sock, const void *data, size_t len) {
-    uint16_t sent = -1;
+    size_t sent = -1;
     link_options *link = (link_options *)sock->link_options;
+    const ipv4_hdr *iph = (const ipv4_hdr *)data;
 
-    void *packet = calloc(1, (sizeof(eth_hdr) + len));
+    NETLIB_STAT_INC(sock->ctx, alloc);
+    void *packet = malloc(sizeof(eth_hdr) + len);
     if (!packet) {
+        NETLIB_STAT_INC(sock->ctx, alloc_failures);
         return sent;
     }
 
     memcpy(packet, link->proto.eth_header, sizeof(eth_hdr));
     memcpy(POINTER_ADD(void *, packet, sizeof(eth_hdr)), data, len);
 
+    eth_hdr *hdr = (eth_hdr *)packet;
+    if ((*(const uint8_t *)data >> 4) == 6) {
+        eth_set_ptcl(hdr, ETH_PTCL_IPV6);
+        eth_map_addr6(link, &((const ipv6_hdr *)data)->dst, hdr->mac_dst);
+        sent = transmit(sock, (const void *)packet, (sizeof(eth_hdr) + len));
+        eth_count_tx(sock->ctx, sent);
+        free(packet);
+        return sent;
+    }
+
+    uint32_t nexthop = eth_nexthop(link, ipv4_dst(iph));
+    if (!eth_map_addr(link, nexthop, hdr->mac_dst) &&
+            !arp_lookup(sock, nexthop, hdr->mac_dst)) {
+        // Frame is now owned by the neighbor cache
+        NETLIB_STAT_INC(sock->ctx, eth_tx_arp_queued);
+        return arp_queue(sock, nexthop, packet, (sizeof(eth_hdr) + len));
+    }
+
     sent = transmit(sock, (const void *)packet, (sizeof(eth_hdr) + len));
+    eth_count_tx(sock->ctx, sent);
 
     free(packet);
     return sent;
 }
 
+/* Transmit IPv4 datagram gathered from several buffers over ethernet.
+ *
+ * @param net_socket *sock  -- Pointer to socket we're working with
+ * @param struct iovec *iov -- Pieces of the datagram, IPv4 header first
+ * @param int iovcnt        -- Amount of entries in iov
+ * @return size_t bytes sent on success or -1 on error.
+ *         Set errno on error.
+ */
+size_t eth_transmitv(net_socket *sock, struct iovec *iov, int iovcnt) {
+    link_options *link = (link_options *)sock->link_options;
+    const ipv4_hdr *iph = (const ipv4_hdr *)iov[0].iov_base;
+    eth_hdr *hdr = (eth_hdr *)((uint8_t *)iov[0].iov_base - sizeof(eth_hdr));
+
+    memcpy(hdr, link->proto.eth_header, sizeof(eth_hdr));
+    eth_set_ptcl(hdr, ETH_PTCL_IPV4);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len += sizeof(eth_hdr);
+
+    uint32_t nexthop = eth_nexthop(link, ipv4_dst(iph));
+    if (!eth_map_addr(link, nexthop, hdr->mac_dst) &&
+            !arp_lookup(sock, nexthop, hdr->mac_dst)) {
+        // Neighbor cache needs a frame of its own to hold on to
+        size_t len;
+        NETLIB_STAT_INC(sock->ctx, alloc);
+        void *frame = iov_gather(iov, iovcnt, &len);
+        if (!frame) {
+            NETLIB_STAT_INC(sock->ctx, alloc_failures);
+            return -1;
+        }
+        NETLIB_STAT_INC(sock->ctx, eth_tx_arp_queued);
+        return arp_queue(sock, nexthop, frame, len);
+    }
+    size_t sent = transmitv(sock, iov, iovcnt);
+    eth_count_tx(sock->ctx, sent);
+    return sent;
+}
+
+/* Ethernet encapsulation node of the TX graph.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Vector of IPv4 datagrams
+ * @return unsigned amount of frames left in vector
+ */
+unsigned eth_encap_vec(net_socket *sock, pkt_vector *v) {
+    link_options *link = (link_options *)sock->link_options;
+    uint32_t last_hop = 0;
+    bool resolved = false;
+    uint8_t mac[6];
+    unsigned kept = 0;
+
+    for (unsigned i = 0; i < v->count; i++) {
+        pkt_desc *d = &v->desc[i];
+        if ((i + GRAPH_PREFETCH) < v->count) {
+            __builtin_prefetch(v->desc[i + GRAPH_PREFETCH].data - sizeof(eth_hdr), 1);
+        }
+        // Neighbor cache is only consulted when next hop changes
+        uint32_t nexthop = eth_nexthop(link, d->dst);
+        if (!resolved || nexthop != last_hop) {
+            resolved = eth_map_addr(link, nexthop, mac) ||
+                arp_lookup(sock, nexthop, mac);
+            last_hop = nexthop;
+        }
+        if (!resolved) {
+            NETLIB_STAT_INC(sock->ctx, alloc);
+            void *frame = malloc(sizeof(eth_hdr) + d->len);
+            if (!frame) {
+                NETLIB_STAT_INC(sock->ctx, alloc_failures);
+                v->dropped++;
+                continue;
+            }
+            memcpy(frame, link->proto.eth_header, sizeof(eth_hdr));
+            eth_set_ptcl((eth_hdr *)frame, ETH_PTCL_IPV4);
+            memcpy(POINTER_ADD(void *, frame, sizeof(eth_hdr)), d->data, d->len);
+            NETLIB_STAT_INC(sock->ctx, eth_tx_arp_queued);
+            arp_queue(sock, nexthop, frame, sizeof(eth_hdr) + d->len);
+            continue;
+        }
+        d->data -= sizeof(eth_hdr);
+        d->len += sizeof(eth_hdr);
+
+        eth_hdr *hdr = (eth_hdr *)d->data;
+        memcpy(hdr->mac_dst, mac, 6);
+        memcpy(hdr->mac_src, link->proto.eth_header->mac_src, 6);
+        eth_set_ptcl(hdr, ETH_PTCL_IPV4);
+        NETLIB_STAT_ADD(sock->ctx, eth_tx_bytes, d->len);
+        v->desc[kept++] = *d;
+    }
+    NETLIB_STAT_ADD(sock->ctx, eth_tx_packets, kept);
+    v->count = kept;
+    return kept;
+}
+
+/* Ethernet input node of the RX graph.
+ *
+ * @param net_socket *sock -- Pointer to socket the frames were received on
+ * @param pkt_vector *v    -- Vector of received frames
+ * @return unsigned amount of IPv4 datagrams left in vector
+ */
+unsigned eth_input_vec(net_socket *sock, pkt_vector *v) {
+    unsigned kept = 0;
+
+    for (unsigned i = 0; i < v->count; i++) {
+        pkt_desc *d = &v->desc[i];
+        if ((i + GRAPH_PREFETCH) < v->count) {
+            __builtin_prefetch(v->desc[i + GRAPH_PREFETCH].data);
+        }
+        uint16_t ptcl;
+        size_t off = eth_payload(sock, d->data, d->len, &ptcl);
+        if (off == (size_t)-1) {
+            NETLIB_STAT_INC(sock->ctx, eth_rx_not_ours);
+            v->dropped++;
+            continue;
+        }
+        NETLIB_STAT_INC(sock->ctx, eth_rx_packets);
+        NETLIB_STAT_ADD(sock->ctx, eth_rx_bytes, d->len);
+        switch (ptcl) {
+        case (ETH_PTCL_IPV4):
+            d->off = off;
+            v->desc[kept++] = *d;
+            break;
+        case (ETH_PTCL_ARP):
+            arp_rx(sock, d->data, d->len);
+            break;
+        case (ETH_PTCL_IPV6):
+            // Doesn't go further down the graph, which is IPv4 only
+            if (ipv6_rx(sock, d->data, off, d->len) == (size_t)-1) {
+                v->dropped++;
+            }
+            break;
+        default:
+            NETLIB_STAT_INC(sock->ctx, eth_rx_unknown_ptcl);
+            v->dropped++;
+            break;
+        }
+    }
+    v->count = kept;
+    return kept;
+}
+
+/* Check if frame is destined to us, or to everyone.
+ *
+ * @param const uint8_t *ours -- Pointer to our MAC address
+ * @param const uint8_t *dst  -- Pointer to destination MAC of the frame
+ * @return bool true if we should process this frame
+ */
+static inline bool eth_for_us(const uint8_t *ours, const uint8_t *dst) {
+    // Group bit covers both broadcast and multicast
+    if (dst[0] & 1) {
+        return true;
+    }
+    return (memcmp(ours, dst, 6) == 0);
+}
+
+/* Handle ethernet frame we've received. Frames that aren't addressed
+ * to us are dropped.
+ *
+ * @param net_socket *sock -- Pointer to socket the frame was received on
+ * @param void *frame      -- Pointer to received frame
+ * @param size_t len       -- Size of the received frame
+ * @return size_t amount of bytes consumed on success or -1 if frame was dropped.
+ *         Set errno on error.
+ */
+size_t eth_rx(net_socket *sock, void *frame, size_t len) {
+    uint16_t ptcl;
+
+    if (eth_payload(sock, frame, len, &ptcl) == (size_t)-1) {
+        NETLIB_STAT_INC(sock->ctx, eth_rx_not_ours);
+        return -1;
+    }
+    NETLIB_STAT_INC(sock->ctx, eth_rx_packets);
+    NETLIB_STAT_ADD(sock->ctx, eth_rx_bytes, len);
+
+    switch (ptcl) {
+    case (ETH_PTCL_IPV4):
+        return ipv4_rx(sock, frame, sizeof(eth_hdr), len);
+    case (ETH_PTCL_ARP):
+        return arp_rx(sock, frame, len);
+    case (ETH_PTCL_IPV6):
+        return ipv6_rx(sock, frame, sizeof(eth_hdr), len);
+    default:
+        break;
+    }
+    NETLIB_STAT_INC(sock->ctx, eth_rx_unknown_ptcl);
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+/* Validate header of ethernet frame we've received.
+ *
+ * @param net_socket *sock  -- Pointer to socket the frame was received on
+ * @param const void *frame -- Pointer to received frame
+ * @param size_t len        -- Size of the received frame
+ * @param uint16_t *ptcl    -- Pointer to where ethertype is written to
+ * @return size_t offset of payload, or -1 if frame isn't for us.
+ *         Set errno on error.
+ */
+size_t eth_payload(net_socket *sock, const void *frame, size_t len,
+        uint16_t *ptcl)
+{
+    link_options *link = (link_options *)sock->link_options;
+    const eth_hdr *hdr = (const eth_hdr *)frame;
+
+    if (len < sizeof(eth_hdr)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!eth_for_us(link->proto.eth_header->mac_src, hdr->mac_dst)) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    *ptcl = eth_ptcl(hdr);
+    return sizeof(eth_hdr);
+}
+
+/* Swap source and destination MAC addresses of a frame in place
+ *
+ * @param eth_hdr *hdr -- Pointer to ethernet header to modify
+ */
+void eth_swap_addr(eth_hdr *hdr) {
+    uint8_t tmp[6];
+
+    memcpy(tmp, hdr->mac_dst, 6);
+    memcpy(hdr->mac_dst, hdr->mac_src, 6);
+    memcpy(hdr->mac_src, tmp, 6);
+}
@@ -0,0 +1,243 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Classic BPF receive filter generated from socket bindings */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <data_util.h>
+#include <eth.h>
+#include <filter.h>
+#include <ip.h>
+#include <link.h>
+#include <socket.h>
+
+// Jump targets resolved once the whole program is out
+enum FILTER_LABEL {
+    L_NEXT = -1,
+    L_ACCEPT = -2,
+    L_DROP = -3,
+    L_PTCL = -4
+};
+
+/* Program under construction. Jumps are recorded against labels, or
+ * against the index of a later instruction, and fixed up at the end.
+ *
+ * @member filter_insn *prog -- Instructions
+ * @member int jt            -- True branch target of each instruction
+ * @member int jf            -- False branch target of each instruction
+ * @member unsigned len      -- Amount of instructions
+ * @member int ptcl          -- Index of instruction loading protocol field
+ */
+typedef struct {
+    filter_insn *prog;
+    int jt[FILTER_MAX_INSNS];
+    int jf[FILTER_MAX_INSNS];
+    unsigned len;
+    int ptcl;
+} filter_prog;
+
+static inline void emit(filter_prog *p, uint16_t code, uint32_t k, int jt, int jf) {
+    if (p->len < FILTER_MAX_INSNS) {
+        p->prog[p->len].code = code;
+        p->prog[p->len].k = k;
+        p->jt[p->len] = jt;
+        p->jf[p->len] = jf;
+    }
+    p->len++;
+}
+
+/* Resolve jump targets to relative offsets
+ *
+ * @param filter_prog *p   -- Program to resolve
+ * @param unsigned accept  -- Index of accept instruction
+ * @param unsigned drop    -- Index of drop instruction
+ * @return int 0 on success or -1 if a jump is out of range
+ */
+static int filter_resolve(filter_prog *p, unsigned accept, unsigned drop) {
+    for (unsigned i = 0; i < p->len; i++) {
+        if (p->prog[i].code == FILTER_RET_K) {
+            p->prog[i].jt = p->prog[i].jf = 0;
+            continue;
+        }
+        int *targets[2] = { &p->jt[i], &p->jf[i] };
+        uint8_t *offs[2] = { &p->prog[i].jt, &p->prog[i].jf };
+
+        for (int j = 0; j < 2; j++) {
+            int t = *targets[j];
+            switch (t) {
+            case (L_NEXT):
+                t = i + 1;
+                break;
+            case (L_ACCEPT):
+                t = accept;
+                break;
+            case (L_DROP):
+                t = drop;
+                break;
+            case (L_PTCL):
+                t = p->ptcl;
+                break;
+            default:
+                break;
+            }
+            if (t <= (int)i || (t - (int)i - 1) > 255) {
+                return -1;
+            }
+            *offs[j] = t - i - 1;
+        }
+        // Unconditional jumps carry their offset in k
+        if (p->prog[i].code == FILTER_JA) {
+            p->prog[i].k = p->prog[i].jt;
+            p->prog[i].jt = p->prog[i].jf = 0;
+        }
+    }
+    return 0;
+}
+
+/* Emit checks for bound ports of one protocol
+ *
+ * @param filter_prog *p       -- Program under construction
+ * @param net_socket *sock     -- Socket whose bindings to use
+ * @param uint8_t ptcl         -- Protocol
+ */
+static void filter_ports(filter_prog *p, net_socket *sock, uint8_t ptcl) {
+    const uint32_t ip = sizeof(eth_hdr);
+
+    emit(p, FILTER_LDX_B_MSH, ip, L_NEXT, L_NEXT);
+    // Destination port sits at the same place for UDP and TCP
+    emit(p, FILTER_LD_H_IND, ip + 2, L_NEXT, L_NEXT);
+    for (unsigned i = 0; i < sock->binding_count; i++) {
+        if (sock->bindings[i].ptcl == ptcl) {
+            emit(p, FILTER_JEQ_K, sock->bindings[i].port, L_ACCEPT, L_NEXT);
+        }
+    }
+    emit(p, FILTER_JA, 0, L_DROP, L_DROP);
+}
+
+/* Generate filter for the socket's current bindings.
+ *
+ * @param net_socket *sock  -- Pointer to socket to generate filter for
+ * @param filter_insn *prog -- Pointer to room for FILTER_MAX_INSNS instructions
+ * @return int amount of instructions on success or -1 on error.
+ *         Set errno on error.
+ */
+int filter_build(net_socket *sock, filter_insn *prog) {
+    link_options *link = (link_options *)sock->link_options;
+    const uint32_t ip = sizeof(eth_hdr);
+    filter_prog p = { .prog = prog };
+    uint8_t ptcls[SOCKET_MAX_BINDINGS];
+    bool any_port[SOCKET_MAX_BINDINGS] = { false };
+    unsigned nptcl = 0;
+
+    // Protocols we have bindings for, and whether any port will do
+    for (unsigned i = 0; i < sock->binding_count; i++) {
+        unsigned j = 0;
+        while (j < nptcl && ptcls[j] != sock->bindings[i].ptcl) {
+            j++;
+        }
+        if (j == nptcl) {
+            ptcls[nptcl++] = sock->bindings[i].ptcl;
+        }
+        if (!sock->bindings[i].port) {
+            any_port[j] = true;
+        }
+    }
+
+    emit(&p, FILTER_LD_H_ABS, 12, L_NEXT, L_NEXT);
+    emit(&p, FILTER_JEQ_K, ETH_PTCL_ARP, L_ACCEPT, L_NEXT);
+    if (sock->family == AF_INET6) {
+        emit(&p, FILTER_JEQ_K, ETH_PTCL_IPV6, L_ACCEPT, L_NEXT);
+    }
+    emit(&p, FILTER_JEQ_K, ETH_PTCL_IPV4, L_NEXT, L_DROP);
+
+    if (link->addr) {
+        uint32_t bcast = link->addr | ~link->netmask;
+        emit(&p, FILTER_LD_W_ABS, ip + 16, L_NEXT, L_NEXT);
+        emit(&p, FILTER_JEQ_K, ntohl(link->addr), L_PTCL, L_NEXT);
+        emit(&p, FILTER_JEQ_K, ntohl(bcast), L_PTCL, L_NEXT);
+        emit(&p, FILTER_JEQ_K, 0xffffffff, L_NEXT, L_DROP);
+    }
+
+    // We don't reassemble, so fragments are of no use to us
+    p.ptcl = p.len;
+    emit(&p, FILTER_LD_H_ABS, ip + 6, L_NEXT, L_NEXT);
+    emit(&p, FILTER_JSET_K, 0x3fff, L_DROP, L_NEXT);
+    emit(&p, FILTER_LD_B_ABS, ip + 9, L_NEXT, L_NEXT);
+    // We always answer pings and listen to path MTU updates
+    emit(&p, FILTER_JEQ_K, IPV4_PTCL_ICMP, L_ACCEPT, L_NEXT);
+
+    /* Chain of protocol checks, each jumping to its port checks. Port
+     * checks of each protocol are laid out after the whole chain, so we
+     * need to know where they begin before emitting the chain.
+     */
+    unsigned chain = p.len;
+    unsigned target = chain + nptcl + 1;
+    for (unsigned i = 0; i < nptcl; i++) {
+        if (any_port[i]) {
+            emit(&p, FILTER_JEQ_K, ptcls[i], L_ACCEPT, L_NEXT);
+            continue;
+        }
+        emit(&p, FILTER_JEQ_K, ptcls[i], target, L_NEXT);
+        unsigned nports = 0;
+        for (unsigned j = 0; j < sock->binding_count; j++) {
+            nports += (sock->bindings[j].ptcl == ptcls[i]);
+        }
+        target += 3 + nports;
+    }
+    emit(&p, FILTER_JA, 0, L_DROP, L_DROP);
+    for (unsigned i = 0; i < nptcl; i++) {
+        if (!any_port[i]) {
+            filter_ports(&p, sock, ptcls[i]);
+        }
+    }
+
+    unsigned accept = p.len;
+    emit(&p, FILTER_RET_K, FILTER_ACCEPT, L_NEXT, L_NEXT);
+    unsigned drop = p.len;
+    emit(&p, FILTER_RET_K, 0, L_NEXT, L_NEXT);
+
+    if (p.len > FILTER_MAX_INSNS) {
+        errno = E2BIG;
+        return -1;
+    }
+    if (filter_resolve(&p, accept, drop) == -1) {
+        errno = E2BIG;
+        return -1;
+    }
+    return p.len;
+}
@@ -0,0 +1,244 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Vector packet processing graph */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctx.h>
+#include <eth.h>
+#include <graph.h>
+#include <icmp.h>
+#include <ip.h>
+#include <link.h>
+#include <socket.h>
+#include <stats.h>
+#include <udp.h>
+
+/* Node of the graph
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param pkt_vector *v    -- Vector to process, modified in place
+ * @return unsigned amount of packets left in vector for the next node
+ */
+typedef unsigned (*graph_node)(net_socket *sock, pkt_vector *v);
+
+/* Allocate vector with buffers for datagrams to send.
+ *
+ * @param size_t max_payload -- Largest UDP payload the vector will carry
+ * @return pointer to vector on success or 0 on error.
+ *         Errno is set for us by aligned_alloc()
+ */
+pkt_vector *pkt_vector_create(size_t max_payload) {
+    pkt_vector *v = netlib_ctx_alloc(sizeof(pkt_vector));
+    if (!v) {
+        return v;
+    }
+    v->slot = (GRAPH_HEADROOM + max_payload + NETLIB_CACHELINE - 1) &
+        ~(size_t)(NETLIB_CACHELINE - 1);
+    v->bufs = netlib_ctx_alloc(GRAPH_VECTOR_MAX * v->slot);
+    if (!v->bufs) {
+        free(v);
+        return 0;
+    }
+    return v;
+}
+
+/* Release vector allocated with pkt_vector_create()
+ *
+ * @param pkt_vector *v -- Pointer to vector
+ */
+void pkt_vector_destroy(pkt_vector *v) {
+    if (v) {
+        free(v->bufs);
+        free(v);
+    }
+}
+
+/* Last node of the TX graph, hands finished frames to the link.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Vector of complete frames
+ * @return unsigned amount of frames sent
+ */
+static unsigned graph_link_tx(net_socket *sock, pkt_vector *v) {
+    link_options *link = (link_options *)sock->link_options;
+    unsigned sent = 0;
+
+    for (unsigned i = 0; i < v->count; i++) {
+        pkt_desc *d = &v->desc[i];
+        size_t ret;
+
+        if (link->type == ETH) {
+            ret = transmit(sock, d->data, d->len);
+        } else {
+            ret = link_slip_transmit(sock, d->data, d->len);
+        }
+        if (ret == (size_t)-1) {
+            NETLIB_STAT_INC(sock->ctx, link_tx_errors);
+            v->dropped++;
+            continue;
+        }
+        if (link->type == SLIP) {
+            NETLIB_STAT_INC(sock->ctx, slip_tx_packets);
+            NETLIB_STAT_ADD(sock->ctx, slip_tx_bytes, d->len);
+        }
+        NETLIB_STAT_ADD(sock->ctx, link_tx_bytes, d->len);
+        sent++;
+    }
+    NETLIB_STAT_ADD(sock->ctx, link_tx_packets, sent);
+    // With a TX queue the whole vector goes out in as few syscalls as possible
+    transmit_flush(sock);
+    return sent;
+}
+
+static const graph_node graph_tx_eth[] = {
+    udp_encap_vec, ipv4_encap_vec, eth_encap_vec, graph_link_tx, 0
+};
+
+static const graph_node graph_tx_slip[] = {
+    udp_encap_vec, ipv4_encap_vec, graph_link_tx, 0
+};
+
+/* Send all datagrams queued in vector over UDP/IPv4, and empty it.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Pointer to vector filled with pkt_vector_add()
+ * @return unsigned amount of datagrams handed to the link
+ */
+unsigned graph_tx(net_socket *sock, pkt_vector *v) {
+    link_options *link = (link_options *)sock->link_options;
+    const graph_node *node = (link->type == ETH) ? graph_tx_eth : graph_tx_slip;
+    unsigned left = 0;
+
+    for (; *node && v->count; node++) {
+        left = (*node)(sock, v);
+    }
+    if (*node) {
+        // Everything got dropped or queued before reaching the link
+        left = 0;
+    }
+    v->count = 0;
+    return left;
+}
+
+/* Run a batch of received frames through the stack. Frames go through
+ * link and IPv4 input as one vector, after which UDP and ICMP each get
+ * their datagrams in one go. IPv6 is handed to ipv6_rx() frame by frame,
+ * same as link_rx() does.
+ *
+ * @param net_socket *sock      -- Pointer to socket the frames were received on
+ * @param const rx_frame *frames -- Frames as returned by receive_batch()
+ * @param unsigned n            -- Amount of frames, at most GRAPH_VECTOR_MAX
+ * @return unsigned amount of frames consumed by the stack
+ */
+unsigned graph_rx(net_socket *sock, const rx_frame *frames, unsigned n) {
+    link_options *link = (link_options *)sock->link_options;
+    pkt_vector v;
+    unsigned consumed = 0;
+
+    if (n > GRAPH_VECTOR_MAX) {
+        n = GRAPH_VECTOR_MAX;
+    }
+    v.count = 0;
+    v.dropped = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (link->type == SLIP) {
+            /* SLIP frames are bare IP datagrams. Compressed ones carry
+             * TCP, which we don't handle here, but the link still has to
+             * see them to keep its slots in sync.
+             */
+            size_t len = frames[i].len;
+            void *ip = link_slip_input(sock, frames[i].data, &len);
+            if (!ip) {
+                NETLIB_STAT_INC(sock->ctx, link_rx_errors);
+                continue;
+            }
+            if (ip != frames[i].data) {
+                NETLIB_STAT_INC(sock->ctx, ipv4_rx_unknown_ptcl);
+                continue;
+            }
+            switch (*(const uint8_t *)ip >> 4) {
+            case (4):
+                break;
+            case (6):
+                if (ipv6_rx(sock, ip, 0, len) != (size_t)-1) {
+                    consumed++;
+                }
+                continue;
+            default:
+                NETLIB_STAT_INC(sock->ctx, link_rx_errors);
+                continue;
+            }
+        }
+        pkt_desc *d = &v.desc[v.count++];
+        d->data = frames[i].data;
+        d->off = 0;
+        d->len = frames[i].len;
+    }
+
+    if (link->type == ETH) {
+        consumed = v.count;
+        eth_input_vec(sock, &v);
+        // ARP was consumed by the ethernet node
+        consumed -= v.count + v.dropped;
+    }
+    ipv4_input_vec(sock, &v);
+
+    for (unsigned i = 0; i < v.count; i++) {
+        pkt_desc *d = &v.desc[i];
+        if ((i + GRAPH_PREFETCH) < v.count) {
+            pkt_desc *next = &v.desc[i + GRAPH_PREFETCH];
+            __builtin_prefetch(next->data + next->off + sizeof(ipv4_hdr));
+        }
+        if (((const ipv4_hdr *)(d->data + d->off))->ptcl == IPV4_PTCL_UDP &&
+                udp_rx(sock, d->data, d->off, d->len) != (size_t)-1) {
+            consumed++;
+        }
+    }
+    for (unsigned i = 0; i < v.count; i++) {
+        pkt_desc *d = &v.desc[i];
+        uint8_t ptcl = ((const ipv4_hdr *)(d->data + d->off))->ptcl;
+        if (ptcl == IPV4_PTCL_ICMP) {
+            if (icmp_rx(sock, d->data, d->off, d->len) != (size_t)-1) {
+                consumed++;
+            }
+        } else if (ptcl != IPV4_PTCL_UDP) {
+            NETLIB_STAT_INC(sock->ctx, ipv4_rx_unknown_ptcl);
+        }
+    }
+    return consumed;
+}
@@ -0,0 +1,134 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* HDR histograms */
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+#include <hist.h>
+
+/* Empty a histogram. Values recorded at the same time may be lost.
+ *
+ * @param hdr_hist *h -- Pointer to histogram
+ */
+void hist_reset(hdr_hist *h) {
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        atomic_store_explicit(&h->bucket[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->min, UINT64_MAX, memory_order_relaxed);
+    atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+}
+
+/* Add values of one histogram to another
+ *
+ * @param hdr_hist *dst       -- Histogram to add to
+ * @param const hdr_hist *src -- Histogram to add
+ */
+void hist_merge(hdr_hist *dst, const hdr_hist *src) {
+    uint64_t count = atomic_load_explicit(&src->count, memory_order_acquire);
+    if (!count) {
+        return;
+    }
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        uint64_t n = atomic_load_explicit(&src->bucket[i], memory_order_relaxed);
+        if (n) {
+            atomic_fetch_add_explicit(&dst->bucket[i], n, memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add_explicit(&dst->sum,
+            atomic_load_explicit(&src->sum, memory_order_relaxed), memory_order_relaxed);
+
+    uint64_t v = atomic_load_explicit(&src->min, memory_order_relaxed);
+    uint64_t cur = atomic_load_explicit(&dst->min, memory_order_relaxed);
+    while (v < cur && !atomic_compare_exchange_weak_explicit(&dst->min, &cur, v,
+                memory_order_relaxed, memory_order_relaxed));
+    v = atomic_load_explicit(&src->max, memory_order_relaxed);
+    cur = atomic_load_explicit(&dst->max, memory_order_relaxed);
+    while (v > cur && !atomic_compare_exchange_weak_explicit(&dst->max, &cur, v,
+                memory_order_relaxed, memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&dst->count, count, memory_order_release);
+}
+
+/* Get value at given percentile
+ *
+ * @param const hdr_hist *h -- Pointer to histogram
+ * @param double pct        -- Percentile, 0 to 100
+ * @return uint64_t largest value of the bucket percentile falls in, never
+ *         above the largest recorded value. 0 if histogram is empty.
+ */
+uint64_t hist_percentile(const hdr_hist *h, double pct) {
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_acquire);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    if (!count) {
+        return 0;
+    }
+    if (pct > 100.0) {
+        pct = 100.0;
+    }
+    double rank = (pct / 100.0) * count;
+    uint64_t want = (uint64_t)rank;
+    if (want < rank) {
+        want++;
+    }
+    if (!want) {
+        want = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+        if (seen >= want) {
+            uint64_t v = hist_value(i);
+            return (v < max) ? v : max;
+        }
+    }
+    return max;
+}
+
+/* Get mean of recorded values
+ *
+ * @param const hdr_hist *h -- Pointer to histogram
+ * @return double mean, 0 if histogram is empty
+ */
+double hist_mean(const hdr_hist *h) {
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_acquire);
+    if (!count) {
+        return 0;
+    }
+    return (double)atomic_load_explicit(&h->sum, memory_order_relaxed) / count;
+}
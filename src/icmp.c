@@ -0,0 +1,305 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Internet Control Message Protocol (ICMP) implementation */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csum.h>
+#include <ctx.h>
+#include <data_util.h>
+#include <eth.h>
+#include <icmp.h>
+#include <ip.h>
+#include <link.h>
+#include <pmtu.h>
+#include <stats.h>
+
+#define ICMP_RL_BITS 8
+#define ICMP_RL_BUCKETS (1 << ICMP_RL_BITS)
+#define NS_PER_SEC 1000000000ULL
+
+/* Token bucket state for a single echo request source
+ *
+ * @member uint32_t addr    -- Source address this bucket belongs to
+ * @member uint64_t tokens  -- Available tokens, scaled by NS_PER_SEC
+ * @member uint64_t last_ns -- Time of last refill
+ */
+typedef struct {
+    uint32_t addr;
+    uint64_t tokens;
+    uint64_t last_ns;
+} icmp_bucket;
+
+/* Echo reply rate limiter of one stack instance
+ *
+ * @member icmp_bucket buckets -- Direct mapped table of per-source buckets. On
+ *                                collision the bucket is simply handed over to
+ *                                the new source with a full set of tokens.
+ * @member uint32_t rate       -- Replies per second per source
+ * @member uint32_t burst      -- Maximum amount of back-to-back replies per source
+ */
+struct icmp_state {
+    icmp_bucket buckets[ICMP_RL_BUCKETS];
+    uint32_t rate;
+    uint32_t burst;
+};
+
+/* Initialise ICMP state of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int icmp_initialise(netlib_ctx *ctx) {
+    ctx->icmp = netlib_ctx_alloc(sizeof(struct icmp_state));
+    if (!ctx->icmp) {
+        return -1;
+    }
+    // Default to 1000 replies/s with bursts of 100 per source
+    ctx->icmp->rate = 1000;
+    ctx->icmp->burst = 100;
+    return 0;
+}
+
+/* Finalise ICMP state of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void icmp_finalise(netlib_ctx *ctx) {
+    free(ctx->icmp);
+    ctx->icmp = 0;
+}
+
+/* Configure per-source rate limit for echo replies.
+ *
+ * @param netlib_ctx *ctx -- Stack instance to configure
+ * @param uint32_t rate   -- Replies per second per source, 0 disables replies
+ * @param uint32_t burst  -- Maximum amount of back-to-back replies per source
+ */
+void icmp_set_echo_ratelimit(netlib_ctx *ctx, uint32_t rate, uint32_t burst) {
+    struct icmp_state *ic = ctx->icmp;
+
+    ic->rate = rate;
+    ic->burst = burst ? burst : 1;
+    for (size_t i = 0; i < ICMP_RL_BUCKETS; i++) {
+        ic->buckets[i].addr = 0;
+        ic->buckets[i].last_ns = 0;
+    }
+}
+
+/* Take one token from the bucket of given source
+ *
+ * @param struct icmp_state *ic -- Rate limiter of our stack instance
+ * @param uint32_t addr          -- Source address of echo request
+ * @return bool true if we may reply
+ */
+static bool icmp_take_token(struct icmp_state *ic, uint32_t addr) {
+    icmp_bucket *b = &ic->buckets[addr_hash(addr, ICMP_RL_BITS)];
+    uint64_t cap = (uint64_t)ic->burst * NS_PER_SEC;
+    uint64_t now = monotonic_ns();
+
+    if (!ic->rate) {
+        return false;
+    }
+    if (b->addr != addr || !b->last_ns) {
+        b->addr = addr;
+        b->tokens = cap;
+    } else {
+        // Clamp elapsed time so that the refill can't overflow
+        uint64_t elapsed = now - b->last_ns;
+        uint64_t fill_ns = cap / ic->rate;
+        if (elapsed > fill_ns) {
+            elapsed = fill_ns;
+        }
+        b->tokens += elapsed * ic->rate;
+        if (b->tokens > cap) {
+            b->tokens = cap;
+        }
+    }
+    b->last_ns = now;
+
+    if (b->tokens < NS_PER_SEC) {
+        return false;
+    }
+    b->tokens -= NS_PER_SEC;
+    return true;
+}
+
+/* Tell if a datagram was sent to us alone. Broadcasts and multicasts
+ * aren't answered, so we can't be used to amplify traffic towards
+ * whoever the source claims to be.
+ *
+ * @param net_socket *sock    -- Pointer to socket the datagram was received on
+ * @param const void *frame   -- Pointer to start of the received frame
+ * @param const ipv4_hdr *iph -- Pointer to IPv4 header inside frame
+ * @return bool true if destination is our unicast address
+ */
+static bool icmp_unicast_to_us(net_socket *sock, const void *frame, const ipv4_hdr *iph) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (!link->addr || ipv4_dst(iph) != link->addr) {
+        return false;
+    }
+    if (link->type == ETH) {
+        const eth_hdr *eth = (const eth_hdr *)frame;
+        return !memcmp(eth->mac_dst, link->proto.eth_header->mac_src, 6);
+    }
+    return true;
+}
+
+/* Turn echo request into echo reply in place and send it back.
+ *
+ * Swapping source and destination doesn't change the IPv4 header checksum,
+ * so only the TTL and ICMP type changes need checksum fixups.
+ *
+ * @param net_socket *sock -- Pointer to socket the request was received on
+ * @param void *frame      -- Pointer to start of the received frame
+ * @param ipv4_hdr *iph    -- Pointer to IPv4 header inside frame
+ * @param icmp_hdr *icmph  -- Pointer to ICMP header inside frame
+ * @param size_t len       -- Size of the frame
+ * @return size_t amount of bytes sent or -1 on error.
+ */
+static size_t icmp_echo_reply(net_socket *sock, void *frame, ipv4_hdr *iph,
+        icmp_hdr *icmph, size_t len)
+{
+    ipv4_socket_options *iopts = (ipv4_socket_options *)sock->ip_options;
+    void *ttl_word = POINTER_ADD(void *, iph, 8);
+    uint16_t from;
+
+    uint32_t tmp = ipv4_src(iph);
+    ipv4_set_src(iph, ipv4_dst(iph));
+    ipv4_set_dst(iph, tmp);
+
+    from = load_u16(ttl_word);
+    iph->ttl = iopts->ttl;
+    ipv4_set_csum(iph, csum_replace16(ipv4_csum(iph), from, load_u16(ttl_word)));
+
+    from = load_u16(icmph);
+    icmph->type = ICMP_TYPE_ECHO_REPLY;
+    icmph->code = 0;
+    icmph->csum = csum_replace16(icmph->csum, from, load_u16(icmph));
+
+    return link_reflect(sock, frame, len);
+}
+
+/* Handle fragmentation needed message by lowering path MTU estimate for
+ * the destination of the datagram that didn't fit. Anyone can send us
+ * one, so the quoted datagram has to look like something we sent.
+ *
+ * @param net_socket *sock -- Pointer to socket the message was received on
+ * @param icmp_hdr *icmph  -- Pointer to ICMP header
+ * @param size_t icmp_len  -- Size of ICMP message
+ * @return size_t amount of bytes consumed on success or -1 on error.
+ */
+static size_t icmp_frag_needed(net_socket *sock, icmp_hdr *icmph, size_t icmp_len) {
+    link_options *link = (link_options *)sock->link_options;
+    // Message carries the offending IPv4 header + 64 bits of its data
+    ipv4_hdr *orig = POINTER_ADD(ipv4_hdr *, icmph, sizeof(icmp_hdr));
+
+    if (icmp_len < (sizeof(icmp_hdr) + sizeof(ipv4_hdr)) || ipv4_version(orig) != 4) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t hlen = ipv4_hlen(orig);
+    if (hlen < sizeof(ipv4_hdr) || (sizeof(icmp_hdr) + hlen) > icmp_len ||
+            ipv4_src(orig) != link->addr ||
+            (orig->ptcl != IPV4_PTCL_UDP && orig->ptcl != IPV4_PTCL_ICMP)) {
+        NETLIB_STAT_INC(sock->ctx, icmp_rx_frag_needed_bogus);
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint16_t mtu = ntohs(icmph->un.frag.mtu);
+    if (!mtu) {
+        // Pre RFC 1191 router, guess from what we tried to send
+        mtu = pmtu_plateau(ipv4_len(orig));
+    }
+    pmtu_update(sock->ctx, ipv4_dst(orig), mtu);
+    return icmp_len;
+}
+
+/* Handle ICMP message we've received.
+ *
+ * @param net_socket *sock -- Pointer to socket the message was received on
+ * @param void *frame      -- Pointer to start of the received frame
+ * @param size_t off       -- Offset of IPv4 header from start of the frame
+ * @param size_t len       -- Size of the frame up to end of IPv4 datagram
+ * @return size_t amount of bytes consumed on success or -1 if message was dropped.
+ *         Set errno on error.
+ */
+size_t icmp_rx(net_socket *sock, void *frame, size_t off, size_t len) {
+    ipv4_hdr *iph = POINTER_ADD(ipv4_hdr *, frame, off);
+    size_t hlen = ipv4_hlen(iph);
+    icmp_hdr *icmph = POINTER_ADD(icmp_hdr *, iph, hlen);
+    size_t icmp_len = len - off - hlen;
+
+    if (icmp_len < sizeof(icmp_hdr)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (csum((uint16_t *)icmph, icmp_len) != 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    switch (icmph->type) {
+    case (ICMP_TYPE_ECHO_REQUEST):
+        if (!icmp_unicast_to_us(sock, frame, iph)) {
+            NETLIB_STAT_INC(sock->ctx, icmp_rx_echo_not_ours);
+            errno = EADDRNOTAVAIL;
+            return -1;
+        }
+        if (!icmp_take_token(sock->ctx->icmp, ipv4_src(iph))) {
+            errno = EBUSY;
+            return -1;
+        }
+        if (icmp_echo_reply(sock, frame, iph, icmph, len) == (size_t)-1) {
+            return -1;
+        }
+        return len;
+    case (ICMP_TYPE_DEST_UNREACH):
+        if (icmph->code == ICMP_CODE_FRAG_NEEDED) {
+            return icmp_frag_needed(sock, icmph, icmp_len);
+        }
+        break;
+    default:
+        break;
+    }
+    errno = ENOTSUP;
+    return -1;
+}
@@ -0,0 +1,162 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Address Resolution Protocol ( https://datatracker.ietf.org/doc/html/rfc826 )
+ * and the neighbor cache built on top of it.
+ *
+ * Lookups from the transmit path don't take any locks, entries are
+ * protected by a per-entry sequence counter (seqlock) instead. Updates from
+ * received ARP traffic and the periodic refresh are serialised with a mutex.
+ */
+#ifndef __NETLIB_ARP_H__
+#define __NETLIB_ARP_H__
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "socket.h"
+
+// Packets queued per neighbor while it's being resolved
+#define ARP_QUEUE_LEN 4
+
+// How long a resolved mapping stays valid without confirmation
+#define ARP_REACHABLE_NS (30ULL * 1000000000ULL)
+
+// How long before expiry we start refreshing a mapping
+#define ARP_REFRESH_NS (5ULL * 1000000000ULL)
+
+// Interval between requests for one neighbor
+#define ARP_RETRANS_NS (1000ULL * 1000000ULL)
+
+// Broadcast requests sent before giving up on unresolved neighbor
+#define ARP_MAX_PROBES 3
+
+/* ARP operation codes
+ *
+ * @member ARP_OP_REQUEST -- Who has tpa? Tell spa
+ * @member ARP_OP_REPLY   -- spa is at sha
+ */
+enum ARP_OP {
+    ARP_OP_REQUEST = 1,
+    ARP_OP_REPLY   = 2
+};
+
+/* ARP packet structure for IPv4 over ethernet
+ *
+ * @member uint16_t htype  -- Hardware type, 1 for ethernet
+ * @member uint16_t ptype  -- Protocol type, ethertype of IPv4
+ * @member uint8_t hlen    -- Hardware address length
+ * @member uint8_t plen    -- Protocol address length
+ * @member uint16_t oper   -- Operation, refer to enum ARP_OP
+ * @member uint8_t sha     -- Sender hardware address
+ * @member uint32_t spa    -- Sender protocol address
+ * @member uint8_t tha     -- Target hardware address
+ * @member uint32_t tpa    -- Target protocol address
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t htype;
+    uint16_t ptype;
+    uint8_t hlen;
+    uint8_t plen;
+    uint16_t oper;
+    uint8_t sha[6];
+    uint32_t spa;
+    uint8_t tha[6];
+    uint32_t tpa;
+} arp_hdr;
+
+/* Initialise neighbor cache of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int arp_initialise(netlib_ctx *ctx);
+
+/* Finalise neighbor cache of a stack instance, drops all queued packets
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void arp_finalise(netlib_ctx *ctx);
+
+/* Look up link layer address of a neighbor without blocking.
+ *
+ * @param net_socket *sock -- Pointer to socket whose stack instance to look in
+ * @param uint32_t addr    -- IPv4 address of the neighbor
+ * @param uint8_t *mac     -- Pointer to where MAC address is written to
+ * @return bool true if neighbor is known, false otherwise
+ */
+bool arp_lookup(net_socket *sock, uint32_t addr, uint8_t *mac);
+
+/* Queue a frame for a neighbor we don't know the address of yet, and start
+ * resolving it. The frame is sent once the neighbor answers, or dropped if
+ * it doesn't. If the queue is already full, the oldest frame is dropped.
+ *
+ * @param net_socket *sock -- Pointer to socket to send on
+ * @param uint32_t addr    -- IPv4 address of the neighbor
+ * @param void *frame      -- Pointer to complete ethernet frame, with
+ *                            destination MAC left for us to fill in.
+ *                            Ownership of the frame moves to neighbor cache.
+ * @param size_t len       -- Size of the frame
+ * @return size_t len on success or -1 on error.
+ *         Set errno on error.
+ */
+size_t arp_queue(net_socket *sock, uint32_t addr, void *frame, size_t len);
+
+/* Handle ARP packet we've received. Requests for our address are answered
+ * by turning the received frame around in place.
+ *
+ * @param net_socket *sock -- Pointer to socket the packet was received on
+ * @param void *frame      -- Pointer to received frame, including ethernet header
+ * @param size_t len       -- Size of the received frame
+ * @return size_t amount of bytes consumed on success or -1 if packet was dropped.
+ *         Set errno on error.
+ */
+size_t arp_rx(net_socket *sock, void *frame, size_t len);
+
+/* Broadcast gratuitous ARP announcing our address, ie. after address change
+ *
+ * @param net_socket *sock -- Pointer to socket to send on
+ * @return size_t amount of bytes sent or -1 on error.
+ *         Set errno on error.
+ */
+size_t arp_announce(net_socket *sock);
+
+/* Run neighbor cache timers: refresh mappings before they expire,
+ * retransmit requests for unresolved neighbors and expire stale entries.
+ * Should be called regularly, ie. from the receive loop.
+ *
+ * @param net_socket *sock -- Pointer to socket to send on
+ */
+void arp_tick(net_socket *sock);
+
+#endif // __NETLIB_ARP_H__
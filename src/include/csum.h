@@ -37,50 +37,54 @@
 #define __NETLIB_CSUM_H__
 
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* ipv{4,6}_psd_hdr structures are pseudo headers that are needed by
  * TCP and UDP checksum calculations. I'd really love not to have TCP/UDP be
  * aware of things on IP layer, but unfortunately that's not possible :(
  *
- * @member uint32_t  src -- Source IPv4 address
- * @member uint32_t  dst -- Destination IPv4 address
- * @member uint8_t  zero -- Needs to be zero
- * @member uint8_t  ptcl -- Protocol identification (TCP or UDP?)
- * @member uint16_t len  -- Length of {TCP,UDP} header + data 
+ * @member uint8_t src  -- Source IPv4 address, network byte order
+ * @member uint8_t dst  -- Destination IPv4 address, network byte order
+ * @member uint8_t zero -- Needs to be zero
+ * @member uint8_t ptcl -- Protocol identification (TCP or UDP?)
+ * @member uint8_t len  -- Length of {TCP,UDP} header + data, big endian
  */
 typedef struct {
-    uint32_t src;
-    uint32_t dst;
-    uint8_t  zero;
-    uint8_t  ptcl;
-    uint16_t len;
+    uint8_t src[4];
+    uint8_t dst[4];
+    uint8_t zero;
+    uint8_t ptcl;
+    uint8_t len[2];
 } ipv4_psd_hdr;
 
+_Static_assert(offsetof(ipv4_psd_hdr, ptcl) == 9, "ipv4_psd_hdr ptcl offset");
+_Static_assert(offsetof(ipv4_psd_hdr, len) == 10, "ipv4_psd_hdr len offset");
+_Static_assert(sizeof(ipv4_psd_hdr) == 12, "ipv4_psd_hdr size");
+
 /* ipv{4,6}_psd_hdr structures are pseudo headers that are needed by
  * TCP and UDP checksum calculations. I'd really love not to have TCP/UDP be
  * aware of things on IP layer, but unfortunately that's not possible :(
  *
- * @member uint64_t src_low      -- Low 64 bits of source IPv6 address
- * @member uint64_t src_high     -- High 64 bits of source IPv6 address
- * @member uint64_t dst_low      -- Low 64 bits of destination IPv6 address
- * @member uint64_t dst_high     -- High 64 bits of destination IPv6 address
- * @member uint32_t len          -- Length of {TCP,UDP} header + data
- * @member uint16_t zero_low     -- Low 16 bits of 24-bit zero field
- * @member uint8_t  zero_high    -- high 8 bits of 24-bit zero field
- * @member uint8_t  ptcl         -- Protocol identification (TCP or UDP?)
+ * @member uint8_t src  -- Source IPv6 address
+ * @member uint8_t dst  -- Destination IPv6 address
+ * @member uint8_t len  -- Length of {TCP,UDP} header + data, big endian
+ * @member uint8_t zero -- 24-bit zero field
+ * @member uint8_t ptcl -- Protocol identification (TCP or UDP?)
  */
 typedef struct {
-    uint64_t src_low;
-    uint64_t src_high;
-    uint64_t dst_low;
-    uint64_t dst_high;
-    uint32_t len;
-    uint16_t zero_low;
-    uint8_t  zero_high;
-    uint8_t  ptcl;
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint8_t len[4];
+    uint8_t zero[3];
+    uint8_t ptcl;
 } ipv6_psd_hdr;
 
+_Static_assert(offsetof(ipv6_psd_hdr, len) == 32, "ipv6_psd_hdr len offset");
+_Static_assert(offsetof(ipv6_psd_hdr, ptcl) == 39, "ipv6_psd_hdr ptcl offset");
+_Static_assert(sizeof(ipv6_psd_hdr) == 40, "ipv6_psd_hdr size");
+
 /* Craft a ipv4 pseudo header from source/destination sockaddr_in structures
  *
  * @param uint32_t src            -- Source address to use
@@ -105,4 +109,54 @@ ipv4_psd_hdr *craft_ipv4_psd_hdr(uint32_t src,
  */
 uint16_t csum(uint16_t *data, size_t size);
 
+/* Add data to a running, unfolded, ones' complement sum. Sums of separate
+ * chunks can be added together, as long as all chunks but the last one
+ * are of even size.
+ *
+ * @param const void *data -- Pointer to data to sum
+ * @param size_t size      -- Size of data in bytes
+ * @param uint32_t sum     -- Sum so far, 0 to start a new one
+ * @return uint32_t updated partial sum
+ */
+uint32_t csum_partial(const void *data, size_t size, uint32_t sum);
+
+/* Add data described by an iovec array to a running, unfolded, ones'
+ * complement sum. Entries don't need to be of even length.
+ *
+ * @param const struct iovec *iov -- Pointer to iovec array
+ * @param int iovcnt              -- Amount of entries in iov
+ * @param uint32_t sum            -- Sum so far, 0 to start a new one
+ * @return uint32_t updated partial sum
+ */
+uint32_t csum_partial_iov(const struct iovec *iov, int iovcnt, uint32_t sum);
+
+/* Fold partial sum into a final 16-bit checksum
+ *
+ * @param uint32_t sum -- Partial sum from csum_partial()
+ * @return uint16_t checksum, ready to be stored in a header
+ */
+uint16_t csum_fold(uint32_t sum);
+
+/* Add two partial sums together
+ *
+ * @param uint32_t a -- First partial sum
+ * @param uint32_t b -- Second partial sum
+ * @return uint32_t combined partial sum
+ */
+static inline uint32_t csum_add(uint32_t a, uint32_t b) {
+    uint32_t ret = a + b;
+    return ret + (ret < a);
+}
+
+/* Incrementally update a checksum after one 16-bit word it covers has
+ * changed, as per RFC 1624 (eqn. 3). This lets us patch headers in place
+ * without summing over the whole header/payload again.
+ *
+ * @param uint16_t sum  -- Checksum as currently stored in the header
+ * @param uint16_t from -- Old value of the modified 16-bit word
+ * @param uint16_t to   -- New value of the modified 16-bit word
+ * @return uint16_t updated checksum
+ */
+uint16_t csum_replace16(uint16_t sum, uint16_t from, uint16_t to);
+
 #endif /* __NETLIB_CSUM_H__ */
@@ -0,0 +1,113 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-core stack instances */
+#ifndef __NETLIB_CTX_H__
+#define __NETLIB_CTX_H__
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NETLIB_CACHELINE 64
+
+// Pass as cpu to netlib_ctx_create() to leave the calling thread unpinned
+#define NETLIB_CPU_ANY (-1)
+
+/* Stack instance. Owns all protocol state, so that instances pinned to
+ * different cores never touch each other's memory. An instance, and every
+ * socket bound to it, must only be driven by the thread that created it.
+ *
+ * @member int cpu                -- CPU the owning thread is pinned to, or NETLIB_CPU_ANY
+ * @member struct ip_state *ip     -- IPv4 ID allocator
+ * @member struct icmp_state *icmp -- Echo reply rate limiter
+ * @member struct pmtu_state *pmtu -- Path MTU cache
+ * @member struct arp_state *arp   -- Neighbor cache
+ * @member int arp_shared          -- Neighbor cache is borrowed from another instance
+ * @member struct netlib_stats *stats -- Counters of this instance
+ * @member int stats_slot          -- Block of counters in the segment, -1 if private
+ */
+typedef struct netlib_ctx {
+    int cpu;
+    int arp_shared;
+    struct ip_state *ip;
+    struct icmp_state *icmp;
+    struct pmtu_state *pmtu;
+    struct arp_state *arp;
+    struct netlib_stats *stats;
+    int stats_slot;
+} netlib_ctx;
+
+/* Create a stack instance. Pins the calling thread to given CPU first,
+ * so that all state gets allocated from memory local to that CPU.
+ *
+ * @param int cpu -- CPU to pin calling thread to, or NETLIB_CPU_ANY
+ * @return pointer to new instance on success or 0 on error.
+ *         Set errno on error.
+ */
+netlib_ctx *netlib_ctx_create(int cpu);
+
+/* Destroy a stack instance. Sockets bound to it must be closed first.
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance to destroy
+ */
+void netlib_ctx_destroy(netlib_ctx *ctx);
+
+/* Make instance use neighbor cache of another instance. Meant for workers
+ * of one fanout group: ARP replies land on whichever worker the kernel
+ * picks, so they all have to see the same cache. The cache is safe for
+ * that, lookups are lockless and updates serialised. Owner has to be
+ * destroyed last.
+ *
+ * @param netlib_ctx *ctx   -- Instance giving up its own cache
+ * @param netlib_ctx *owner -- Instance whose cache to use
+ */
+void netlib_ctx_share_neighbors(netlib_ctx *ctx, netlib_ctx *owner);
+
+/* Allocate zeroed, cache line aligned memory for instance state
+ *
+ * @param size_t size -- Amount of bytes to allocate
+ * @return pointer to memory on success or 0 on error.
+ *         Errno is set for us by aligned_alloc()
+ */
+void *netlib_ctx_alloc(size_t size);
+
+/* Pin calling thread to given CPU
+ *
+ * @param int cpu -- CPU to run on
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int netlib_pin_cpu(int cpu);
+
+#endif // __NETLIB_CTX_H__
@@ -40,26 +40,21 @@
 #define __NETLIB_DATA_UTIL_H__
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 
 /* Simple byteswap
  *
  */
 inline uint16_t bswap_16(uint16_t in) {
-    uint8_t hi = (in & 0xFF00) >> 8;
-    uint8_t lo = (in & 0x00FF);
-    uint16_t ret = (lo << 8) | hi;
-    return ret;
+    return __builtin_bswap16(in);
 }
 
 inline uint32_t bswap_32(uint32_t in) {
-    uint16_t lo = (in & 0x0000FFFF);
-    uint16_t hi = (in & 0xFFFF0000) >> 16;
-
-    uint32_t ret = (bswap_16(lo) << 16) | (bswap_16(hi));
-    return ret;
+    return __builtin_bswap32(in);
 }
 
 /* Create uint32_t ipv4 address from
@@ -93,10 +88,139 @@ inline uint16_t ntohs(uint16_t in) {
  * @param uint32_t in -- Data to convert
  * @return uint32_t data in network host order
  */
-inline uint32_t htonl(uint16_t in) {
+inline uint32_t htonl(uint32_t in) {
+    return bswap_32(in);
+}
+
+/* Swap bytes to host order
+ *
+ * @param uint32_t in -- Data to convert
+ * @return uint32_t data in host order
+ */
+inline uint32_t ntohl(uint32_t in) {
     return bswap_32(in);
 }
 
+/* Wire format accessors. Headers are plain byte arrays, so they can sit
+ * at any alignment inside a frame, and these compile to a single load or
+ * store, plus bswap for the big endian ones.
+ */
+
+/* Read 16 bit big endian value
+ *
+ * @param const void *p -- Pointer to value
+ * @return uint16_t value in host order
+ */
+static inline uint16_t load_be16(const void *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap16(v);
+}
+
+/* Read 32 bit big endian value
+ *
+ * @param const void *p -- Pointer to value
+ * @return uint32_t value in host order
+ */
+static inline uint32_t load_be32(const void *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap32(v);
+}
+
+/* Write 16 bit value in big endian
+ *
+ * @param void *p     -- Pointer to where value is written to
+ * @param uint16_t v  -- Value in host order
+ */
+static inline void store_be16(void *p, uint16_t v) {
+    v = __builtin_bswap16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Write 32 bit value in big endian
+ *
+ * @param void *p     -- Pointer to where value is written to
+ * @param uint32_t v  -- Value in host order
+ */
+static inline void store_be32(void *p, uint32_t v) {
+    v = __builtin_bswap32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Read 16 bits as they are, for checksums and values kept in network order
+ *
+ * @param const void *p -- Pointer to value
+ * @return uint16_t value as stored
+ */
+static inline uint16_t load_u16(const void *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Read 32 bits as they are, for addresses kept in network order
+ *
+ * @param const void *p -- Pointer to value
+ * @return uint32_t value as stored
+ */
+static inline uint32_t load_u32(const void *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Write 16 bits as they are
+ *
+ * @param void *p     -- Pointer to where value is written to
+ * @param uint16_t v  -- Value to store
+ */
+static inline void store_u16(void *p, uint16_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Write 32 bits as they are
+ *
+ * @param void *p     -- Pointer to where value is written to
+ * @param uint32_t v  -- Value to store
+ */
+static inline void store_u32(void *p, uint32_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/* IPv6 address, stored in network byte order
+ *
+ * @member uint8_t octets -- Address octets
+ */
+typedef struct {
+    uint8_t octets[16];
+} ipv6_addr;
+
+/* Create IPv6 address from string representation, ie. "fe80::1".
+ * Dotted quad suffixes ("::ffff:1.2.3.4") aren't supported.
+ *
+ * @param const char *ip -- Pointer to IPv6 address string
+ * @param ipv6_addr *out -- Pointer to where address is written to
+ * @return int 0 on success or -1 if string isn't a valid address
+ */
+int inet6_addr(const char *ip, ipv6_addr *out);
+
+/* Hash IPv4 address into a table index (Fibonacci hashing)
+ *
+ * @param uint32_t addr -- Address to hash
+ * @param unsigned bits -- log2 of table size, 1..32
+ * @return uint32_t index in range [0, 1 << bits)
+ */
+static inline uint32_t addr_hash(uint32_t addr, unsigned bits) {
+    return (addr * 2654435761U) >> (32 - bits);
+}
+
+/* Read monotonic clock
+ *
+ * @return uint64_t current monotonic time in nanoseconds
+ */
+uint64_t monotonic_ns(void);
+
 /* Add 'addition' amount of bytes to orig_ptr, since ptr+adddition is
  * gnu_extension for most data types
  *
@@ -136,4 +260,31 @@ size_t build_packet(void **pkt, void *iphdr, size_t iplen,
         void *ptclhdr, size_t ptclen,
         void *payload, size_t len);
 
+/* Get total size of data described by an iovec array
+ *
+ * @param const struct iovec *iov -- Pointer to iovec array
+ * @param int iovcnt              -- Amount of entries in iov
+ * @return size_t sum of iov_len of all entries
+ */
+static inline size_t iov_length(const struct iovec *iov, int iovcnt) {
+    size_t ret = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ret += iov[i].iov_len;
+    }
+    return ret;
+}
+
+/* Copy data described by an iovec array into a single buffer. For the
+ * few paths that need a frame in one piece.
+ *
+ * @param const struct iovec *iov -- Pointer to iovec array
+ * @param int iovcnt              -- Amount of entries in iov
+ * @param size_t *len             -- Pointer to where size of the buffer is written to
+ * @return pointer to allocated buffer on success or 0 on error.
+ *         Errno is set for us by malloc()
+ *
+ * NOTE: returned buffer is to be freed by the caller
+ */
+void *iov_gather(const struct iovec *iov, int iovcnt, size_t *len);
+
 #endif // __NETLIB_DATA_UTIL_H__
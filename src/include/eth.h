@@ -37,35 +37,76 @@
 #define __NETLIB_ETH_H__
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include <data_util.h>
+#include <graph.h>
 #include <socket.h>
 
 /* This structure defines ethernet header content.
  * We're having two 6-byte MAC addresses, and 2-byte 
- * protocol field.
+ * protocol field, use eth_ptcl()/eth_set_ptcl() for the latter.
  *
  * @member uint8_t mac_dst -- Destination MAC address
  * @member uint8_t mac_src -- Source MAC address
- * @member uint16_t ptcl   -- Protocol identifier
+ * @member uint8_t ptcl    -- Protocol identifier, big endian
  */
-typedef struct __attribute__((packed)) {
+typedef struct {
     uint8_t mac_dst[6];
     uint8_t mac_src[6];
-    uint16_t ptcl;
+    uint8_t ptcl[2];
 } eth_hdr;
 
+_Static_assert(offsetof(eth_hdr, mac_src) == 6, "eth_hdr mac_src offset");
+_Static_assert(offsetof(eth_hdr, ptcl) == 12, "eth_hdr ptcl offset");
+_Static_assert(sizeof(eth_hdr) == 14, "eth_hdr size");
+
+/* Get ethertype of frame
+ *
+ * @param const eth_hdr *h -- Pointer to ethernet header
+ * @return uint16_t ethertype in host order
+ */
+static inline uint16_t eth_ptcl(const eth_hdr *h) {
+    return load_be16(h->ptcl);
+}
+
+/* Set ethertype of frame
+ *
+ * @param eth_hdr *h     -- Pointer to ethernet header
+ * @param uint16_t ptcl  -- Ethertype in host order
+ */
+static inline void eth_set_ptcl(eth_hdr *h, uint16_t ptcl) {
+    store_be16(h->ptcl, ptcl);
+}
+
+/* Ethertypes we know how to handle
+ *
+ * @member ETH_PTCL_IPV4 -- Internet Protocol version 4
+ * @member ETH_PTCL_ARP  -- Address Resolution Protocol
+ * @member ETH_PTCL_IPV6 -- Internet Protocol version 6
+ */
+enum ETH_PTCL {
+    ETH_PTCL_IPV4 = 0x0800,
+    ETH_PTCL_ARP  = 0x0806,
+    ETH_PTCL_IPV6 = 0x86DD
+};
+
 /* Create ethernet header with given source and destination MAC addresses
  * and protocol type
  *
  * @param uint8_t *src      -- Pointer to source mac address
- * @param uint8_t *dst      -- Pointer to destination mac address
+ * @param uint8_t *dst      -- Pointer to destination mac address, or 0 to
+ *                             leave it for eth_transmit() to fill in
  * @param uint16_t proto    -- Protocol to use
  * @return pointer to populated ethernet header
  */
 eth_hdr *create_eth_hdr(uint8_t *src, uint8_t *dst, uint16_t proto);
 
-/* Transmit datagram over ethernet.
+/* Transmit datagram over ethernet. Destination MAC address is looked up
+ * from the neighbor cache, if the next hop isn't known yet the frame is
+ * queued until it has been resolved. IPv6 datagrams go to the configured
+ * IPv6 router, or straight to the multicast group's MAC address.
  *
  * @param net_socket *sock -- Pointer to socket we're working with
  * @param const void *data -- Pointer to protocol headers and data above this layer
@@ -75,4 +116,66 @@ eth_hdr *create_eth_hdr(uint8_t *src, uint8_t *dst, uint16_t proto);
  */
 size_t eth_transmit(net_socket *sock, const void *data, size_t len);
 
+/* Transmit IPv4 datagram gathered from several buffers over ethernet.
+ * Ethernet header is written in front of iov[0].iov_base, and the pieces
+ * are handed to transmitv() as they are. If the next hop isn't resolved
+ * yet, the datagram is copied to the neighbor cache instead.
+ *
+ * @param net_socket *sock  -- Pointer to socket we're working with
+ * @param struct iovec *iov -- Pieces of the datagram, IPv4 header first
+ * @param int iovcnt        -- Amount of entries in iov
+ * @return size_t bytes sent on success or -1 on error.
+ *         Set errno on error.
+ */
+size_t eth_transmitv(net_socket *sock, struct iovec *iov, int iovcnt);
+
+/* Ethernet encapsulation node of the TX graph. Prepends ethernet header
+ * to every IPv4 datagram in vector. Datagrams whose next hop isn't
+ * resolved yet are copied to the neighbor cache, and taken off the vector.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Vector of IPv4 datagrams
+ * @return unsigned amount of frames left in vector
+ */
+unsigned eth_encap_vec(net_socket *sock, pkt_vector *v);
+
+/* Ethernet input node of the RX graph. ARP is handled right away, IPv4
+ * datagrams are left in vector with off pointing past ethernet header,
+ * and anything else is dropped.
+ *
+ * @param net_socket *sock -- Pointer to socket the frames were received on
+ * @param pkt_vector *v    -- Vector of received frames
+ * @return unsigned amount of IPv4 datagrams left in vector
+ */
+unsigned eth_input_vec(net_socket *sock, pkt_vector *v);
+
+/* Handle ethernet frame we've received. Frames that aren't addressed
+ * to us are dropped.
+ *
+ * @param net_socket *sock -- Pointer to socket the frame was received on
+ * @param void *frame      -- Pointer to received frame
+ * @param size_t len       -- Size of the received frame
+ * @return size_t amount of bytes consumed on success or -1 if frame was dropped.
+ *         Set errno on error.
+ */
+size_t eth_rx(net_socket *sock, void *frame, size_t len);
+
+/* Validate header of ethernet frame we've received.
+ *
+ * @param net_socket *sock  -- Pointer to socket the frame was received on
+ * @param const void *frame -- Pointer to received frame
+ * @param size_t len        -- Size of the received frame
+ * @param uint16_t *ptcl    -- Pointer to where ethertype is written to
+ * @return size_t offset of payload, or -1 if frame isn't for us.
+ *         Set errno on error.
+ */
+size_t eth_payload(net_socket *sock, const void *frame, size_t len,
+        uint16_t *ptcl);
+
+/* Swap source and destination MAC addresses of a frame in place
+ *
+ * @param eth_hdr *hdr -- Pointer to ethernet header to modify
+ */
+void eth_swap_addr(eth_hdr *hdr);
+
 #endif
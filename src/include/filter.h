@@ -0,0 +1,86 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Classic BPF receive filter generated from socket bindings */
+#ifndef __NETLIB_FILTER_H__
+#define __NETLIB_FILTER_H__
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+#include "socket.h"
+
+// Longest program filter_build() generates
+#define FILTER_MAX_INSNS 128
+
+// Opcodes we use, encoded as in classic BPF
+#define FILTER_LD_W_ABS  0x20
+#define FILTER_LD_H_ABS  0x28
+#define FILTER_LD_B_ABS  0x30
+#define FILTER_LD_H_IND  0x48
+#define FILTER_LDX_B_MSH 0xb1
+#define FILTER_JA        0x05
+#define FILTER_JEQ_K     0x15
+#define FILTER_JSET_K    0x45
+#define FILTER_RET_K     0x06
+
+// Snap length for accepted frames, large enough for anything
+#define FILTER_ACCEPT 0x40000
+
+/* Single classic BPF instruction, same layout as struct sock_filter
+ *
+ * @member uint16_t code -- Opcode
+ * @member uint8_t jt    -- Instructions to skip if condition is true
+ * @member uint8_t jf    -- Instructions to skip if condition is false
+ * @member uint32_t k    -- Operand
+ */
+typedef struct {
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+} filter_insn;
+
+/* Generate filter accepting only what the stack of this socket handles:
+ * ARP, ICMP and bound protocols and ports addressed to us (or to a
+ * broadcast address), plus IPv6 for AF_INET6 sockets. Everything else is
+ * dropped before it's ever copied to us.
+ *
+ * @param net_socket *sock -- Pointer to socket to generate filter for
+ * @param filter_insn *prog -- Pointer to room for FILTER_MAX_INSNS instructions
+ * @return int amount of instructions on success or -1 on error.
+ *         Set errno on error, E2BIG if there are too many bindings.
+ */
+int filter_build(net_socket *sock, filter_insn *prog);
+
+#endif // __NETLIB_FILTER_H__
@@ -0,0 +1,166 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Vector packet processing.
+ *
+ * Instead of running every packet through the whole stack one at a time,
+ * each layer is a node that handles a vector of up to GRAPH_VECTOR_MAX
+ * packets before passing the vector on to the next node. Code of a node
+ * stays hot in instruction cache for the whole vector, and headers of
+ * packets further down the vector get prefetched while we work on the
+ * current one.
+ *
+ * TX: udp_encap_vec -> ipv4_encap_vec -> eth_encap_vec -> transmit
+ * RX: eth_input_vec -> ipv4_input_vec -> udp_rx / icmp_rx
+ */
+#ifndef __NETLIB_GRAPH_H__
+#define __NETLIB_GRAPH_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "socket.h"
+
+// Largest amount of packets a vector holds
+#define GRAPH_VECTOR_MAX 256
+
+// Space reserved in front of payload for headers the TX nodes prepend
+#define GRAPH_HEADROOM 64
+
+// How many packets ahead nodes prefetch headers of
+#define GRAPH_PREFETCH 4
+
+/* Descriptor of a packet in a vector.
+ *
+ * On TX data points to the outermost header written so far, and each
+ * node moves it back by the size of its own header. On RX data points to
+ * start of the received frame and off to the header of the layer that
+ * handles the packet next.
+ *
+ * @member uint8_t *data  -- Pointer to packet
+ * @member uint16_t off   -- Offset of current layer header from data
+ * @member uint16_t len   -- Size of packet starting from data
+ * @member uint16_t sport -- Source port, in host byte order
+ * @member uint16_t dport -- Destination port, in host byte order
+ * @member uint32_t src   -- Source IP address
+ * @member uint32_t dst   -- Destination IP address
+ */
+typedef struct {
+    uint8_t *data;
+    uint16_t off;
+    uint16_t len;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t src;
+    uint32_t dst;
+} pkt_desc;
+
+/* Vector of packets passed between nodes. Nodes drop packets by
+ * compacting them out of desc, so order of the rest is kept.
+ *
+ * @member unsigned count   -- Amount of packets in the vector
+ * @member unsigned dropped -- Packets dropped by nodes since creation
+ * @member size_t slot      -- Size of a single TX buffer, including headroom
+ * @member uint8_t *bufs    -- TX buffers, or 0 for vectors of received frames
+ * @member pkt_desc desc    -- Packet descriptors
+ */
+typedef struct {
+    unsigned count;
+    unsigned dropped;
+    size_t slot;
+    uint8_t *bufs;
+    pkt_desc desc[GRAPH_VECTOR_MAX];
+} pkt_vector;
+
+/* Allocate vector with buffers for datagrams to send.
+ *
+ * @param size_t max_payload -- Largest UDP payload the vector will carry
+ * @return pointer to vector on success or 0 on error.
+ *         Errno is set for us by aligned_alloc()
+ */
+pkt_vector *pkt_vector_create(size_t max_payload);
+
+/* Release vector allocated with pkt_vector_create()
+ *
+ * @param pkt_vector *v -- Pointer to vector
+ */
+void pkt_vector_destroy(pkt_vector *v);
+
+/* Queue a datagram in vector, caller writes the payload to returned
+ * pointer before calling graph_tx().
+ *
+ * @param pkt_vector *v        -- Pointer to vector
+ * @param uint32_t src_addr    -- Source IP address
+ * @param uint32_t dst_addr    -- Destination IP address
+ * @param uint16_t sport       -- UDP Port to send our data from
+ * @param uint16_t dport       -- UDP Port to send our data to
+ * @param uint16_t len         -- Amount of payload bytes
+ * @return pointer to payload area or 0 if the vector is full or len
+ *         doesn't fit in a buffer
+ */
+static inline void *pkt_vector_add(pkt_vector *v, uint32_t src_addr,
+        uint32_t dst_addr, uint16_t sport, uint16_t dport, uint16_t len)
+{
+    if (v->count == GRAPH_VECTOR_MAX || (GRAPH_HEADROOM + (size_t)len) > v->slot) {
+        return 0;
+    }
+    pkt_desc *d = &v->desc[v->count];
+    d->data = v->bufs + (v->count * v->slot) + GRAPH_HEADROOM;
+    d->off = 0;
+    d->len = len;
+    d->sport = sport;
+    d->dport = dport;
+    d->src = src_addr;
+    d->dst = dst_addr;
+    v->count++;
+    return d->data;
+}
+
+/* Send all datagrams queued in vector over UDP/IPv4, and empty it.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Pointer to vector filled with pkt_vector_add()
+ * @return unsigned amount of datagrams handed to the link. Datagrams
+ *         waiting for address resolution are not counted.
+ */
+unsigned graph_tx(net_socket *sock, pkt_vector *v);
+
+/* Run a batch of received frames through the stack.
+ *
+ * @param net_socket *sock      -- Pointer to socket the frames were received on
+ * @param const rx_frame *frames -- Frames as returned by receive_batch()
+ * @param unsigned n            -- Amount of frames, at most GRAPH_VECTOR_MAX
+ * @return unsigned amount of frames consumed by the stack
+ */
+unsigned graph_rx(net_socket *sock, const rx_frame *frames, unsigned n);
+
+#endif // __NETLIB_GRAPH_H__
@@ -0,0 +1,150 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Lock-free HDR histograms
+ *
+ * Values are bucketed log-linearly: exact below HIST_SUB, and beyond that
+ * each power of two is split into HIST_SUB / 2 buckets, so every bucket
+ * is within about 3% of the values it holds. Buckets are atomics, so any
+ * thread may record or read at any time without taking a lock.
+ */
+#ifndef __NETLIB_HIST_H__
+#define __NETLIB_HIST_H__
+
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Precision of the histogram, in bits
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+
+// Enough buckets for any 64 bit value
+#define HIST_BUCKETS (HIST_SUB + (64 - HIST_SUB_BITS) * (HIST_SUB / 2))
+
+/* Histogram of values, typically nanoseconds
+ *
+ * @member atomic_uint_fast64_t count  -- Amount of recorded values
+ * @member atomic_uint_fast64_t sum    -- Sum of recorded values
+ * @member atomic_uint_fast64_t min    -- Smallest recorded value, UINT64_MAX if none
+ * @member atomic_uint_fast64_t max    -- Largest recorded value
+ * @member atomic_uint_fast64_t bucket -- Amount of values per bucket
+ *
+ * Zeroed histograms need hist_reset() before use, for min to start out right.
+ */
+typedef struct {
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t min;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t bucket[HIST_BUCKETS];
+} hdr_hist;
+
+/* Get bucket a value falls in
+ *
+ * @param uint64_t v -- Value
+ * @return unsigned index of bucket
+ */
+static inline unsigned hist_index(uint64_t v) {
+    if (v < HIST_SUB) {
+        return (unsigned)v;
+    }
+    unsigned shift = (63 - __builtin_clzll(v)) - (HIST_SUB_BITS - 1);
+    return HIST_SUB + ((shift - 1) * (HIST_SUB / 2)) +
+        (unsigned)((v >> shift) - (HIST_SUB / 2));
+}
+
+/* Get largest value that falls in a bucket
+ *
+ * @param unsigned idx -- Index of bucket
+ * @return uint64_t largest value of the bucket
+ */
+static inline uint64_t hist_value(unsigned idx) {
+    if (idx < HIST_SUB) {
+        return idx;
+    }
+    unsigned k = idx - HIST_SUB;
+    unsigned shift = (k / (HIST_SUB / 2)) + 1;
+    uint64_t sub = (k % (HIST_SUB / 2)) + (HIST_SUB / 2);
+    return ((sub + 1) << shift) - 1;
+}
+
+/* Record a value
+ *
+ * @param hdr_hist *h -- Pointer to histogram
+ * @param uint64_t v  -- Value to record
+ */
+static inline void hist_record(hdr_hist *h, uint64_t v) {
+    atomic_fetch_add_explicit(&h->bucket[hist_index(v)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, v, memory_order_relaxed);
+
+    uint64_t cur = atomic_load_explicit(&h->min, memory_order_relaxed);
+    while (v < cur && !atomic_compare_exchange_weak_explicit(&h->min, &cur, v,
+                memory_order_relaxed, memory_order_relaxed));
+    cur = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (v > cur && !atomic_compare_exchange_weak_explicit(&h->max, &cur, v,
+                memory_order_relaxed, memory_order_relaxed));
+
+    // Last, so readers never see more values than buckets hold
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_release);
+}
+
+/* Empty a histogram. Values recorded at the same time may be lost.
+ *
+ * @param hdr_hist *h -- Pointer to histogram
+ */
+void hist_reset(hdr_hist *h);
+
+/* Add values of one histogram to another
+ *
+ * @param hdr_hist *dst       -- Histogram to add to
+ * @param const hdr_hist *src -- Histogram to add
+ */
+void hist_merge(hdr_hist *dst, const hdr_hist *src);
+
+/* Get value at given percentile
+ *
+ * @param const hdr_hist *h -- Pointer to histogram
+ * @param double pct        -- Percentile, 0 to 100
+ * @return uint64_t largest value of the bucket percentile falls in, never
+ *         above the largest recorded value. 0 if histogram is empty.
+ */
+uint64_t hist_percentile(const hdr_hist *h, double pct);
+
+/* Get mean of recorded values
+ *
+ * @param const hdr_hist *h -- Pointer to histogram
+ * @return double mean, 0 if histogram is empty
+ */
+double hist_mean(const hdr_hist *h);
+
+#endif // __NETLIB_HIST_H__
@@ -34,6 +34,91 @@
 #ifndef __ICMP_H__
 #define __ICMP_H__
 
+#include <sys/types.h>
+#include <stdint.h>
 
+#include "socket.h"
+
+/* ICMP message types we care about
+ *
+ * @member ICMP_TYPE_ECHO_REPLY   -- Echo reply
+ * @member ICMP_TYPE_DEST_UNREACH -- Destination unreachable
+ * @member ICMP_TYPE_ECHO_REQUEST -- Echo request
+ */
+enum ICMP_TYPE {
+    ICMP_TYPE_ECHO_REPLY   = 0,
+    ICMP_TYPE_DEST_UNREACH = 3,
+    ICMP_TYPE_ECHO_REQUEST = 8
+};
+
+/* Destination unreachable codes we care about
+ *
+ * @member ICMP_CODE_FRAG_NEEDED -- Fragmentation needed but DF was set
+ */
+enum ICMP_UNREACH_CODE {
+    ICMP_CODE_FRAG_NEEDED = 4
+};
+
+/* ICMP header structure ( https://datatracker.ietf.org/doc/html/rfc792 )
+ *
+ * @member uint8_t type  -- Message type, refer to enum ICMP_TYPE
+ * @member uint8_t code  -- Message subtype
+ * @member uint16_t csum -- Checksum over ICMP header and data
+ * @member union un      -- Type specific rest of the header
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t code;
+    uint16_t csum;
+    union {
+        struct {
+            uint16_t id;
+            uint16_t seq;
+        } echo;
+        struct {
+            uint16_t unused;
+            uint16_t mtu;
+        } frag;
+        uint32_t unused;
+    } un;
+} icmp_hdr;
+
+/* Initialise ICMP state of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int icmp_initialise(netlib_ctx *ctx);
+
+/* Finalise ICMP state of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void icmp_finalise(netlib_ctx *ctx);
+
+/* Configure per-source rate limit for echo replies. Each source address
+ * gets a token bucket holding up to `burst` tokens, refilled at `rate`
+ * tokens per second. Echo requests arriving to an empty bucket are dropped.
+ *
+ * @param netlib_ctx *ctx -- Stack instance to configure
+ * @param uint32_t rate   -- Replies per second per source, 0 disables replies
+ * @param uint32_t burst  -- Maximum amount of back-to-back replies per source
+ */
+void icmp_set_echo_ratelimit(netlib_ctx *ctx, uint32_t rate, uint32_t burst);
+
+/* Handle ICMP message we've received.
+ *
+ * Echo requests are answered by turning the received frame around in place,
+ * no memory is allocated nor any payload copied. Fragmentation needed
+ * messages update the path MTU cache.
+ *
+ * @param net_socket *sock -- Pointer to socket the message was received on
+ * @param void *frame      -- Pointer to start of the received frame
+ * @param size_t off       -- Offset of IPv4 header from start of the frame
+ * @param size_t len       -- Size of the frame up to end of IPv4 datagram
+ * @return size_t amount of bytes consumed on success or -1 if message was dropped.
+ *         Set errno on error.
+ */
+size_t icmp_rx(net_socket *sock, void *frame, size_t off, size_t len);
 
 #endif
@@ -36,15 +36,39 @@
 
 #include <sys/types.h>
 
+#include <stddef.h>
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "ctx.h"
+#include "data_util.h"
+#include "graph.h"
 #include "socket.h"
 
-/* Initialise ip header system */
-void ip_initialise(void);
+/* Initialise ip header system of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int ip_initialise(netlib_ctx *ctx);
 
-/* Finalise ip header system */
-void ip_finalise(void);
+/* Finalise ip header system of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void ip_finalise(netlib_ctx *ctx);
+
+/* Protocol numbers for the next header carried by IPv4
+ *
+ * @member IPV4_PTCL_ICMP -- Internet Control Message Protocol
+ * @member IPV4_PTCL_TCP  -- Transmission Control Protocol
+ * @member IPV4_PTCL_UDP  -- User Datagram Protocol
+ */
+enum IPV4_PTCL {
+    IPV4_PTCL_ICMP = 1,
+    IPV4_PTCL_TCP  = 6,
+    IPV4_PTCL_UDP  = 17
+};
 
 /* IPv4 option class definitions */
 enum IPV4_OPTION_CLASS {
@@ -142,6 +166,19 @@ enum IPV4_TOS_PRE {
     NETWORK_CTRL
 };  
 
+/* Type of Service bits following precedence
+ * ( https://datatracker.ietf.org/doc/html/rfc1349#section-4 )
+ *
+ * @member IPV4_TOS_LOW_DELAY   -- Minimize delay
+ * @member IPV4_TOS_THROUGHPUT  -- Maximize throughput
+ * @member IPV4_TOS_RELIABILITY -- Maximize reliability
+ */
+enum IPV4_TOS_BITS {
+    IPV4_TOS_LOW_DELAY   = (1 << 4),
+    IPV4_TOS_THROUGHPUT  = (1 << 3),
+    IPV4_TOS_RELIABILITY = (1 << 2)
+};
+
 /* ipv4 flags structure
  *
  * @member unsigned reserved      -- Always 0
@@ -160,6 +197,8 @@ enum IPV4_FLAGS {
  * @member int low_delay                         -- Normal or low delay
  * @member int high_throughput                   -- Mark this as high throughput datagram
  * @member int high_reliability                  -- Mark this datagram requiring high reliability
+ * @member int no_fragment                       -- Set DF, required as we neither fragment
+ *                                                  nor hold IDs past sending
  * @member uint8_t ttl                           -- Time to live value to use
  * @member struct ipv4_option_structure *options -- Pointer to populated IPv4 options structure if options are used,
  *                                                  or NULL if not
@@ -178,35 +217,120 @@ typedef struct __attribute__((packed)) {
 
 /* IPv4 Header structure ( https://datatracker.ietf.org/doc/html/rfc791#section-3.1 )
  *
- * @member unsigned version      -- 4 bit version field
- * @member unsigned ihl          -- internet header length
- * @member enum IPV4_TOS_PRE tos -- type of servce
- * @member unsigned len          -- total length
- * @member unsigned id           -- identification
- * @member unsigned flags        -- refer to enum IPV4_FLAGS 
- * @membef foff                  -- fragment offset
- * @member ttl                   -- time to live
- * @member ptcl                  -- protocol identifier for next protocol header (icmp, tcp, udp, ..)
- * @member csum                  -- checksum
- * @member src                   -- source ipv4 address
- * @member dst                   -- destination ipv4 address
+ * Laid out byte by byte as on the wire, use the accessors below for
+ * anything wider than a byte.
+ *
+ * @member uint8_t ver_ihl    -- 4 bit version, 4 bit internet header length
+ * @member uint8_t tos        -- type of service
+ * @member uint8_t len        -- total length
+ * @member uint8_t id         -- identification
+ * @member uint8_t flags_foff -- refer to enum IPV4_FLAGS, and fragment offset
+ * @member uint8_t ttl        -- time to live
+ * @member uint8_t ptcl       -- protocol identifier for next protocol header (icmp, tcp, udp, ..)
+ * @member uint8_t csum       -- checksum
+ * @member uint8_t src        -- source ipv4 address
+ * @member uint8_t dst        -- destination ipv4 address
  */
-typedef struct __attribute__((packed)) {
-    unsigned ihl          : 4;
-    unsigned version      : 4;
-    enum IPV4_TOS_PRE tos : 8;
-    unsigned len          : 16;
-    unsigned id           : 16;
-    unsigned flags_foff   : 16;
-    unsigned ttl          : 8;
-    unsigned ptcl         : 8;
-    unsigned csum         : 16;
-    unsigned src          : 32;
-    unsigned dst          : 32;
+typedef struct {
+    uint8_t ver_ihl;
+    uint8_t tos;
+    uint8_t len[2];
+    uint8_t id[2];
+    uint8_t flags_foff[2];
+    uint8_t ttl;
+    uint8_t ptcl;
+    uint8_t csum[2];
+    uint8_t src[4];
+    uint8_t dst[4];
 } ipv4_hdr;
 
+_Static_assert(offsetof(ipv4_hdr, len) == 2, "ipv4_hdr len offset");
+_Static_assert(offsetof(ipv4_hdr, id) == 4, "ipv4_hdr id offset");
+_Static_assert(offsetof(ipv4_hdr, flags_foff) == 6, "ipv4_hdr flags offset");
+_Static_assert(offsetof(ipv4_hdr, ttl) == 8, "ipv4_hdr ttl offset");
+_Static_assert(offsetof(ipv4_hdr, ptcl) == 9, "ipv4_hdr ptcl offset");
+_Static_assert(offsetof(ipv4_hdr, csum) == 10, "ipv4_hdr csum offset");
+_Static_assert(offsetof(ipv4_hdr, src) == 12, "ipv4_hdr src offset");
+_Static_assert(offsetof(ipv4_hdr, dst) == 16, "ipv4_hdr dst offset");
+_Static_assert(sizeof(ipv4_hdr) == 20, "ipv4_hdr size");
+
+/* IPv4 header accessors. Lengths, ID and flags are in host order.
+ * Addresses stay in network byte order like everywhere else, and
+ * checksum is kept as stored so it can be fed to the csum helpers.
+ */
+static inline uint8_t ipv4_version(const ipv4_hdr *h) {
+    return h->ver_ihl >> 4;
+}
+
+static inline size_t ipv4_hlen(const ipv4_hdr *h) {
+    return (h->ver_ihl & 0x0f) * 4;
+}
+
+static inline void ipv4_set_hlen(ipv4_hdr *h, size_t hlen) {
+    h->ver_ihl = (4 << 4) | (uint8_t)(hlen / 4);
+}
+
+static inline uint16_t ipv4_len(const ipv4_hdr *h) {
+    return load_be16(h->len);
+}
+
+static inline void ipv4_set_len(ipv4_hdr *h, uint16_t len) {
+    store_be16(h->len, len);
+}
+
+static inline uint16_t ipv4_id(const ipv4_hdr *h) {
+    return load_be16(h->id);
+}
+
+static inline void ipv4_set_id(ipv4_hdr *h, uint16_t id) {
+    store_be16(h->id, id);
+}
+
+static inline uint16_t ipv4_flags_foff(const ipv4_hdr *h) {
+    return load_be16(h->flags_foff);
+}
+
+static inline void ipv4_set_flags_foff(ipv4_hdr *h, uint16_t flags_foff) {
+    store_be16(h->flags_foff, flags_foff);
+}
+
+/* Check if datagram is a fragment, either with more to follow or with a
+ * nonzero offset
+ *
+ * @param const ipv4_hdr *h -- Pointer to IPv4 header
+ * @return bool true if datagram is a fragment
+ */
+static inline bool ipv4_is_fragment(const ipv4_hdr *h) {
+    return (ipv4_flags_foff(h) & 0x3fff) != 0;
+}
+
+static inline uint16_t ipv4_csum(const ipv4_hdr *h) {
+    return load_u16(h->csum);
+}
+
+static inline void ipv4_set_csum(ipv4_hdr *h, uint16_t sum) {
+    store_u16(h->csum, sum);
+}
+
+static inline uint32_t ipv4_src(const ipv4_hdr *h) {
+    return load_u32(h->src);
+}
+
+static inline void ipv4_set_src(ipv4_hdr *h, uint32_t addr) {
+    store_u32(h->src, addr);
+}
+
+static inline uint32_t ipv4_dst(const ipv4_hdr *h) {
+    return load_u32(h->dst);
+}
+
+static inline void ipv4_set_dst(ipv4_hdr *h, uint32_t addr) {
+    store_u32(h->dst, addr);
+}
+
 /* Allocate IPv4 header when non-standard header is required.
  *
+ * @param netlib_ctx *ctx -- Stack instance to allocate ID from
  * @param uint32_t src -- Pointer to source sockaddr_in struct
  * @param uint32_t dst -- Pointer to destination sockaddr_in struct
  * @param uint8_t tos             -- Type of service value
@@ -220,16 +344,23 @@ typedef struct __attribute__((packed)) {
  *                                   and payload we're delivering
  * @return pointer to populated ipv4 header structure on success or 0 on error
  */
-ipv4_hdr *create_ipv4_hdr(uint32_t src,
+ipv4_hdr *create_ipv4_hdr(netlib_ctx *ctx, uint32_t src,
         uint32_t dst, uint8_t tos, uint16_t f_off_vcf,
         uint8_t ttl, uint8_t proto, uint8_t option_type, uint8_t option_len,
         uint8_t *option_buf, uint16_t tlen);
 
+/* Release IPv4 header from create_ipv4_hdr(), and free its ID for reuse
+ *
+ * @param netlib_ctx *ctx -- Stack instance the header got its ID from
+ * @param ipv4_hdr *iph   -- Pointer to header to release, may be 0
+ */
+void destroy_ipv4_hdr(netlib_ctx *ctx, ipv4_hdr *iph);
 
 /* Allocate and populate a default non-priority IPv4 header for user.
  * Unless there's a need for high priority delay, reliability or throughput, this
  * is likely the type of routine packet header you want.
  *
+ * @param netlib_ctx *ctx         -- Stack instance to allocate ID from
  * @param uint32_t src            -- Source address to use
  * @param uint32_t dst            -- Destination address to use
  * @param uint8_t proto           -- Protocol identification number
@@ -237,11 +368,21 @@ ipv4_hdr *create_ipv4_hdr(uint32_t src,
  *                                   and payload we're delivering
  * @return pointer to populated ipv4 header structure
  */
-inline ipv4_hdr *create_std_ipv4_hdr(uint32_t src, uint32_t dst, 
+inline ipv4_hdr *create_std_ipv4_hdr(netlib_ctx *ctx, uint32_t src, uint32_t dst, 
         uint8_t proto, uint16_t tlen) {
-    return create_ipv4_hdr(src, dst, 16, 0, 64, proto, 0, 0, 0, tlen);
+    return create_ipv4_hdr(ctx, src, dst, 16, 0, 64, proto, 0, 0, 0, tlen);
 }
 
+/* Get path MTU towards destination, and store it as the MTU in use in
+ * socket's ipv4_socket_options. Takes link MTU, MTU of the route and
+ * path MTU cache into account.
+ *
+ * @param net_socket *socket -- Pointer to populated net_socket structure
+ * @param uint32_t dst       -- Destination address
+ * @return uint16_t largest IPv4 datagram we can send to dst without it being dropped
+ */
+uint16_t ipv4_path_mtu(net_socket *socket, uint32_t dst);
+
 /* Transmit datagram over IPv4 protocol
  *
  * @param net_socket *socket -- Pointer to populated net_socket structure
@@ -251,11 +392,48 @@ inline ipv4_hdr *create_std_ipv4_hdr(uint32_t src, uint32_t dst,
  *                              protocol header
  * @param size_t data_len    -- Length of datagram to send
  * @return size_t amount of bytes sent excluding ip header on success or -1 on error.
- * Set errno on error.
+ * Set errno on error, EMSGSIZE if datagram doesn't fit in path MTU,
+ * EINVAL if socket has no_fragment cleared.
  */
 size_t ipv4_transmit_datagram(net_socket *socket, uint32_t src,
         uint32_t dst, const void *data, size_t data_len);
 
+/* Transmit datagram gathered from several buffers over IPv4 protocol.
+ * IPv4 header is written in front of iov[0].iov_base, which must have
+ * sizeof(ipv4_hdr) + LINK_HEADROOM writable bytes before it. Rest of the
+ * pieces go down to the link as they are.
+ *
+ * @param net_socket *socket -- Pointer to populated net_socket structure
+ * @param uint32_t src       -- Source address to use
+ * @param uint32_t dst       -- Destination address to use
+ * @param struct iovec *iov  -- Pieces of the datagram, protocol header first
+ * @param int iovcnt         -- Amount of entries in iov
+ * @return size_t amount of bytes sent on success or -1 on error.
+ * Set errno on error, EMSGSIZE if datagram doesn't fit in path MTU,
+ * EINVAL if socket has no_fragment cleared.
+ */
+size_t ipv4_transmitv(net_socket *socket, uint32_t src, uint32_t dst,
+        struct iovec *iov, int iovcnt);
+
+/* IPv4 encapsulation node of the TX graph. Prepends IPv4 header to
+ * every datagram in vector, datagrams that don't fit in path MTU are
+ * dropped. Whole vector is dropped if socket has no_fragment cleared.
+ *
+ * @param net_socket *socket -- Pointer to socket we're sending on
+ * @param pkt_vector *v      -- Vector of datagrams carrying src and dst
+ * @return unsigned amount of datagrams left in vector
+ */
+unsigned ipv4_encap_vec(net_socket *socket, pkt_vector *v);
+
+/* IPv4 input node of the RX graph. Drops malformed datagrams, and trims
+ * link layer padding off the rest.
+ *
+ * @param net_socket *socket -- Pointer to socket the datagrams were received on
+ * @param pkt_vector *v      -- Vector of frames, off pointing at IPv4 header
+ * @return unsigned amount of datagrams left in vector
+ */
+unsigned ipv4_input_vec(net_socket *socket, pkt_vector *v);
+
 /* Receive datagram over IPv4 protocol
  *
  * @param net_socket *socket        -- Pointer to populated net_socket structure
@@ -266,4 +444,151 @@ size_t ipv4_transmit_datagram(net_socket *socket, uint32_t src,
  */
 size_t ipv4_receive_datagram(net_socket *socket, void *dst, size_t r_len);
 
+/* Handle IPv4 datagram we've received from the link layer, and pass it on
+ * to the next protocol.
+ *
+ * @param net_socket *socket -- Pointer to socket the datagram was received on
+ * @param void *frame        -- Pointer to start of the received frame
+ * @param size_t off         -- Offset of IPv4 header from start of the frame
+ * @param size_t len         -- Size of the whole frame
+ * @return size_t amount of bytes consumed on success or -1 if datagram was dropped.
+ *         Set errno on error.
+ */
+size_t ipv4_rx(net_socket *socket, void *frame, size_t off, size_t len);
+
+/* IPv6 next header values we know about
+ *
+ * @member IPV6_NXT_HOPOPTS  -- Hop-by-hop options extension header
+ * @member IPV6_NXT_TCP      -- Transmission Control Protocol
+ * @member IPV6_NXT_UDP      -- User Datagram Protocol
+ * @member IPV6_NXT_ROUTING  -- Routing extension header
+ * @member IPV6_NXT_FRAGMENT -- Fragment extension header
+ * @member IPV6_NXT_AH       -- Authentication header
+ * @member IPV6_NXT_ICMPV6   -- ICMP for IPv6
+ * @member IPV6_NXT_NONE     -- No next header
+ * @member IPV6_NXT_DSTOPTS  -- Destination options extension header
+ */
+enum IPV6_NXT {
+    IPV6_NXT_HOPOPTS  = 0,
+    IPV6_NXT_TCP      = 6,
+    IPV6_NXT_UDP      = 17,
+    IPV6_NXT_ROUTING  = 43,
+    IPV6_NXT_FRAGMENT = 44,
+    IPV6_NXT_AH       = 51,
+    IPV6_NXT_ICMPV6   = 58,
+    IPV6_NXT_NONE     = 59,
+    IPV6_NXT_DSTOPTS  = 60
+};
+
+// Every IPv6 link must be able to carry datagrams of this size (RFC 8200)
+#define IPV6_MIN_MTU 1280
+
+/* IPv6 Header structure ( https://datatracker.ietf.org/doc/html/rfc8200#section-3 )
+ *
+ * @member uint32_t vtc_flow -- 4 bit version, 8 bit traffic class and 20 bit flow label
+ * @member uint16_t plen     -- payload length, including extension headers
+ * @member uint8_t nxt       -- next header, refer to enum IPV6_NXT
+ * @member uint8_t hlim      -- hop limit
+ * @member ipv6_addr src     -- source address
+ * @member ipv6_addr dst     -- destination address
+ */
+typedef struct {
+    uint32_t vtc_flow;
+    uint16_t plen;
+    uint8_t nxt;
+    uint8_t hlim;
+    ipv6_addr src;
+    ipv6_addr dst;
+} ipv6_hdr;
+
+/* IPv6 specific socket options.
+ *
+ * The header of the last source/destination pair we sent to is kept
+ * around as a template, together with the pseudo header sum upper layers
+ * need for their checksums, so back-to-back datagrams of the same flow
+ * don't need to rebuild either.
+ *
+ * @member uint8_t tclass     -- Traffic class to use
+ * @member uint8_t hop_limit  -- Hop limit to use
+ * @member uint32_t flow      -- Fixed flow label, or 0 to derive one per flow
+ * @member uint16_t mtu       -- Maximum transmission unit
+ * @member int tmpl_valid     -- Set once tmpl has been built
+ * @member ipv6_hdr tmpl      -- Prebuilt header for last source/destination pair
+ * @member uint32_t psd_sum   -- Partial sum of pseudo header for tmpl, without length
+ * @member uint32_t addr_hash -- Hash of tmpl addresses, seed for flow labels
+ */
+typedef struct {
+    uint8_t tclass;
+    uint8_t hop_limit;
+    uint32_t flow;
+    uint16_t mtu;
+    int tmpl_valid;
+    ipv6_hdr tmpl;
+    uint32_t psd_sum;
+    uint32_t addr_hash;
+} ipv6_socket_options;
+
+/* Get partial sum of the IPv6 pseudo header for given addresses, excluding
+ * the upper layer length. The sum is cached per socket, so this is cheap
+ * for consecutive datagrams between the same pair of addresses.
+ *
+ * @param net_socket *socket   -- Pointer to populated AF_INET6 net_socket structure
+ * @param const ipv6_addr *src -- Pointer to source address
+ * @param const ipv6_addr *dst -- Pointer to destination address
+ * @return uint32_t partial sum to feed into csum_partial()
+ */
+uint32_t ipv6_psd_sum(net_socket *socket, const ipv6_addr *src,
+        const ipv6_addr *dst);
+
+/* Walk IPv6 extension headers to find the upper layer header.
+ *
+ * @param const void *pkt -- Pointer to IPv6 header
+ * @param size_t len      -- Size of the datagram
+ * @param uint8_t *nxt    -- Pointer to where upper layer protocol is written to
+ * @return size_t offset of upper layer header from start of IPv6 header,
+ *         or -1 if datagram is malformed or a non-first fragment.
+ */
+size_t ipv6_upper_layer(const void *pkt, size_t len, uint8_t *nxt);
+
+/* Handle IPv6 datagram we've received from the link layer. The header,
+ * destination, extension headers and upper layer checksum are checked.
+ * Nothing in the stack consumes IPv6 yet, so valid datagrams are counted
+ * and left for ipv6_receive_datagram() callers.
+ *
+ * @param net_socket *socket -- Pointer to socket the datagram was received on
+ * @param void *frame        -- Pointer to start of the received frame
+ * @param size_t off         -- Offset of IPv6 header from start of the frame
+ * @param size_t len         -- Size of the whole frame
+ * @return size_t amount of bytes consumed on success or -1 if datagram was dropped.
+ *         Set errno on error.
+ */
+size_t ipv6_rx(net_socket *socket, void *frame, size_t off, size_t len);
+
+/* Transmit datagram over IPv6 protocol
+ *
+ * @param net_socket *socket   -- Pointer to populated AF_INET6 net_socket structure
+ * @param const ipv6_addr *src -- Pointer to source address
+ * @param const ipv6_addr *dst -- Pointer to destination address
+ * @param const void *data     -- Pointer to datagram to send, including appropriate
+ *                                protocol header
+ * @param size_t data_len      -- Length of datagram to send
+ * @return size_t amount of bytes sent on success or -1 on error.
+ * Set errno on error, EMSGSIZE if datagram doesn't fit in link MTU.
+ */
+size_t ipv6_transmit_datagram(net_socket *socket, const ipv6_addr *src,
+        const ipv6_addr *dst, const void *data, size_t data_len);
+
+/* Receive datagram over IPv6 protocol. Frames that aren't IPv6 are handed
+ * to link_rx() while we wait, so that ie. ARP keeps working. IPv6
+ * datagrams that ipv6_rx() would drop are skipped.
+ *
+ * @param net_socket *socket        -- Pointer to populated net_socket structure
+ * @param const void *dst           -- Pointer to memory where we'll write received data to
+ * @param size_t r_len              -- How many bytes do we want to receive *including* IPv6 header
+ * @return size_t amount of bytes received on success or -1 on error.
+ *                Set errno on error, EAGAIN if nothing arrived before
+ *                receive timeout.
+ */
+size_t ipv6_receive_datagram(net_socket *socket, void *dst, size_t r_len);
+
 #endif // __NETLIB_IP_H__
@@ -41,6 +41,8 @@
 #include <sys/types.h>
 
 #include <eth.h>
+#include <ip.h>
+#include <route.h>
 #include <socket.h>
 
 /* different types of links we support
@@ -53,20 +55,123 @@ enum LINK_TYPE {
     SLIP = 1
 };
 
+// Default MTUs for the links we support
+#define ETH_DEFAULT_MTU  1500
+#define SLIP_DEFAULT_MTU 1006
+
+/* Van Jacobson TCP/IP header compression on a SLIP link, CSLIP
+ *
+ * @member SLIP_VJ_OFF  -- Plain SLIP, compressed frames are dropped
+ * @member SLIP_VJ_ON   -- Compress from the start
+ * @member SLIP_VJ_AUTO -- Send plain SLIP until the other end sends a
+ *                         compressed frame, then compress as well
+ */
+enum SLIP_VJ {
+    SLIP_VJ_OFF  = 0,
+    SLIP_VJ_ON   = 1,
+    SLIP_VJ_AUTO = 2
+};
+
+// Room link_txv() needs in front of the network header for link header
+#define LINK_HEADROOM 16
+
 /* Hold information related to link layer we're dealing with.
  *
  * @member enum LINK_TYPE type -- type of link we're communicating over
+ * @member uint16_t mtu        -- maximum transmission unit of the link
  * @member union hdr           -- pointer to link protocol specific data
+ * @member uint32_t addr       -- Our IPv4 address on this link
+ * @member uint32_t netmask    -- Netmask of the subnet on this link
+ * @member uint32_t gateway    -- Default gateway, or 0 if everyone's on-link
+ * @member ipv6_addr addr6     -- Our IPv6 address on this link
+ * @member uint8_t router6_mac -- MAC address unicast IPv6 traffic is sent to.
+ *                                We don't do neighbor discovery (yet), so
+ *                                this needs to be configured up front.
+ * @member route_table *routes -- Routing table to pick next hops and MTUs
+ *                                from, or 0 to go by addr/netmask/gateway
+ * @member void *slip_line     -- Line state when SLIP runs over a file
+ *                                descriptor, see socket_set_slip_fd(), or 0
+ *                                to use the UART at proto.slip_port
+ * @member void *slip_vj       -- Header compression state of a SLIP link,
+ *                                see link_set_slip_vj(), or 0 if it's off
  *
  */
 typedef struct {
     enum LINK_TYPE type;
+    uint16_t mtu;
     union {
         eth_hdr *eth_header;
         uint16_t slip_port;
     } proto;
+    uint32_t addr;
+    uint32_t netmask;
+    uint32_t gateway;
+    ipv6_addr addr6;
+    uint8_t router6_mac[6];
+    route_table *routes;
+    void *slip_line;
+    void *slip_vj;
 } link_options;
 
+/* Find IPv4 header of a frame about to be sent on this socket
+ *
+ * @param net_socket *sock  -- Pointer to socket
+ * @param const void *frame -- Pointer to frame, link header first
+ * @param size_t len        -- Size of the frame
+ * @return const ipv4_hdr * pointer to header, or 0 if the frame doesn't
+ *         carry a complete IPv4 header
+ */
+static inline const ipv4_hdr *link_ipv4_hdr(net_socket *sock, const void *frame,
+        size_t len)
+{
+    link_options *link = (link_options *)sock->link_options;
+    size_t off = 0;
+
+    if (link->type == ETH) {
+        if (len < sizeof(eth_hdr) || eth_ptcl((const eth_hdr *)frame) != ETH_PTCL_IPV4) {
+            return 0;
+        }
+        off = sizeof(eth_hdr);
+    }
+    if ((len - off) < sizeof(ipv4_hdr)) {
+        return 0;
+    }
+    return POINTER_ADD(const ipv4_hdr *, frame, off);
+}
+
+/* Configure IPv4 addressing of the link this socket is bound to
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param uint32_t addr    -- Our address
+ * @param uint32_t netmask -- Netmask of the local subnet
+ * @param uint32_t gateway -- Default gateway, or 0 if there's none
+ */
+void link_set_ipv4(net_socket *sock, uint32_t addr, uint32_t netmask,
+        uint32_t gateway);
+
+/* Attach routing table to the link this socket is bound to. Next hops
+ * and MTUs of outgoing datagrams are then taken from the table.
+ *
+ * @param net_socket *sock  -- Pointer to socket
+ * @param route_table *rt   -- Pointer to routing table, or 0 to detach
+ */
+void link_set_routes(net_socket *sock, route_table *rt);
+
+/* Configure IPv6 address of the link this socket is bound to. Datagrams
+ * are accepted for it, its solicited-node group and all-nodes.
+ *
+ * @param net_socket *sock     -- Pointer to socket
+ * @param const ipv6_addr *addr -- Our address
+ */
+void link_set_ipv6(net_socket *sock, const ipv6_addr *addr);
+
+/* Configure MAC address of the router unicast IPv6 traffic is sent to
+ *
+ * @param net_socket *sock    -- Pointer to socket
+ * @param const uint8_t *mac  -- MAC address of the router
+ */
+void link_set_ipv6_router(net_socket *sock, const uint8_t *mac);
+
 /* Transmit data over link that has been associated with this socket.
  *
  * @param net_socket *sock       -- Pointer to socket
@@ -77,4 +182,95 @@ typedef struct {
  */
 size_t link_tx(net_socket *sock, const void *data, size_t size);
 
+/* Transmit datagram gathered from several buffers over link that has been
+ * associated with this socket. Link header is written in front of
+ * iov[0].iov_base, which must have LINK_HEADROOM writable bytes before it.
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param struct iovec *iov -- Pieces of the datagram, network header first.
+ *                             iov[0] is updated to cover the link header.
+ * @param int iovcnt       -- Amount of entries in iov
+ * @return size_t sent bytes or -1 on error.
+ *         set errno on error.
+ */
+size_t link_txv(net_socket *sock, struct iovec *iov, int iovcnt);
+
+/* Send a bare IP datagram as a SLIP frame, over the file descriptor
+ * attached with socket_set_slip_fd() or else the UART. TCP/IP headers
+ * are compressed if the link does so, see link_set_slip_vj().
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param const void *data -- Pointer to datagram
+ * @param size_t len       -- Size of the datagram
+ * @return size_t sent bytes or -1 on error.
+ *         set errno on error.
+ */
+size_t link_slip_transmit(net_socket *sock, const void *data, size_t len);
+
+/* Set up TCP/IP header compression on a SLIP link. Both ends need the
+ * same amount of slots. Turning compression off releases its state.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param int mode         -- Refer to enum SLIP_VJ
+ * @param unsigned slots   -- Connections remembered in each direction,
+ *                            0 for VJ_DEFAULT_SLOTS
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int link_set_slip_vj(net_socket *sock, int mode, unsigned slots);
+
+/* Get IP datagram out of a received SLIP frame, decompressing it if the
+ * link does header compression.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param void *frame      -- Pointer to received frame
+ * @param size_t *len      -- Size of the frame, updated to size of the datagram
+ * @return void * pointer to the datagram, frame itself or a buffer of the
+ *         link valid until next frame, or 0 if the frame was dropped.
+ *         set errno on error.
+ */
+void *link_slip_input(net_socket *sock, void *frame, size_t *len);
+
+/* Tell the link a received SLIP frame was lost or damaged. Compressed
+ * frames are then dropped until the other end resyncs.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ */
+void link_slip_rx_error(net_socket *sock);
+
+/* Hand a frame received from the link over to the protocol layers above.
+ *
+ * @param net_socket *sock -- Pointer to socket the frame was received on
+ * @param void *frame      -- Pointer to received frame, including link header.
+ *                            Upper layers may modify the frame in place.
+ * @param size_t len       -- Size of the received frame
+ * @return size_t amount of bytes consumed on success or -1 if frame was dropped.
+ *         set errno on error.
+ */
+size_t link_rx(net_socket *sock, void *frame, size_t len);
+
+/* Find payload of a received frame, and the protocol it carries.
+ *
+ * @param net_socket *sock  -- Pointer to socket the frame was received on
+ * @param const void *frame -- Pointer to received frame, including link header
+ * @param size_t len        -- Size of the received frame
+ * @param uint16_t *ptcl    -- Pointer to where ethertype of payload is written to
+ * @return size_t offset of payload from start of frame, or -1 if frame
+ *         isn't for us. Set errno on error.
+ */
+size_t link_payload(net_socket *sock, const void *frame, size_t len,
+        uint16_t *ptcl);
+
+/* Send a received frame back where it came from. Link layer addresses
+ * are swapped in place, upper layers are expected to have already turned
+ * their part of the frame around.
+ *
+ * @param net_socket *sock -- Pointer to socket the frame was received on
+ * @param void *frame      -- Pointer to frame, including link header
+ * @param size_t len       -- Size of the frame
+ * @return size_t sent bytes.
+ *         set errno on error.
+ */
+size_t link_reflect(net_socket *sock, void *frame, size_t len);
+
 #endif // __NETLIB_LINK__
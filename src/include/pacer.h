@@ -0,0 +1,127 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Transmit pacing.
+ *
+ * Every frame gets an earliest departure time from two token buckets:
+ * one for the socket as a whole, and one for the flow the frame belongs
+ * to. Frames that may not leave yet wait on a timing wheel, and get sent
+ * in batches by pacer_release() once their time has come. Alternatively
+ * frames are handed to the kernel right away with SO_TXTIME, and the fq
+ * qdisc holds on to them instead.
+ */
+#ifndef __NETLIB_PACER_H__
+#define __NETLIB_PACER_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "socket.h"
+
+// Width of a timing wheel slot in nanoseconds
+#define PACER_SLOT_NS 1024
+
+// Amount of slots in the timing wheel, about 4ms worth of departures
+#define PACER_WHEEL_SLOTS 4096
+
+// Amount of per-flow buckets, flows hashing to the same one share it
+#define PACER_FLOWS 1024
+
+/* Pacing configuration of a socket.
+ *
+ * Burst is how many bytes may leave back to back after the bucket has
+ * been idle for long enough. Rates are in bits per second, counting
+ * whole frames including link header.
+ *
+ * @member uint64_t rate_bps      -- Rate of the whole socket, 0 for no limit
+ * @member uint64_t burst         -- Burst size of the whole socket in bytes
+ * @member uint64_t flow_rate_bps -- Rate of a single flow, 0 for no limit
+ * @member uint64_t flow_burst    -- Burst size of a single flow in bytes
+ * @member unsigned queue_len     -- Amount of frames that can wait to be sent
+ * @member int txtime             -- Leave holding frames to the kernel with SO_TXTIME
+ */
+typedef struct {
+    uint64_t rate_bps;
+    uint64_t burst;
+    uint64_t flow_rate_bps;
+    uint64_t flow_burst;
+    unsigned queue_len;
+    int txtime;
+} pacer_config;
+
+/* Start pacing frames sent on a socket. From now on transmit() hands
+ * frames to the pacer, and pacer_release() needs to be called regularly.
+ * Workers do that once per loop, so their receive timeout bounds how
+ * late a frame may leave.
+ *
+ * @param net_socket *sock        -- Pointer to socket we're working with
+ * @param const pacer_config *cfg -- Pacing configuration
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, EOPNOTSUPP if cfg->txtime is set but the
+ *         socket doesn't support SO_TXTIME.
+ */
+int pacer_attach(net_socket *sock, const pacer_config *cfg);
+
+/* Stop pacing frames sent on a socket. Frames still waiting are dropped.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ */
+void pacer_detach(net_socket *sock);
+
+/* Schedule a frame for sending, called by transmit().
+ *
+ * @param net_socket *sock -- Pointer to socket with a pacer
+ * @param const void *data -- Pointer to frame, copied if it has to wait
+ * @param size_t len       -- Size of the frame
+ * @return size_t len on success or -1 on error.
+ *         Set errno on error, ENOBUFS if the frame would have to wait
+ *         longer than the timing wheel reaches, or there's no room for it.
+ */
+size_t pacer_enqueue(net_socket *sock, const void *data, size_t len);
+
+/* Send all frames whose departure time has passed.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return unsigned amount of frames sent
+ */
+unsigned pacer_release(net_socket *sock);
+
+/* Get departure time of the next waiting frame, to know how long the
+ * caller can sleep for.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return uint64_t monotonic time in nanoseconds, or UINT64_MAX if
+ *         nothing is waiting
+ */
+uint64_t pacer_next(net_socket *sock);
+
+#endif // __NETLIB_PACER_H__
@@ -0,0 +1,105 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Path MTU discovery ( https://datatracker.ietf.org/doc/html/rfc1191 )
+ *
+ * We keep a cache of path MTU estimates per destination, learned from
+ * ICMP "fragmentation needed" messages. Estimates age out after a while
+ * so that we'll notice if the path MTU has increased again.
+ */
+#ifndef __NETLIB_PMTU_H__
+#define __NETLIB_PMTU_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "ctx.h"
+
+// Smallest MTU every IPv4 host must be able to handle (RFC 791)
+#define PMTU_MIN 68
+
+// Default time an estimate is kept around (RFC 1191 recommends 10 minutes)
+#define PMTU_DEFAULT_TIMEOUT_NS (600ULL * 1000000000ULL)
+
+/* Initialise path MTU cache of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int pmtu_initialise(netlib_ctx *ctx);
+
+/* Finalise path MTU cache of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void pmtu_finalise(netlib_ctx *ctx);
+
+/* Look up path MTU towards given destination
+ *
+ * @param netlib_ctx *ctx  -- Stack instance owning the cache
+ * @param uint32_t dst      -- Destination address
+ * @param uint16_t link_mtu -- MTU of the link we'd send over
+ * @return uint16_t path MTU estimate, never larger than link_mtu
+ */
+uint16_t pmtu_get(netlib_ctx *ctx, uint32_t dst, uint16_t link_mtu);
+
+/* Record new path MTU estimate for given destination. Estimates are only
+ * ever lowered, raising happens by letting the estimate age out.
+ *
+ * @param netlib_ctx *ctx -- Stack instance owning the cache
+ * @param uint32_t dst    -- Destination address
+ * @param uint16_t mtu    -- Next-hop MTU reported by a router
+ */
+void pmtu_update(netlib_ctx *ctx, uint32_t dst, uint16_t mtu);
+
+/* Guess path MTU for routers that don't report next-hop MTU, by picking
+ * next plateau below the size of datagram that was too big (RFC 1191 sec. 7).
+ *
+ * @param uint16_t len -- Total length of the datagram that didn't fit
+ * @return uint16_t estimated path MTU
+ */
+uint16_t pmtu_plateau(uint16_t len);
+
+/* Set how long path MTU estimates are kept
+ *
+ * @param netlib_ctx *ctx     -- Stack instance owning the cache
+ * @param uint64_t timeout_ns -- Lifetime of an estimate in nanoseconds
+ */
+void pmtu_set_timeout(netlib_ctx *ctx, uint64_t timeout_ns);
+
+/* Drop all cached estimates
+ *
+ * @param netlib_ctx *ctx -- Stack instance owning the cache
+ */
+void pmtu_flush(netlib_ctx *ctx);
+
+#endif // __NETLIB_PMTU_H__
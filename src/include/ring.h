@@ -0,0 +1,286 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Lock-free rings for handing packets between threads */
+#ifndef __NETLIB_RING_H__
+#define __NETLIB_RING_H__
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ctx.h"
+
+// Bytes in front of each MPSC slot holding its sequence number
+#define RING_SLOT_HDR 16
+
+/* Bounded multi-producer single-consumer ring. Elements are stored inline,
+ * so producers copy straight into the ring and nothing gets allocated.
+ * Every slot carries a sequence number telling whether it's free, being
+ * written, or ready, so that producers only contend on the tail index.
+ *
+ * @member atomic_size_t tail    -- Next slot producers claim
+ * @member atomic_ulong full     -- Times a producer found the ring full
+ * @member size_t head           -- Next slot consumer reads, consumer only
+ * @member size_t mask           -- Amount of slots - 1
+ * @member size_t stride         -- Bytes per slot, a multiple of cache line size
+ * @member size_t elem_size      -- Usable bytes per slot
+ * @member uint8_t *slots        -- Slot memory
+ */
+typedef struct {
+    _Alignas(NETLIB_CACHELINE) atomic_size_t tail;
+    atomic_ulong full;
+    _Alignas(NETLIB_CACHELINE) size_t head;
+    _Alignas(NETLIB_CACHELINE) size_t mask;
+    size_t stride;
+    size_t elem_size;
+    uint8_t *slots;
+} mpsc_ring;
+
+/* Bounded single-producer single-consumer ring. Both sides keep a cached
+ * copy of the other side's index, so they only touch the other's cache
+ * line when the ring looks full or empty.
+ *
+ * @member atomic_size_t tail    -- Slots up to here are published
+ * @member size_t next           -- Next slot producer writes, producer only
+ * @member size_t head_cache     -- Last seen head, producer only
+ * @member atomic_ulong dropped  -- Elements the producer had no room for
+ * @member atomic_size_t head    -- Slots up to here are consumed
+ * @member size_t tail_cache     -- Last seen tail, consumer only
+ * @member size_t mask           -- Amount of slots - 1
+ * @member size_t stride         -- Bytes per slot, a multiple of cache line size
+ * @member size_t elem_size      -- Usable bytes per slot
+ * @member uint8_t *slots        -- Slot memory
+ */
+typedef struct {
+    _Alignas(NETLIB_CACHELINE) atomic_size_t tail;
+    size_t next;
+    size_t head_cache;
+    atomic_ulong dropped;
+    _Alignas(NETLIB_CACHELINE) atomic_size_t head;
+    size_t tail_cache;
+    _Alignas(NETLIB_CACHELINE) size_t mask;
+    size_t stride;
+    size_t elem_size;
+    uint8_t *slots;
+} spsc_ring;
+
+/* Create MPSC ring
+ *
+ * @param size_t len       -- Amount of slots, rounded up to a power of two
+ * @param size_t elem_size -- Bytes per element
+ * @return pointer to ring on success or 0 on error.
+ *         Set errno on error.
+ */
+mpsc_ring *mpsc_ring_create(size_t len, size_t elem_size);
+
+/* Destroy MPSC ring
+ *
+ * @param mpsc_ring *r -- Ring to destroy
+ */
+void mpsc_ring_destroy(mpsc_ring *r);
+
+/* Create SPSC ring
+ *
+ * @param size_t len       -- Amount of slots, rounded up to a power of two
+ * @param size_t elem_size -- Bytes per element
+ * @return pointer to ring on success or 0 on error.
+ *         Set errno on error.
+ */
+spsc_ring *spsc_ring_create(size_t len, size_t elem_size);
+
+/* Destroy SPSC ring
+ *
+ * @param spsc_ring *r -- Ring to destroy
+ */
+void spsc_ring_destroy(spsc_ring *r);
+
+static inline atomic_size_t *mpsc_seq(mpsc_ring *r, size_t pos) {
+    return (atomic_size_t *)(r->slots + ((pos & r->mask) * r->stride));
+}
+
+/* Claim a slot to write an element into. Safe to call from any thread.
+ *
+ * @param mpsc_ring *r   -- Ring to submit to
+ * @param size_t *ticket -- Pointer to where slot's ticket is stored, needed
+ *                          by mpsc_commit()
+ * @return pointer to elem_size bytes to fill in, or 0 if the ring is full.
+ *         Set errno to EAGAIN if the ring is full.
+ */
+static inline void *mpsc_reserve(mpsc_ring *r, size_t *ticket) {
+    size_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    for (;;) {
+        atomic_size_t *seq = mpsc_seq(r, pos);
+        intptr_t diff = (intptr_t)atomic_load_explicit(seq, memory_order_acquire) -
+            (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                *ticket = pos;
+                return (uint8_t *)seq + RING_SLOT_HDR;
+            }
+        } else if (diff < 0) {
+            // Consumer hasn't freed this slot from the previous lap yet
+            atomic_fetch_add_explicit(&r->full, 1, memory_order_relaxed);
+            errno = EAGAIN;
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        }
+    }
+}
+
+/* Publish an element written into a slot from mpsc_reserve()
+ *
+ * @param mpsc_ring *r -- Ring the slot belongs to
+ * @param size_t ticket -- Ticket from mpsc_reserve()
+ */
+static inline void mpsc_commit(mpsc_ring *r, size_t ticket) {
+    atomic_store_explicit(mpsc_seq(r, ticket), ticket + 1, memory_order_release);
+}
+
+/* Look at ready elements without consuming them. Consumer only.
+ *
+ * @param mpsc_ring *r -- Ring to read from
+ * @param void **elems -- Array receiving pointers to ready elements, in order
+ * @param unsigned n   -- Maximum amount of elements
+ * @return unsigned amount of elements stored to elems
+ */
+static inline unsigned mpsc_peek(mpsc_ring *r, void **elems, unsigned n) {
+    unsigned count = 0;
+
+    while (count < n) {
+        size_t pos = r->head + count;
+        atomic_size_t *seq = mpsc_seq(r, pos);
+        if (atomic_load_explicit(seq, memory_order_acquire) != pos + 1) {
+            break;
+        }
+        elems[count++] = (uint8_t *)seq + RING_SLOT_HDR;
+    }
+    return count;
+}
+
+/* Hand slots of consumed elements back to producers. Consumer only.
+ *
+ * @param mpsc_ring *r -- Ring the elements came from
+ * @param unsigned n   -- Amount of elements consumed, at most what mpsc_peek() returned
+ */
+static inline void mpsc_release(mpsc_ring *r, unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        size_t pos = r->head + i;
+        atomic_store_explicit(mpsc_seq(r, pos), pos + r->mask + 1, memory_order_release);
+    }
+    r->head += n;
+}
+
+/* Approximate amount of elements waiting in the ring
+ *
+ * @param mpsc_ring *r -- Ring to look at
+ * @return size_t amount of claimed slots not yet released
+ */
+static inline size_t mpsc_count(mpsc_ring *r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = *(volatile size_t *)&r->head;
+    return tail - head;
+}
+
+static inline void *spsc_slot(spsc_ring *r, size_t pos) {
+    return r->slots + ((pos & r->mask) * r->stride);
+}
+
+/* Get next free slot to write an element into. Producer only. Nothing is
+ * visible to the consumer until spsc_commit().
+ *
+ * @param spsc_ring *r -- Ring to write to
+ * @return pointer to elem_size bytes to fill in, or 0 if the ring is full.
+ *         Set errno to EAGAIN if the ring is full.
+ */
+static inline void *spsc_reserve(spsc_ring *r) {
+    if (r->next - r->head_cache > r->mask) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (r->next - r->head_cache > r->mask) {
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            errno = EAGAIN;
+            return 0;
+        }
+    }
+    return spsc_slot(r, r->next++);
+}
+
+/* Publish all elements written since last commit. Producer only.
+ *
+ * @param spsc_ring *r -- Ring to publish on
+ */
+static inline void spsc_commit(spsc_ring *r) {
+    atomic_store_explicit(&r->tail, r->next, memory_order_release);
+}
+
+/* Look at published elements without consuming them. Consumer only.
+ *
+ * @param spsc_ring *r -- Ring to read from
+ * @param void **elems -- Array receiving pointers to elements, in order
+ * @param unsigned n   -- Maximum amount of elements
+ * @return unsigned amount of elements stored to elems
+ */
+static inline unsigned spsc_peek(spsc_ring *r, void **elems, unsigned n) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    if (r->tail_cache - head < n) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    }
+    size_t avail = r->tail_cache - head;
+    if (avail > n) {
+        avail = n;
+    }
+    for (size_t i = 0; i < avail; i++) {
+        elems[i] = spsc_slot(r, head + i);
+    }
+    return (unsigned)avail;
+}
+
+/* Hand slots of consumed elements back to producer. Consumer only.
+ *
+ * @param spsc_ring *r -- Ring the elements came from
+ * @param unsigned n   -- Amount of elements consumed, at most what spsc_peek() returned
+ */
+static inline void spsc_release(spsc_ring *r, unsigned n) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+}
+
+#endif // __NETLIB_RING_H__
@@ -0,0 +1,176 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* IPv4 routing table, longest prefix match using DIR-24-8
+ * ( Gupta, Lin, McKeown: "Routing Lookups in Hardware at Memory Access Speeds" )
+ *
+ * tbl24 has an entry for every /24. Prefixes of length 24 or less are
+ * expanded straight into it, longer ones get a 256-entry tbl8 group that
+ * the tbl24 entry points to. Lookups thus take one memory access, or two
+ * for destinations covered by prefixes longer than /24.
+ *
+ * Lookups never take locks. Writers are serialised with a mutex and only
+ * ever replace whole 32-bit entries, tbl8 groups are fully populated before
+ * being published, and are never handed out to another /24 once used.
+ * Next hops are append-only, so a reader can't see one change under it.
+ */
+#ifndef __NETLIB_ROUTE_H__
+#define __NETLIB_ROUTE_H__
+
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "data_util.h"
+#include "socket.h"
+
+// Table entry layout: valid, extended (points to tbl8), prefix depth, index
+#define ROUTE_VALID      (1U << 31)
+#define ROUTE_EXT        (1U << 30)
+#define ROUTE_DEPTH(e)   (((e) >> 24) & 0x3f)
+#define ROUTE_IDX(e)     ((e) & 0x00ffffff)
+
+#define ROUTE_TBL24_SIZE (1U << 24)
+#define ROUTE_TBL8_SIZE  256
+
+/* Where to send datagrams matching a route
+ *
+ * @member net_socket *sock -- Socket of the interface to send on
+ * @member uint32_t gateway -- Next hop address, or 0 if destination is on-link
+ * @member uint32_t src     -- Source address to use
+ * @member uint16_t mtu     -- MTU of the route, or 0 to use link MTU
+ */
+typedef struct {
+    net_socket *sock;
+    uint32_t gateway;
+    uint32_t src;
+    uint16_t mtu;
+} route_nexthop;
+
+/* Prefixes of single length, kept to find what to fall back to when a
+ * more specific route is removed.
+ *
+ * @member uint32_t *keys -- Prefixes
+ * @member uint32_t *vals -- Next hop index + 1, 0 for empty slots
+ * @member uint32_t size  -- Amount of slots, power of two or 0
+ * @member uint32_t count -- Amount of used slots
+ */
+typedef struct {
+    uint32_t *keys;
+    uint32_t *vals;
+    uint32_t size;
+    uint32_t count;
+} route_rules;
+
+/* Routing table
+ *
+ * @member _Atomic uint32_t *tbl24    -- First level, indexed by top 24 bits
+ * @member _Atomic uint32_t *tbl8     -- Second level groups
+ * @member uint32_t tbl8_used         -- Amount of tbl8 groups handed out
+ * @member uint32_t tbl8_max          -- Amount of tbl8 groups available
+ * @member route_nexthop *nexthops    -- Next hops, append-only
+ * @member uint32_t nh_count          -- Amount of next hops in use
+ * @member uint32_t nh_max            -- Capacity of nexthops
+ * @member route_rules rules          -- Prefixes per depth 0..32
+ * @member mtx_t lock                 -- Serialises writers
+ */
+typedef struct {
+    _Atomic uint32_t *tbl24;
+    _Atomic uint32_t *tbl8;
+    uint32_t tbl8_used;
+    uint32_t tbl8_max;
+    route_nexthop *nexthops;
+    uint32_t nh_count;
+    uint32_t nh_max;
+    route_rules rules[33];
+    mtx_t lock;
+} route_table;
+
+/* Create empty routing table
+ *
+ * @param uint32_t max_tbl8     -- Amount of /24s that may hold prefixes longer than /24
+ * @param uint32_t max_nexthops -- Amount of distinct next hops the table can hold
+ * @return pointer to new routing table or 0 on error.
+ *         Set errno on error.
+ */
+route_table *route_table_create(uint32_t max_tbl8, uint32_t max_nexthops);
+
+/* Destroy routing table. There must be no readers left.
+ *
+ * @param route_table *rt -- Pointer to routing table
+ */
+void route_table_destroy(route_table *rt);
+
+/* Add route, or replace next hop of an existing one
+ *
+ * @param route_table *rt         -- Pointer to routing table
+ * @param uint32_t prefix         -- Destination prefix, network byte order
+ * @param uint8_t depth           -- Prefix length, 0..32
+ * @param const route_nexthop *nh -- Pointer to next hop
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, ENOSPC if table is out of tbl8 groups or next hops.
+ */
+int route_add(route_table *rt, uint32_t prefix, uint8_t depth,
+        const route_nexthop *nh);
+
+/* Remove route
+ *
+ * @param route_table *rt -- Pointer to routing table
+ * @param uint32_t prefix -- Destination prefix, network byte order
+ * @param uint8_t depth   -- Prefix length, 0..32
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, ENOENT if there's no such route.
+ */
+int route_del(route_table *rt, uint32_t prefix, uint8_t depth);
+
+/* Find route for given destination
+ *
+ * @param route_table *rt -- Pointer to routing table
+ * @param uint32_t dst    -- Destination address, network byte order
+ * @return pointer to next hop or 0 if there's no route
+ */
+static inline const route_nexthop *route_lookup(route_table *rt, uint32_t dst) {
+    uint32_t addr = ntohl(dst);
+    uint32_t e = atomic_load_explicit(&rt->tbl24[addr >> 8], memory_order_acquire);
+
+    if (e & ROUTE_EXT) {
+        e = atomic_load_explicit(&rt->tbl8[(ROUTE_IDX(e) * ROUTE_TBL8_SIZE) + (addr & 0xff)],
+                memory_order_acquire);
+    }
+    if (!(e & ROUTE_VALID)) {
+        return 0;
+    }
+    return &rt->nexthops[ROUTE_IDX(e)];
+}
+
+#endif // __NETLIB_ROUTE_H__
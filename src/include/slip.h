@@ -44,6 +44,86 @@ static const unsigned char SLIP_FRAME_ESCAPE = 0xDB;
 static const unsigned char SLIP_ESCAPE_END = 0xDC;
 static const unsigned char SLIP_ESCAPE_ESCAPE = 0xDD;
 
+// Worst case size of an encoded frame: every byte escaped, plus both ENDs
+#define SLIP_ENCODED_MAX(len) (2 * (len) + 2)
+
+// Depth of the 16550A transmit FIFO, filled in one go per THRE wait
+#define SLIP_UART_FIFO 16
+
+// Most UARTs slip_uart_init() keeps FIFO depths of
+#define SLIP_UART_MAX 4
+
+/* Escape data for the serial line, without frame delimiters.
+ *
+ * @param void *dst        -- Where to write escaped data, must have room
+ *                            for 2 * len bytes
+ * @param const void *src  -- Pointer to data to escape
+ * @param size_t len       -- Size of data in bytes
+ * @return size_t amount of bytes written to dst
+ */
+size_t slip_escape(void *dst, const void *src, size_t len);
+
+/* Encode a whole frame, END delimited on both sides.
+ *
+ * @param void *dst        -- Where to write encoded frame, must have room
+ *                            for SLIP_ENCODED_MAX(len) bytes
+ * @param const void *src  -- Pointer to frame to encode
+ * @param size_t len       -- Size of frame in bytes
+ * @return size_t amount of bytes written to dst
+ */
+size_t slip_encode(void *dst, const void *src, size_t len);
+
+/* State of a streaming decoder. Bytes can be fed in whatever pieces they
+ * arrive in, frames come out whole.
+ *
+ * @member uint8_t *frame   -- Buffer frames are decoded into
+ * @member size_t size      -- Size of the buffer, longer frames are dropped
+ * @member size_t len       -- Bytes of current frame decoded so far
+ * @member uint8_t escaped  -- Last byte was FRAME_ESCAPE
+ * @member uint8_t broken   -- Current frame is dropped once it ends
+ * @member uint64_t errors  -- Frames dropped for bad escapes or overruns
+ */
+typedef struct {
+    uint8_t *frame;
+    size_t size;
+    size_t len;
+    uint8_t escaped;
+    uint8_t broken;
+    uint64_t errors;
+} slip_decoder;
+
+/* Set up a streaming decoder
+ *
+ * @param slip_decoder *d -- Pointer to decoder
+ * @param void *frame     -- Buffer to decode frames into
+ * @param size_t size     -- Size of the buffer
+ */
+void slip_decoder_init(slip_decoder *d, void *frame, size_t size);
+
+/* Feed received bytes to a decoder. Decoding stops after the first frame
+ * that completes, so it can be taken out of the buffer before the next
+ * one overwrites it.
+ *
+ * @param slip_decoder *d  -- Pointer to decoder
+ * @param const void *data -- Pointer to received bytes
+ * @param size_t len       -- Amount of received bytes
+ * @param size_t *frame_len -- Where size of a completed frame is written to,
+ *                             or -1 if none completed
+ * @return size_t amount of bytes consumed from data
+ */
+size_t slip_decode(slip_decoder *d, const void *data, size_t len, size_t *frame_len);
+
+/* Enable and reset FIFOs of a 16550 compatible UART. slip_transmit() writes
+ * SLIP_UART_FIFO bytes per wait once this has succeeded on the port, and
+ * a byte per wait otherwise.
+ *
+ * @param uint16_t port -- Port of the UART
+ * @return int 0 on success or -1 if the UART has no working FIFO.
+ *         set errno on error, ENODEV if there's no FIFO, ENOSPC if
+ *         SLIP_UART_MAX ports have been set up already.
+ */
+int slip_uart_init(uint16_t port);
+
 /* Transmit packet over slip
  *
  * @param uint16_t port    -- Port to use
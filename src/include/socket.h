@@ -37,48 +37,395 @@
 #define __NETLIB_SOCKET_H__
 
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <stddef.h>
 #include <stdint.h>
 
-/*
+#include "ctx.h"
+#include "ring.h"
+
+// Most protocol/port pairs a socket can be bound to
+#define SOCKET_MAX_BINDINGS 32
+
+/* Protocol and port a socket accepts traffic for
+ *
+ * @member uint8_t ptcl  -- IPv4 protocol number
+ * @member uint16_t port -- Port in host byte order, 0 for any port
+ */
+typedef struct {
+    uint8_t ptcl;
+    uint16_t port;
+} socket_binding;
+
+/* Socket, laid out so that everything a send touches sits in the first
+ * cache line. Link and IP options live in the same allocation right
+ * after it, see new_socket().
+ *
  * @member int raw_sockfd        -- Socket file descriptor to use
- * @member int family            -- Socket family (AF_INET, AF_INET6, ...)
  * @member int protocol          -- Protocol to use (TCP/UDP/ICMP/..)
  * @member void *link_options    -- Link layer options
  * @member void *ip_options      -- ipv4 or ipv6 options structure
+ * @member netlib_ctx *ctx       -- Stack instance this socket is bound to
+ * @member void *txsched         -- Scheduler frames are handed to by transmit(), or 0
+ * @member void *pacer           -- Pacer frames are handed to by transmit(), or 0
+ * @member void *tx_queue        -- Frames waiting for transmit_flush(), or 0 if
+ *                                  frames are sent right away
+ * @member int family            -- Socket family (AF_INET, AF_INET6, ...)
+ * @member unsigned binding_count  -- Amount of bindings
+ * @member void *rx_batch        -- Buffers and state for receive_batch(), or 0
+ * @member mpsc_ring *tx_ring    -- Datagrams submitted by other threads, or 0
+ * @member spsc_ring *rx_ring    -- Received datagrams for a consumer thread, or 0
  * @member void *ptcl_options    -- Protocol specific options structure
  * @member char *iface           -- Name of interface to use
+ * @member size_t mem            -- Bytes of memory owned by the socket
+ * @member size_t mem_limit      -- Most bytes the socket may own, 0 for no limit
+ * @member void *slab            -- Slab the socket was allocated from, or 0
+ * @member uint32_t slot         -- Slot of the socket in its slab
+ * @member int shared_fd         -- raw_sockfd is shared by sockets of the slab
+ *                                  on the same stack instance and interface,
+ *                                  and read with socket_slab_rx()
+ * @member void *trace           -- Latency tracing state, or 0 when not tracing
+ * @member socket_binding bindings -- Protocols and ports we accept traffic for
  *
  */
 typedef struct {
     int raw_sockfd;
-    int family;
     int protocol;
     void *link_options;
     void *ip_options;
+    netlib_ctx *ctx;
+    void *txsched;
+    void *pacer;
+    void *tx_queue;
+    int family;
+    unsigned binding_count;
+
+    void *rx_batch;
+    mpsc_ring *tx_ring;
+    spsc_ring *rx_ring;
     void *proto_options;
     char *iface;
-} net_socket;
+    size_t mem;
+    size_t mem_limit;
+    void *slab;
+    uint32_t slot;
+    int shared_fd;
+    void *trace;
+    socket_binding bindings[SOCKET_MAX_BINDINGS];
+} __attribute__((aligned(NETLIB_CACHELINE))) net_socket;
+
+_Static_assert(offsetof(net_socket, binding_count) + sizeof(unsigned) <= NETLIB_CACHELINE,
+        "TX path members of net_socket must fit in the first cache line");
+
+/* Handle of a socket allocated from a socket_slab. Upper half is the
+ * generation of the slot, so handles of closed sockets are told apart
+ * from whatever reuses the slot. 0 is never a valid handle.
+ */
+typedef uint64_t socket_handle;
+
+// Sockets of a slab are allocated this many at a time
+#define SOCKET_SLAB_CHUNK 64
+
+/* Slab of sockets, for holding lots of them with a predictable memory
+ * footprint. Like the stack instance it's used with, a slab must only
+ * be used by a single thread.
+ */
+typedef struct socket_slab socket_slab;
+
+/* Frame returned by receive_batch()
+ *
+ * @member void *data -- Pointer to the frame
+ * @member size_t len -- Size of the frame
+ */
+typedef struct {
+    void *data;
+    size_t len;
+} rx_frame;
+
+/* How frames get spread between sockets of a fanout group
+ *
+ * @member FANOUT_HASH -- By flow hash, so each flow sticks to one socket
+ * @member FANOUT_CPU  -- By CPU that received the frame
+ * @member FANOUT_QM   -- By NIC receive queue the frame arrived on
+ * @member FANOUT_EBPF -- By user supplied eBPF program
+ */
+enum FANOUT_MODE {
+    FANOUT_HASH,
+    FANOUT_CPU,
+    FANOUT_QM,
+    FANOUT_EBPF
+};
 
-/* Open a raw network socket for user
+/* Open a raw network socket for user. Receiving from the socket times
+ * out periodically, so that receive loops get to run their timers.
  *
  * @param const char *iface -- Name of interface to use
  * @return int socket on success or -1 on error.
  */
 int raw_socket(const char *iface);
 
-/* Open new network socket for user.
+/* Prepare raw socket from raw_socket() for sharing between sockets. Each
+ * of them wants different traffic, so the socket lets everything for the
+ * interface in, and socket_slab_rx() sorts it out.
  *
+ * @param int fd -- Raw socket
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int raw_socket_share(int fd);
+
+/* Receive a single frame from a raw socket shared between sockets
+ *
+ * @param int fd     -- Raw socket prepared with raw_socket_share()
+ * @param void *data -- Pointer to buffer to receive frame into
+ * @param size_t len -- Size of the buffer
+ * @return amount of bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout.
+ */
+size_t raw_socket_receive(int fd, void *data, size_t len);
+
+/* Open new network socket for user. The socket is bound to given stack
+ * instance, and must only be used by the thread owning that instance.
+ *
+ * @param netlib_ctx *ctx     -- Stack instance to bind the socket to
  * @param int family          -- AF_INET/AF_INET6/...
  * @param int protocol        -- TCP/UDP/...
  * @param enum LINK_TYPE type -- ETH/SLIP/PPP/..
  * @param const uint8_t *smac -- Source Mac address
- * @param const uint8_t *dmac -- Source Mac address
  * @param char *iface         -- Name of network interface we're using
  * @return pointer to populated net_socket structure on success or 0 on error.
  * set errno on error.
  */
-net_socket *new_socket(int family, int protocol, int type,
-        uint8_t *smac, uint8_t *dmac, char *iface);
+net_socket *new_socket(netlib_ctx *ctx, int family, int protocol, int type,
+        uint8_t *smac, char *iface);
+
+/* Accept traffic for given protocol and port on this socket. Anything
+ * not bound to is dropped by the kernel before it reaches us, where the
+ * platform supports it.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param uint8_t ptcl     -- IPv4 protocol number (IPV4_PTCL_UDP, ...)
+ * @param uint16_t port    -- Destination port in host byte order, 0 for any
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOSPC if socket has too many bindings.
+ */
+int socket_bind(net_socket *sock, uint8_t ptcl, uint16_t port);
+
+/* Stop accepting traffic for given protocol and port
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param uint8_t ptcl     -- IPv4 protocol number
+ * @param uint16_t port    -- Port in host byte order, as given to socket_bind()
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOENT if there was no such binding.
+ */
+int socket_unbind(net_socket *sock, uint8_t ptcl, uint16_t port);
+
+/* Update how received traffic finds the socket after its bindings or
+ * addresses have changed: regenerate its receive filter, or for sockets
+ * sharing their raw socket, its entries in the slab's demux index.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_update_rx(net_socket *sock);
+
+/* Regenerate and attach the receive filter, called by socket_update_rx().
+ * Sockets sharing their raw socket have no filter of their own.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_update_filter(net_socket *sock);
+
+/* Close a socket and free everything it owns. Rings attached to the
+ * socket are left alone, they belong to whoever attached them.
+ *
+ * @param net_socket *sock -- Pointer to socket to close
+ */
+void close_socket(net_socket *sock);
+
+/* Account memory to a socket before allocating it on the socket's behalf
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param size_t size      -- Amount of bytes about to be allocated
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOBUFS if socket would go over its limit.
+ */
+int socket_mem_charge(net_socket *sock, size_t size);
+
+/* Give back memory accounted with socket_mem_charge()
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param size_t size      -- Amount of bytes freed
+ */
+void socket_mem_uncharge(net_socket *sock, size_t size);
+
+/* Limit memory a socket may own, including the socket itself
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param size_t limit     -- Most bytes the socket may own, 0 for no limit
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOBUFS if socket already owns more.
+ */
+int socket_set_mem_limit(net_socket *sock, size_t limit);
+
+/* Create a slab of sockets
+ *
+ * @param unsigned max_sockets -- Most sockets open at the same time
+ * @return pointer to new slab on success or 0 on error.
+ *         set errno on error.
+ */
+socket_slab *socket_slab_create(unsigned max_sockets);
+
+/* Close all sockets of a slab and release its memory
+ *
+ * @param socket_slab *slab -- Pointer to slab
+ */
+void socket_slab_destroy(socket_slab *slab);
+
+/* Open new network socket from a slab, see new_socket().
+ *
+ * Ethernet sockets of a slab share a single raw socket per stack instance
+ * and interface. Frames are read from it with socket_slab_rx(), which
+ * hands each to the socket it's for. Receiving on the sockets themselves,
+ * and settings that would apply to the shared raw socket as a whole, fail
+ * with EINVAL: receive timeout, batching, fanout, transmit timestamps and
+ * SO_TXTIME.
+ *
+ * @param socket_slab *slab   -- Slab to allocate socket from
+ * @param netlib_ctx *ctx     -- Stack instance to bind the socket to
+ * @param int family          -- AF_INET/AF_INET6/...
+ * @param int protocol        -- TCP/UDP/...
+ * @param enum LINK_TYPE type -- ETH/SLIP/PPP/..
+ * @param const uint8_t *smac -- Source Mac address
+ * @param char *iface         -- Name of network interface we're using
+ * @return socket_handle handle of the new socket on success or 0 on error.
+ *         set errno on error, ENFILE if slab is full.
+ */
+socket_handle socket_open(socket_slab *slab, netlib_ctx *ctx, int family,
+        int protocol, int type, uint8_t *smac, char *iface);
+
+/* Receive a frame on the raw socket shared by ethernet sockets of a slab
+ * on given stack instance and interface, and hand it to link_rx() of the
+ * socket it's for. UDP goes to the socket bound to its port, and address
+ * if the socket has one. ARP and ICMP go to a socket with the address
+ * they're for. Anything else, including UDP nobody is bound to, goes to
+ * one of the sockets, whose stack drops and counts what it doesn't want.
+ *
+ * @param socket_slab *slab -- Slab the sockets were opened from
+ * @param netlib_ctx *ctx   -- Stack instance of the sockets
+ * @param const char *iface -- Name of network interface
+ * @param void *frame       -- Pointer to buffer to receive frame into
+ * @param size_t size       -- Size of the buffer
+ * @return size_t what link_rx() returned, or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout,
+ *         ENODEV if the slab has no ethernet sockets on ctx and iface,
+ *         ENOENT if none of them could be indexed.
+ */
+size_t socket_slab_rx(socket_slab *slab, netlib_ctx *ctx, const char *iface,
+        void *frame, size_t size);
+
+/* Look up socket by its handle
+ *
+ * @param socket_slab *slab -- Slab socket was opened from
+ * @param socket_handle h   -- Handle of the socket
+ * @return pointer to socket on success or 0 on error.
+ *         set errno on error, ESTALE if socket has been closed.
+ */
+net_socket *socket_get(socket_slab *slab, socket_handle h);
+
+/* Close a socket opened from a slab. Closing it with close_socket() works
+ * too, this just checks the handle first.
+ *
+ * @param socket_slab *slab -- Slab socket was opened from
+ * @param socket_handle h   -- Handle of the socket
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ESTALE if socket has already been closed.
+ */
+int socket_release(socket_slab *slab, socket_handle h);
+
+/* Get amount of memory used by a slab, including everything charged to
+ * its sockets
+ *
+ * @param socket_slab *slab -- Pointer to slab
+ * @return size_t bytes in use
+ */
+size_t socket_slab_mem(socket_slab *slab);
+
+/* Get amount of sockets open in a slab
+ *
+ * @param socket_slab *slab -- Pointer to slab
+ * @return unsigned open sockets
+ */
+unsigned socket_slab_count(socket_slab *slab);
+
+/* Release platform resources of a socket, called by close_socket()
+ *
+ * @param net_socket *sock -- Pointer to socket being closed
+ */
+void raw_socket_close(net_socket *sock);
+
+/* Make socket part of a fanout group, so that received frames are spread
+ * between all sockets in the group instead of each getting a copy.
+ *
+ * @param net_socket *sock -- Pointer to socket to add
+ * @param uint16_t *group  -- Pointer to group id. If it's 0, a new group with
+ *                            unique id is created and its id written back.
+ * @param int mode         -- Refer to enum FANOUT_MODE
+ * @param int prog_fd      -- eBPF program selecting the socket with FANOUT_EBPF,
+ *                            ignored otherwise
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_join_fanout(net_socket *sock, uint16_t *group, int mode, int prog_fd);
+
+/* Set how long receive() waits for a frame before failing with EAGAIN
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param unsigned usec    -- Timeout in microseconds, 0 to never wait
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_rx_timeout(net_socket *sock, unsigned usec);
+
+/* Queue transmitted frames on the socket instead of sending each one
+ * right away. Queue gets sent in one go by transmit_flush(), or when it
+ * fills up.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param unsigned len     -- Amount of frames the queue holds
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_set_tx_queue(net_socket *sock, unsigned len);
+
+/* Run the SLIP link of this socket over a file descriptor, such as a
+ * serial tty or one end of a pty pair, instead of the UART. The socket
+ * takes the descriptor over and makes it non-blocking; ttys are switched
+ * to raw mode. Frames are queued, and transmit_flush() writes everything
+ * queued with a single write(). Whatever the line doesn't take stays
+ * queued for the next flush, and frames are dropped with ENOBUFS once
+ * the queue is full. Received bytes are decoded as they stream in.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param int fd           -- File descriptor of the line
+ * @param unsigned baud    -- Line speed in bits per second, 0 to leave as is
+ * @param unsigned len     -- Amount of full sized frames the queue holds
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_set_slip_fd(net_socket *sock, int fd, unsigned baud, unsigned len);
+
+/* Send all frames queued on the socket
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return amount of frames sent on success or -1 on error.
+ *         set errno on error.
+ */
+size_t transmit_flush(net_socket *sock);
 
 /* Send up to size_t bytes of data
  *
@@ -90,4 +437,123 @@ net_socket *new_socket(int family, int protocol, int type,
  */
 size_t transmit(net_socket *sock, const void *data, size_t len);
 
+/* Send a frame without going through the pacer. With txtime set the
+ * frame is handed to the kernel right away, to be sent at that time by
+ * a qdisc honoring SO_TXTIME.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param const void *data -- Pointer to data to transmit
+ * @param size_t len       -- Amount of bytes to send
+ * @param uint64_t txtime  -- Monotonic time in nanoseconds the kernel should
+ *                            send the frame at, 0 to send as usual
+ * @return amount of bytes written on success or -1 on error.
+ *         set errno on error.
+ */
+size_t transmit_at(net_socket *sock, const void *data, size_t len, uint64_t txtime);
+
+/* Let the kernel hold frames until their departure time with SO_TXTIME,
+ * see transmit_at().
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_txtime(net_socket *sock);
+
+/* Send a frame gathered from several buffers, without copying them into
+ * one first. Frames queued with socket_set_tx_queue() are flushed first
+ * to keep ordering.
+ *
+ * @param net_socket *sock        -- Pointer to socket we're working with
+ * @param const struct iovec *iov -- Pieces of the frame, link header first
+ * @param int iovcnt              -- Amount of entries in iov
+ * @return amount of bytes written on success or -1 on error.
+ *         set errno on error.
+ */
+size_t transmitv(net_socket *sock, const struct iovec *iov, int iovcnt);
+
+/* Receive a single frame from the link this socket is bound to
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param void *data       -- Pointer to buffer to receive frame into
+ * @param size_t len       -- Size of the buffer
+ * @return amount of bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout,
+ *         EINVAL if raw socket is shared, see socket_open().
+ */
+size_t receive(net_socket *sock, void *data, size_t len);
+
+/* Set socket up for receiving frames in batches with receive_batch().
+ * Frames are received into buffers owned by the socket, and batch size
+ * adapts to the rate frames arrive at: it grows while batches come back
+ * full, and shrinks down to single reads when traffic is sparse.
+ *
+ * @param net_socket *sock    -- Pointer to socket we're working with
+ * @param unsigned max_batch  -- Largest amount of frames per batch
+ * @param unsigned budget_us  -- How long a batch may wait for more frames
+ *                               once traffic is heavy, 0 to never wait.
+ *                               Batches are never held back at low rates.
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_rx_batch(net_socket *sock, unsigned max_batch, unsigned budget_us);
+
+/* Receive a batch of frames. Blocks until at least one frame arrives,
+ * or receive timeout expires.
+ *
+ * @param net_socket *sock -- Pointer to socket set up with socket_set_rx_batch()
+ * @param rx_frame *frames -- Array receiving the frames, valid until next call
+ * @param unsigned max     -- Size of frames array
+ * @return amount of frames received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout,
+ *         EINVAL if raw socket is shared, see socket_open().
+ */
+size_t receive_batch(net_socket *sock, rx_frame *frames, unsigned max);
+
+// Kinds of transmit timestamps
+enum TX_TSTAMP {
+    TX_TSTAMP_SCHED,    // Frame entered the qdisc
+    TX_TSTAMP_SND,      // Frame was handed to the driver
+    TX_TSTAMP_HW        // Frame left the NIC, PHC time
+};
+
+/* Transmit timestamp reported by the kernel
+ *
+ * @member uint32_t id -- Frame the timestamp belongs to, counting every
+ *                        frame handed to the kernel from 0
+ * @member int type    -- Refer to enum TX_TSTAMP
+ * @member uint64_t ns -- Realtime clock timestamp in nanoseconds
+ */
+typedef struct {
+    uint32_t id;
+    int type;
+    uint64_t ns;
+} tx_timestamp;
+
+/* Have the kernel report when transmitted frames enter the qdisc and
+ * leave for the driver, and optionally when they leave the NIC. Hardware
+ * timestamps need a NIC that supports them and CAP_NET_ADMIN.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param int hw           -- Enable hardware timestamps as well
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_tx_timestamps(net_socket *sock, int hw);
+
+/* Stop reporting transmit timestamps
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ */
+void socket_clear_tx_timestamps(net_socket *sock);
+
+/* Read a transmit timestamp reported by the kernel, never blocks.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param tx_timestamp *ts -- Where to store the timestamp
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EAGAIN if there are no timestamps waiting.
+ */
+int receive_tx_timestamp(net_socket *sock, tx_timestamp *ts);
+
 #endif // __NETLIB_SOCKET_H__
@@ -0,0 +1,222 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-instance statistics counters.
+ *
+ * Every stack instance counts into its own cache line aligned block of
+ * counters, so bumping one is a plain increment that never bounces a
+ * cache line between cores. Blocks live in one segment, which can be
+ * exported as POSIX shared memory for netlib_stat to read while we run.
+ * Totals are summed up on read.
+ */
+#ifndef __NETLIB_STATS_H__
+#define __NETLIB_STATS_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "ctx.h"
+
+// Default name of exported segment
+#define NETLIB_STATS_SHM "/netlib_stats"
+
+// Identifies an exported segment, and its layout
+#define NETLIB_STATS_MAGIC   0x6e6c7374
+#define NETLIB_STATS_VERSION 1
+
+// Amount of instance blocks unless exported with more
+#define NETLIB_STATS_SLOTS 64
+
+/* All counters, by layer. Names are also what netlib_stat prints.
+ */
+#define NETLIB_STAT_LIST(X) \
+    X(udp_tx_packets) \
+    X(udp_tx_bytes) \
+    X(udp_tx_errors) \
+    X(udp_rx_packets) \
+    X(udp_rx_bytes) \
+    X(udp_rx_hdr_errors) \
+    X(udp_rx_csum_errors) \
+    X(udp_rx_drops) \
+    X(udp_rx_not_bound) \
+    X(ipv4_tx_packets) \
+    X(ipv4_tx_bytes) \
+    X(ipv4_tx_errors) \
+    X(ipv4_rx_packets) \
+    X(ipv4_rx_bytes) \
+    X(ipv4_rx_hdr_errors) \
+    X(ipv4_rx_csum_errors) \
+    X(ipv4_rx_fragments) \
+    X(ipv4_rx_unknown_ptcl) \
+    X(ipv6_rx_packets) \
+    X(ipv6_rx_bytes) \
+    X(ipv6_rx_hdr_errors) \
+    X(ipv6_rx_csum_errors) \
+    X(ipv6_rx_not_ours) \
+    X(ipv6_rx_unknown_ptcl) \
+    X(icmp_rx_echo_not_ours) \
+    X(icmp_rx_frag_needed_bogus) \
+    X(link_tx_packets) \
+    X(link_tx_bytes) \
+    X(link_tx_errors) \
+    X(link_rx_packets) \
+    X(link_rx_bytes) \
+    X(link_rx_errors) \
+    X(eth_tx_packets) \
+    X(eth_tx_bytes) \
+    X(eth_tx_arp_queued) \
+    X(eth_rx_packets) \
+    X(eth_rx_bytes) \
+    X(eth_rx_not_ours) \
+    X(eth_rx_unknown_ptcl) \
+    X(slip_tx_packets) \
+    X(slip_tx_bytes) \
+    X(slip_tx_errors) \
+    X(slip_rx_packets) \
+    X(slip_rx_bytes) \
+    X(slip_rx_errors) \
+    X(slip_vj_tx_compressed) \
+    X(slip_vj_rx_compressed) \
+    X(slip_vj_rx_tossed) \
+    X(alloc) \
+    X(alloc_failures)
+
+#define NETLIB_STAT_ENUM(name) NETLIB_STAT_##name,
+#define NETLIB_STAT_FIELD(name) uint64_t name;
+
+// Index of each counter, and amount of them
+enum NETLIB_STAT {
+    NETLIB_STAT_LIST(NETLIB_STAT_ENUM)
+    NETLIB_STAT_COUNT
+};
+
+/* Counters of a single stack instance, see NETLIB_STAT_LIST for members
+ */
+typedef struct netlib_stats {
+    NETLIB_STAT_LIST(NETLIB_STAT_FIELD)
+} __attribute__((aligned(NETLIB_CACHELINE))) netlib_stats;
+
+/* Header of a counter segment, followed by slots blocks of counters
+ *
+ * @member uint32_t magic   -- NETLIB_STATS_MAGIC
+ * @member uint32_t version -- NETLIB_STATS_VERSION
+ * @member uint32_t count   -- NETLIB_STAT_COUNT of the writer
+ * @member uint32_t slots   -- Amount of blocks in segment
+ * @member uint32_t used    -- Amount of blocks ever handed out
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t slots;
+    uint32_t used;
+} __attribute__((aligned(NETLIB_CACHELINE))) netlib_stats_shm;
+
+// Names of counters, by index
+extern const char *const netlib_stat_names[NETLIB_STAT_COUNT];
+
+// Bump a counter of the instance, only from the thread owning it
+#define NETLIB_STAT_INC(ctx, name) ((ctx)->stats->name++)
+#define NETLIB_STAT_ADD(ctx, name, n) ((ctx)->stats->name += (n))
+
+/* Get counter by index
+ *
+ * @param const netlib_stats *s -- Pointer to counters
+ * @param unsigned i            -- Refer to enum NETLIB_STAT
+ * @return uint64_t counter value
+ */
+static inline uint64_t netlib_stat_get(const netlib_stats *s, unsigned i) {
+    return ((const uint64_t *)s)[i];
+}
+
+/* Initialise counters of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int stats_initialise(netlib_ctx *ctx);
+
+/* Finalise counters of a stack instance. Counts stay in the segment, and
+ * the next instance created picks up from there.
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void stats_finalise(netlib_ctx *ctx);
+
+/* Export counters of this process as POSIX shared memory. Has to be called
+ * before any stack instance is created.
+ *
+ * @param const char *name -- Name of segment, NETLIB_STATS_SHM by default
+ * @param unsigned slots   -- Most stack instances alive at the same time
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, EBUSY if instances already exist.
+ */
+int netlib_stats_export(const char *name, unsigned slots);
+
+/* Remove exported segment. Processes having it mapped keep their mapping.
+ *
+ * @param const char *name -- Name of segment
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int netlib_stats_unlink(const char *name);
+
+/* Map counters exported by another process, read only
+ *
+ * @param const char *name -- Name of segment
+ * @return pointer to segment on success or 0 on error.
+ *         Set errno on error, EPROTO if segment has an unknown layout.
+ */
+const netlib_stats_shm *netlib_stats_attach(const char *name);
+
+/* Unmap segment mapped with netlib_stats_attach()
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment
+ */
+void netlib_stats_detach(const netlib_stats_shm *shm);
+
+/* Get counters of a single instance from a segment
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment, 0 for our own
+ * @param unsigned slot               -- Index of block, below shm->used
+ * @return const netlib_stats * pointer to counters, or 0 if there's no such block
+ */
+const netlib_stats *netlib_stats_slot(const netlib_stats_shm *shm, unsigned slot);
+
+/* Sum up counters of every instance in a segment
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment, 0 for our own
+ * @param netlib_stats *sum           -- Where totals are written to
+ */
+void netlib_stats_sum(const netlib_stats_shm *shm, netlib_stats *sum);
+
+#endif // __NETLIB_STATS_H__
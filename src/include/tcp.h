@@ -36,8 +36,60 @@
 #define __NETLIB_TCP_H__
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* TCP header flags
+ *
+ * @member TCP_FIN -- No more data from sender
+ * @member TCP_SYN -- Synchronize sequence numbers
+ * @member TCP_RST -- Reset the connection
+ * @member TCP_PSH -- Push function
+ * @member TCP_ACK -- Acknowledgment field is significant
+ * @member TCP_URG -- Urgent pointer field is significant
+ */
+enum TCP_FLAGS {
+    TCP_FIN = 0x01,
+    TCP_SYN = 0x02,
+    TCP_RST = 0x04,
+    TCP_PSH = 0x08,
+    TCP_ACK = 0x10,
+    TCP_URG = 0x20
+};
+
+/* TCP header ( https://datatracker.ietf.org/doc/html/rfc793#section-3.1 )
+ *
+ * Laid out byte by byte as on the wire, like ipv4_hdr.
+ *
+ * @member uint8_t sport  -- Source port
+ * @member uint8_t dport  -- Destination port
+ * @member uint8_t seq    -- Sequence number
+ * @member uint8_t ack    -- Acknowledgment number
+ * @member uint8_t off    -- 4 bit data offset in 32-bit words, 4 reserved bits
+ * @member uint8_t flags  -- Refer to enum TCP_FLAGS
+ * @member uint8_t win    -- Window
+ * @member uint8_t csum   -- Checksum
+ * @member uint8_t urg    -- Urgent pointer
+ */
+typedef struct {
+    uint8_t sport[2];
+    uint8_t dport[2];
+    uint8_t seq[4];
+    uint8_t ack[4];
+    uint8_t off;
+    uint8_t flags;
+    uint8_t win[2];
+    uint8_t csum[2];
+    uint8_t urg[2];
+} tcp_hdr;
+
+_Static_assert(offsetof(tcp_hdr, off) == 12, "tcp_hdr off offset");
+_Static_assert(sizeof(tcp_hdr) == 20, "tcp_hdr size");
+
+static inline size_t tcp_hlen(const tcp_hdr *h) {
+    return (h->off >> 4) * 4;
+}
+
 
 /* Options related to TCP connection of ours
  */
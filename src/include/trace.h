@@ -0,0 +1,156 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-packet transmit latency tracing.
+ *
+ * A traced send is timestamped as it enters UDP, IP and the link layer,
+ * when it gets to transmit() and when the frame has been handed over.
+ * The kernel adds its own timestamps for when the frame entered the
+ * qdisc, when it was given to the driver and, with hardware support,
+ * when it left the NIC. Each stage gets its own histogram.
+ *
+ * Tracing is compiled in only with NETLIB_TRACE defined, otherwise the
+ * trace points below are empty and cost nothing.
+ */
+#ifndef __NETLIB_TRACE_H__
+#define __NETLIB_TRACE_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "hist.h"
+#include "socket.h"
+
+// Points in the transmit path a send is timestamped at
+enum TRACE_POINT {
+    TRACE_UDP,          // udp_send() was called
+    TRACE_IP,           // Datagram reached IP
+    TRACE_LINK,         // First frame reached the link layer
+    TRACE_TRANSMIT,     // First frame reached transmit()
+    TRACE_RETURN,       // transmit() was done with the first frame
+    TRACE_POINTS
+};
+
+// Stages with a latency histogram
+enum TRACE_STAGE {
+    TRACE_UDP_IP,           // UDP to IP
+    TRACE_IP_LINK,          // IP to link layer
+    TRACE_LINK_TRANSMIT,    // Link layer to transmit()
+    TRACE_TRANSMIT_RETURN,  // transmit() to kernel returning the frame
+    TRACE_TOTAL,            // Whole send, from UDP to udp_send() returning
+    TRACE_KERNEL_SCHED,     // UDP to frame entering the qdisc
+    TRACE_KERNEL_SND,       // UDP to frame being handed to the driver
+    TRACE_KERNEL_HW,        // UDP to frame leaving the NIC, meaningful only
+                            // if the NIC clock is synced to system time
+    TRACE_STAGES
+};
+
+// Names of stages, for reporting
+extern const char *const trace_stage_names[TRACE_STAGES];
+
+// Amount of sends waiting for kernel timestamps we keep track of
+#define TRACE_PENDING 1024
+
+/* Start tracing sends on a socket. Sends are traced from udp_send() and
+ * udp_sendv() on, and kernel timestamps are collected by trace_poll(),
+ * which workers call for their socket.
+ *
+ * @param net_socket *sock -- Pointer to socket to trace
+ * @param int hw           -- Ask the NIC for hardware timestamps as well
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOSYS if built without NETLIB_TRACE.
+ */
+int trace_enable(net_socket *sock, int hw);
+
+/* Stop tracing a socket and release histograms
+ *
+ * @param net_socket *sock -- Pointer to socket
+ */
+void trace_disable(net_socket *sock);
+
+/* Collect transmit timestamps reported by the kernel
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ * @return unsigned amount of timestamps collected
+ */
+unsigned trace_poll(net_socket *sock);
+
+/* Get histogram of a stage. Histogram may be read while the socket is
+ * sending, values are in nanoseconds.
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ * @param int stage        -- Refer to enum TRACE_STAGE
+ * @return pointer to histogram or 0 if socket isn't traced.
+ */
+const hdr_hist *trace_histogram(net_socket *sock, int stage);
+
+/* Empty all histograms of a socket
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ */
+void trace_reset(net_socket *sock);
+
+/* Used through the macros below
+ */
+void trace_begin(net_socket *sock);
+void trace_point(net_socket *sock, int point);
+void trace_end(net_socket *sock);
+void trace_kernel(net_socket *sock);
+
+#ifdef NETLIB_TRACE
+
+// Start of a traced send
+#define TRACE_BEGIN(sock) do { if ((sock)->trace) trace_begin(sock); } while (0)
+
+// Send reached a point, only the first time per send counts
+#define TRACE_POINT(sock, point) do { if ((sock)->trace) trace_point((sock), (point)); } while (0)
+
+// End of a traced send
+#define TRACE_END(sock) do { if ((sock)->trace) trace_end(sock); } while (0)
+
+// Frame is about to be handed to the kernel, in the order the kernel sees them
+#define TRACE_KERNEL(sock) do { if ((sock)->trace) trace_kernel(sock); } while (0)
+
+// Collect kernel timestamps
+#define TRACE_POLL(sock) do { if ((sock)->trace) trace_poll(sock); } while (0)
+
+#else
+
+#define TRACE_BEGIN(sock) do { } while (0)
+#define TRACE_POINT(sock, point) do { } while (0)
+#define TRACE_END(sock) do { } while (0)
+#define TRACE_KERNEL(sock) do { } while (0)
+#define TRACE_POLL(sock) do { } while (0)
+
+#endif // NETLIB_TRACE
+
+#endif // __NETLIB_TRACE_H__
@@ -0,0 +1,135 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Transmit scheduling by type of service.
+ *
+ * Frames are sorted into classes by the DSCP of their IPv4 header. The
+ * control class is strict priority and always goes first, the rest share
+ * what's left by deficit round robin, weighted by their quantum. Frames
+ * wait on the socket until txsched_run() sends a batch of them, so a
+ * control message sent right after a burst of bulk traffic still leaves
+ * ahead of it.
+ */
+#ifndef __NETLIB_TXSCHED_H__
+#define __NETLIB_TXSCHED_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "socket.h"
+
+/* Transmit classes
+ *
+ * @member TXSCHED_CONTROL     -- Network control, EF, and anything that's not
+ *                                IPv4 (ARP). Strict priority.
+ * @member TXSCHED_INTERACTIVE -- Low delay, precedence 3 to 5
+ * @member TXSCHED_BEST_EFFORT -- Everything else
+ * @member TXSCHED_BULK        -- High throughput, precedence 1
+ */
+enum TXSCHED_CLASS {
+    TXSCHED_CONTROL,
+    TXSCHED_INTERACTIVE,
+    TXSCHED_BEST_EFFORT,
+    TXSCHED_BULK,
+    TXSCHED_CLASSES
+};
+
+// Amount of DSCP values
+#define TXSCHED_DSCP_MAX 64
+
+/* Scheduler configuration of a socket.
+ *
+ * @member unsigned limit   -- Amount of frames each class may have waiting
+ * @member unsigned quantum -- Bytes each round robin class may send per
+ *                             round, ignored for TXSCHED_CONTROL. 0 picks
+ *                             a default weighted for the class.
+ * @member unsigned batch   -- Most frames sent per txsched_run()
+ */
+typedef struct {
+    unsigned limit[TXSCHED_CLASSES];
+    unsigned quantum[TXSCHED_CLASSES];
+    unsigned batch;
+} txsched_config;
+
+/* Start scheduling frames sent on a socket. From now on transmit() hands
+ * frames to the scheduler, and txsched_run() needs to be called regularly.
+ * Workers do that once per loop.
+ *
+ * @param net_socket *sock          -- Pointer to socket we're working with
+ * @param const txsched_config *cfg -- Scheduler configuration
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int txsched_attach(net_socket *sock, const txsched_config *cfg);
+
+/* Stop scheduling frames sent on a socket. Frames still waiting are dropped.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ */
+void txsched_detach(net_socket *sock);
+
+/* Override class of a DSCP value
+ *
+ * @param net_socket *sock -- Pointer to socket with a scheduler
+ * @param uint8_t dscp     -- DSCP value, upper six bits of TOS
+ * @param unsigned cls     -- Refer to enum TXSCHED_CLASS
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int txsched_map(net_socket *sock, uint8_t dscp, unsigned cls);
+
+/* Queue a frame on its class, called by transmit().
+ *
+ * @param net_socket *sock -- Pointer to socket with a scheduler
+ * @param const void *data -- Pointer to frame, copied
+ * @param size_t len       -- Size of the frame
+ * @return size_t len on success or -1 on error.
+ *         Set errno on error, ENOBUFS if the class is full.
+ */
+size_t txsched_enqueue(net_socket *sock, const void *data, size_t len);
+
+/* Send a batch of waiting frames, control class first.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return unsigned amount of frames sent
+ */
+unsigned txsched_run(net_socket *sock);
+
+/* Get amount of frames waiting in a class
+ *
+ * @param net_socket *sock -- Pointer to socket with a scheduler
+ * @param unsigned cls     -- Refer to enum TXSCHED_CLASS
+ * @return unsigned amount of waiting frames
+ */
+unsigned txsched_backlog(net_socket *sock, unsigned cls);
+
+#endif // __NETLIB_TXSCHED_H__
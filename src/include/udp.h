@@ -35,21 +35,84 @@
 #define __NETLIB_UDP_H__
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "data_util.h"
+#include "graph.h"
+#include "ring.h"
 #include "socket.h"
 
-/* UDP header structure
- *
+// Largest amount of datagrams udp_drain() sends per call
+#define UDP_DRAIN_MAX 256
+
+// Largest amount of payload pieces udp_sendv() takes
+#define UDP_SENDV_MAX_IOV 64
+
+// Times udp_sendfile() retries a datagram the link has no room for
+#define UDP_SENDFILE_RETRIES 1000
+
+// How far ahead of the datagram being sent udp_sendfile() reads the file
+#define UDP_SENDFILE_WINDOW (4 << 20)
+
+/* UDP header structure, laid out byte by byte as on the wire.
  *
+ * @member uint8_t src  -- Source port
+ * @member uint8_t dst  -- Destination port
+ * @member uint8_t len  -- Length of header and payload
+ * @member uint8_t csum -- Checksum, or 0 if there's none
  */
 typedef struct {
-    uint16_t src;
-    uint16_t dst;
-    uint16_t len;
-    uint16_t csum;
+    uint8_t src[2];
+    uint8_t dst[2];
+    uint8_t len[2];
+    uint8_t csum[2];
 } udp_hdr;
 
+_Static_assert(offsetof(udp_hdr, dst) == 2, "udp_hdr dst offset");
+_Static_assert(offsetof(udp_hdr, len) == 4, "udp_hdr len offset");
+_Static_assert(offsetof(udp_hdr, csum) == 6, "udp_hdr csum offset");
+_Static_assert(sizeof(udp_hdr) == 8, "udp_hdr size");
+
+/* UDP header accessors. Ports and length are in host order, checksum
+ * is kept as stored so it can be fed to the csum helpers.
+ */
+static inline uint16_t udp_sport(const udp_hdr *h) {
+    return load_be16(h->src);
+}
+
+static inline uint16_t udp_dport(const udp_hdr *h) {
+    return load_be16(h->dst);
+}
+
+static inline uint16_t udp_len(const udp_hdr *h) {
+    return load_be16(h->len);
+}
+
+static inline uint16_t udp_csum(const udp_hdr *h) {
+    return load_u16(h->csum);
+}
+
+/* Fill in UDP header
+ *
+ * @param udp_hdr *h     -- Pointer to header
+ * @param uint16_t sport -- Source port
+ * @param uint16_t dport -- Destination port
+ * @param uint16_t len   -- Length of header and payload
+ */
+static inline void udp_set_hdr(udp_hdr *h, uint16_t sport, uint16_t dport,
+        uint16_t len)
+{
+    store_be16(h->src, sport);
+    store_be16(h->dst, dport);
+    store_be16(h->len, len);
+    store_u16(h->csum, 0);
+}
+
+static inline void udp_set_csum(udp_hdr *h, uint16_t sum) {
+    store_u16(h->csum, sum);
+}
+
 /* Create udp header for user.
  *
  * @param uint16_t sport       -- src port
@@ -61,6 +124,23 @@ typedef struct {
 udp_hdr *create_udp_hdr(uint16_t sport, uint16_t dport,
         uint8_t *data, uint16_t len);
 
+/* UDP encapsulation node of the TX graph. Prepends UDP header to
+ * every datagram in vector.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Vector of payloads queued with pkt_vector_add()
+ * @return unsigned amount of datagrams left in vector
+ */
+unsigned udp_encap_vec(net_socket *sock, pkt_vector *v);
+
+/* Get largest UDP payload we can send to destination in a single datagram
+ *
+ * @param net_socket *sock     -- Pointer to populated net_socket structure
+ * @param uint32_t dst_addr    -- Destination IP address
+ * @return size_t maximum payload size in bytes
+ */
+size_t udp_max_payload(net_socket *sock, uint32_t dst_addr);
+
 /* Send a message over UDP to a remote host
  *
  * @param net_socket *sock     -- Pointer to populated net_socket structure
@@ -70,9 +150,138 @@ udp_hdr *create_udp_hdr(uint16_t sport, uint16_t dport,
  * @param uint16_t dport       -- UDP Port to send our data to
  * @param uint8_t *data        -- Pointer to data to transmit
  * @param size_t len           -- Amount of bytes to send
- * @return size_t bytes sent
+ * @return size_t bytes sent or -1 on error.
+ *         Set errno on error, EMSGSIZE if len exceeds udp_max_payload().
  */
 size_t udp_send(net_socket *sock, uint32_t src_addr, uint32_t dst_addr,
         uint16_t sport, uint16_t dport, uint8_t *data, size_t len);
 
+/* Send a message gathered from several buffers over UDP to a remote host.
+ *
+ * Headers of all layers are built into a small buffer on our stack, and
+ * the payload pieces are handed to the raw socket as they are, so payload
+ * is never copied on its way down. Checksum is computed across the pieces.
+ *
+ * @param net_socket *sock        -- Pointer to populated net_socket structure
+ * @param uint32_t src_addr       -- Source IP address
+ * @param uint32_t dst_addr       -- Destination IP address
+ * @param uint16_t sport          -- UDP Port to send our data from
+ * @param uint16_t dport          -- UDP Port to send our data to
+ * @param const struct iovec *iov -- Payload pieces
+ * @param int iovcnt              -- Amount of entries in iov, at most UDP_SENDV_MAX_IOV
+ * @return size_t bytes sent or -1 on error.
+ *         Set errno on error, EMSGSIZE if payload exceeds udp_max_payload(),
+ *         EINVAL if there's too many pieces.
+ */
+size_t udp_sendv(net_socket *sock, uint32_t src_addr, uint32_t dst_addr,
+        uint16_t sport, uint16_t dport, const struct iovec *iov, int iovcnt);
+
+/* Stream part of a file out as UDP datagrams.
+ *
+ * File is mapped into memory and read ahead sequentially, and payload of
+ * every datagram points straight into the mapping, so file data is only
+ * ever copied by the kernel when it's sent. Checksums are computed as
+ * datagrams go out.
+ *
+ * @param net_socket *sock   -- Pointer to populated net_socket structure
+ * @param int fd             -- File to send, opened for reading
+ * @param off_t off          -- Offset in file to start from
+ * @param size_t len         -- Amount of bytes to send, cut short at end of file
+ * @param size_t dgram_size  -- Payload per datagram, 0 for udp_max_payload()
+ * @param uint32_t src_addr  -- Source IP address
+ * @param uint32_t dst_addr  -- Destination IP address
+ * @param uint16_t sport     -- UDP Port to send our data from
+ * @param uint16_t dport     -- UDP Port to send our data to
+ * @param uint64_t rate_bps  -- Payload bits per second to pace datagrams to,
+ *                              0 to send as fast as we can
+ * @return size_t amount of payload bytes sent, or -1 if nothing was sent.
+ *         Set errno on error, EMSGSIZE if dgram_size exceeds udp_max_payload(),
+ *         EINVAL if off is negative or past end of file.
+ *         If sending fails midway, or the link stays full for
+ *         UDP_SENDFILE_RETRIES attempts, errno is set and bytes sent so far
+ *         returned.
+ *
+ * NOTE: file must not be truncated while it's being sent
+ */
+size_t udp_sendfile(net_socket *sock, int fd, off_t off, size_t len,
+        size_t dgram_size, uint32_t src_addr, uint32_t dst_addr,
+        uint16_t sport, uint16_t dport, uint64_t rate_bps);
+
+/* Send a message over UDP to a remote host over IPv6. Unlike with IPv4,
+ * the checksum is mandatory, it's computed on top of the pseudo header
+ * sum the IPv6 layer caches per socket.
+ *
+ * @param net_socket *sock     -- Pointer to populated AF_INET6 net_socket structure
+ * @param const ipv6_addr *src -- Source IP address
+ * @param const ipv6_addr *dst -- Destination IP address
+ * @param uint16_t sport       -- UDP Port to send our data from
+ * @param uint16_t dport       -- UDP Port to send our data to
+ * @param uint8_t *data        -- Pointer to data to transmit
+ * @param size_t len           -- Amount of bytes to send
+ * @return size_t bytes sent or -1 on error.
+ *         Set errno on error, EMSGSIZE if datagram doesn't fit in link MTU.
+ */
+size_t udp6_send(net_socket *sock, const ipv6_addr *src, const ipv6_addr *dst,
+        uint16_t sport, uint16_t dport, uint8_t *data, size_t len);
+
+/* Datagram handed between threads through a ring. Addresses are in network
+ * byte order, ports in host byte order, same as with udp_send().
+ *
+ * @member uint32_t src   -- Source IP address
+ * @member uint32_t dst   -- Destination IP address
+ * @member uint16_t sport -- Source port
+ * @member uint16_t dport -- Destination port
+ * @member uint16_t len   -- Amount of payload bytes
+ * @member uint8_t data   -- Payload
+ */
+typedef struct {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint16_t len;
+    uint8_t data[];
+} udp_desc;
+
+// Ring element size needed for datagrams of up to given payload size
+#define UDP_DESC_SIZE(max_payload) (sizeof(udp_desc) + (max_payload))
+
+/* Submit a datagram for the I/O thread to send. Never blocks, locks or
+ * enters the kernel, so it's safe to call from any amount of threads.
+ *
+ * @param mpsc_ring *ring      -- Ring the I/O thread drains with udp_drain()
+ * @param uint32_t src_addr    -- Source IP address
+ * @param uint32_t dst_addr    -- Destination IP address
+ * @param uint16_t sport       -- UDP Port to send our data from
+ * @param uint16_t dport       -- UDP Port to send our data to
+ * @param const void *data     -- Pointer to data to transmit, copied into the ring
+ * @param size_t len           -- Amount of bytes to send
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, EAGAIN if the ring is full and the caller
+ *         should back off, EMSGSIZE if len doesn't fit in a ring element.
+ */
+int udp_submit(mpsc_ring *ring, uint32_t src_addr, uint32_t dst_addr,
+        uint16_t sport, uint16_t dport, const void *data, size_t len);
+
+/* Send datagrams submitted to socket's tx_ring. I/O thread only.
+ *
+ * @param net_socket *sock -- Pointer to socket with a tx_ring
+ * @param unsigned burst   -- Maximum amount of datagrams to send, at most UDP_DRAIN_MAX
+ * @return unsigned amount of datagrams taken off the ring
+ */
+unsigned udp_drain(net_socket *sock, unsigned burst);
+
+/* Handle UDP datagram we've received from the IPv4 layer. Datagram is
+ * copied into socket's rx_ring for a consumer thread to pick up with
+ * spsc_peek()/spsc_release(), elements being udp_desc.
+ *
+ * @param net_socket *sock -- Pointer to socket the datagram was received on
+ * @param void *frame      -- Pointer to start of the received frame
+ * @param size_t off       -- Offset of IPv4 header from start of the frame
+ * @param size_t len       -- Size of the frame up to end of IPv4 datagram
+ * @return size_t amount of bytes consumed on success or -1 if datagram was dropped.
+ *         Set errno on error, ENOBUFS if the consumer isn't keeping up.
+ */
+size_t udp_rx(net_socket *sock, void *frame, size_t off, size_t len);
+
 #endif // __NETLIB_UDP_H__
@@ -0,0 +1,183 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Van Jacobson TCP/IP header compression for serial links, RFC 1144.
+ *
+ * Both ends remember the last header of every TCP connection crossing
+ * the link in a numbered slot. A compressed frame then carries only what
+ * changed since, usually 3 to 5 bytes instead of 40. Frames are told apart
+ * by their first byte, see vj_type().
+ */
+#ifndef __NETLIB_VJ_H__
+#define __NETLIB_VJ_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+// Connection ids are a single byte on the wire
+#define VJ_MAX_SLOTS     256
+#define VJ_DEFAULT_SLOTS 16
+
+// Largest IPv4 plus TCP header a slot remembers, both with options
+#define VJ_MAX_HDR 120
+
+/* Types of frames on a compressing link
+ *
+ * @member VJ_TYPE_IP               -- Anything sent as is
+ * @member VJ_TYPE_UNCOMPRESSED_TCP -- Full TCP/IP datagram that (re)loads a
+ *                                     slot, protocol field holds the slot
+ * @member VJ_TYPE_COMPRESSED_TCP   -- Changes since last header of a slot
+ */
+enum VJ_TYPE {
+    VJ_TYPE_IP               = 0x40,
+    VJ_TYPE_UNCOMPRESSED_TCP = 0x70,
+    VJ_TYPE_COMPRESSED_TCP   = 0x80
+};
+
+/* Last header seen on a connection
+ *
+ * @member uint8_t hlen -- Size of the header, 0 if slot is unused
+ * @member uint8_t hdr  -- IPv4 header and TCP header, options included
+ */
+typedef struct {
+    uint8_t hlen;
+    uint8_t hdr[VJ_MAX_HDR];
+} vj_slot;
+
+/* Compression state of one link, for both directions
+ *
+ * @member unsigned slots -- Amount of slots in each direction
+ * @member int last_tx    -- Slot of last TCP frame sent, -1 if none
+ * @member int last_rx    -- Slot of last TCP frame received, -1 if none
+ * @member int toss       -- Drop compressed frames until one names its slot,
+ *                           set after errors so we don't rebuild bad headers
+ * @member uint8_t *lru   -- Transmit slots, most recently used first
+ * @member vj_slot *tx    -- Headers we sent
+ * @member vj_slot *rx    -- Headers we received
+ */
+typedef struct {
+    unsigned slots;
+    int last_tx;
+    int last_rx;
+    int toss;
+    uint8_t *lru;
+    vj_slot *tx;
+    vj_slot *rx;
+} vj_state;
+
+/* Tell type of a frame received on a compressing link
+ *
+ * @param uint8_t first -- First byte of the frame
+ * @return enum VJ_TYPE type of the frame
+ */
+static inline enum VJ_TYPE vj_type(uint8_t first) {
+    if (first & VJ_TYPE_COMPRESSED_TCP) {
+        return VJ_TYPE_COMPRESSED_TCP;
+    }
+    if ((first & 0xf0) == VJ_TYPE_UNCOMPRESSED_TCP) {
+        return VJ_TYPE_UNCOMPRESSED_TCP;
+    }
+    return VJ_TYPE_IP;
+}
+
+/* Create compression state for a link
+ *
+ * @param unsigned slots -- Connections remembered in each direction, 3 to
+ *                          VJ_MAX_SLOTS. Both ends must use the same amount.
+ * @return pointer to new state on success or 0 on error.
+ *         set errno on error.
+ */
+vj_state *vj_create(unsigned slots);
+
+/* Release compression state
+ *
+ * @param vj_state *vj -- Pointer to state
+ */
+void vj_destroy(vj_state *vj);
+
+/* Get amount of memory a state with given amount of slots takes
+ *
+ * @param unsigned slots -- Connections remembered in each direction
+ * @return size_t bytes
+ */
+size_t vj_mem(unsigned slots);
+
+/* Compress an IPv4 datagram for the link. Anything but a plain TCP
+ * segment is left alone, and so is a segment the other end couldn't
+ * rebuild from its slot.
+ *
+ * @param vj_state *vj     -- Pointer to state
+ * @param const void *data -- Pointer to IPv4 datagram
+ * @param size_t len       -- Size of the datagram
+ * @param void *out        -- Where to write the frame, room for len bytes
+ * @return size_t size of the frame written to out, or 0 if the datagram
+ *         should be sent as is
+ */
+size_t vj_compress(vj_state *vj, const void *data, size_t len, void *out);
+
+/* Rebuild the IPv4 datagram of a received TCP frame
+ *
+ * @param vj_state *vj      -- Pointer to state
+ * @param const void *frame -- Pointer to VJ_TYPE_UNCOMPRESSED_TCP or
+ *                             VJ_TYPE_COMPRESSED_TCP frame
+ * @param size_t len        -- Size of the frame
+ * @param void *out         -- Where to write the datagram
+ * @param size_t size       -- Size of out
+ * @return size_t size of the datagram on success or -1 if the frame was dropped.
+ *         set errno on error, EBADMSG if the frame is malformed or we're
+ *         waiting for resync, EMSGSIZE if the datagram doesn't fit in out.
+ */
+size_t vj_uncompress(vj_state *vj, const void *frame, size_t len, void *out, size_t size);
+
+/* Drop compressed frames until the other end reloads or names a slot.
+ * Called when the link lost a frame, as the next compressed one would
+ * otherwise be rebuilt from a stale header.
+ *
+ * @param vj_state *vj -- Pointer to state
+ */
+static inline void vj_toss(vj_state *vj) {
+    vj->toss = 1;
+}
+
+/* Forget header of the last frame compressed, as it never made it to
+ * the link. Next segment of the connection then goes uncompressed.
+ *
+ * @param vj_state *vj -- Pointer to state
+ */
+static inline void vj_tx_lost(vj_state *vj) {
+    if (vj->last_tx != -1) {
+        vj->tx[vj->last_tx].hlen = 0;
+        vj->last_tx = -1;
+    }
+}
+
+#endif // __NETLIB_VJ_H__
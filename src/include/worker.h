@@ -0,0 +1,170 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Multi-worker receive and transmit over a fanout group */
+#ifndef __NETLIB_WORKER_H__
+#define __NETLIB_WORKER_H__
+
+#include <sys/types.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "ctx.h"
+#include "socket.h"
+
+// Largest frame a worker receives
+#define WORKER_FRAME_SIZE 16384
+
+// Frames queued per worker before transmit is forced
+#define WORKER_DEFAULT_TX_QUEUE 64
+
+// Largest rx_batch a worker can be configured with
+#define WORKER_RX_BATCH_MAX 256
+
+// Datagrams taken off a worker's tx_ring per loop iteration
+#define WORKER_TX_BURST 64
+
+/* Worker pool configuration
+ *
+ * @member int family           -- Socket family (AF_INET, AF_INET6, ...)
+ * @member int protocol         -- Protocol to use (TCP/UDP/ICMP/..)
+ * @member int type             -- Link type, refer to enum LINK_TYPE
+ * @member uint8_t *smac        -- Source MAC address
+ * @member char *iface          -- Name of interface to use
+ * @member unsigned workers     -- Amount of worker threads
+ * @member const int *cpus      -- CPU for each worker, or 0 to use CPUs 0..workers-1.
+ *                                 NETLIB_CPU_ANY leaves a worker unpinned.
+ * @member int fanout_mode      -- Refer to enum FANOUT_MODE
+ * @member int fanout_prog_fd   -- eBPF program for FANOUT_EBPF
+ * @member uint16_t fanout_group -- Fanout group id, or 0 to have one picked
+ * @member unsigned tx_queue    -- Frames queued per worker, 0 for default
+ * @member unsigned rx_batch    -- Receive up to this many frames per call, with
+ *                                 batch size adapting to load. 0 receives
+ *                                 frames one by one.
+ * @member unsigned latency_budget_us -- How long a batch may wait to fill up
+ *                                 under heavy traffic, refer to socket_set_rx_batch()
+ * @member int busy_poll        -- Spin on receive instead of sleeping in it, so
+ *                                 datagrams submitted to a worker's tx_ring
+ *                                 go out right away
+ * @member setup                -- Called on each worker thread once its socket
+ *                                 is open, to set addresses, routes, rings etc. Return
+ *                                 -1 to fail the start of the pool.
+ * @member rx                   -- Called for each received frame, or 0 to pass
+ *                                 batches of frames to graph_rx()
+ * @member poll                 -- Called once per worker loop iteration, or 0
+ * @member void *arg            -- Passed to the callbacks
+ */
+typedef struct {
+    int family;
+    int protocol;
+    int type;
+    uint8_t *smac;
+    char *iface;
+    unsigned workers;
+    const int *cpus;
+    int fanout_mode;
+    int fanout_prog_fd;
+    uint16_t fanout_group;
+    unsigned tx_queue;
+    unsigned rx_batch;
+    unsigned latency_budget_us;
+    int busy_poll;
+    int (*setup)(net_socket *sock, unsigned worker, void *arg);
+    void (*rx)(net_socket *sock, void *frame, size_t len, void *arg);
+    void (*poll)(net_socket *sock, void *arg);
+    void *arg;
+} worker_config;
+
+typedef struct worker_pool worker_pool;
+
+/* Single worker. Everything but the counters is only touched by the
+ * worker's own thread once it's running.
+ *
+ * @member worker_pool *pool    -- Pool this worker belongs to
+ * @member unsigned id          -- Index of the worker in the pool
+ * @member int cpu              -- CPU the worker is pinned to
+ * @member thrd_t thread        -- Worker thread
+ * @member netlib_ctx *ctx      -- Stack instance owned by the worker
+ * @member net_socket *sock     -- Socket owned by the worker
+ * @member uint8_t *frame       -- Receive buffer
+ * @member atomic_int state     -- Refer to enum WORKER_STATE
+ * @member int error            -- Errno value if the worker failed to start
+ * @member atomic_ulong rx_frames -- Frames received
+ */
+typedef struct {
+    worker_pool *pool;
+    unsigned id;
+    int cpu;
+    thrd_t thread;
+    netlib_ctx *ctx;
+    net_socket *sock;
+    uint8_t *frame;
+    atomic_int state;
+    int error;
+    atomic_ulong rx_frames;
+} __attribute__((aligned(NETLIB_CACHELINE))) worker;
+
+/* Pool of workers sharing one fanout group
+ *
+ * @member worker_config cfg -- Configuration pool was started with
+ * @member atomic_bool stop  -- Set to make workers exit
+ * @member unsigned count    -- Amount of workers started
+ * @member worker *workers   -- Workers
+ */
+struct worker_pool {
+    worker_config cfg;
+    atomic_bool stop;
+    unsigned count;
+    worker *workers;
+};
+
+/* Start a pool of workers. Each worker pins itself to its CPU, creates its
+ * own stack instance and socket, joins the fanout group, and then loops
+ * receiving frames, sending datagrams submitted to its socket's tx_ring,
+ * and flushing its transmit queue. Returns once all
+ * workers are running.
+ *
+ * @param const worker_config *cfg -- Pool configuration
+ * @return pointer to running pool on success or 0 on error.
+ *         Set errno on error.
+ */
+worker_pool *workers_start(const worker_config *cfg);
+
+/* Stop all workers and free the pool
+ *
+ * @param worker_pool *pool -- Pool to stop
+ */
+void workers_stop(worker_pool *pool);
+
+#endif // __NETLIB_WORKER_H__
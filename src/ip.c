@@ -34,48 +34,80 @@
 #include <sys/types.h>
 #include <assert.h>
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
-//#include <threads.h>
-
 #include <bitmap.h>
 #include <csum.h>
+#include <ctx.h>
 #include <data_util.h>
+#include <icmp.h>
 #include <link.h>
 #include <ip.h>
+#include <pmtu.h>
+#include <stats.h>
+#include <trace.h>
+#include <udp.h>
 
-// This bitmask contains those ip id values that are
-// currently in use.
-static bitmap_t used_ip_id_values = 0;
-
-// Last block we used for selecting ip id from
-static uint16_t last_block = 0;
-
-// maximum amout of blocks present
-uint16_t max_blocks = 1024;
-
-// Mutex lock for id bitmask
-// mtx_t id_map_lock;
+/* IPv4 ID allocator state of one stack instance
+ *
+ * @member bitmap_t used_ids     -- ip id values that are currently in use
+ * @member uint64_t rng          -- xorshift state for picking starting blocks
+ * @member uint16_t last_block   -- Last block we used for selecting ip id from
+ * @member uint16_t max_blocks   -- Maximum amount of blocks present
+ */
+struct ip_state {
+    bitmap_t used_ids;
+    uint64_t rng;
+    uint16_t last_block;
+    uint16_t max_blocks;
+};
+
+static inline uint32_t ip_rand(struct ip_state *ip) {
+    ip->rng ^= ip->rng << 13;
+    ip->rng ^= ip->rng >> 7;
+    ip->rng ^= ip->rng << 17;
+    return (uint32_t)ip->rng;
+}
 
-/* Initialise ip header system */
-void ip_initialise(void) {
-   // mtx_init(&id_map_lock, 0);
-    srand(((uint64_t)&ip_initialise) % 0xffff);
-    last_block = rand() % 0x1000; 
-    used_ip_id_values = calloc(1, (65536 / 8));
-    memset(used_ip_id_values, 0, (65536 / 8));
-    assert(used_ip_id_values && "Could not allocate memory for ip id management");
+/* Initialise ip header system of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ *         Errno is set for us by aligned_alloc()
+ */
+int ip_initialise(netlib_ctx *ctx) {
+    struct ip_state *ip = netlib_ctx_alloc(sizeof(struct ip_state));
+    if (!ip) {
+        return -1;
+    }
+    ip->used_ids = netlib_ctx_alloc(65536 / 8);
+    if (!ip->used_ids) {
+        free(ip);
+        return -1;
+    }
+    // Instances must not walk the ID space in lockstep
+    ip->rng = (monotonic_ns() ^ ((uint64_t)(ctx->cpu + 1) << 32)) | 1;
+    ip->max_blocks = 1024;
+    ip->last_block = ip_rand(ip) % ip->max_blocks;
+    ctx->ip = ip;
+    return 0;
 }
 
-/* Finalise ip header system */
-void ip_finalise(void) {
-    //mtx_lock(&id_map_lock);
-    //mtx_destroy(&id_map_lock);
-    free(used_ip_id_values);
+/* Finalise ip header system of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void ip_finalise(netlib_ctx *ctx) {
+    if (ctx->ip) {
+        free(ctx->ip->used_ids);
+        free(ctx->ip);
+        ctx->ip = 0;
+    }
 }
 
 /* Select unique IPv4 ID field value as per RFC 6864[1]. 
@@ -83,69 +115,54 @@ void ip_finalise(void) {
  * The current idea is, that each IPv4 "stream"[2] gets one ID value
  * when create_..._ipv4_hdr(...) is called. The ID value is 'freed' once
  * destroy_ipv4_hdr(...) is called after all datagrams have been transmitted.
+ * Every stack instance has an ID space of its own, and only its owning
+ * thread allocates from it, so there's nothing to lock.
  * 
  * [1]: https://www.rfc-editor.org/rfc/rfc6864
  * [2]: With the stream here, we don't refer to TCP stream, but rather 
  *      IPv4 datagrams that are fragmented for whatever reason.
  *
+ * @param struct ip_state *ip -- ID allocator of our stack instance
  * @param struct iphdr *iph -- Pointer to populated IPv4 header, that
  *                             has no ID or checksum fields filled yet.
  * @return bool true on success or false on error.
  */
-static bool allocate_ipv4_id(ipv4_hdr *iph) {
-    //int mutex_result;
-
-    /* Try and lock mutex, if result isn't success or busy,
-     * we've errored out and should return false.
-     */
-    /*
-    do {
-        mutex_result = mtx_trylock(&id_map_lock);
-    } while (mutex_result == thrd_busy);
-    if (mutex_result != thrd_success) {
-        return false;
-    }
-    */
-
+static bool allocate_ipv4_id(struct ip_state *ip, ipv4_hdr *iph) {
     /* Select a random starting point */
-    srand(last_block);
-    uint16_t current_block = (last_block + rand()) % max_blocks;
+    uint16_t current_block = (ip->last_block + ip_rand(ip)) % ip->max_blocks;
     uint16_t entry = (current_block * 8);
     uint16_t current_id = 0;
-    last_block = current_block;
+    ip->last_block = current_block;
 
     do {
-        if (bitmap_get(used_ip_id_values, entry) == false) {
+        if (bitmap_get(ip->used_ids, entry) == false) {
             current_id = entry;
-            bitmap_set(used_ip_id_values, current_id);
+            bitmap_set(ip->used_ids, current_id);
         } else {
             entry = (entry + 3) % 65535;
         }
     } while (!current_id);
-    iph->id = current_id;
-    //mtx_unlock(&id_map_lock);
+    ipv4_set_id(iph, current_id);
 
     return true;
 }
 
 /* Free IP ID value
  *
+ * @param struct ip_state *ip -- ID allocator the value came from
  * @param uint16_t ip id to free
- *
- * Note, I _think_ I don't need to lock the mutex, it shouldn't matter
- * that we're freeing this ID value whilst some other process is going on to
- * allocate a new ID for themselves.
  */
-static inline void free_ipv4_id(uint16_t id) {
-    bitmap_clear(used_ip_id_values, id);
+static inline void free_ipv4_id(struct ip_state *ip, uint16_t id) {
+    bitmap_clear(ip->used_ids, id);
 }
 
 /* Allocate IPv4 header when non-standard header is required.
  *
+ * @param netlib_ctx *ctx         -- Stack instance to allocate ID from
  * @param uint32_t src            -- Pointer to source sockaddr_in struct
  * @param uint32_t dst            -- Pointer to destination sockaddr_in struct
  * @param uint8_t tos             -- Type of service value
- * @param uint16_t f_off          -- Fragment offset
+ * @param uint16_t f_off          -- Fragment offset, DF gets always set on top
  * @param uint8_t ttl             -- Time to live
  * @param uint8_t proto           -- Protocol
  * @param uint8_t option_type     -- Type field for additional IPv4 options or 0 if unused
@@ -156,7 +173,7 @@ static inline void free_ipv4_id(uint16_t id) {
  * @return pointer to populated ipv4 header structure on success or NULL on error.
  * Errno is set for us by malloc()
  */
-ipv4_hdr *create_ipv4_hdr(uint32_t src,
+ipv4_hdr *create_ipv4_hdr(netlib_ctx *ctx, uint32_t src,
         uint32_t dst, uint8_t tos, uint16_t f_off_vcf,
         uint8_t ttl, uint8_t proto, uint8_t option_type, uint8_t option_len,
         uint8_t *option_buf, uint16_t tlen) 
@@ -179,17 +196,15 @@ ipv4_hdr *create_ipv4_hdr(uint32_t src,
         return iph;
     }
 
-    iph->version = 4;
-    iph->ihl = ihl;
+    ipv4_set_hlen(iph, ihl * 4);
     iph->tos = tos;
-    iph->len = htons(len + tlen);
-    iph->flags_foff = htons(f_off_vcf | (DONT_FRAGMENT << 8));
+    ipv4_set_len(iph, len + tlen);
+    ipv4_set_flags_foff(iph, f_off_vcf | (DONT_FRAGMENT << 8));
     iph->ttl = ttl;
     iph->ptcl = proto;
-    iph->src = src;
-    iph->dst = dst;
-    iph->csum = 0;
-    allocate_ipv4_id(iph);
+    ipv4_set_src(iph, src);
+    ipv4_set_dst(iph, dst);
+    allocate_ipv4_id(ctx->ip, iph);
 
     if (option_type) {
         memcpy(POINTER_ADD(void *, iph, sizeof(ipv4_hdr)), &option_type, 1);
@@ -198,18 +213,71 @@ ipv4_hdr *create_ipv4_hdr(uint32_t src,
         memcpy(POINTER_ADD(void *, iph, sizeof(ipv4_hdr) + 1), &option_len, 1);
         memcpy(POINTER_ADD(void *, iph, sizeof(ipv4_hdr) + 2), option_buf, option_len);
     }
-    iph->csum = csum((uint16_t *)iph, len);
+    ipv4_set_csum(iph, csum((uint16_t *)iph, len));
 
     return iph; 
 }
 
+/* Release IPv4 header from create_ipv4_hdr(), along with its ID
+ *
+ * @param netlib_ctx *ctx -- Stack instance the header got its ID from
+ * @param ipv4_hdr *iph   -- Pointer to header to release
+ */
+void destroy_ipv4_hdr(netlib_ctx *ctx, ipv4_hdr *iph) {
+    if (iph) {
+        free_ipv4_id(ctx->ip, ipv4_id(iph));
+        free(iph);
+    }
+}
+
 /* Helper for parsing IPv4 Type of Service value 
  *
  * @param struct ipv4_socket_options *sopts -- Pointer to populated ipv4_socket_options structure
  * @return uint8_t type of service
  */
 static inline uint8_t ipv4_parse_tos(ipv4_socket_options *sopts) {
-    return (sopts->pre | (sopts->low_delay << 3) | (sopts->high_throughput << 4) | (sopts->high_reliability << 5));
+    // Precedence takes the top three bits, rfc 791 numbers bits from the left
+    return ((sopts->pre << 5) |
+            (sopts->low_delay ? IPV4_TOS_LOW_DELAY : 0) |
+            (sopts->high_throughput ? IPV4_TOS_THROUGHPUT : 0) |
+            (sopts->high_reliability ? IPV4_TOS_RELIABILITY : 0));
+}
+
+/* Check that socket's options are ones we can send with. Every datagram
+ * goes out with DF set, as we don't fragment and IDs are released right
+ * after sending, which rfc 6864 only allows for atomic datagrams.
+ *
+ * @param ipv4_socket_options *iopts -- Options of the sending socket
+ * @return int 0 if options are usable or -1 if not, errno set to EINVAL
+ */
+static inline int ipv4_check_opts(ipv4_socket_options *iopts) {
+    if (!iopts->no_fragment) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Get path MTU towards destination, and store it as the MTU in use in
+ * socket's ipv4_socket_options.
+ *
+ * @param net_socket *socket -- Pointer to populated net_socket structure
+ * @param uint32_t dst       -- Destination address
+ * @return uint16_t largest IPv4 datagram we can send to dst without it being dropped
+ */
+uint16_t ipv4_path_mtu(net_socket *socket, uint32_t dst) {
+    ipv4_socket_options *iopts = (ipv4_socket_options *)socket->ip_options;
+    link_options *link = (link_options *)socket->link_options;
+    uint16_t mtu = link->mtu;
+
+    if (link->routes) {
+        const route_nexthop *nh = route_lookup(link->routes, dst);
+        if (nh && nh->mtu && nh->mtu < mtu) {
+            mtu = nh->mtu;
+        }
+    }
+    iopts->mtu = pmtu_get(socket->ctx, dst, mtu);
+    return iopts->mtu;
 }
 
 /* Transmit datagram over IPv4 protocol
@@ -221,27 +289,42 @@ static inline uint8_t ipv4_parse_tos(ipv4_socket_options *sopts) {
  *                                     protocol header
  * @param size_t data_len           -- Length of datagram to send
  * @return amount of bytes sent excluding ip header on success or -1 on error.
- * Set errno on error.
+ * Set errno on error, EMSGSIZE if datagram doesn't fit in path MTU,
+ * EINVAL if socket has no_fragment cleared.
  */
 size_t ipv4_transmit_datagram(net_socket *socket, uint32_t src,
         uint32_t dst, const void *data, size_t data_len)
 {
     ipv4_socket_options *iopts = (ipv4_socket_options *)socket->ip_options;
     uint8_t ttl = iopts->ttl;
-//    uint8_t tos = ipv4_parse_tos(iopts);
-    uint16_t f_off = 0 ? 2 : iopts->no_fragment;
+    uint8_t tos = ipv4_parse_tos(iopts);
 
-    ipv4_hdr *ip_hdr = create_ipv4_hdr(src, dst, 0, f_off, ttl, socket->protocol, 
+    TRACE_POINT(socket, TRACE_IP);
+    if (ipv4_check_opts(iopts)) {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+        return -1;
+    }
+    // DF is set, so anything above path MTU would just vanish
+    if ((sizeof(ipv4_hdr) + data_len) > ipv4_path_mtu(socket, dst)) {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    NETLIB_STAT_ADD(socket->ctx, alloc, 2);
+    ipv4_hdr *ip_hdr = create_ipv4_hdr(socket->ctx, src, dst, tos, 0, ttl, socket->protocol, 
             0, 0, 0, data_len);
     if (!ip_hdr) {
         // Errno was set to us by malloc()
+        NETLIB_STAT_INC(socket->ctx, alloc_failures);
         return -1;
     }
 
-    uint16_t size = ntohs(ip_hdr->len);
+    uint16_t size = ipv4_len(ip_hdr);
     void *packet = calloc(1, size);
     if (!packet) {
         // Errno was set to us by realloc()
+        NETLIB_STAT_INC(socket->ctx, alloc_failures);
         free(ip_hdr);
         return -1;
     }
@@ -251,14 +334,223 @@ size_t ipv4_transmit_datagram(net_socket *socket, uint32_t src,
                 sizeof(ipv4_hdr)), data, data_len);
 
     // uint16_t sent = eth_transmit_frame(socket, (const void *)packet, size);
-    uint16_t sent = link_tx(socket, (const void *)packet, size);
+    size_t sent = link_tx(socket, (const void *)packet, size);
+    if (sent == (size_t)-1) {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+    } else {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_packets);
+        NETLIB_STAT_ADD(socket->ctx, ipv4_tx_bytes, size);
+    }
 
-    free_ipv4_id(ip_hdr->id);
+    free_ipv4_id(socket->ctx->ip, ipv4_id(ip_hdr));
     free(ip_hdr);
     free(packet);
     return sent;
 }
 
+/* Transmit datagram gathered from several buffers over IPv4 protocol
+ *
+ * @param net_socket *socket -- Pointer to populated net_socket structure
+ * @param uint32_t src       -- Source address to use
+ * @param uint32_t dst       -- Destination address to use
+ * @param struct iovec *iov  -- Pieces of the datagram, protocol header first
+ * @param int iovcnt         -- Amount of entries in iov
+ * @return size_t amount of bytes sent on success or -1 on error.
+ * Set errno on error, EMSGSIZE if datagram doesn't fit in path MTU,
+ * EINVAL if socket has no_fragment cleared.
+ */
+size_t ipv4_transmitv(net_socket *socket, uint32_t src, uint32_t dst,
+        struct iovec *iov, int iovcnt)
+{
+    ipv4_socket_options *iopts = (ipv4_socket_options *)socket->ip_options;
+    size_t tlen = sizeof(ipv4_hdr) + iov_length(iov, iovcnt);
+
+    TRACE_POINT(socket, TRACE_IP);
+    if (ipv4_check_opts(iopts)) {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+        return -1;
+    }
+    if (tlen > ipv4_path_mtu(socket, dst)) {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    ipv4_hdr *iph = (ipv4_hdr *)((uint8_t *)iov[0].iov_base - sizeof(ipv4_hdr));
+    ipv4_set_hlen(iph, sizeof(ipv4_hdr));
+    iph->tos = ipv4_parse_tos(iopts);
+    ipv4_set_len(iph, tlen);
+    ipv4_set_flags_foff(iph, DONT_FRAGMENT << 8);
+    iph->ttl = iopts->ttl;
+    iph->ptcl = socket->protocol;
+    ipv4_set_csum(iph, 0);
+    ipv4_set_src(iph, src);
+    ipv4_set_dst(iph, dst);
+    allocate_ipv4_id(socket->ctx->ip, iph);
+    ipv4_set_csum(iph, csum((uint16_t *)iph, sizeof(ipv4_hdr)));
+    iov[0].iov_base = iph;
+    iov[0].iov_len += sizeof(ipv4_hdr);
+
+    size_t sent = link_txv(socket, iov, iovcnt);
+    if (sent == (size_t)-1) {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+    } else {
+        NETLIB_STAT_INC(socket->ctx, ipv4_tx_packets);
+        NETLIB_STAT_ADD(socket->ctx, ipv4_tx_bytes, tlen);
+    }
+
+    free_ipv4_id(socket->ctx->ip, ipv4_id(iph));
+    return sent;
+}
+
+/* IPv4 encapsulation node of the TX graph.
+ *
+ * @param net_socket *socket -- Pointer to socket we're sending on
+ * @param pkt_vector *v      -- Vector of datagrams carrying src and dst
+ * @return unsigned amount of datagrams left in vector
+ */
+unsigned ipv4_encap_vec(net_socket *socket, pkt_vector *v) {
+    ipv4_socket_options *iopts = (ipv4_socket_options *)socket->ip_options;
+    uint8_t tos = ipv4_parse_tos(iopts);
+    uint16_t ids[GRAPH_VECTOR_MAX];
+    uint32_t mtu_dst = 0;
+    uint16_t mtu = 0;
+    unsigned kept = 0;
+
+    if (ipv4_check_opts(iopts)) {
+        NETLIB_STAT_ADD(socket->ctx, ipv4_tx_errors, v->count);
+        v->dropped += v->count;
+        v->count = 0;
+        return 0;
+    }
+    for (unsigned i = 0; i < v->count; i++) {
+        pkt_desc *d = &v->desc[i];
+        if ((i + GRAPH_PREFETCH) < v->count) {
+            __builtin_prefetch(v->desc[i + GRAPH_PREFETCH].data - sizeof(ipv4_hdr), 1);
+        }
+        // Vectors mostly go to a handful of destinations
+        if (!mtu || d->dst != mtu_dst) {
+            mtu = ipv4_path_mtu(socket, d->dst);
+            mtu_dst = d->dst;
+        }
+        if ((sizeof(ipv4_hdr) + d->len) > mtu) {
+            NETLIB_STAT_INC(socket->ctx, ipv4_tx_errors);
+            v->dropped++;
+            continue;
+        }
+        d->data -= sizeof(ipv4_hdr);
+        d->len += sizeof(ipv4_hdr);
+
+        ipv4_hdr *iph = (ipv4_hdr *)d->data;
+        ipv4_set_hlen(iph, sizeof(ipv4_hdr));
+        iph->tos = tos;
+        ipv4_set_len(iph, d->len);
+        ipv4_set_flags_foff(iph, DONT_FRAGMENT << 8);
+        iph->ttl = iopts->ttl;
+        iph->ptcl = socket->protocol;
+        ipv4_set_csum(iph, 0);
+        ipv4_set_src(iph, d->src);
+        ipv4_set_dst(iph, d->dst);
+        allocate_ipv4_id(socket->ctx->ip, iph);
+        ids[kept] = ipv4_id(iph);
+        ipv4_set_csum(iph, csum((uint16_t *)iph, sizeof(ipv4_hdr)));
+        NETLIB_STAT_ADD(socket->ctx, ipv4_tx_bytes, d->len);
+        v->desc[kept++] = *d;
+    }
+    NETLIB_STAT_ADD(socket->ctx, ipv4_tx_packets, kept);
+
+    /* Same as with ipv4_transmit_datagram(), IDs are only held while
+     * datagrams are being built. Every datagram has DF set, so they only
+     * need to be unique among datagrams of the vector.
+     */
+    for (unsigned i = 0; i < kept; i++) {
+        free_ipv4_id(socket->ctx->ip, ids[i]);
+    }
+    v->count = kept;
+    return kept;
+}
+
+/* Check that IPv4 header of received datagram is sane
+ *
+ * @param const void *frame -- Pointer to start of the received frame
+ * @param size_t off        -- Offset of IPv4 header from start of the frame
+ * @param size_t len        -- Size of the whole frame
+ * @return size_t total length of the datagram or -1 if it's malformed.
+ *         Set errno on error, EMSGSIZE for fragments as we don't reassemble.
+ */
+static inline size_t ipv4_check(const void *frame, size_t off, size_t len) {
+    const ipv4_hdr *iph = POINTER_ADD(const ipv4_hdr *, frame, off);
+
+    if ((len - off) < sizeof(ipv4_hdr) || ipv4_version(iph) != 4) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t hlen = ipv4_hlen(iph);
+    size_t tlen = ipv4_len(iph);
+    if (hlen < sizeof(ipv4_hdr) || tlen < hlen || tlen > (len - off)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (csum((uint16_t *)iph, hlen) != 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    if (ipv4_is_fragment(iph)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return tlen;
+}
+
+/* Count datagram ipv4_check() turned down, by errno it set
+ *
+ * @param netlib_ctx *ctx -- Stack instance the datagram arrived on
+ */
+static inline void ipv4_count_error(netlib_ctx *ctx) {
+    switch (errno) {
+    case (EBADMSG):
+        NETLIB_STAT_INC(ctx, ipv4_rx_csum_errors);
+        break;
+    case (EMSGSIZE):
+        NETLIB_STAT_INC(ctx, ipv4_rx_fragments);
+        break;
+    default:
+        NETLIB_STAT_INC(ctx, ipv4_rx_hdr_errors);
+        break;
+    }
+}
+
+/* IPv4 input node of the RX graph.
+ *
+ * @param net_socket *socket -- Pointer to socket the datagrams were received on
+ * @param pkt_vector *v      -- Vector of frames, off pointing at IPv4 header
+ * @return unsigned amount of datagrams left in vector
+ */
+unsigned ipv4_input_vec(net_socket *socket, pkt_vector *v) {
+    unsigned kept = 0;
+
+    for (unsigned i = 0; i < v->count; i++) {
+        pkt_desc *d = &v->desc[i];
+        if ((i + GRAPH_PREFETCH) < v->count) {
+            pkt_desc *n = &v->desc[i + GRAPH_PREFETCH];
+            __builtin_prefetch(n->data + n->off);
+        }
+        size_t tlen = ipv4_check(d->data, d->off, d->len);
+        if (tlen == (size_t)-1) {
+            ipv4_count_error(socket->ctx);
+            v->dropped++;
+            continue;
+        }
+        // Anything past total length is link layer padding
+        d->len = d->off + tlen;
+        NETLIB_STAT_ADD(socket->ctx, ipv4_rx_bytes, tlen);
+        v->desc[kept++] = *d;
+    }
+    NETLIB_STAT_ADD(socket->ctx, ipv4_rx_packets, kept);
+    v->count = kept;
+    return kept;
+}
+
 /* Receive datagram over IPv4 protocol
  *
  * @param net_socket *socket        -- Pointer to populated net_socket structure
@@ -272,5 +564,37 @@ size_t ipv4_transmit_datagram(net_socket *socket, uint32_t src,
 //    return ret;
 //}
 
+/* Handle IPv4 datagram we've received from the link layer, and pass it on
+ * to the next protocol.
+ *
+ * @param net_socket *socket -- Pointer to socket the datagram was received on
+ * @param void *frame        -- Pointer to start of the received frame
+ * @param size_t off         -- Offset of IPv4 header from start of the frame
+ * @param size_t len         -- Size of the whole frame
+ * @return size_t amount of bytes consumed on success or -1 if datagram was dropped.
+ *         Set errno on error.
+ */
+size_t ipv4_rx(net_socket *socket, void *frame, size_t off, size_t len) {
+    ipv4_hdr *iph = POINTER_ADD(ipv4_hdr *, frame, off);
+    size_t tlen = ipv4_check(frame, off, len);
 
-
+    if (tlen == (size_t)-1) {
+        ipv4_count_error(socket->ctx);
+        return -1;
+    }
+    NETLIB_STAT_INC(socket->ctx, ipv4_rx_packets);
+    NETLIB_STAT_ADD(socket->ctx, ipv4_rx_bytes, tlen);
+
+    // Anything past total length is link layer padding
+    switch (iph->ptcl) {
+    case (IPV4_PTCL_ICMP):
+        return icmp_rx(socket, frame, off, off + tlen);
+    case (IPV4_PTCL_UDP):
+        return udp_rx(socket, frame, off, off + tlen);
+    default:
+        break;
+    }
+    NETLIB_STAT_INC(socket->ctx, ipv4_rx_unknown_ptcl);
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
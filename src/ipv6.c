@@ -0,0 +1,430 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* IPv6 transmit and receive path */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csum.h>
+#include <data_util.h>
+#include <eth.h>
+#include <ip.h>
+#include <link.h>
+#include <stats.h>
+
+// Give up on datagrams with more extension headers than this
+#define IPV6_MAX_EXTHDRS 8
+
+/* Mix 32-bit value, finaliser from murmur3
+ *
+ * @param uint32_t h -- Value to mix
+ * @return uint32_t mixed value
+ */
+static inline uint32_t ipv6_mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Rebuild header template and cached pseudo header sum of a socket if
+ * source or destination changed since last datagram.
+ *
+ * @param net_socket *socket      -- Pointer to AF_INET6 socket
+ * @param ipv6_socket_options *o  -- Pointer to its IPv6 options
+ * @param const ipv6_addr *src    -- Pointer to source address
+ * @param const ipv6_addr *dst    -- Pointer to destination address
+ */
+static inline void ipv6_refresh_tmpl(net_socket *socket,
+        ipv6_socket_options *o, const ipv6_addr *src, const ipv6_addr *dst)
+{
+    ipv6_hdr *h = &o->tmpl;
+
+    if (o->tmpl_valid && !memcmp(&h->src, src, sizeof(ipv6_addr)) &&
+            !memcmp(&h->dst, dst, sizeof(ipv6_addr))) {
+        return;
+    }
+
+    h->vtc_flow = htonl((6U << 28) | ((uint32_t)o->tclass << 20) | (o->flow & 0xfffff));
+    h->plen = 0;
+    h->nxt = (uint8_t)socket->protocol;
+    h->hlim = o->hop_limit;
+    h->src = *src;
+    h->dst = *dst;
+
+    ipv6_psd_hdr psd;
+    memset(&psd, 0, sizeof(psd));
+    memcpy(psd.src, src, sizeof(ipv6_addr));
+    memcpy(psd.dst, dst, sizeof(ipv6_addr));
+    psd.ptcl = (uint8_t)socket->protocol;
+    o->psd_sum = csum_partial(&psd, sizeof(psd), 0);
+
+    uint32_t words[8];
+    uint32_t hash = (uint32_t)socket->protocol;
+    memcpy(words, src, sizeof(ipv6_addr));
+    memcpy(&words[4], dst, sizeof(ipv6_addr));
+    for (int i = 0; i < 8; i++) {
+        hash = ipv6_mix32(hash ^ words[i]);
+    }
+    o->addr_hash = hash;
+    o->tmpl_valid = 1;
+}
+
+/* Derive flow label from addresses, protocol and ports (RFC 6437), so
+ * that ECMP and RSS can spread flows without looking past the IPv6 header.
+ *
+ * @param ipv6_socket_options *o -- Pointer to IPv6 options with valid template
+ * @param const void *data       -- Pointer to upper layer header
+ * @param size_t len             -- Size of upper layer data
+ * @return uint32_t 20-bit non-zero flow label
+ */
+static inline uint32_t ipv6_flow_label(ipv6_socket_options *o,
+        const void *data, size_t len)
+{
+    uint32_t ports = 0;
+
+    // Both TCP and UDP start with source and destination ports
+    if (len >= 4 && (o->tmpl.nxt == IPV6_NXT_UDP || o->tmpl.nxt == IPV6_NXT_TCP)) {
+        memcpy(&ports, data, 4);
+    }
+    uint32_t label = ipv6_mix32(o->addr_hash ^ ports) & 0xfffff;
+    return label ? label : 1;
+}
+
+/* Get partial sum of the IPv6 pseudo header for given addresses, excluding
+ * the upper layer length.
+ *
+ * @param net_socket *socket   -- Pointer to populated AF_INET6 net_socket structure
+ * @param const ipv6_addr *src -- Pointer to source address
+ * @param const ipv6_addr *dst -- Pointer to destination address
+ * @return uint32_t partial sum to feed into csum_partial()
+ */
+uint32_t ipv6_psd_sum(net_socket *socket, const ipv6_addr *src,
+        const ipv6_addr *dst)
+{
+    ipv6_socket_options *o = (ipv6_socket_options *)socket->ip_options;
+
+    ipv6_refresh_tmpl(socket, o, src, dst);
+    return o->psd_sum;
+}
+
+/* Walk IPv6 extension headers to find the upper layer header.
+ *
+ * @param const void *pkt -- Pointer to IPv6 header
+ * @param size_t len      -- Size of the datagram
+ * @param uint8_t *nxt    -- Pointer to where upper layer protocol is written to
+ * @return size_t offset of upper layer header from start of IPv6 header,
+ *         or -1 if datagram is malformed or a non-first fragment.
+ */
+size_t ipv6_upper_layer(const void *pkt, size_t len, uint8_t *nxt) {
+    const uint8_t *p = (const uint8_t *)pkt;
+    const ipv6_hdr *hdr = (const ipv6_hdr *)pkt;
+
+    if (len < sizeof(ipv6_hdr) || (p[0] >> 4) != 6) {
+        return -1;
+    }
+    size_t end = sizeof(ipv6_hdr) + ntohs(hdr->plen);
+    if (end > len) {
+        return -1;
+    }
+
+    size_t off = sizeof(ipv6_hdr);
+    uint8_t nh = hdr->nxt;
+    for (int i = 0; i <= IPV6_MAX_EXTHDRS; i++) {
+        switch (nh) {
+        case (IPV6_NXT_HOPOPTS):
+        case (IPV6_NXT_ROUTING):
+        case (IPV6_NXT_DSTOPTS):
+            if ((off + 8) > end) {
+                return -1;
+            }
+            nh = p[off];
+            off += (p[off + 1] + 1) * 8;
+            break;
+        case (IPV6_NXT_FRAGMENT):
+            if ((off + 8) > end) {
+                return -1;
+            }
+            // Only first fragment carries the upper layer header
+            if (((p[off + 2] << 8) | p[off + 3]) & 0xfff8) {
+                return -1;
+            }
+            nh = p[off];
+            off += 8;
+            break;
+        case (IPV6_NXT_AH):
+            if ((off + 8) > end) {
+                return -1;
+            }
+            nh = p[off];
+            off += (p[off + 1] + 2) * 4;
+            break;
+        default:
+            if (off > end) {
+                return -1;
+            }
+            *nxt = nh;
+            return off;
+        }
+    }
+    return -1;
+}
+
+/* Check if datagram is addressed to us: our unicast address, its
+ * solicited-node group or all-nodes.
+ *
+ * @param const link_options *link -- Link the datagram arrived on
+ * @param const ipv6_addr *dst     -- Destination address of the datagram
+ * @return bool true if we should process the datagram
+ */
+static inline bool ipv6_for_us(const link_options *link, const ipv6_addr *dst) {
+    static const uint8_t all_nodes[16] = { 0xff, 0x02, [15] = 0x01 };
+    static const uint8_t solicited[13] = { 0xff, 0x02, [11] = 0x01, [12] = 0xff };
+    const uint8_t *ours = link->addr6.octets;
+    static const uint8_t unset[16];
+
+    if (!memcmp(dst->octets, all_nodes, 16)) {
+        return true;
+    }
+    if (!memcmp(ours, unset, 16)) {
+        return false;
+    }
+    if (!memcmp(dst->octets, ours, 16)) {
+        return true;
+    }
+    // ff02::1:ffXX:XXXX, low 24 bits taken from our address
+    return !memcmp(dst->octets, solicited, 13) && !memcmp(dst->octets + 13, ours + 13, 3);
+}
+
+/* Check that received IPv6 datagram is sane and for us
+ *
+ * @param net_socket *socket -- Pointer to socket the datagram was received on
+ * @param const void *frame  -- Pointer to start of the received frame
+ * @param size_t off         -- Offset of IPv6 header from start of the frame
+ * @param size_t len         -- Size of the whole frame
+ * @return size_t total length of the datagram or -1 if it's dropped.
+ *         Set errno on error.
+ */
+static size_t ipv6_check(net_socket *socket, const void *frame, size_t off, size_t len) {
+    link_options *link = (link_options *)socket->link_options;
+    const ipv6_hdr *hdr = POINTER_ADD(const ipv6_hdr *, frame, off);
+
+    if ((len - off) < sizeof(ipv6_hdr) || (*(const uint8_t *)hdr >> 4) != 6) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t tlen = sizeof(ipv6_hdr) + ntohs(hdr->plen);
+    if (tlen > (len - off)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!ipv6_for_us(link, &hdr->dst)) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+
+    uint8_t nxt;
+    size_t ul = ipv6_upper_layer(hdr, tlen, &nxt);
+    if (ul == (size_t)-1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (nxt != IPV6_NXT_UDP && nxt != IPV6_NXT_ICMPV6) {
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+    const uint8_t *upper = POINTER_ADD(const uint8_t *, hdr, ul);
+    size_t ulen = tlen - ul;
+    if (nxt == IPV6_NXT_UDP && (ulen < 8 || !load_u16(upper + 6))) {
+        // Checksum is mandatory for UDP over IPv6
+        errno = EBADMSG;
+        return -1;
+    }
+
+    ipv6_psd_hdr psd;
+    memset(&psd, 0, sizeof(psd));
+    memcpy(psd.src, &hdr->src, sizeof(ipv6_addr));
+    memcpy(psd.dst, &hdr->dst, sizeof(ipv6_addr));
+    store_be32(psd.len, (uint32_t)ulen);
+    psd.ptcl = nxt;
+    if (csum_fold(csum_partial(upper, ulen, csum_partial(&psd, sizeof(psd), 0))) != 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return tlen;
+}
+
+/* Count datagram ipv6_check() turned down, by errno it set
+ *
+ * @param netlib_ctx *ctx -- Stack instance the datagram arrived on
+ */
+static inline void ipv6_count_error(netlib_ctx *ctx) {
+    switch (errno) {
+    case (EBADMSG):
+        NETLIB_STAT_INC(ctx, ipv6_rx_csum_errors);
+        break;
+    case (EADDRNOTAVAIL):
+        NETLIB_STAT_INC(ctx, ipv6_rx_not_ours);
+        break;
+    case (EPROTONOSUPPORT):
+        NETLIB_STAT_INC(ctx, ipv6_rx_unknown_ptcl);
+        break;
+    default:
+        NETLIB_STAT_INC(ctx, ipv6_rx_hdr_errors);
+        break;
+    }
+}
+
+/* Handle IPv6 datagram we've received from the link layer.
+ *
+ * @param net_socket *socket -- Pointer to socket the datagram was received on
+ * @param void *frame        -- Pointer to start of the received frame
+ * @param size_t off         -- Offset of IPv6 header from start of the frame
+ * @param size_t len         -- Size of the whole frame
+ * @return size_t amount of bytes consumed on success or -1 if datagram was dropped.
+ *         Set errno on error.
+ */
+size_t ipv6_rx(net_socket *socket, void *frame, size_t off, size_t len) {
+    size_t tlen = ipv6_check(socket, frame, off, len);
+
+    if (tlen == (size_t)-1) {
+        ipv6_count_error(socket->ctx);
+        return -1;
+    }
+    NETLIB_STAT_INC(socket->ctx, ipv6_rx_packets);
+    NETLIB_STAT_ADD(socket->ctx, ipv6_rx_bytes, tlen);
+    // Anything past payload length is link layer padding
+    return off + tlen;
+}
+
+/* Transmit datagram over IPv6 protocol
+ *
+ * @param net_socket *socket   -- Pointer to populated AF_INET6 net_socket structure
+ * @param const ipv6_addr *src -- Pointer to source address
+ * @param const ipv6_addr *dst -- Pointer to destination address
+ * @param const void *data     -- Pointer to datagram to send, including appropriate
+ *                                protocol header
+ * @param size_t data_len      -- Length of datagram to send
+ * @return size_t amount of bytes sent on success or -1 on error.
+ * Set errno on error, EMSGSIZE if datagram doesn't fit in link MTU.
+ */
+size_t ipv6_transmit_datagram(net_socket *socket, const ipv6_addr *src,
+        const ipv6_addr *dst, const void *data, size_t data_len)
+{
+    ipv6_socket_options *o = (ipv6_socket_options *)socket->ip_options;
+
+    if ((sizeof(ipv6_hdr) + data_len) > o->mtu) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    ipv6_refresh_tmpl(socket, o, src, dst);
+
+    size_t size = sizeof(ipv6_hdr) + data_len;
+    void *packet = malloc(size);
+    if (!packet) {
+        return -1;
+    }
+
+    ipv6_hdr *hdr = (ipv6_hdr *)packet;
+    memcpy(hdr, &o->tmpl, sizeof(ipv6_hdr));
+    hdr->plen = htons((uint16_t)data_len);
+    if (!o->flow) {
+        hdr->vtc_flow |= htonl(ipv6_flow_label(o, data, data_len));
+    }
+    memcpy(POINTER_ADD(void *, packet, sizeof(ipv6_hdr)), data, data_len);
+
+    size_t sent = link_tx(socket, (const void *)packet, size);
+
+    free(packet);
+    return sent;
+}
+
+/* Receive datagram over IPv6 protocol
+ *
+ * @param net_socket *socket        -- Pointer to populated net_socket structure
+ * @param const void *dst           -- Pointer to memory where we'll write received data to
+ * @param size_t r_len              -- How many bytes do we want to receive *including* IPv6 header
+ * @return size_t amount of bytes received on success or -1 on error.
+ *                Set errno on error
+ */
+size_t ipv6_receive_datagram(net_socket *socket, void *dst, size_t r_len) {
+    link_options *link = (link_options *)socket->link_options;
+    size_t cap = sizeof(eth_hdr) + link->mtu;
+    size_t ret = -1;
+
+    uint8_t *frame = malloc(cap);
+    if (!frame) {
+        return ret;
+    }
+
+    for (;;) {
+        size_t len = receive(socket, frame, cap);
+        if (len == (size_t)-1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        uint16_t ptcl;
+        size_t off = link_payload(socket, frame, len, &ptcl);
+        if (off == (size_t)-1) {
+            continue;
+        }
+        if (ptcl != ETH_PTCL_IPV6) {
+            link_rx(socket, frame, len);
+            continue;
+        }
+
+        size_t tlen = ipv6_rx(socket, frame, off, len);
+        if (tlen == (size_t)-1) {
+            continue;
+        }
+        ret = tlen - off;
+        if (ret > r_len) {
+            ret = r_len;
+        }
+        memcpy(dst, &frame[off], ret);
+        break;
+    }
+
+    free(frame);
+    return ret;
+}
@@ -38,11 +38,69 @@
 
 #include <sys/types.h>
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctx.h>
 #include <eth.h>
+#include <ip.h>
 #include <slip.h>
+#include <vj.h>
 
 #include <link.h>
 #include <socket.h>
+#include <stats.h>
+#include <trace.h>
+
+/* Header compression of a SLIP link, see link_set_slip_vj()
+ *
+ * @member vj_state *vj -- Compression state of both directions
+ * @member int compress -- Compress what we send, set once the other end
+ *                         does in SLIP_VJ_AUTO mode
+ * @member size_t size  -- Size of tx and rx, MTU of the link
+ * @member size_t mem   -- Bytes charged to the socket
+ * @member uint8_t *tx  -- Frame being compressed
+ * @member uint8_t *rx  -- Last decompressed datagram
+ */
+typedef struct {
+    vj_state *vj;
+    int compress;
+    size_t size;
+    size_t mem;
+    uint8_t *tx;
+    uint8_t *rx;
+} link_vj;
+
+/* Count frame handed to the link
+ *
+ * @param netlib_ctx *ctx -- Stack instance the frame was sent on
+ * @param size_t ret      -- What the link returned
+ * @param size_t len      -- Size of the frame
+ */
+static inline void link_count_tx(netlib_ctx *ctx, size_t ret, size_t len) {
+    if (ret == (size_t)-1) {
+        NETLIB_STAT_INC(ctx, link_tx_errors);
+    } else {
+        NETLIB_STAT_INC(ctx, link_tx_packets);
+        NETLIB_STAT_ADD(ctx, link_tx_bytes, len);
+    }
+}
+
+/* Count frame handed to the serial line
+ *
+ * @param netlib_ctx *ctx -- Stack instance the frame was sent on
+ * @param size_t ret      -- What link_slip_transmit() returned
+ * @param size_t len      -- Size of the frame
+ */
+static inline void link_count_slip(netlib_ctx *ctx, size_t ret, size_t len) {
+    if (ret == (size_t)-1) {
+        NETLIB_STAT_INC(ctx, slip_tx_errors);
+    } else {
+        NETLIB_STAT_INC(ctx, slip_tx_packets);
+        NETLIB_STAT_ADD(ctx, slip_tx_bytes, len);
+    }
+}
 
 /* Transmit data over link that has been associated with this socket.
  *
@@ -56,18 +114,370 @@ size_t link_tx(net_socket *sock, const void *data, size_t size) {
     link_options *link = (link_options *)sock->link_options;
     size_t ret = 0;
 
+    TRACE_POINT(sock, TRACE_LINK);
     switch (link->type) {
     case (ETH):
         ret = eth_transmit(sock, data, size);
         break;
     case (SLIP):
-        ret = slip_transmit(0x02f8, data, size);
+        ret = link_slip_transmit(sock, data, size);
+        link_count_slip(sock->ctx, ret, size);
+        break;
+    default:
+        break;
+    }
+    link_count_tx(sock->ctx, ret, size);
+    return ret;
+
+}
+
+/* Transmit datagram gathered from several buffers over link that has been
+ * associated with this socket. SLIP has to escape the whole frame anyway,
+ * so it gets the datagram in one piece.
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param struct iovec *iov -- Pieces of the datagram, network header first
+ * @param int iovcnt       -- Amount of entries in iov
+ * @return size_t sent bytes or -1 on error.
+ *         set errno on error.
+ */
+size_t link_txv(net_socket *sock, struct iovec *iov, int iovcnt) {
+    link_options *link = (link_options *)sock->link_options;
+    size_t ret = -1;
+
+    TRACE_POINT(sock, TRACE_LINK);
+    switch (link->type) {
+    case (ETH):
+        ret = eth_transmitv(sock, iov, iovcnt);
+        break;
+    case (SLIP): {
+        size_t len;
+        NETLIB_STAT_INC(sock->ctx, alloc);
+        void *frame = iov_gather(iov, iovcnt, &len);
+        if (frame) {
+            ret = link_slip_transmit(sock, frame, len);
+            link_count_slip(sock->ctx, ret, len);
+            free(frame);
+        } else {
+            NETLIB_STAT_INC(sock->ctx, alloc_failures);
+        }
+        break;
+    }
+    default:
+        errno = EPROTONOSUPPORT;
+        break;
+    }
+    link_count_tx(sock->ctx, ret, iov_length(iov, iovcnt));
+    return ret;
+}
+
+/* Send a SLIP frame. Over a file descriptor the frame goes through
+ * transmit(), so it gets queued and paced like any.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param const void *data -- Pointer to frame contents
+ * @param size_t len       -- Size of the frame
+ * @return size_t sent bytes or -1 on error.
+ *         set errno on error.
+ */
+static size_t link_slip_send(net_socket *sock, const void *data, size_t len) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (link->slip_line) {
+        return transmit(sock, data, len);
+    }
+    return slip_transmit(link->proto.slip_port, data, len);
+}
+
+/* Send a bare IP datagram as a SLIP frame, compressing TCP/IP headers if
+ * the link does so.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param const void *data -- Pointer to datagram
+ * @param size_t len       -- Size of the datagram
+ * @return size_t sent bytes or -1 on error.
+ *         set errno on error.
+ */
+size_t link_slip_transmit(net_socket *sock, const void *data, size_t len) {
+    link_options *link = (link_options *)sock->link_options;
+    link_vj *v = (link_vj *)link->slip_vj;
+
+    if (!v || !v->compress || len > v->size) {
+        return link_slip_send(sock, data, len);
+    }
+    size_t n = vj_compress(v->vj, data, len, v->tx);
+    if (!n) {
+        return link_slip_send(sock, data, len);
+    }
+    if (link_slip_send(sock, v->tx, n) == (size_t)-1) {
+        // Other end never sees this header, so don't send deltas against it
+        vj_tx_lost(v->vj);
+        return -1;
+    }
+    if (vj_type(v->tx[0]) == VJ_TYPE_COMPRESSED_TCP) {
+        NETLIB_STAT_INC(sock->ctx, slip_vj_tx_compressed);
+    }
+    return len;
+}
+
+/* Get IP datagram out of a received SLIP frame
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param void *frame      -- Pointer to received frame
+ * @param size_t *len      -- Size of the frame, updated to size of the datagram
+ * @return void * pointer to the datagram, or 0 if the frame was dropped.
+ *         set errno on error.
+ */
+void *link_slip_input(net_socket *sock, void *frame, size_t *len) {
+    link_options *link = (link_options *)sock->link_options;
+    link_vj *v = (link_vj *)link->slip_vj;
+
+    if (!*len) {
+        errno = EBADMSG;
+        return 0;
+    }
+    enum VJ_TYPE type = vj_type(*(const uint8_t *)frame);
+    if (type == VJ_TYPE_IP) {
+        return frame;
+    }
+    if (!v) {
+        errno = EPROTONOSUPPORT;
+        return 0;
+    }
+    size_t n = vj_uncompress(v->vj, frame, *len, v->rx, v->size);
+    if (n == (size_t)-1) {
+        NETLIB_STAT_INC(sock->ctx, slip_vj_rx_tossed);
+        return 0;
+    }
+    if (type == VJ_TYPE_COMPRESSED_TCP) {
+        NETLIB_STAT_INC(sock->ctx, slip_vj_rx_compressed);
+    }
+    // Other end speaks CSLIP, so answer in kind
+    v->compress = 1;
+    *len = n;
+    return v->rx;
+}
+
+/* Tell the link a received SLIP frame was lost or damaged
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ */
+void link_slip_rx_error(net_socket *sock) {
+    link_vj *v = (link_vj *)((link_options *)sock->link_options)->slip_vj;
+
+    if (v) {
+        vj_toss(v->vj);
+    }
+}
+
+/* Set up TCP/IP header compression on a SLIP link
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param int mode         -- Refer to enum SLIP_VJ
+ * @param unsigned slots   -- Connections remembered in each direction,
+ *                            0 for VJ_DEFAULT_SLOTS
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int link_set_slip_vj(net_socket *sock, int mode, unsigned slots) {
+    link_options *link = (link_options *)sock->link_options;
+    link_vj *v = (link_vj *)link->slip_vj;
+
+    if (!slots) {
+        slots = VJ_DEFAULT_SLOTS;
+    }
+    if (link->type != SLIP || mode < SLIP_VJ_OFF || mode > SLIP_VJ_AUTO ||
+            slots < 3 || slots > VJ_MAX_SLOTS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (v) {
+        socket_mem_uncharge(sock, v->mem);
+        vj_destroy(v->vj);
+        free(v->tx);
+        free(v->rx);
+        free(v);
+        link->slip_vj = 0;
+    }
+    if (mode == SLIP_VJ_OFF) {
+        return 0;
+    }
+
+    v = netlib_ctx_alloc(sizeof(link_vj));
+    if (!v) {
+        return -1;
+    }
+    v->size = link->mtu;
+    v->mem = sizeof(link_vj) + vj_mem(slots) + 2 * v->size;
+    if (socket_mem_charge(sock, v->mem) == -1) {
+        free(v);
+        return -1;
+    }
+    v->vj = vj_create(slots);
+    v->tx = netlib_ctx_alloc(v->size);
+    v->rx = netlib_ctx_alloc(v->size);
+    if (!v->vj || !v->tx || !v->rx) {
+        socket_mem_uncharge(sock, v->mem);
+        vj_destroy(v->vj);
+        free(v->tx);
+        free(v->rx);
+        free(v);
+        return -1;
+    }
+    v->compress = (mode == SLIP_VJ_ON);
+    link->slip_vj = v;
+    return 0;
+}
+
+/* Hand a frame received from the link over to the protocol layers above.
+ *
+ * @param net_socket *sock -- Pointer to socket the frame was received on
+ * @param void *frame      -- Pointer to received frame, including link header.
+ *                            Upper layers may modify the frame in place.
+ * @param size_t len       -- Size of the received frame
+ * @return size_t amount of bytes consumed on success or -1 if frame was dropped.
+ *         set errno on error.
+ */
+size_t link_rx(net_socket *sock, void *frame, size_t len) {
+    link_options *link = (link_options *)sock->link_options;
+
+    NETLIB_STAT_INC(sock->ctx, link_rx_packets);
+    NETLIB_STAT_ADD(sock->ctx, link_rx_bytes, len);
+    switch (link->type) {
+    case (ETH):
+        return eth_rx(sock, frame, len);
+    case (SLIP):
+        NETLIB_STAT_INC(sock->ctx, slip_rx_packets);
+        NETLIB_STAT_ADD(sock->ctx, slip_rx_bytes, len);
+        // SLIP frames are bare IP datagrams, once decompressed
+        frame = link_slip_input(sock, frame, &len);
+        if (!frame) {
+            NETLIB_STAT_INC(sock->ctx, link_rx_errors);
+            return -1;
+        }
+        switch (*(uint8_t *)frame >> 4) {
+        case (4):
+            return ipv4_rx(sock, frame, 0, len);
+        case (6):
+            return ipv6_rx(sock, frame, 0, len);
+        default:
+            break;
+        }
+        break;
+    default:
+        break;
+    }
+    NETLIB_STAT_INC(sock->ctx, link_rx_errors);
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+/* Find payload of a received frame, and the protocol it carries.
+ *
+ * @param net_socket *sock  -- Pointer to socket the frame was received on
+ * @param const void *frame -- Pointer to received frame, including link header
+ * @param size_t len        -- Size of the received frame
+ * @param uint16_t *ptcl    -- Pointer to where ethertype of payload is written to
+ * @return size_t offset of payload from start of frame, or -1 if frame
+ *         isn't for us. Set errno on error.
+ */
+size_t link_payload(net_socket *sock, const void *frame, size_t len,
+        uint16_t *ptcl)
+{
+    link_options *link = (link_options *)sock->link_options;
+
+    switch (link->type) {
+    case (ETH):
+        return eth_payload(sock, frame, len, ptcl);
+    case (SLIP):
+        if (!len || vj_type(*(const uint8_t *)frame) != VJ_TYPE_IP) {
+            break;
+        }
+        // No link header, so go by IP version
+        *ptcl = ((*(const uint8_t *)frame >> 4) == 6) ? ETH_PTCL_IPV6 : ETH_PTCL_IPV4;
+        return 0;
+    default:
+        break;
+    }
+    errno = EPROTONOSUPPORT;
+    return -1;
+}
+
+/* Send a received frame back where it came from. Link layer addresses
+ * are swapped in place, upper layers are expected to have already turned
+ * their part of the frame around.
+ *
+ * @param net_socket *sock -- Pointer to socket the frame was received on
+ * @param void *frame      -- Pointer to frame, including link header
+ * @param size_t len       -- Size of the frame
+ * @return size_t sent bytes.
+ *         set errno on error.
+ */
+size_t link_reflect(net_socket *sock, void *frame, size_t len) {
+    link_options *link = (link_options *)sock->link_options;
+    size_t ret = 0;
+
+    switch (link->type) {
+    case (ETH):
+        eth_swap_addr((eth_hdr *)frame);
+        ret = transmit(sock, frame, len);
+        break;
+    case (SLIP):
+        ret = link_slip_transmit(sock, frame, len);
         break;
     default:
         break;
     }
     return ret;
+}
 
+/* Configure IPv4 addressing of the link this socket is bound to
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param uint32_t addr    -- Our address
+ * @param uint32_t netmask -- Netmask of the local subnet
+ * @param uint32_t gateway -- Default gateway, or 0 if there's none
+ */
+void link_set_ipv4(net_socket *sock, uint32_t addr, uint32_t netmask,
+        uint32_t gateway)
+{
+    link_options *link = (link_options *)sock->link_options;
+
+    link->addr = addr;
+    link->netmask = netmask;
+    link->gateway = gateway;
+    socket_update_rx(sock);
+}
+
+/* Configure IPv6 address of the link this socket is bound to
+ *
+ * @param net_socket *sock     -- Pointer to socket
+ * @param const ipv6_addr *addr -- Our address
+ */
+void link_set_ipv6(net_socket *sock, const ipv6_addr *addr) {
+    link_options *link = (link_options *)sock->link_options;
+
+    link->addr6 = *addr;
+}
+
+/* Configure MAC address of the router unicast IPv6 traffic is sent to
+ *
+ * @param net_socket *sock    -- Pointer to socket
+ * @param const uint8_t *mac  -- MAC address of the router
+ */
+void link_set_ipv6_router(net_socket *sock, const uint8_t *mac) {
+    link_options *link = (link_options *)sock->link_options;
+
+    memcpy(link->router6_mac, mac, 6);
 }
 
+/* Attach routing table to the link this socket is bound to.
+ *
+ * @param net_socket *sock  -- Pointer to socket
+ * @param route_table *rt   -- Pointer to routing table, or 0 to detach
+ */
+void link_set_routes(net_socket *sock, route_table *rt) {
+    link_options *link = (link_options *)sock->link_options;
 
+    link->routes = rt;
+}
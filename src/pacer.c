@@ -0,0 +1,366 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Earliest departure time pacing on a timing wheel */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <eth.h>
+#include <ip.h>
+#include <link.h>
+#include <pacer.h>
+#include <socket.h>
+
+// End of frame list
+#define PACER_NIL UINT32_MAX
+
+/* Pacer of a socket
+ *
+ * Buckets are kept as the time they become empty, so that a frame may
+ * leave as soon as that time has passed. Idle buckets are allowed to
+ * fall behind by up to burst worth of time, which is what lets a burst
+ * through.
+ *
+ * @member uint64_t sock_next     -- When socket bucket becomes empty
+ * @member uint64_t sock_ps       -- Picoseconds per byte at socket rate, 0 for no limit
+ * @member uint64_t sock_burst_ns -- Socket burst as time
+ * @member uint64_t flow_ps       -- Picoseconds per byte at flow rate, 0 for no limit
+ * @member uint64_t flow_burst_ns -- Flow burst as time
+ * @member uint64_t *flow_next    -- When each flow bucket becomes empty
+ * @member uint64_t cursor        -- Next wheel slot to release, in PACER_SLOT_NS units
+ * @member unsigned queued        -- Amount of frames on the wheel
+ * @member int txtime             -- Frames are paced by the kernel through SO_TXTIME
+ * @member uint32_t *head         -- First frame of each wheel slot
+ * @member uint32_t *tail         -- Last frame of each wheel slot
+ * @member uint32_t free_head     -- First unused frame buffer
+ * @member uint32_t *link         -- Next frame in the same list, per buffer
+ * @member uint16_t *len          -- Size of the frame, per buffer
+ * @member size_t slot            -- Size of a single frame buffer
+ * @member uint8_t *frames        -- Frame buffers
+ * @member size_t mem             -- Bytes charged to the socket for the pacer
+ */
+struct pacer {
+    uint64_t sock_next;
+    uint64_t sock_ps;
+    uint64_t sock_burst_ns;
+    uint64_t flow_ps;
+    uint64_t flow_burst_ns;
+    uint64_t *flow_next;
+    uint64_t cursor;
+    unsigned queued;
+    int txtime;
+    uint32_t *head;
+    uint32_t *tail;
+    uint32_t free_head;
+    uint32_t *link;
+    uint16_t *len;
+    size_t slot;
+    uint8_t *frames;
+    size_t mem;
+};
+
+/* Release memory of a pacer
+ *
+ * @param struct pacer *p -- Pointer to pacer
+ */
+static void pacer_free(struct pacer *p) {
+    free(p->flow_next);
+    free(p->head);
+    free(p->tail);
+    free(p->link);
+    free(p->len);
+    free(p->frames);
+    free(p);
+}
+
+/* Start pacing frames sent on a socket.
+ *
+ * @param net_socket *sock        -- Pointer to socket we're working with
+ * @param const pacer_config *cfg -- Pacing configuration
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int pacer_attach(net_socket *sock, const pacer_config *cfg) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (sock->pacer || (!cfg->rate_bps && !cfg->flow_rate_bps) ||
+            (!cfg->txtime && !cfg->queue_len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (cfg->txtime && socket_set_txtime(sock) == -1) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    size_t slot = (link->mtu + sizeof(eth_hdr) + 4 + NETLIB_CACHELINE - 1) &
+        ~(size_t)(NETLIB_CACHELINE - 1);
+    size_t mem = sizeof(struct pacer) + PACER_FLOWS * sizeof(uint64_t);
+    if (!cfg->txtime) {
+        mem += PACER_WHEEL_SLOTS * 2 * sizeof(uint32_t) +
+            cfg->queue_len * (sizeof(uint32_t) + sizeof(uint16_t) + slot);
+    }
+    if (socket_mem_charge(sock, mem) == -1) {
+        return -1;
+    }
+
+    struct pacer *p = netlib_ctx_alloc(sizeof(struct pacer));
+    if (!p) {
+        socket_mem_uncharge(sock, mem);
+        return -1;
+    }
+    p->mem = mem;
+    if (cfg->rate_bps) {
+        p->sock_ps = 8000000000000ULL / cfg->rate_bps;
+        p->sock_burst_ns = (cfg->burst * p->sock_ps) / 1000;
+    }
+    if (cfg->flow_rate_bps) {
+        p->flow_ps = 8000000000000ULL / cfg->flow_rate_bps;
+        p->flow_burst_ns = (cfg->flow_burst * p->flow_ps) / 1000;
+    }
+    p->txtime = cfg->txtime;
+    p->cursor = monotonic_ns() / PACER_SLOT_NS;
+    p->free_head = PACER_NIL;
+    p->flow_next = netlib_ctx_alloc(PACER_FLOWS * sizeof(uint64_t));
+    if (!p->flow_next) {
+        socket_mem_uncharge(sock, mem);
+        pacer_free(p);
+        return -1;
+    }
+
+    if (!cfg->txtime) {
+        p->slot = slot;
+        p->head = netlib_ctx_alloc(PACER_WHEEL_SLOTS * sizeof(uint32_t));
+        p->tail = netlib_ctx_alloc(PACER_WHEEL_SLOTS * sizeof(uint32_t));
+        p->link = netlib_ctx_alloc(cfg->queue_len * sizeof(uint32_t));
+        p->len = netlib_ctx_alloc(cfg->queue_len * sizeof(uint16_t));
+        p->frames = netlib_ctx_alloc(cfg->queue_len * p->slot);
+        if (!p->head || !p->tail || !p->link || !p->len || !p->frames) {
+            socket_mem_uncharge(sock, mem);
+            pacer_free(p);
+            return -1;
+        }
+        memset(p->head, 0xff, PACER_WHEEL_SLOTS * sizeof(uint32_t));
+        memset(p->tail, 0xff, PACER_WHEEL_SLOTS * sizeof(uint32_t));
+        for (unsigned i = 0; i < cfg->queue_len; i++) {
+            p->link[i] = (i + 1 < cfg->queue_len) ? (i + 1) : PACER_NIL;
+        }
+        p->free_head = 0;
+    }
+    sock->pacer = p;
+    return 0;
+}
+
+/* Stop pacing frames sent on a socket.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ */
+void pacer_detach(net_socket *sock) {
+    if (sock->pacer) {
+        socket_mem_uncharge(sock, ((struct pacer *)sock->pacer)->mem);
+        pacer_free((struct pacer *)sock->pacer);
+        sock->pacer = 0;
+    }
+}
+
+/* Pick flow bucket of a frame by its destination address and ports
+ *
+ * @param net_socket *sock -- Pointer to socket frame is sent on
+ * @param const void *data -- Pointer to frame
+ * @param size_t len       -- Size of the frame
+ * @return uint32_t index of the bucket
+ */
+static inline uint32_t pacer_flow(net_socket *sock, const void *data, size_t len) {
+    const ipv4_hdr *iph = link_ipv4_hdr(sock, data, len);
+    if (!iph) {
+        return 0;
+    }
+    uint32_t key = ipv4_dst(iph);
+    size_t hlen = ipv4_hlen(iph);
+    size_t left = len - ((const uint8_t *)iph - (const uint8_t *)data);
+    if ((iph->ptcl == IPV4_PTCL_UDP || iph->ptcl == IPV4_PTCL_TCP) &&
+            !(ipv4_flags_foff(iph) & 0x1fff) && left >= (hlen + 4)) {
+        // Both ports at once
+        key ^= load_u32(POINTER_ADD(const uint8_t *, iph, hlen)) * 0x9e3779b1U;
+    }
+    return addr_hash(key, 10) & (PACER_FLOWS - 1);
+}
+
+/* Find when a bucket lets a frame go
+ *
+ * @param uint64_t next     -- When the bucket becomes empty
+ * @param uint64_t now      -- Current time
+ * @param uint64_t burst_ns -- Burst of the bucket as time
+ * @return uint64_t departure time as far as this bucket is concerned
+ */
+static inline uint64_t pacer_bucket(uint64_t next, uint64_t now, uint64_t burst_ns) {
+    if (now > burst_ns && next < (now - burst_ns)) {
+        return now - burst_ns;
+    }
+    return next;
+}
+
+/* Schedule a frame for sending.
+ *
+ * @param net_socket *sock -- Pointer to socket with a pacer
+ * @param const void *data -- Pointer to frame, copied if it has to wait
+ * @param size_t len       -- Size of the frame
+ * @return size_t len on success or -1 on error.
+ *         Set errno on error.
+ */
+size_t pacer_enqueue(net_socket *sock, const void *data, size_t len) {
+    struct pacer *p = (struct pacer *)sock->pacer;
+    uint64_t now = monotonic_ns();
+    uint64_t depart = now;
+    uint64_t sock_t = 0;
+    uint64_t flow_t = 0;
+    uint64_t *flow = 0;
+
+    if (p->sock_ps) {
+        sock_t = pacer_bucket(p->sock_next, now, p->sock_burst_ns);
+        depart = (sock_t > depart) ? sock_t : depart;
+    }
+    if (p->flow_ps) {
+        flow = &p->flow_next[pacer_flow(sock, data, len)];
+        flow_t = pacer_bucket(*flow, now, p->flow_burst_ns);
+        depart = (flow_t > depart) ? flow_t : depart;
+    }
+
+    if (!p->txtime && (depart > now || p->queued)) {
+        if (!p->queued && p->cursor < (now / PACER_SLOT_NS)) {
+            p->cursor = now / PACER_SLOT_NS;
+        }
+        uint64_t s = depart / PACER_SLOT_NS;
+        if (s < p->cursor) {
+            s = p->cursor;
+        }
+        if ((s - p->cursor) >= PACER_WHEEL_SLOTS || p->free_head == PACER_NIL ||
+                len > p->slot) {
+            errno = ENOBUFS;
+            return -1;
+        }
+    }
+
+    // Frame is going out, charge the buckets
+    if (p->sock_ps) {
+        p->sock_next = sock_t + ((len * p->sock_ps) / 1000);
+    }
+    if (flow) {
+        *flow = flow_t + ((len * p->flow_ps) / 1000);
+    }
+
+    if (p->txtime) {
+        return transmit_at(sock, data, len, depart);
+    }
+    if (depart <= now && !p->queued) {
+        return transmit_at(sock, data, len, 0);
+    }
+
+    uint64_t s = depart / PACER_SLOT_NS;
+    if (s < p->cursor) {
+        s = p->cursor;
+    }
+    uint32_t idx = s & (PACER_WHEEL_SLOTS - 1);
+    uint32_t f = p->free_head;
+    p->free_head = p->link[f];
+    memcpy(p->frames + (f * p->slot), data, len);
+    p->len[f] = (uint16_t)len;
+    p->link[f] = PACER_NIL;
+    if (p->tail[idx] == PACER_NIL) {
+        p->head[idx] = f;
+    } else {
+        p->link[p->tail[idx]] = f;
+    }
+    p->tail[idx] = f;
+    p->queued++;
+    return len;
+}
+
+/* Send all frames whose departure time has passed.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return unsigned amount of frames sent
+ */
+unsigned pacer_release(net_socket *sock) {
+    struct pacer *p = (struct pacer *)sock->pacer;
+    unsigned sent = 0;
+
+    if (!p || !p->queued) {
+        return 0;
+    }
+    uint64_t now = monotonic_ns() / PACER_SLOT_NS;
+    while (p->cursor <= now && p->queued) {
+        uint32_t idx = p->cursor & (PACER_WHEEL_SLOTS - 1);
+        uint32_t f = p->head[idx];
+        while (f != PACER_NIL) {
+            uint32_t next = p->link[f];
+            transmit_at(sock, p->frames + (f * p->slot), p->len[f], 0);
+            p->link[f] = p->free_head;
+            p->free_head = f;
+            p->queued--;
+            sent++;
+            f = next;
+        }
+        p->head[idx] = PACER_NIL;
+        p->tail[idx] = PACER_NIL;
+        p->cursor++;
+    }
+    // Whatever the socket queued up goes out in one go
+    transmit_flush(sock);
+    return sent;
+}
+
+/* Get departure time of the next waiting frame
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return uint64_t monotonic time in nanoseconds, or UINT64_MAX if
+ *         nothing is waiting
+ */
+uint64_t pacer_next(net_socket *sock) {
+    struct pacer *p = (struct pacer *)sock->pacer;
+
+    if (!p || !p->queued) {
+        return UINT64_MAX;
+    }
+    for (uint64_t s = p->cursor; s < (p->cursor + PACER_WHEEL_SLOTS); s++) {
+        if (p->head[s & (PACER_WHEEL_SLOTS - 1)] != PACER_NIL) {
+            return s * PACER_SLOT_NS;
+        }
+    }
+    return UINT64_MAX;
+}
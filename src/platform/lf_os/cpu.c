@@ -0,0 +1,10 @@
+#include <ctx.h>
+
+/* Pin calling thread to given CPU. We're single core for now.
+ *
+ * @param int cpu -- CPU to run on
+ * @return int 0 on success or -1 on error.
+ */
+int netlib_pin_cpu(int cpu) {
+    return cpu == 0 ? 0 : -1;
+}
@@ -2,21 +2,42 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 
+#include <linux/errqueue.h>
+#include <linux/filter.h>
 #include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
 #include <net/ethernet.h>
 #include <net/if.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
+#include <termios.h>
 
 #include <unistd.h>
 
+#include <ctx.h>
 #include <data_util.h>
+#include <eth.h>
+#include <filter.h>
 #include <ip.h>
 #include <link.h>
+#include <pacer.h>
+#include <slip.h>
 #include <socket.h>
+#include <stats.h>
+#include <trace.h>
+#include <txsched.h>
 
 /* Get and setup unix-styled socket for us
  *
@@ -31,9 +52,746 @@ int raw_socket(const char *iface) {
         close(sock);
         return stat;
     }
+
+    /* Don't let anything in until the stack has told us what it wants,
+     * and throw away whatever got queued before the filter was in place.
+     */
+    struct sock_filter drop = { FILTER_RET_K, 0, 0, 0 };
+    struct sock_fprog fprog = { .len = 1, .filter = &drop };
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0) {
+        uint8_t junk[1];
+        while (recv(sock, junk, sizeof(junk), MSG_DONTWAIT) >= 0);
+    }
+
+    // Our own transmissions would otherwise be looped back to us
+    int one = 1;
+    setsockopt(sock, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+    // Wake up receivers every now and then so timers get to run
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    stat = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (stat == -1) {
+        close(sock);
+        return stat;
+    }
     return sock;
 }
 
+_Static_assert(sizeof(filter_insn) == sizeof(struct sock_filter),
+        "filter_insn must match struct sock_filter");
+
+/* Frames waiting to be sent with a single sendmmsg()
+ *
+ * @member unsigned count         -- Amount of queued frames
+ * @member unsigned len           -- Amount of frames the queue holds
+ * @member size_t slot            -- Size of buffer for a single frame
+ * @member size_t mem             -- Bytes charged to the socket for the queue
+ * @member struct sockaddr_ll addr -- Where frames go, resolved once
+ * @member struct mmsghdr *msgs   -- Message per queued frame
+ * @member struct iovec *iov      -- Buffer per queued frame
+ * @member uint8_t *frames        -- Frame buffers, slot bytes each
+ */
+typedef struct {
+    unsigned count;
+    unsigned len;
+    size_t slot;
+    size_t mem;
+    struct sockaddr_ll addr;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    uint8_t *frames;
+} tx_queue;
+
+/* Buffers and adaptive batch size for receive_batch()
+ *
+ * @member unsigned max       -- Largest batch
+ * @member unsigned batch     -- Current batch size
+ * @member uint64_t budget_ns -- How long a heavy traffic batch may wait to fill up
+ * @member size_t slot        -- Size of buffer for a single frame
+ * @member size_t mem         -- Bytes charged to the socket for the buffers
+ * @member struct mmsghdr *msgs -- Message per buffer
+ * @member struct iovec *iov  -- Buffer per message
+ * @member uint8_t *frames    -- Frame buffers, slot bytes each
+ */
+typedef struct {
+    unsigned max;
+    unsigned batch;
+    uint64_t budget_ns;
+    size_t slot;
+    size_t mem;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    uint8_t *frames;
+} rx_batch;
+
+// Single read returning faster than this means a frame was already queued
+#define RX_BATCH_QUEUED_NS 2000
+
+// Bytes read from a SLIP line at a time
+#define SLIP_LINE_READ 4096
+
+/* SLIP running over a file descriptor, see socket_set_slip_fd()
+ *
+ * @member size_t mem         -- Bytes charged to the socket for the line
+ * @member unsigned timeout_us -- How long receive() waits for a frame, 0 to never
+ * @member unsigned queued    -- Frames in the TX queue
+ * @member size_t tx_head     -- Offset of first unwritten byte in tx
+ * @member size_t tx_len      -- Amount of unwritten bytes
+ * @member size_t tx_size     -- Size of tx
+ * @member uint8_t *tx        -- Encoded frames waiting to be written
+ * @member size_t rx_pos      -- Offset of first undecoded byte in rx
+ * @member size_t rx_len      -- Amount of bytes read into rx
+ * @member slip_decoder dec   -- Decoder of the received byte stream
+ * @member uint8_t rx         -- Bytes read from the line
+ */
+typedef struct {
+    size_t mem;
+    unsigned timeout_us;
+    unsigned queued;
+    size_t tx_head;
+    size_t tx_len;
+    size_t tx_size;
+    uint8_t *tx;
+    size_t rx_pos;
+    size_t rx_len;
+    slip_decoder dec;
+    uint8_t rx[SLIP_LINE_READ];
+} slip_line;
+
+/* Put a tty into raw mode at given speed. Anything that isn't a tty,
+ * like a pipe or a socket, is left alone.
+ *
+ * @param int fd        -- File descriptor of the line
+ * @param unsigned baud -- Line speed in bits per second, 0 to leave as is
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if speed isn't supported.
+ */
+static int slip_tty_setup(int fd, unsigned baud) {
+    static const struct {
+        unsigned baud;
+        speed_t speed;
+    } speeds[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+        { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 },
+        { 460800, B460800 }, { 500000, B500000 }, { 921600, B921600 },
+        { 1000000, B1000000 }, { 1500000, B1500000 }, { 2000000, B2000000 },
+        { 3000000, B3000000 }, { 4000000, B4000000 },
+    };
+    struct termios tio;
+
+    if (tcgetattr(fd, &tio) == -1) {
+        return (errno == ENOTTY || errno == EINVAL) ? 0 : -1;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    if (baud) {
+        unsigned i = 0;
+        while (i < (sizeof(speeds) / sizeof(speeds[0])) && speeds[i].baud != baud) {
+            i++;
+        }
+        if (i == (sizeof(speeds) / sizeof(speeds[0]))) {
+            errno = EINVAL;
+            return -1;
+        }
+        cfsetispeed(&tio, speeds[i].speed);
+        cfsetospeed(&tio, speeds[i].speed);
+    }
+    return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/* Write as much of the TX queue as the line takes without blocking
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param slip_line *l     -- Line of the socket
+ * @return amount of frames written once the queue empties, 0 while
+ *         some are still waiting, or -1 on error. Set errno on error.
+ */
+static size_t slip_line_flush(net_socket *sock, slip_line *l) {
+    while (l->tx_len) {
+        ssize_t n = write(sock->raw_sockfd, l->tx + l->tx_head, l->tx_len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                // Line is busy, the rest goes out with a later flush
+                return 0;
+            }
+            // Same as a failed transmit_flush(), queued frames are dropped
+            l->tx_len = 0;
+            l->tx_head = 0;
+            l->queued = 0;
+            return -1;
+        }
+        l->tx_head += n;
+        l->tx_len -= n;
+    }
+    size_t sent = l->queued;
+    l->tx_head = 0;
+    l->queued = 0;
+    return sent;
+}
+
+/* Encode a frame into the TX queue of a line
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param slip_line *l     -- Line of the socket
+ * @param const void *data -- Pointer to frame
+ * @param size_t len       -- Size of the frame
+ * @return amount of bytes queued on success or -1 on error.
+ *         set errno on error, ENOBUFS if the queue is full.
+ */
+static size_t slip_line_send(net_socket *sock, slip_line *l, const void *data, size_t len) {
+    size_t need = SLIP_ENCODED_MAX(len);
+
+    if ((l->tx_head + l->tx_len + need) > l->tx_size) {
+        if (slip_line_flush(sock, l) == (size_t)-1) {
+            return -1;
+        }
+        memmove(l->tx, l->tx + l->tx_head, l->tx_len);
+        l->tx_head = 0;
+        if ((l->tx_len + need) > l->tx_size) {
+            errno = ENOBUFS;
+            return -1;
+        }
+    }
+    uint8_t *p = l->tx + l->tx_head + l->tx_len;
+    size_t n = 0;
+    // Queued frames already end with END, which serves as our leading one
+    if (!l->tx_len) {
+        p[n++] = SLIP_FRAME_END;
+    }
+    n += slip_escape(p + n, data, len);
+    p[n++] = SLIP_FRAME_END;
+    l->tx_len += n;
+    l->queued++;
+    return len;
+}
+
+/* Receive next frame from a line
+ *
+ * @param net_socket *sock -- Pointer to socket
+ * @param slip_line *l     -- Line of the socket
+ * @param void *data       -- Pointer to buffer to receive frame into
+ * @param size_t len       -- Size of the buffer, longer frames are truncated
+ * @param int wait         -- Wait up to the receive timeout if nothing's there
+ * @return amount of bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if no frame is complete yet.
+ */
+static size_t slip_line_recv(net_socket *sock, slip_line *l, void *data, size_t len,
+        int wait)
+{
+    for (;;) {
+        while (l->rx_pos < l->rx_len) {
+            uint64_t errors = l->dec.errors;
+            size_t frame_len;
+            l->rx_pos += slip_decode(&l->dec, l->rx + l->rx_pos, l->rx_len - l->rx_pos,
+                    &frame_len);
+            if (l->dec.errors != errors) {
+                NETLIB_STAT_ADD(sock->ctx, slip_rx_errors, l->dec.errors - errors);
+                link_slip_rx_error(sock);
+            }
+            if (frame_len != (size_t)-1) {
+                frame_len = (frame_len < len) ? frame_len : len;
+                memcpy(data, l->dec.frame, frame_len);
+                return frame_len;
+            }
+        }
+
+        ssize_t n = read(sock->raw_sockfd, l->rx, sizeof(l->rx));
+        if (n > 0) {
+            l->rx_pos = 0;
+            l->rx_len = n;
+            continue;
+        }
+        if (n == 0) {
+            // Other end hung up
+            errno = ENOTCONN;
+            return -1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN || !wait || !l->timeout_us) {
+            return -1;
+        }
+        struct pollfd pfd = { .fd = sock->raw_sockfd, .events = POLLIN };
+        struct timespec ts = {
+            .tv_sec = l->timeout_us / 1000000,
+            .tv_nsec = (l->timeout_us % 1000000) * 1000
+        };
+        int ret = ppoll(&pfd, 1, &ts, 0);
+        if (ret == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (ret == -1 && errno != EINTR) {
+            return -1;
+        }
+        // Only wait once, a partial frame shouldn't hold us up any longer
+        wait = 0;
+    }
+}
+
+/* Make socket part of a fanout group, so that received frames are spread
+ * between all sockets in the group instead of each getting a copy.
+ *
+ * @param net_socket *sock -- Pointer to socket to add
+ * @param uint16_t *group  -- Pointer to group id. If it's 0, a new group with
+ *                            unique id is created and its id written back.
+ * @param int mode         -- Refer to enum FANOUT_MODE
+ * @param int prog_fd      -- eBPF program selecting the socket with FANOUT_EBPF,
+ *                            ignored otherwise
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_join_fanout(net_socket *sock, uint16_t *group, int mode, int prog_fd) {
+    static const int modes[] = {
+        // Keep fragments of one datagram together, or flows would split
+        [FANOUT_HASH] = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG,
+        [FANOUT_CPU]  = PACKET_FANOUT_CPU,
+        [FANOUT_QM]   = PACKET_FANOUT_QM,
+        [FANOUT_EBPF] = PACKET_FANOUT_EBPF
+    };
+
+    if (mode < FANOUT_HASH || mode > FANOUT_EBPF || sock->shared_fd) {
+        errno = EINVAL;
+        return -1;
+    }
+    int type = modes[mode];
+    if (!*group) {
+        type |= PACKET_FANOUT_FLAG_UNIQUEID;
+    }
+
+    int arg = *group | (type << 16);
+    if (setsockopt(sock->raw_sockfd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) == -1) {
+        return -1;
+    }
+    if (!*group) {
+        socklen_t alen = sizeof(arg);
+        if (getsockopt(sock->raw_sockfd, SOL_PACKET, PACKET_FANOUT, &arg, &alen) == -1) {
+            return -1;
+        }
+        *group = arg & 0xffff;
+    }
+    if (mode == FANOUT_EBPF) {
+        return setsockopt(sock->raw_sockfd, SOL_PACKET, PACKET_FANOUT_DATA,
+                &prog_fd, sizeof(prog_fd));
+    }
+    return 0;
+}
+
+/* Regenerate and attach the receive filter after bindings or addresses
+ * of the socket have changed. If the filter can't be generated, we fall
+ * back to receiving everything rather than nothing.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_update_filter(net_socket *sock) {
+    link_options *link = (link_options *)sock->link_options;
+    filter_insn prog[FILTER_MAX_INSNS];
+
+    // Offsets in the filter assume ethernet framing
+    if (link->type != ETH || sock->raw_sockfd == -1 || sock->shared_fd) {
+        return 0;
+    }
+    int len = filter_build(sock, prog);
+    if (len == -1) {
+        int err = errno;
+        setsockopt(sock->raw_sockfd, SOL_SOCKET, SO_DETACH_FILTER, 0, 0);
+        errno = err;
+        return -1;
+    }
+
+    struct sock_fprog fprog = { .len = len, .filter = (struct sock_filter *)prog };
+    return setsockopt(sock->raw_sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+}
+
+/* Set how long receive() waits for a frame before failing with EAGAIN
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param unsigned usec    -- Timeout in microseconds, 0 to never wait
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_rx_timeout(net_socket *sock, unsigned usec) {
+    slip_line *l = (slip_line *)((link_options *)sock->link_options)->slip_line;
+
+    if (l) {
+        // Line stays non-blocking, receive() does the waiting
+        l->timeout_us = usec;
+        return 0;
+    }
+    if (sock->shared_fd) {
+        // Would apply to every socket sharing the raw socket
+        errno = EINVAL;
+        return -1;
+    }
+    int flags = fcntl(sock->raw_sockfd, F_GETFL);
+    if (flags == -1) {
+        return -1;
+    }
+    if (!usec) {
+        return fcntl(sock->raw_sockfd, F_SETFL, flags | O_NONBLOCK);
+    }
+    if (fcntl(sock->raw_sockfd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = usec / 1000000, .tv_usec = usec % 1000000 };
+    return setsockopt(sock->raw_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+/* Queue transmitted frames on the socket instead of sending each one
+ * right away. Queue gets sent in one go by transmit_flush(), or when it
+ * fills up.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param unsigned len     -- Amount of frames the queue holds
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_set_tx_queue(net_socket *sock, unsigned len) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (!len || sock->tx_queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    int ifindex = if_nametoindex(sock->iface);
+    if (!ifindex) {
+        return -1;
+    }
+
+    tx_queue *q = netlib_ctx_alloc(sizeof(tx_queue));
+    if (!q) {
+        return -1;
+    }
+    q->len = len;
+    q->slot = (link->mtu + sizeof(eth_hdr) + NETLIB_CACHELINE - 1) &
+        ~(size_t)(NETLIB_CACHELINE - 1);
+    q->mem = sizeof(tx_queue) + len * (sizeof(struct mmsghdr) + sizeof(struct iovec) + q->slot);
+    if (socket_mem_charge(sock, q->mem) == -1) {
+        free(q);
+        return -1;
+    }
+    q->msgs = netlib_ctx_alloc(len * sizeof(struct mmsghdr));
+    q->iov = netlib_ctx_alloc(len * sizeof(struct iovec));
+    q->frames = netlib_ctx_alloc(len * q->slot);
+    if (!q->msgs || !q->iov || !q->frames) {
+        socket_mem_uncharge(sock, q->mem);
+        free(q->msgs);
+        free(q->iov);
+        free(q->frames);
+        free(q);
+        return -1;
+    }
+
+    memcpy(q->addr.sll_addr, link->proto.eth_header->mac_src, 6);
+    q->addr.sll_family   = AF_PACKET;
+    q->addr.sll_protocol = htons(ETH_P_ALL);
+    q->addr.sll_ifindex  = ifindex;
+    q->addr.sll_hatype   = 1;
+    q->addr.sll_pkttype  = PACKET_OTHERHOST;
+    q->addr.sll_halen    = ETH_ALEN;
+
+    for (unsigned i = 0; i < len; i++) {
+        q->iov[i].iov_base = q->frames + (i * q->slot);
+        q->msgs[i].msg_hdr.msg_iov = &q->iov[i];
+        q->msgs[i].msg_hdr.msg_iovlen = 1;
+        q->msgs[i].msg_hdr.msg_name = &q->addr;
+        q->msgs[i].msg_hdr.msg_namelen = sizeof(q->addr);
+    }
+    sock->tx_queue = q;
+    return 0;
+}
+
+/* Run the SLIP link of this socket over a file descriptor.
+ *
+ * @param net_socket *sock -- Pointer to socket with a SLIP link
+ * @param int fd           -- File descriptor of the line
+ * @param unsigned baud    -- Line speed in bits per second, 0 to leave as is
+ * @param unsigned len     -- Amount of full sized frames the queue holds
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_set_slip_fd(net_socket *sock, int fd, unsigned baud, unsigned len) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (link->type != SLIP || link->slip_line || fd == -1 || !len) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (slip_tty_setup(fd, baud) == -1) {
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return -1;
+    }
+
+    slip_line *l = netlib_ctx_alloc(sizeof(slip_line));
+    if (!l) {
+        return -1;
+    }
+    l->timeout_us = 100000;
+    l->tx_size = len * SLIP_ENCODED_MAX(link->mtu);
+    l->mem = sizeof(slip_line) + l->tx_size + link->mtu;
+    if (socket_mem_charge(sock, l->mem) == -1) {
+        free(l);
+        return -1;
+    }
+    l->tx = netlib_ctx_alloc(l->tx_size);
+    uint8_t *frame = netlib_ctx_alloc(link->mtu);
+    if (!l->tx || !frame) {
+        socket_mem_uncharge(sock, l->mem);
+        free(l->tx);
+        free(frame);
+        free(l);
+        return -1;
+    }
+    slip_decoder_init(&l->dec, frame, link->mtu);
+
+    if (sock->raw_sockfd != -1) {
+        close(sock->raw_sockfd);
+    }
+    sock->raw_sockfd = fd;
+    link->slip_line = l;
+    return 0;
+}
+
+/* Send all frames queued on the socket. Frames the kernel refuses are
+ * dropped, same as a failed transmit() would drop them.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return amount of frames sent on success or -1 on error.
+ *         set errno on error.
+ */
+size_t transmit_flush(net_socket *sock) {
+    tx_queue *q = (tx_queue *)sock->tx_queue;
+    slip_line *l = (slip_line *)((link_options *)sock->link_options)->slip_line;
+    unsigned sent = 0;
+
+    if (l) {
+        return slip_line_flush(sock, l);
+    }
+    if (!q) {
+        return 0;
+    }
+    while (sent < q->count) {
+        int ret = sendmmsg(sock->raw_sockfd, &q->msgs[sent], q->count - sent, 0);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            q->count = 0;
+            return -1;
+        }
+        sent += ret;
+    }
+    q->count = 0;
+    return sent;
+}
+
+/* Set socket up for receiving frames in batches with receive_batch().
+ *
+ * @param net_socket *sock    -- Pointer to socket we're working with
+ * @param unsigned max_batch  -- Largest amount of frames per batch
+ * @param unsigned budget_us  -- How long a batch may wait for more frames
+ *                               once traffic is heavy, 0 to never wait
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_rx_batch(net_socket *sock, unsigned max_batch, unsigned budget_us) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (!max_batch || max_batch > UIO_MAXIOV || sock->rx_batch || sock->shared_fd) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rx_batch *b = netlib_ctx_alloc(sizeof(rx_batch));
+    if (!b) {
+        return -1;
+    }
+    b->max = max_batch;
+    b->batch = 1;
+    b->budget_ns = (uint64_t)budget_us * 1000;
+    // Room for a VLAN tag on top of a full sized frame
+    b->slot = (link->mtu + sizeof(eth_hdr) + 4 + NETLIB_CACHELINE - 1) &
+        ~(size_t)(NETLIB_CACHELINE - 1);
+    b->mem = sizeof(rx_batch) + max_batch * (sizeof(struct mmsghdr) + sizeof(struct iovec) + b->slot);
+    if (socket_mem_charge(sock, b->mem) == -1) {
+        free(b);
+        return -1;
+    }
+    b->msgs = netlib_ctx_alloc(max_batch * sizeof(struct mmsghdr));
+    b->iov = netlib_ctx_alloc(max_batch * sizeof(struct iovec));
+    b->frames = netlib_ctx_alloc(max_batch * b->slot);
+    if (!b->msgs || !b->iov || !b->frames) {
+        socket_mem_uncharge(sock, b->mem);
+        free(b->msgs);
+        free(b->iov);
+        free(b->frames);
+        free(b);
+        return -1;
+    }
+    for (unsigned i = 0; i < max_batch; i++) {
+        b->iov[i].iov_base = b->frames + (i * b->slot);
+        b->iov[i].iov_len = b->slot;
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    sock->rx_batch = b;
+    return 0;
+}
+
+/* Receive a batch of frames.
+ *
+ * Batch size follows the load: a full batch doubles it, a batch that
+ * comes back at most half full halves it. At size 1 we do plain single
+ * reads, and go back to batching once a read finds a frame already
+ * waiting. recvmmsg() only ever blocks for the first frame, so at low
+ * rates nothing gets delayed. Only when batches are being used anyway do
+ * we keep polling for up to budget_ns to fill one up.
+ *
+ * @param net_socket *sock -- Pointer to socket set up with socket_set_rx_batch()
+ * @param rx_frame *frames -- Array receiving the frames, valid until next call
+ * @param unsigned max     -- Size of frames array
+ * @return amount of frames received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout.
+ */
+size_t receive_batch(net_socket *sock, rx_frame *frames, unsigned max) {
+    rx_batch *b = (rx_batch *)sock->rx_batch;
+    slip_line *l = (slip_line *)((link_options *)sock->link_options)->slip_line;
+
+    if (!b || !max) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (l) {
+        // Only the first frame is waited for, the rest is whatever has arrived
+        unsigned n = 0;
+        while (n < max && n < b->max) {
+            size_t len = slip_line_recv(sock, l, b->iov[n].iov_base, b->slot, !n);
+            if (len == (size_t)-1) {
+                break;
+            }
+            frames[n].data = b->iov[n].iov_base;
+            frames[n].len = len;
+            n++;
+        }
+        return n ? n : (size_t)-1;
+    }
+    unsigned want = (b->batch < max) ? b->batch : max;
+    unsigned n;
+
+    if (want == 1) {
+        uint64_t start = monotonic_ns();
+        ssize_t len = recv(sock->raw_sockfd, b->iov[0].iov_base, b->slot, 0);
+        if (len == -1) {
+            return -1;
+        }
+        b->msgs[0].msg_len = len;
+        n = 1;
+        if ((monotonic_ns() - start) < RX_BATCH_QUEUED_NS && b->max > 1) {
+            b->batch = 2;
+        }
+    } else {
+        int ret = recvmmsg(sock->raw_sockfd, b->msgs, want, MSG_WAITFORONE, 0);
+        if (ret == -1) {
+            return -1;
+        }
+        n = ret;
+        if (n < want && b->budget_ns) {
+            uint64_t deadline = monotonic_ns() + b->budget_ns;
+            do {
+                ret = recvmmsg(sock->raw_sockfd, &b->msgs[n], want - n, MSG_DONTWAIT, 0);
+                if (ret > 0) {
+                    n += ret;
+                }
+            } while (n < want && monotonic_ns() < deadline);
+        }
+
+        if (n == want && want < b->max) {
+            b->batch = ((want * 2) < b->max) ? (want * 2) : b->max;
+        } else if ((n * 2) <= want) {
+            b->batch = want / 2;
+        }
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        frames[i].data = b->iov[i].iov_base;
+        frames[i].len = b->msgs[i].msg_len;
+    }
+    return n;
+}
+
+/* Prepare raw socket from raw_socket() for sharing between sockets
+ *
+ * @param int fd -- Raw socket
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int raw_socket_share(int fd) {
+    // Replaces the drop-all filter raw_socket() put in place
+    struct sock_filter accept = { FILTER_RET_K, 0, 0, FILTER_ACCEPT };
+    struct sock_fprog fprog = { .len = 1, .filter = &accept };
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+}
+
+/* Receive a single frame from a raw socket shared between sockets
+ *
+ * @param int fd     -- Raw socket prepared with raw_socket_share()
+ * @param void *data -- Pointer to buffer to receive frame into
+ * @param size_t len -- Size of the buffer
+ * @return amount of bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout.
+ */
+size_t raw_socket_receive(int fd, void *data, size_t len) {
+    return recv(fd, data, len, 0);
+}
+
+/* Release platform resources of a socket, called by close_socket()
+ *
+ * @param net_socket *sock -- Pointer to socket being closed
+ */
+void raw_socket_close(net_socket *sock) {
+    tx_queue *q = (tx_queue *)sock->tx_queue;
+
+    if (q) {
+        socket_mem_uncharge(sock, q->mem);
+        free(q->msgs);
+        free(q->iov);
+        free(q->frames);
+        free(q);
+        sock->tx_queue = 0;
+    }
+    rx_batch *b = (rx_batch *)sock->rx_batch;
+    if (b) {
+        socket_mem_uncharge(sock, b->mem);
+        free(b->msgs);
+        free(b->iov);
+        free(b->frames);
+        free(b);
+        sock->rx_batch = 0;
+    }
+    link_options *link = (link_options *)sock->link_options;
+    slip_line *l = (slip_line *)link->slip_line;
+    if (l) {
+        socket_mem_uncharge(sock, l->mem);
+        free(l->dec.frame);
+        free(l->tx);
+        free(l);
+        link->slip_line = 0;
+    }
+    // Shared ones are closed by their last user
+    if (!sock->shared_fd) {
+        close(sock->raw_sockfd);
+    }
+}
+
 /* Send up to size_t bytes of data
  *
  * @param net_socket *sock -- Pointer to socket we're working with
@@ -43,19 +801,296 @@ int raw_socket(const char *iface) {
  *         set errno on error.
  */
 size_t transmit(net_socket *sock, const void *data, size_t len) {
+    size_t ret;
+
+    TRACE_POINT(sock, TRACE_TRANSMIT);
+    if (sock->txsched) {
+        ret = txsched_enqueue(sock, data, len);
+    } else if (sock->pacer) {
+        ret = pacer_enqueue(sock, data, len);
+    } else {
+        ret = transmit_at(sock, data, len, 0);
+    }
+    TRACE_POINT(sock, TRACE_RETURN);
+    return ret;
+}
+
+/* Send a frame without going through the pacer, optionally at given time.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param const void *data -- Pointer to data to transmit
+ * @param size_t len       -- Amount of bytes to send
+ * @param uint64_t txtime  -- Monotonic time in nanoseconds the kernel should
+ *                            send the frame at, 0 to send as usual
+ * @return amount of bytes written on success or -1 on error.
+ *         set errno on error.
+ */
+size_t transmit_at(net_socket *sock, const void *data, size_t len, uint64_t txtime) {
     struct sockaddr_ll saddr;
     link_options *link = (link_options *)sock->link_options;
+    tx_queue *q = (tx_queue *)sock->tx_queue;
 
-    memcpy(saddr.sll_addr, link->proto.eth_header->mac_src, 6);
-    saddr.sll_family   = AF_PACKET;
-    saddr.sll_protocol = htons(ETH_P_ALL);
-    saddr.sll_ifindex  = if_nametoindex(sock->iface);
-    saddr.sll_hatype   = 1;
-    saddr.sll_pkttype  = PACKET_OTHERHOST;
-    saddr.sll_halen    = ETH_ALEN;
+    if (link->slip_line) {
+        // A serial line has no departure times, frames just go in order
+        return slip_line_send(sock, (slip_line *)link->slip_line, data, len);
+    }
+    TRACE_KERNEL(sock);
+    if (q && !txtime && len <= q->slot) {
+        memcpy(q->iov[q->count].iov_base, data, len);
+        q->iov[q->count].iov_len = len;
+        if (++q->count == q->len) {
+            transmit_flush(sock);
+        }
+        return len;
+    }
+    if (q) {
+        // Oversized or timed frame, keep ordering by sending what came before it
+        transmit_flush(sock);
+        saddr = q->addr;
+    } else {
+        memcpy(saddr.sll_addr, link->proto.eth_header->mac_src, 6);
+        saddr.sll_family   = AF_PACKET;
+        saddr.sll_protocol = htons(ETH_P_ALL);
+        saddr.sll_ifindex  = if_nametoindex(sock->iface);
+        saddr.sll_hatype   = 1;
+        saddr.sll_pkttype  = PACKET_OTHERHOST;
+        saddr.sll_halen    = ETH_ALEN;
+    }
+
+    if (!txtime) {
+        return sendto(sock->raw_sockfd, data, len, 0,
+                (const struct sockaddr *)&saddr, sizeof(struct sockaddr_ll));
+    }
+
+#ifdef SCM_TXTIME
+    union {
+        char buf[CMSG_SPACE(sizeof(uint64_t))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &saddr;
+    msg.msg_namelen = sizeof(struct sockaddr_ll);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cmsg), &txtime, sizeof(uint64_t));
+    return sendmsg(sock->raw_sockfd, &msg, 0);
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+/* Let the kernel hold frames until their departure time with SO_TXTIME.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_txtime(net_socket *sock) {
+#ifdef SO_TXTIME
+    struct sock_txtime cfg = { .clockid = CLOCK_MONOTONIC, .flags = 0 };
+
+    if (sock->shared_fd) {
+        // Would apply to every socket sharing the raw socket
+        errno = EINVAL;
+        return -1;
+    }
+    return setsockopt(sock->raw_sockfd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg));
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+/* Send a frame gathered from several buffers.
+ *
+ * @param net_socket *sock        -- Pointer to socket we're working with
+ * @param const struct iovec *iov -- Pieces of the frame, link header first
+ * @param int iovcnt              -- Amount of entries in iov
+ * @return amount of bytes written on success or -1 on error.
+ *         set errno on error.
+ */
+size_t transmitv(net_socket *sock, const struct iovec *iov, int iovcnt) {
+    struct sockaddr_ll saddr;
+    struct msghdr msg;
+    link_options *link = (link_options *)sock->link_options;
+    tx_queue *q = (tx_queue *)sock->tx_queue;
+
+    TRACE_POINT(sock, TRACE_TRANSMIT);
+    if (sock->txsched || sock->pacer) {
+        // Frame may have to wait, so it needs to be in one piece
+        size_t len;
+        void *frame = iov_gather(iov, iovcnt, &len);
+        if (!frame) {
+            return -1;
+        }
+        size_t ret = transmit(sock, frame, len);
+        free(frame);
+        return ret;
+    }
+    if (q) {
+        transmit_flush(sock);
+        saddr = q->addr;
+    } else {
+        memcpy(saddr.sll_addr, link->proto.eth_header->mac_src, 6);
+        saddr.sll_family   = AF_PACKET;
+        saddr.sll_protocol = htons(ETH_P_ALL);
+        saddr.sll_ifindex  = if_nametoindex(sock->iface);
+        saddr.sll_hatype   = 1;
+        saddr.sll_pkttype  = PACKET_OTHERHOST;
+        saddr.sll_halen    = ETH_ALEN;
+    }
+
+    TRACE_KERNEL(sock);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &saddr;
+    msg.msg_namelen = sizeof(struct sockaddr_ll);
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = iovcnt;
+    size_t ret = sendmsg(sock->raw_sockfd, &msg, 0);
+    TRACE_POINT(sock, TRACE_RETURN);
+    return ret;
+}
+
+/* Receive a single frame from the link this socket is bound to
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param void *data       -- Pointer to buffer to receive frame into
+ * @param size_t len       -- Size of the buffer
+ * @return amount of bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout,
+ *         EINVAL if raw socket is shared, see socket_open().
+ */
+size_t receive(net_socket *sock, void *data, size_t len) {
+    slip_line *l = (slip_line *)((link_options *)sock->link_options)->slip_line;
 
-    return sendto(sock->raw_sockfd, data, len, 0, 
-            (const struct sockaddr *)&saddr, sizeof(struct sockaddr_ll));
+    if (l) {
+        return slip_line_recv(sock, l, data, len, 1);
+    }
+    if (sock->shared_fd) {
+        // Frames of a shared raw socket are read with socket_slab_rx()
+        errno = EINVAL;
+        return -1;
+    }
+    return recv(sock->raw_sockfd, data, len, 0);
 }
 
+/* Have the kernel report transmit timestamps on the error queue of the
+ * socket. Timestamps carry the id of the frame rather than the frame
+ * itself, ids count every frame sent on the socket from 0.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param int hw           -- Enable hardware timestamps as well
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EINVAL if raw socket is shared, see socket_open().
+ */
+int socket_set_tx_timestamps(net_socket *sock, int hw) {
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_SCHED |
+        SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+        SOF_TIMESTAMPING_OPT_TSONLY;
 
+    // Frame ids count frames of every socket sharing the raw socket
+    if (sock->shared_fd) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (hw) {
+        // Setting is per NIC and left as is afterwards, others may rely on it
+        struct hwtstamp_config cfg = {
+            .flags = 0,
+            .tx_type = HWTSTAMP_TX_ON,
+            .rx_filter = HWTSTAMP_FILTER_NONE
+        };
+        struct ifreq ifr;
+
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, sock->iface, sizeof(ifr.ifr_name) - 1);
+        ifr.ifr_data = (void *)&cfg;
+        if (ioctl(sock->raw_sockfd, SIOCSHWTSTAMP, &ifr) == -1) {
+            return -1;
+        }
+        flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+    return setsockopt(sock->raw_sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+/* Stop reporting transmit timestamps, and throw away unread ones
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ */
+void socket_clear_tx_timestamps(net_socket *sock) {
+    tx_timestamp ts;
+    int flags = 0;
+
+    // Never enabled on shared ones, and the error queue isn't ours alone
+    if (sock->shared_fd) {
+        return;
+    }
+    setsockopt(sock->raw_sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    while (receive_tx_timestamp(sock, &ts) == 0);
+}
+
+/* Read a transmit timestamp from the error queue of the socket. Anything
+ * else found there is skipped.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param tx_timestamp *ts -- Where to store the timestamp
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, EAGAIN if there are no timestamps waiting.
+ */
+int receive_tx_timestamp(net_socket *sock, tx_timestamp *ts) {
+    union {
+        char buf[CMSG_SPACE(sizeof(struct scm_timestamping)) +
+            CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_ll))];
+        struct cmsghdr align;
+    } control;
+    uint8_t junk[64];
+    struct iovec iov = { .iov_base = junk, .iov_len = sizeof(junk) };
+    struct msghdr msg;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        if (recvmsg(sock->raw_sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            return -1;
+        }
+
+        const struct scm_timestamping *tss = 0;
+        const struct sock_extended_err *ee = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                tss = (const struct scm_timestamping *)CMSG_DATA(cmsg);
+            } else if (cmsg->cmsg_level == SOL_PACKET && cmsg->cmsg_type == PACKET_TX_TIMESTAMP) {
+                ee = (const struct sock_extended_err *)CMSG_DATA(cmsg);
+            }
+        }
+        if (!tss || !ee || ee->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+            continue;
+        }
+
+        // Software timestamps go in the first slot, hardware ones in the last
+        const struct timespec *t = &tss->ts[0];
+        ts->type = (ee->ee_info == SCM_TSTAMP_SCHED) ? TX_TSTAMP_SCHED : TX_TSTAMP_SND;
+        if (tss->ts[2].tv_sec || tss->ts[2].tv_nsec) {
+            t = &tss->ts[2];
+            ts->type = TX_TSTAMP_HW;
+        }
+        ts->id = ee->ee_data;
+        ts->ns = ((uint64_t)t->tv_sec * 1000000000ull) + t->tv_nsec;
+        return 0;
+    }
+}
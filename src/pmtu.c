@@ -0,0 +1,210 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Path MTU discovery, per-destination PMTU cache */
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <pmtu.h>
+
+#define PMTU_CACHE_BITS 10
+#define PMTU_CACHE_SIZE (1 << PMTU_CACHE_BITS)
+
+// How many slots we look at before evicting
+#define PMTU_PROBE_LEN 8
+
+/* Single cached path MTU estimate
+ *
+ * @member uint32_t dst     -- Destination address
+ * @member uint16_t mtu     -- Path MTU estimate, 0 if slot is unused
+ * @member uint64_t expires -- Monotonic time at which this estimate ages out
+ */
+typedef struct {
+    uint32_t dst;
+    uint16_t mtu;
+    uint64_t expires;
+} pmtu_entry;
+
+/* Path MTU cache of one stack instance
+ *
+ * @member pmtu_entry cache   -- Open addressed table of estimates
+ * @member uint64_t timeout   -- How long estimates are kept, in nanoseconds
+ */
+struct pmtu_state {
+    pmtu_entry cache[PMTU_CACHE_SIZE];
+    uint64_t timeout;
+};
+
+// MTU plateaus from RFC 1191 section 7
+static const uint16_t pmtu_plateaus[] = {
+    32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, PMTU_MIN
+};
+
+/* Find cache entry for given destination
+ *
+ * @param struct pmtu_state *pm -- Cache to look in
+ * @param uint32_t dst           -- Destination address
+ * @param uint64_t now           -- Current monotonic time
+ * @return pointer to live entry or 0 if there's none
+ */
+static pmtu_entry *pmtu_find(struct pmtu_state *pm, uint32_t dst, uint64_t now) {
+    uint32_t idx = addr_hash(dst, PMTU_CACHE_BITS);
+
+    for (int i = 0; i < PMTU_PROBE_LEN; i++) {
+        pmtu_entry *e = &pm->cache[(idx + i) % PMTU_CACHE_SIZE];
+        if (!e->mtu || e->dst != dst) {
+            continue;
+        }
+        if (e->expires <= now) {
+            e->mtu = 0;
+            return 0;
+        }
+        return e;
+    }
+    return 0;
+}
+
+/* Look up path MTU towards given destination
+ *
+ * @param netlib_ctx *ctx  -- Stack instance owning the cache
+ * @param uint32_t dst      -- Destination address
+ * @param uint16_t link_mtu -- MTU of the link we'd send over
+ * @return uint16_t path MTU estimate, never larger than link_mtu
+ */
+uint16_t pmtu_get(netlib_ctx *ctx, uint32_t dst, uint16_t link_mtu) {
+    pmtu_entry *e = pmtu_find(ctx->pmtu, dst, monotonic_ns());
+
+    if (e && e->mtu < link_mtu) {
+        return e->mtu;
+    }
+    return link_mtu;
+}
+
+/* Record new path MTU estimate for given destination.
+ *
+ * @param netlib_ctx *ctx -- Stack instance owning the cache
+ * @param uint32_t dst    -- Destination address
+ * @param uint16_t mtu    -- Next-hop MTU reported by a router
+ */
+void pmtu_update(netlib_ctx *ctx, uint32_t dst, uint16_t mtu) {
+    struct pmtu_state *pm = ctx->pmtu;
+    uint64_t now = monotonic_ns();
+    pmtu_entry *e = pmtu_find(pm, dst, now);
+
+    if (mtu < PMTU_MIN) {
+        mtu = PMTU_MIN;
+    }
+    if (e) {
+        if (mtu < e->mtu) {
+            e->mtu = mtu;
+            e->expires = now + pm->timeout;
+        }
+        return;
+    }
+
+    // Take first free slot, or evict the one closest to aging out
+    uint32_t idx = addr_hash(dst, PMTU_CACHE_BITS);
+    e = &pm->cache[idx];
+    for (int i = 0; i < PMTU_PROBE_LEN; i++) {
+        pmtu_entry *cand = &pm->cache[(idx + i) % PMTU_CACHE_SIZE];
+        if (!cand->mtu || cand->expires <= now) {
+            e = cand;
+            break;
+        }
+        if (cand->expires < e->expires) {
+            e = cand;
+        }
+    }
+    e->dst = dst;
+    e->mtu = mtu;
+    e->expires = now + pm->timeout;
+}
+
+/* Guess path MTU for routers that don't report next-hop MTU.
+ *
+ * @param uint16_t len -- Total length of the datagram that didn't fit
+ * @return uint16_t estimated path MTU
+ */
+uint16_t pmtu_plateau(uint16_t len) {
+    for (size_t i = 0; i < sizeof(pmtu_plateaus) / sizeof(pmtu_plateaus[0]); i++) {
+        if (pmtu_plateaus[i] < len) {
+            return pmtu_plateaus[i];
+        }
+    }
+    return PMTU_MIN;
+}
+
+/* Set how long path MTU estimates are kept
+ *
+ * @param netlib_ctx *ctx     -- Stack instance owning the cache
+ * @param uint64_t timeout_ns -- Lifetime of an estimate in nanoseconds
+ */
+void pmtu_set_timeout(netlib_ctx *ctx, uint64_t timeout_ns) {
+    ctx->pmtu->timeout = timeout_ns;
+}
+
+/* Drop all cached estimates
+ *
+ * @param netlib_ctx *ctx -- Stack instance owning the cache
+ */
+void pmtu_flush(netlib_ctx *ctx) {
+    memset(ctx->pmtu->cache, 0, sizeof(ctx->pmtu->cache));
+}
+
+/* Initialise path MTU cache of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int pmtu_initialise(netlib_ctx *ctx) {
+    ctx->pmtu = netlib_ctx_alloc(sizeof(struct pmtu_state));
+    if (!ctx->pmtu) {
+        return -1;
+    }
+    ctx->pmtu->timeout = PMTU_DEFAULT_TIMEOUT_NS;
+    return 0;
+}
+
+/* Finalise path MTU cache of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void pmtu_finalise(netlib_ctx *ctx) {
+    free(ctx->pmtu);
+    ctx->pmtu = 0;
+}
@@ -0,0 +1,143 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Lock-free rings for handing packets between threads */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <ctx.h>
+#include <ring.h>
+
+/* Round ring length up to a power of two and slot size up to whole
+ * cache lines, so that neighboring slots written by different threads
+ * never share a line.
+ *
+ * @param size_t *len   -- Pointer to requested amount of slots, rounded in place
+ * @param size_t bytes  -- Bytes needed per slot
+ * @return size_t slot stride in bytes, or 0 if the request makes no sense
+ */
+static size_t ring_geometry(size_t *len, size_t bytes) {
+    size_t n = 1;
+
+    if (!*len || *len > ((size_t)1 << 30)) {
+        return 0;
+    }
+    while (n < *len) {
+        n <<= 1;
+    }
+    *len = n;
+    return (bytes + NETLIB_CACHELINE - 1) & ~(size_t)(NETLIB_CACHELINE - 1);
+}
+
+/* Create MPSC ring
+ *
+ * @param size_t len       -- Amount of slots, rounded up to a power of two
+ * @param size_t elem_size -- Bytes per element
+ * @return pointer to ring on success or 0 on error.
+ *         Set errno on error.
+ */
+mpsc_ring *mpsc_ring_create(size_t len, size_t elem_size) {
+    size_t stride = ring_geometry(&len, RING_SLOT_HDR + elem_size);
+    if (!stride) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    mpsc_ring *r = netlib_ctx_alloc(sizeof(mpsc_ring));
+    if (!r) {
+        return 0;
+    }
+    r->slots = netlib_ctx_alloc(len * stride);
+    if (!r->slots) {
+        free(r);
+        return 0;
+    }
+    r->mask = len - 1;
+    r->stride = stride;
+    r->elem_size = elem_size;
+
+    // Slot i is free for whoever claims position i
+    for (size_t i = 0; i < len; i++) {
+        atomic_init(mpsc_seq(r, i), i);
+    }
+    return r;
+}
+
+/* Destroy MPSC ring
+ *
+ * @param mpsc_ring *r -- Ring to destroy
+ */
+void mpsc_ring_destroy(mpsc_ring *r) {
+    free(r->slots);
+    free(r);
+}
+
+/* Create SPSC ring
+ *
+ * @param size_t len       -- Amount of slots, rounded up to a power of two
+ * @param size_t elem_size -- Bytes per element
+ * @return pointer to ring on success or 0 on error.
+ *         Set errno on error.
+ */
+spsc_ring *spsc_ring_create(size_t len, size_t elem_size) {
+    size_t stride = ring_geometry(&len, elem_size);
+    if (!stride) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    spsc_ring *r = netlib_ctx_alloc(sizeof(spsc_ring));
+    if (!r) {
+        return 0;
+    }
+    r->slots = netlib_ctx_alloc(len * stride);
+    if (!r->slots) {
+        free(r);
+        return 0;
+    }
+    r->mask = len - 1;
+    r->stride = stride;
+    r->elem_size = elem_size;
+    return r;
+}
+
+/* Destroy SPSC ring
+ *
+ * @param spsc_ring *r -- Ring to destroy
+ */
+void spsc_ring_destroy(spsc_ring *r) {
+    free(r->slots);
+    free(r);
+}
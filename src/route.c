@@ -0,0 +1,406 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* IPv4 routing table, longest prefix match using DIR-24-8 */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <data_util.h>
+#include <route.h>
+
+/* Netmask for given prefix length, host byte order
+ *
+ * @param uint8_t depth -- Prefix length, 0..32
+ * @return uint32_t netmask
+ */
+static inline uint32_t route_mask(uint8_t depth) {
+    return depth ? (0xffffffffU << (32 - depth)) : 0;
+}
+
+/* Build table entry pointing to a next hop
+ *
+ * @param uint8_t depth -- Length of prefix the entry was expanded from
+ * @param uint32_t idx  -- Index of next hop
+ * @return uint32_t table entry
+ */
+static inline uint32_t route_entry(uint8_t depth, uint32_t idx) {
+    return ROUTE_VALID | ((uint32_t)depth << 24) | idx;
+}
+
+/* Find prefix from rules
+ *
+ * @param route_rules *r -- Pointer to rules of one depth
+ * @param uint32_t key   -- Prefix, host byte order
+ * @return pointer to slot value or 0 if prefix isn't there
+ */
+static uint32_t *rules_find(route_rules *r, uint32_t key) {
+    if (!r->size) {
+        return 0;
+    }
+    uint32_t bits = __builtin_ctz(r->size);
+    for (uint32_t i = addr_hash(key, bits); r->vals[i]; i = (i + 1) & (r->size - 1)) {
+        if (r->keys[i] == key) {
+            return &r->vals[i];
+        }
+    }
+    return 0;
+}
+
+/* Grow rules to given size, rehashing existing prefixes
+ *
+ * @param route_rules *r -- Pointer to rules of one depth
+ * @param uint32_t size  -- New amount of slots, power of two
+ * @return int 0 on success or -1 on error.
+ */
+static int rules_grow(route_rules *r, uint32_t size) {
+    route_rules grown = { 0 };
+
+    grown.keys = calloc(size, sizeof(uint32_t));
+    grown.vals = calloc(size, sizeof(uint32_t));
+    if (!grown.keys || !grown.vals) {
+        free(grown.keys);
+        free(grown.vals);
+        return -1;
+    }
+    grown.size = size;
+
+    uint32_t bits = __builtin_ctz(size);
+    for (uint32_t i = 0; i < r->size; i++) {
+        if (!r->vals[i]) {
+            continue;
+        }
+        uint32_t j = addr_hash(r->keys[i], bits);
+        while (grown.vals[j]) {
+            j = (j + 1) & (size - 1);
+        }
+        grown.keys[j] = r->keys[i];
+        grown.vals[j] = r->vals[i];
+        grown.count++;
+    }
+    free(r->keys);
+    free(r->vals);
+    *r = grown;
+    return 0;
+}
+
+/* Insert or update prefix in rules
+ *
+ * @param route_rules *r -- Pointer to rules of one depth
+ * @param uint32_t key   -- Prefix, host byte order
+ * @param uint32_t val   -- Next hop index + 1
+ * @return int 0 on success or -1 on error.
+ */
+static int rules_put(route_rules *r, uint32_t key, uint32_t val) {
+    uint32_t *slot = rules_find(r, key);
+    if (slot) {
+        *slot = val;
+        return 0;
+    }
+
+    // Keep load factor at or below 1/2
+    if (((r->count + 1) * 2) > r->size) {
+        if (rules_grow(r, r->size ? (r->size * 2) : 16) == -1) {
+            return -1;
+        }
+    }
+    uint32_t i = addr_hash(key, __builtin_ctz(r->size));
+    while (r->vals[i]) {
+        i = (i + 1) & (r->size - 1);
+    }
+    r->keys[i] = key;
+    r->vals[i] = val;
+    r->count++;
+    return 0;
+}
+
+/* Remove prefix from rules, shifting back entries after it so that
+ * probe sequences stay unbroken.
+ *
+ * @param route_rules *r -- Pointer to rules of one depth
+ * @param uint32_t *slot -- Pointer to slot value, as returned by rules_find()
+ */
+static void rules_remove(route_rules *r, uint32_t *slot) {
+    uint32_t mask = r->size - 1;
+    uint32_t bits = __builtin_ctz(r->size);
+    uint32_t hole = (uint32_t)(slot - r->vals);
+
+    for (uint32_t i = (hole + 1) & mask; r->vals[i]; i = (i + 1) & mask) {
+        uint32_t home = addr_hash(r->keys[i], bits);
+        // Move entry into the hole if the hole lies between its home and it
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            r->keys[hole] = r->keys[i];
+            r->vals[hole] = r->vals[i];
+            hole = i;
+        }
+    }
+    r->vals[hole] = 0;
+    r->count--;
+}
+
+/* Find index of next hop, adding it if it's not known yet
+ *
+ * @param route_table *rt         -- Pointer to routing table
+ * @param const route_nexthop *nh -- Pointer to next hop
+ * @return uint32_t index of next hop or -1 if table is full
+ */
+static uint32_t route_nexthop_idx(route_table *rt, const route_nexthop *nh) {
+    for (uint32_t i = 0; i < rt->nh_count; i++) {
+        route_nexthop *cur = &rt->nexthops[i];
+        if (cur->sock == nh->sock && cur->gateway == nh->gateway &&
+                cur->src == nh->src && cur->mtu == nh->mtu) {
+            return i;
+        }
+    }
+    if (rt->nh_count == rt->nh_max) {
+        return -1;
+    }
+    // Entries referring to this are published with release stores,
+    // so readers will see the next hop before they can find it.
+    rt->nexthops[rt->nh_count] = *nh;
+    return rt->nh_count++;
+}
+
+/* Should a table slot be overwritten
+ *
+ * @param uint32_t e     -- Current slot value
+ * @param uint8_t depth  -- Prefix length of route being added or removed
+ * @param bool del       -- True if route is being removed
+ * @return bool true if slot belongs to the route
+ */
+static inline bool route_slot_match(uint32_t e, uint8_t depth, bool del) {
+    if (del) {
+        return (e & ROUTE_VALID) && ROUTE_DEPTH(e) == depth;
+    }
+    return !(e & ROUTE_VALID) || ROUTE_DEPTH(e) <= depth;
+}
+
+/* Update range of slots a prefix covers in a tbl8 group
+ *
+ * @param _Atomic uint32_t *group -- Pointer to group
+ * @param uint32_t start          -- First slot
+ * @param uint32_t count          -- Amount of slots
+ * @param uint8_t depth           -- Prefix length
+ * @param uint32_t entry          -- Entry to store
+ * @param bool del                -- True if route is being removed
+ */
+static void route_set_tbl8(_Atomic uint32_t *group, uint32_t start,
+        uint32_t count, uint8_t depth, uint32_t entry, bool del)
+{
+    for (uint32_t j = start; j < (start + count); j++) {
+        uint32_t e = atomic_load_explicit(&group[j], memory_order_relaxed);
+        if (route_slot_match(e, depth, del)) {
+            atomic_store_explicit(&group[j], entry, memory_order_release);
+        }
+    }
+}
+
+/* Store entry in every slot the prefix covers, unless a more specific
+ * prefix owns the slot.
+ *
+ * @param route_table *rt -- Pointer to routing table
+ * @param uint32_t pfx    -- Prefix, host byte order
+ * @param uint8_t depth   -- Prefix length
+ * @param uint32_t entry  -- Entry to store
+ * @param bool del        -- True if route is being removed
+ */
+static void route_set_range(route_table *rt, uint32_t pfx, uint8_t depth,
+        uint32_t entry, bool del)
+{
+    if (depth <= 24) {
+        uint32_t start = pfx >> 8;
+        uint32_t count = 1U << (24 - depth);
+        for (uint32_t i = start; i < (start + count); i++) {
+            uint32_t e = atomic_load_explicit(&rt->tbl24[i], memory_order_relaxed);
+            if (e & ROUTE_EXT) {
+                _Atomic uint32_t *group = &rt->tbl8[ROUTE_IDX(e) * ROUTE_TBL8_SIZE];
+                route_set_tbl8(group, 0, ROUTE_TBL8_SIZE, depth, entry, del);
+            } else if (route_slot_match(e, depth, del)) {
+                atomic_store_explicit(&rt->tbl24[i], entry, memory_order_release);
+            }
+        }
+        return;
+    }
+
+    uint32_t i = pfx >> 8;
+    uint32_t start = pfx & 0xff;
+    uint32_t count = 1U << (32 - depth);
+    uint32_t e = atomic_load_explicit(&rt->tbl24[i], memory_order_relaxed);
+    if (e & ROUTE_EXT) {
+        _Atomic uint32_t *group = &rt->tbl8[ROUTE_IDX(e) * ROUTE_TBL8_SIZE];
+        route_set_tbl8(group, start, count, depth, entry, del);
+        return;
+    }
+
+    // First long prefix in this /24. Populate a fresh group with whatever
+    // the /24 resolved to so far before letting readers see it.
+    uint32_t g = rt->tbl8_used++;
+    _Atomic uint32_t *group = &rt->tbl8[g * ROUTE_TBL8_SIZE];
+    for (uint32_t j = 0; j < ROUTE_TBL8_SIZE; j++) {
+        bool ours = (j >= start && j < (start + count));
+        atomic_store_explicit(&group[j], ours ? entry : e, memory_order_relaxed);
+    }
+    atomic_store_explicit(&rt->tbl24[i], ROUTE_EXT | g, memory_order_release);
+}
+
+/* Create empty routing table
+ *
+ * @param uint32_t max_tbl8     -- Amount of /24s that may hold prefixes longer than /24
+ * @param uint32_t max_nexthops -- Amount of distinct next hops the table can hold
+ * @return pointer to new routing table or 0 on error.
+ *         Set errno on error.
+ */
+route_table *route_table_create(uint32_t max_tbl8, uint32_t max_nexthops) {
+    if (max_tbl8 > ROUTE_IDX(0xffffffff) || max_nexthops > ROUTE_IDX(0xffffffff)) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    route_table *rt = calloc(1, sizeof(route_table));
+    if (!rt) {
+        return 0;
+    }
+    rt->tbl24 = calloc(ROUTE_TBL24_SIZE, sizeof(uint32_t));
+    rt->tbl8 = calloc((size_t)max_tbl8 * ROUTE_TBL8_SIZE, sizeof(uint32_t));
+    rt->nexthops = calloc(max_nexthops, sizeof(route_nexthop));
+    if (!rt->tbl24 || (max_tbl8 && !rt->tbl8) || !rt->nexthops) {
+        route_table_destroy(rt);
+        errno = ENOMEM;
+        return 0;
+    }
+    rt->tbl8_max = max_tbl8;
+    rt->nh_max = max_nexthops;
+    mtx_init(&rt->lock, mtx_plain);
+    return rt;
+}
+
+/* Destroy routing table. There must be no readers left.
+ *
+ * @param route_table *rt -- Pointer to routing table
+ */
+void route_table_destroy(route_table *rt) {
+    for (int d = 0; d <= 32; d++) {
+        free(rt->rules[d].keys);
+        free(rt->rules[d].vals);
+    }
+    free((void *)rt->tbl24);
+    free((void *)rt->tbl8);
+    free(rt->nexthops);
+    if (rt->nh_max) {
+        mtx_destroy(&rt->lock);
+    }
+    free(rt);
+}
+
+/* Add route, or replace next hop of an existing one
+ *
+ * @param route_table *rt         -- Pointer to routing table
+ * @param uint32_t prefix         -- Destination prefix, network byte order
+ * @param uint8_t depth           -- Prefix length, 0..32
+ * @param const route_nexthop *nh -- Pointer to next hop
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, ENOSPC if table is out of tbl8 groups or next hops.
+ */
+int route_add(route_table *rt, uint32_t prefix, uint8_t depth,
+        const route_nexthop *nh)
+{
+    if (depth > 32) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t pfx = ntohl(prefix) & route_mask(depth);
+
+    mtx_lock(&rt->lock);
+    if (depth > 24 && rt->tbl8_used == rt->tbl8_max &&
+            !(atomic_load(&rt->tbl24[pfx >> 8]) & ROUTE_EXT)) {
+        mtx_unlock(&rt->lock);
+        errno = ENOSPC;
+        return -1;
+    }
+    uint32_t idx = route_nexthop_idx(rt, nh);
+    if (idx == (uint32_t)-1) {
+        mtx_unlock(&rt->lock);
+        errno = ENOSPC;
+        return -1;
+    }
+    if (rules_put(&rt->rules[depth], pfx, idx + 1) == -1) {
+        mtx_unlock(&rt->lock);
+        errno = ENOMEM;
+        return -1;
+    }
+    route_set_range(rt, pfx, depth, route_entry(depth, idx), false);
+    mtx_unlock(&rt->lock);
+    return 0;
+}
+
+/* Remove route
+ *
+ * @param route_table *rt -- Pointer to routing table
+ * @param uint32_t prefix -- Destination prefix, network byte order
+ * @param uint8_t depth   -- Prefix length, 0..32
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, ENOENT if there's no such route.
+ */
+int route_del(route_table *rt, uint32_t prefix, uint8_t depth) {
+    if (depth > 32) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t pfx = ntohl(prefix) & route_mask(depth);
+
+    mtx_lock(&rt->lock);
+    uint32_t *slot = rules_find(&rt->rules[depth], pfx);
+    if (!slot) {
+        mtx_unlock(&rt->lock);
+        errno = ENOENT;
+        return -1;
+    }
+    rules_remove(&rt->rules[depth], slot);
+
+    // Slots of the removed route fall back to the next less specific one
+    uint32_t repl = 0;
+    for (int d = depth - 1; d >= 0; d--) {
+        uint32_t *cover = rules_find(&rt->rules[d], pfx & route_mask(d));
+        if (cover) {
+            repl = route_entry(d, *cover - 1);
+            break;
+        }
+    }
+    route_set_range(rt, pfx, depth, repl, true);
+    mtx_unlock(&rt->lock);
+    return 0;
+}
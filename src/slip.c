@@ -32,21 +32,290 @@
 
 /* Serial Line Internet Protocol (SLIP) implementation
  *
+ * Frames are escaped into a buffer first, so the UART only sees finished
+ * bytes and can be fed a whole FIFO worth of them per wait.
  */
 #include <sys/types.h>
 #include <sys/io.h>
 
+#include <errno.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <slip.h>
 
+// Source bytes slip_transmit() escapes at a time
+#define SLIP_TX_CHUNK 256
+
+// 16550 registers and bits, as offsets from the base port
+#define UART_FCR 2
+#define UART_IIR 2
+#define UART_LSR 5
+#define UART_FCR_ENABLE 0x07 // Enable FIFOs and clear both of them
+#define UART_IIR_FIFO   0xC0 // Both set when FIFOs are enabled and work
+#define UART_LSR_THRE   0x20 // Transmit FIFO is empty
+
+/* Transmit FIFO depth of an UART, as found by slip_uart_init()
+ *
+ * @member uint16_t port -- Port of the UART, 0 for a free slot
+ * @member uint8_t fifo  -- Bytes we may write per THRE wait
+ */
+typedef struct {
+    uint16_t port;
+    uint8_t fifo;
+} slip_uart;
+
+static slip_uart slip_uarts[SLIP_UART_MAX];
+
+/* Get transmit FIFO depth of an UART
+ *
+ * @param uint16_t port -- Port of the UART
+ * @return size_t bytes we may write per THRE wait, 1 unless
+ *         slip_uart_init() found a working FIFO
+ */
+static inline size_t slip_uart_fifo(uint16_t port) {
+    for (unsigned i = 0; i < SLIP_UART_MAX; i++) {
+        if (slip_uarts[i].port == port) {
+            return slip_uarts[i].fifo;
+        }
+    }
+    return 1;
+}
+
 static inline void serial_wait(uint16_t port) {
-    do { } while ((inb(port + 5) & 0x20) == 0);
+    do { } while ((inb(port + UART_LSR) & UART_LSR_THRE) == 0);
 }
 
-static inline void tx_byte(unsigned char c, uint16_t port) {
-    serial_wait(port);
-    outb(port, c);
+/* Write bytes to the UART, a FIFO worth at a time
+ *
+ * @param uint16_t port       -- Port of the UART
+ * @param size_t fifo         -- Bytes to write per wait
+ * @param const uint8_t *data -- Pointer to bytes to write
+ * @param size_t len          -- Amount of bytes to write
+ */
+static inline void tx_burst(uint16_t port, size_t fifo, const uint8_t *data, size_t len) {
+    while (len) {
+        size_t n = (len < fifo) ? len : fifo;
+        serial_wait(port);
+        outsb(port, data, n);
+        data += n;
+        len -= n;
+    }
+}
+
+/* Find how many bytes from the start need no escaping
+ *
+ * @param const uint8_t *p -- Pointer to data
+ * @param size_t len       -- Size of data in bytes
+ * @return size_t offset of first END or ESC byte, or len if there's none
+ */
+static inline size_t slip_clean_run(const uint8_t *p, size_t len) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i end = _mm_set1_epi8((char)SLIP_FRAME_END);
+    const __m128i esc = _mm_set1_epi8((char)SLIP_FRAME_ESCAPE);
+
+    for (; (i + 16) <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(v, end), _mm_cmpeq_epi8(v, esc)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#else
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+
+    for (; (i + 8) <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        uint64_t a = w ^ (ones * SLIP_FRAME_END);
+        uint64_t b = w ^ (ones * SLIP_FRAME_ESCAPE);
+        // Top bit of each byte that is zero in a or b, exact for every byte
+        uint64_t za = ~(((a & low7) + low7) | a | low7);
+        uint64_t zb = ~(((b & low7) + low7) | b | low7);
+        uint64_t mask = za | zb;
+        if (mask) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return i + (__builtin_ctzll(mask) / 8);
+#else
+            return i + (__builtin_clzll(mask) / 8);
+#endif
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (p[i] == SLIP_FRAME_END || p[i] == SLIP_FRAME_ESCAPE) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* Escape data for the serial line, without frame delimiters.
+ *
+ * @param void *dst        -- Where to write escaped data, must have room
+ *                            for 2 * len bytes
+ * @param const void *src  -- Pointer to data to escape
+ * @param size_t len       -- Size of data in bytes
+ * @return size_t amount of bytes written to dst
+ */
+size_t slip_escape(void *dst, const void *src, size_t len) {
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *out = (uint8_t *)dst;
+
+    while (len) {
+        // Escapes tend to come in runs, so check for another one first
+        if (*in != SLIP_FRAME_END && *in != SLIP_FRAME_ESCAPE) {
+            size_t run = slip_clean_run(in, len);
+            memcpy(out, in, run);
+            out += run;
+            in += run;
+            len -= run;
+            if (!len) {
+                break;
+            }
+        }
+        *out++ = SLIP_FRAME_ESCAPE;
+        *out++ = (*in == SLIP_FRAME_END) ? SLIP_ESCAPE_END : SLIP_ESCAPE_ESCAPE;
+        in++;
+        len--;
+    }
+    return (size_t)(out - (uint8_t *)dst);
+}
+
+/* Encode a whole frame, END delimited on both sides.
+ *
+ * @param void *dst        -- Where to write encoded frame, must have room
+ *                            for SLIP_ENCODED_MAX(len) bytes
+ * @param const void *src  -- Pointer to frame to encode
+ * @param size_t len       -- Size of frame in bytes
+ * @return size_t amount of bytes written to dst
+ */
+size_t slip_encode(void *dst, const void *src, size_t len) {
+    uint8_t *out = (uint8_t *)dst;
+    size_t n = 0;
+
+    // Leading END flushes whatever line noise the receiver has collected
+    out[n++] = SLIP_FRAME_END;
+    n += slip_escape(out + n, src, len);
+    out[n++] = SLIP_FRAME_END;
+    return n;
+}
+
+/* Set up a streaming decoder
+ *
+ * @param slip_decoder *d -- Pointer to decoder
+ * @param void *frame     -- Buffer to decode frames into
+ * @param size_t size     -- Size of the buffer
+ */
+void slip_decoder_init(slip_decoder *d, void *frame, size_t size) {
+    memset(d, 0, sizeof(slip_decoder));
+    d->frame = (uint8_t *)frame;
+    d->size = size;
+}
+
+/* Feed received bytes to a decoder, stopping after the first complete frame.
+ *
+ * @param slip_decoder *d  -- Pointer to decoder
+ * @param const void *data -- Pointer to received bytes
+ * @param size_t len       -- Amount of received bytes
+ * @param size_t *frame_len -- Where size of a completed frame is written to,
+ *                             or -1 if none completed
+ * @return size_t amount of bytes consumed from data
+ */
+size_t slip_decode(slip_decoder *d, const void *data, size_t len, size_t *frame_len) {
+    const uint8_t *in = (const uint8_t *)data;
+    size_t i = 0;
+
+    *frame_len = -1;
+    while (i < len) {
+        uint8_t c = in[i];
+
+        if (d->escaped) {
+            d->escaped = 0;
+            if (c == SLIP_ESCAPE_END || c == SLIP_ESCAPE_ESCAPE) {
+                if (d->len < d->size) {
+                    d->frame[d->len++] = (c == SLIP_ESCAPE_END) ? SLIP_FRAME_END : SLIP_FRAME_ESCAPE;
+                } else {
+                    d->broken = 1;
+                }
+                i++;
+                continue;
+            }
+            // Anything else after an escape is a protocol violation
+            d->broken = 1;
+        }
+        if (c == SLIP_FRAME_END) {
+            i++;
+            if (d->broken) {
+                d->errors++;
+            } else if (d->len) {
+                *frame_len = d->len;
+                d->len = 0;
+                return i;
+            }
+            // Back to back ENDs just flush line noise, no need to count them
+            d->len = 0;
+            d->broken = 0;
+            continue;
+        }
+        if (c == SLIP_FRAME_ESCAPE) {
+            d->escaped = 1;
+            i++;
+            continue;
+        }
+        size_t run = slip_clean_run(in + i, len - i);
+        if (!d->broken) {
+            if (run > (d->size - d->len)) {
+                d->broken = 1;
+            } else {
+                memcpy(d->frame + d->len, in + i, run);
+                d->len += run;
+            }
+        }
+        i += run;
+    }
+    return i;
+}
+
+/* Enable and reset FIFOs of a 16550 compatible UART, and remember how
+ * many bytes slip_transmit() may write to it per wait.
+ *
+ * @param uint16_t port -- Port of the UART
+ * @return int 0 on success or -1 if the UART has no working FIFO, in
+ *         which case slip_transmit() writes a byte per wait.
+ *         set errno on error, ENODEV if there's no FIFO, ENOSPC if
+ *         SLIP_UART_MAX ports have been set up already.
+ */
+int slip_uart_init(uint16_t port) {
+    slip_uart *uart = 0;
+
+    for (unsigned i = 0; i < SLIP_UART_MAX && !uart; i++) {
+        if (slip_uarts[i].port == port || !slip_uarts[i].port) {
+            uart = &slip_uarts[i];
+        }
+    }
+    if (!uart) {
+        errno = ENOSPC;
+        return -1;
+    }
+    uart->port = port;
+    uart->fifo = 1;
+
+    outb(UART_FCR_ENABLE, port + UART_FCR);
+    if ((inb(port + UART_IIR) & UART_IIR_FIFO) != UART_IIR_FIFO) {
+        errno = ENODEV;
+        return -1;
+    }
+    uart->fifo = SLIP_UART_FIFO;
+    return 0;
 }
 
 /* Transmit packet over slip
@@ -56,24 +325,24 @@ static inline void tx_byte(unsigned char c, uint16_t port) {
  * @param size_t len       -- Amount of bytes to write
  */
 size_t slip_transmit(uint16_t port, const void *data, size_t len) {
-    unsigned char *tx = (unsigned char *)data;
-    tx_byte(SLIP_FRAME_END, port);
-    
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = tx[i];
-        switch (c) {
-        case (SLIP_FRAME_END):
-            tx_byte(SLIP_ESCAPE_END, port);
-            break;
-        case (SLIP_FRAME_ESCAPE):
-            tx_byte(SLIP_ESCAPE_ESCAPE, port);
-            break;
+    uint8_t buf[SLIP_ENCODED_MAX(SLIP_TX_CHUNK)];
+    const uint8_t *tx = (const uint8_t *)data;
+    size_t fifo = slip_uart_fifo(port);
+    size_t left = len;
+    size_t n = 0;
+
+    buf[n++] = SLIP_FRAME_END;
+    do {
+        size_t chunk = (left < SLIP_TX_CHUNK) ? left : SLIP_TX_CHUNK;
+        n += slip_escape(buf + n, tx, chunk);
+        tx += chunk;
+        left -= chunk;
+        if (!left) {
+            buf[n++] = SLIP_FRAME_END;
         }
-        tx_byte(c, port);
-    }
-    tx_byte(SLIP_FRAME_END, port);
+        tx_burst(port, fifo, buf, n);
+        n = 0;
+    } while (left);
 
     return len;
 }
-
-
@@ -35,65 +35,910 @@
  */
 
 #include <sys/types.h>
+#include <sys/socket.h>
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <arp.h>
+#include <data_util.h>
+#include <eth.h>
 #include <ip.h>
 #include <link.h>
+#include <pacer.h>
 #include <socket.h>
+#include <trace.h>
+#include <txsched.h>
+#include <udp.h>
+
+// Buckets in the demux index of each shared raw socket
+#define SLAB_DEMUX_BITS 12
+#define SLAB_DEMUX_SIZE (1U << SLAB_DEMUX_BITS)
+
+// End of a chain in the demux index
+#define SLAB_DEMUX_END UINT32_MAX
+
+/* Socket and everything it always needs, in a single allocation
+ *
+ * @member net_socket sock     -- The socket itself, must come first
+ * @member link_options link   -- Link options, pointed to by sock.link_options
+ * @member union ip            -- IP options, pointed to by sock.ip_options
+ * @member eth_hdr eth         -- Link header template of ethernet links
+ * @member uint32_t demux      -- First of the socket's bindings in the demux
+ *                                index of its shared raw socket
+ * @member uint32_t demux_addr -- Address the socket is indexed under
+ * @member int demuxed         -- Socket is in the demux index
+ */
+typedef struct {
+    net_socket sock;
+    link_options link;
+    union {
+        ipv4_socket_options v4;
+        ipv6_socket_options v6;
+    } ip;
+    eth_hdr eth;
+    uint32_t demux;
+    uint32_t demux_addr;
+    int demuxed;
+} socket_object;
+
+/* Binding in the demux index of a shared raw socket. Entries of a bucket
+ * are chained both ways, so that a socket can drop its own entries
+ * without walking the whole bucket.
+ *
+ * @member uint32_t key       -- Protocol in the upper half, port in the lower
+ * @member uint32_t slot      -- Slot of the socket
+ * @member uint32_t prev      -- Previous entry in bucket, or SLAB_DEMUX_END
+ * @member uint32_t next      -- Next entry in bucket, or SLAB_DEMUX_END.
+ *                               Links free entries together as well.
+ * @member uint32_t sock_next -- Next entry of the same socket
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t slot;
+    uint32_t prev;
+    uint32_t next;
+    uint32_t sock_next;
+} demux_entry;
+
+/* Address used by sockets of a shared raw socket
+ *
+ * @member uint32_t addr -- The address, 0 for sockets without one
+ * @member uint32_t slot -- Socket ARP and ICMP for the address go to
+ * @member unsigned refs -- Amount of sockets with the address
+ */
+typedef struct {
+    uint32_t addr;
+    uint32_t slot;
+    unsigned refs;
+} demux_addr;
+
+/* Raw socket shared by sockets of a slab
+ *
+ * @member netlib_ctx *ctx     -- Stack instance the sockets are bound to
+ * @member char *iface         -- Interface the raw socket is bound to
+ * @member int fd              -- The raw socket
+ * @member unsigned refs       -- Amount of sockets using it
+ * @member uint32_t *buckets   -- Demux index of bindings, SLAB_DEMUX_SIZE chains
+ * @member unsigned addr_count -- Amount of entries in addrs
+ * @member demux_addr *addrs   -- Addresses of the sockets
+ */
+typedef struct {
+    netlib_ctx *ctx;
+    char *iface;
+    int fd;
+    unsigned refs;
+    uint32_t *buckets;
+    unsigned addr_count;
+    demux_addr *addrs;
+} slab_link;
+
+/* Slab of sockets
+ *
+ * @member unsigned max          -- Most sockets open at the same time
+ * @member unsigned count        -- Amount of open sockets
+ * @member unsigned slots        -- Amount of slots allocated so far
+ * @member unsigned free_count   -- Amount of entries in free
+ * @member size_t mem            -- Bytes allocated, plus what sockets have charged
+ * @member uint32_t *free        -- Stack of unused slots
+ * @member uint32_t *gen         -- Generation per slot, odd while in use
+ * @member socket_object **chunk -- Sockets, SOCKET_SLAB_CHUNK per chunk
+ * @member unsigned link_count   -- Amount of entries in links
+ * @member slab_link *links      -- Raw sockets of ethernet sockets, one per
+ *                                  stack instance and interface
+ * @member uint32_t entry_count  -- Amount of entries allocated
+ * @member uint32_t entry_free   -- First free entry, or SLAB_DEMUX_END
+ * @member demux_entry *entries  -- Entries of demux indexes of all links
+ */
+struct socket_slab {
+    unsigned max;
+    unsigned count;
+    unsigned slots;
+    unsigned free_count;
+    size_t mem;
+    uint32_t *free;
+    uint32_t *gen;
+    socket_object **chunk;
+    unsigned link_count;
+    slab_link *links;
+    uint32_t entry_count;
+    uint32_t entry_free;
+    demux_entry *entries;
+};
+
+/* Set up a socket in memory given to us
+ *
+ * @param socket_object *obj  -- Zeroed memory for the socket
+ * @param netlib_ctx *ctx     -- Stack instance to bind the socket to
+ * @param int family          -- AF_INET/AF_INET6/...
+ * @param int protocol        -- TCP/UDP/...
+ * @param enum LINK_TYPE type -- ETH/SLIP/PPP/..
+ * @param const uint8_t *smac -- Source Mac address
+ * @param char *iface         -- Name of network interface we're using
+ * @param int fd              -- Raw socket for the interface, or -1
+ */
+static void socket_init(socket_object *obj, netlib_ctx *ctx, int family,
+        int protocol, int type, uint8_t *smac, char *iface, int fd)
+{
+    net_socket *ret = &obj->sock;
+    link_options *link = &obj->link;
+
+    ret->raw_sockfd = fd;
+    ret->iface = iface;
+    ret->ctx = ctx;
+    ret->family = family;
+    ret->protocol = protocol;
+    ret->ip_options = &obj->ip;
+    ret->link_options = link;
+    ret->mem = sizeof(socket_object);
+
+    link->type = type;
+    switch (type) {
+    case (ETH):
+        memcpy(obj->eth.mac_src, smac, 6);
+        eth_set_ptcl(&obj->eth, ETH_PTCL_IPV4);
+        link->proto.eth_header = &obj->eth;
+        link->mtu = ETH_DEFAULT_MTU;
+        break;
+    case (SLIP):
+        link->proto.slip_port = 0x02f8;
+        link->mtu = SLIP_DEFAULT_MTU;
+        break;
+    }
+
+    if (family == AF_INET6) {
+        ipv6_socket_options *iopts = &obj->ip.v6;
+        iopts->hop_limit = 64;
+        iopts->mtu = link->mtu;
+    } else {
+        ipv4_socket_options *iopts = &obj->ip.v4;
+        iopts->ttl = 64;
+        iopts->high_throughput = 1;
+        // Required, we send every datagram with DF set
+        iopts->no_fragment = 1;
+        iopts->mtu = link->mtu;
+    }
+
+    // Failing this only costs us performance, we'd just see more frames
+    socket_update_filter(ret);
+}
 
 /* Open new network socket for user.
  *
+ * @param netlib_ctx *ctx     -- Stack instance to bind the socket to
  * @param int family          -- AF_INET/AF_INET6/...
  * @param int protocol        -- TCP/UDP/...
  * @param enum LINK_TYPE type -- ETH/SLIP/PPP/..
  * @param const uint8_t *smac -- Source Mac address
- * @param const uint8_t *dmac -- Source Mac address
  * @param char *iface         -- Name of network interface we're using
  * @return pointer to populated net_socket structure on success or 0 on error.
  *         set errno on error.
  */
-net_socket *new_socket(int family, int protocol, int type,
-        uint8_t *smac, uint8_t *dmac, char *iface) {
-    net_socket *ret = (net_socket *)calloc(1, sizeof(net_socket));
-    if (!ret) {
+net_socket *new_socket(netlib_ctx *ctx, int family, int protocol, int type,
+        uint8_t *smac, char *iface) {
+    socket_object *obj = netlib_ctx_alloc(sizeof(socket_object));
+    if (!obj) {
         return 0;
     }
-    ret->raw_sockfd = raw_socket(iface);
-    ret->iface = iface;
+    socket_init(obj, ctx, family, protocol, type, smac, iface, raw_socket(iface));
+    return &obj->sock;
+}
 
-    ret->family = family;
-    ret->protocol = protocol;
+/* Accept traffic for given protocol and port on this socket.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param uint8_t ptcl     -- IPv4 protocol number (IPV4_PTCL_UDP, ...)
+ * @param uint16_t port    -- Destination port in host byte order, 0 for any
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOSPC if socket has too many bindings.
+ */
+int socket_bind(net_socket *sock, uint8_t ptcl, uint16_t port) {
+    for (unsigned i = 0; i < sock->binding_count; i++) {
+        if (sock->bindings[i].ptcl == ptcl && sock->bindings[i].port == port) {
+            return 0;
+        }
+    }
+    if (sock->binding_count == SOCKET_MAX_BINDINGS) {
+        errno = ENOSPC;
+        return -1;
+    }
+    sock->bindings[sock->binding_count].ptcl = ptcl;
+    sock->bindings[sock->binding_count].port = port;
+    sock->binding_count++;
+
+    if (socket_update_rx(sock) == -1) {
+        int err = errno;
+        sock->binding_count--;
+        socket_update_rx(sock);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* Stop accepting traffic for given protocol and port
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param uint8_t ptcl     -- IPv4 protocol number
+ * @param uint16_t port    -- Port in host byte order, as given to socket_bind()
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOENT if there was no such binding.
+ */
+int socket_unbind(net_socket *sock, uint8_t ptcl, uint16_t port) {
+    for (unsigned i = 0; i < sock->binding_count; i++) {
+        if (sock->bindings[i].ptcl == ptcl && sock->bindings[i].port == port) {
+            sock->bindings[i] = sock->bindings[--sock->binding_count];
+            return socket_update_rx(sock);
+        }
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+
+
+static inline socket_object *slab_object(socket_slab *slab, uint32_t slot) {
+    return &slab->chunk[slot / SOCKET_SLAB_CHUNK][slot % SOCKET_SLAB_CHUNK];
+}
+
+/* Find raw socket shared by ethernet sockets of a slab
+ *
+ * @param socket_slab *slab -- Slab the sockets are allocated from
+ * @param netlib_ctx *ctx   -- Stack instance the sockets are bound to
+ * @param const char *iface -- Name of network interface
+ * @return pointer to shared raw socket or 0 if there's none
+ */
+static slab_link *slab_link_find(socket_slab *slab, netlib_ctx *ctx, const char *iface) {
+    for (unsigned i = 0; i < slab->link_count; i++) {
+        slab_link *l = &slab->links[i];
+        if (l->ctx == ctx && !strcmp(l->iface, iface)) {
+            return l;
+        }
+    }
+    return 0;
+}
+
+/* Find shared raw socket a socket uses
+ *
+ * @param socket_slab *slab -- Slab the socket is allocated from
+ * @param net_socket *sock  -- Socket sharing its raw socket
+ * @return pointer to shared raw socket
+ */
+static slab_link *slab_link_of(socket_slab *slab, net_socket *sock) {
+    for (unsigned i = 0; i < slab->link_count; i++) {
+        if (slab->links[i].fd == sock->raw_sockfd) {
+            return &slab->links[i];
+        }
+    }
+    return 0;
+}
+
+/* Get raw socket shared by ethernet sockets of a slab, opening it if
+ * this is the first socket on the stack instance and interface.
+ *
+ * @param socket_slab *slab -- Slab the socket is allocated from
+ * @param netlib_ctx *ctx   -- Stack instance the socket is bound to
+ * @param const char *iface -- Name of network interface
+ * @return int raw socket on success or -1 on error.
+ *         set errno on error.
+ */
+static int slab_link_get(socket_slab *slab, netlib_ctx *ctx, const char *iface) {
+    slab_link *l = slab_link_find(slab, ctx, iface);
+    if (l) {
+        l->refs++;
+        return l->fd;
+    }
+
+    slab_link *links = realloc(slab->links, (slab->link_count + 1) * sizeof(slab_link));
+    if (!links) {
+        return -1;
+    }
+    slab->links = links;
+    char *name = strdup(iface);
+    uint32_t *buckets = malloc(SLAB_DEMUX_SIZE * sizeof(uint32_t));
+    if (!name || !buckets) {
+        free(name);
+        free(buckets);
+        return -1;
+    }
+    memset(buckets, 0xff, SLAB_DEMUX_SIZE * sizeof(uint32_t));
+    int fd = raw_socket(iface);
+    if (fd == -1) {
+        free(name);
+        free(buckets);
+        return -1;
+    }
+    if (raw_socket_share(fd) == -1) {
+        int err = errno;
+        close(fd);
+        free(name);
+        free(buckets);
+        errno = err;
+        return -1;
+    }
+    slab->links[slab->link_count++] = (slab_link){ ctx, name, fd, 1, buckets, 0, 0 };
+    slab->mem += sizeof(slab_link) + SLAB_DEMUX_SIZE * sizeof(uint32_t);
+    return fd;
+}
+
+/* Take an entry for the demux index, growing the pool if there's none free
+ *
+ * @param socket_slab *slab -- Slab to take the entry from
+ * @return uint32_t index of the entry, or SLAB_DEMUX_END on error.
+ *         set errno on error.
+ */
+static uint32_t demux_entry_alloc(socket_slab *slab) {
+    if (slab->entry_free == SLAB_DEMUX_END) {
+        uint32_t count = slab->entry_count ? (slab->entry_count * 2) : SOCKET_SLAB_CHUNK;
+        demux_entry *entries = realloc(slab->entries, count * sizeof(demux_entry));
+        if (!entries) {
+            return SLAB_DEMUX_END;
+        }
+        for (uint32_t i = count; i > slab->entry_count; i--) {
+            entries[i - 1].next = slab->entry_free;
+            slab->entry_free = i - 1;
+        }
+        slab->mem += (count - slab->entry_count) * sizeof(demux_entry);
+        slab->entries = entries;
+        slab->entry_count = count;
+    }
+    uint32_t i = slab->entry_free;
+    slab->entry_free = slab->entries[i].next;
+    return i;
+}
+
+/* Index bindings of a socket
+ *
+ * @param socket_slab *slab  -- Slab the socket is allocated from
+ * @param slab_link *l       -- Shared raw socket of the socket
+ * @param socket_object *obj -- Socket to index
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+static int demux_add_bindings(socket_slab *slab, slab_link *l, socket_object *obj) {
+    for (unsigned b = 0; b < obj->sock.binding_count; b++) {
+        uint32_t i = demux_entry_alloc(slab);
+        if (i == SLAB_DEMUX_END) {
+            return -1;
+        }
+        demux_entry *e = &slab->entries[i];
+        e->key = ((uint32_t)obj->sock.bindings[b].ptcl << 16) | obj->sock.bindings[b].port;
+        e->slot = obj->sock.slot;
+
+        uint32_t *head = &l->buckets[addr_hash(e->key, SLAB_DEMUX_BITS)];
+        e->prev = SLAB_DEMUX_END;
+        e->next = *head;
+        if (*head != SLAB_DEMUX_END) {
+            slab->entries[*head].prev = i;
+        }
+        *head = i;
+        e->sock_next = obj->demux;
+        obj->demux = i;
+    }
+    return 0;
+}
+
+/* Drop bindings of a socket from the index
+ *
+ * @param socket_slab *slab  -- Slab the socket is allocated from
+ * @param slab_link *l       -- Shared raw socket of the socket
+ * @param socket_object *obj -- Socket to drop
+ */
+static void demux_remove_bindings(socket_slab *slab, slab_link *l, socket_object *obj) {
+    uint32_t i = obj->demux;
+
+    while (i != SLAB_DEMUX_END) {
+        demux_entry *e = &slab->entries[i];
+        uint32_t next = e->sock_next;
+
+        if (e->prev == SLAB_DEMUX_END) {
+            l->buckets[addr_hash(e->key, SLAB_DEMUX_BITS)] = e->next;
+        } else {
+            slab->entries[e->prev].next = e->next;
+        }
+        if (e->next != SLAB_DEMUX_END) {
+            slab->entries[e->next].prev = e->prev;
+        }
+        e->next = slab->entry_free;
+        slab->entry_free = i;
+        i = next;
+    }
+    obj->demux = SLAB_DEMUX_END;
+}
+
+/* Count a socket as having an address
+ *
+ * @param socket_slab *slab  -- Slab the socket is allocated from
+ * @param slab_link *l       -- Shared raw socket of the socket
+ * @param socket_object *obj -- Socket with the address
+ * @param uint32_t addr      -- The address
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+static int demux_addr_get(socket_slab *slab, slab_link *l, socket_object *obj, uint32_t addr) {
+    for (unsigned i = 0; i < l->addr_count; i++) {
+        if (l->addrs[i].addr == addr) {
+            l->addrs[i].refs++;
+            obj->demux_addr = addr;
+            return 0;
+        }
+    }
+    demux_addr *addrs = realloc(l->addrs, (l->addr_count + 1) * sizeof(demux_addr));
+    if (!addrs) {
+        return -1;
+    }
+    l->addrs = addrs;
+    l->addrs[l->addr_count++] = (demux_addr){ addr, obj->sock.slot, 1 };
+    slab->mem += sizeof(demux_addr);
+    obj->demux_addr = addr;
+    return 0;
+}
+
+/* Stop counting a socket as having its address. If it was the one
+ * frames for the address went to, another socket with it takes over.
+ *
+ * @param socket_slab *slab  -- Slab the socket is allocated from
+ * @param slab_link *l       -- Shared raw socket of the socket
+ * @param socket_object *obj -- Socket giving up its address
+ */
+static void demux_addr_put(socket_slab *slab, slab_link *l, socket_object *obj) {
+    for (unsigned i = 0; i < l->addr_count; i++) {
+        demux_addr *a = &l->addrs[i];
+        if (a->addr != obj->demux_addr) {
+            continue;
+        }
+        if (!--a->refs) {
+            *a = l->addrs[--l->addr_count];
+            slab->mem -= sizeof(demux_addr);
+            return;
+        }
+        if (a->slot != obj->sock.slot) {
+            return;
+        }
+        for (uint32_t slot = 0; slot < slab->slots; slot++) {
+            socket_object *o = slab_object(slab, slot);
+            if (slot != a->slot && o->demuxed && o->sock.raw_sockfd == l->fd &&
+                    o->demux_addr == a->addr) {
+                a->slot = slot;
+                return;
+            }
+        }
+        return;
+    }
+}
 
-    ret->ip_options = calloc(1, sizeof(ipv4_socket_options));
-    if (!ret->ip_options) {
-        free(ret);
+/* Bring demux index of a socket sharing its raw socket up to date with
+ * its bindings and address
+ *
+ * @param net_socket *sock -- Socket sharing its raw socket
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+static int slab_demux_update(net_socket *sock) {
+    socket_slab *slab = (socket_slab *)sock->slab;
+    socket_object *obj = (socket_object *)sock;
+    slab_link *l = slab_link_of(slab, sock);
+    uint32_t addr = ((link_options *)sock->link_options)->addr;
+
+    if (obj->demuxed && obj->demux_addr != addr) {
+        demux_remove_bindings(slab, l, obj);
+        demux_addr_put(slab, l, obj);
+        obj->demuxed = 0;
+    }
+    if (!obj->demuxed) {
+        obj->demux = SLAB_DEMUX_END;
+        if (demux_addr_get(slab, l, obj, addr) == -1) {
+            return -1;
+        }
+        obj->demuxed = 1;
+    }
+    demux_remove_bindings(slab, l, obj);
+    return demux_add_bindings(slab, l, obj);
+}
+
+/* Drop a socket from its shared raw socket
+ *
+ * @param socket_slab *slab -- Slab the socket was allocated from
+ * @param net_socket *sock  -- Socket sharing its raw socket
+ * @return unsigned amount of sockets still using the raw socket. The
+ *         caller closes it when this drops to 0.
+ */
+static unsigned slab_link_put(socket_slab *slab, net_socket *sock) {
+    socket_object *obj = (socket_object *)sock;
+    slab_link *l = slab_link_of(slab, sock);
+
+    if (obj->demuxed) {
+        demux_remove_bindings(slab, l, obj);
+        demux_addr_put(slab, l, obj);
+        obj->demuxed = 0;
+    }
+    if (--l->refs) {
+        return l->refs;
+    }
+    free(l->iface);
+    free(l->buckets);
+    free(l->addrs);
+    *l = slab->links[--slab->link_count];
+    slab->mem -= sizeof(slab_link) + SLAB_DEMUX_SIZE * sizeof(uint32_t);
+    return 0;
+}
+
+/* Pick socket a frame received on a shared raw socket is for
+ *
+ * @param socket_slab *slab -- Slab the sockets are allocated from
+ * @param slab_link *l      -- Shared raw socket the frame came from
+ * @param const void *frame -- Pointer to received frame
+ * @param size_t len        -- Size of the received frame
+ * @return pointer to socket to hand the frame to, or 0 if no socket is
+ *         in the index
+ */
+static net_socket *slab_demux(socket_slab *slab, slab_link *l, const void *frame, size_t len) {
+    const eth_hdr *eh = (const eth_hdr *)frame;
+    uint32_t dst = 0;
+
+    if (len >= (sizeof(eth_hdr) + sizeof(arp_hdr)) && eth_ptcl(eh) == ETH_PTCL_ARP) {
+        dst = POINTER_ADD(const arp_hdr *, frame, sizeof(eth_hdr))->tpa;
+    } else if (len >= (sizeof(eth_hdr) + sizeof(ipv4_hdr)) && eth_ptcl(eh) == ETH_PTCL_IPV4) {
+        const ipv4_hdr *iph = POINTER_ADD(const ipv4_hdr *, frame, sizeof(eth_hdr));
+        size_t hlen = ipv4_hlen(iph);
+
+        dst = ipv4_dst(iph);
+        if (iph->ptcl == IPV4_PTCL_UDP && !ipv4_is_fragment(iph) && hlen >= sizeof(ipv4_hdr) &&
+                len >= (sizeof(eth_hdr) + hlen + sizeof(udp_hdr))) {
+            uint16_t dport = udp_dport(POINTER_ADD(const udp_hdr *, iph, hlen));
+            // Sockets bound to the port come before ones taking any port
+            uint32_t keys[2] = {
+                ((uint32_t)IPV4_PTCL_UDP << 16) | dport,
+                ((uint32_t)IPV4_PTCL_UDP << 16)
+            };
+            for (int k = 0; k < 2; k++) {
+                uint32_t i = l->buckets[addr_hash(keys[k], SLAB_DEMUX_BITS)];
+                for (; i != SLAB_DEMUX_END; i = slab->entries[i].next) {
+                    const demux_entry *e = &slab->entries[i];
+                    if (e->key != keys[k]) {
+                        continue;
+                    }
+                    net_socket *sock = &slab_object(slab, e->slot)->sock;
+                    link_options *link = (link_options *)sock->link_options;
+                    if (!link->addr || dst == link->addr || dst == 0xffffffff ||
+                            dst == (link->addr | ~link->netmask)) {
+                        return sock;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!l->addr_count) {
         return 0;
     }
+    // Socket with the address, or any socket to drop the frame
+    const demux_addr *a = &l->addrs[0];
+    for (unsigned i = 0; i < l->addr_count; i++) {
+        if (l->addrs[i].addr == dst) {
+            a = &l->addrs[i];
+            break;
+        }
+    }
+    return &slab_object(slab, a->slot)->sock;
+}
 
-    ipv4_socket_options *iopts = (ipv4_socket_options *)ret->ip_options;
-    iopts->ttl = 64;
-    iopts->high_throughput = 1;
+/* Update how received traffic finds the socket after its bindings or
+ * addresses have changed.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int socket_update_rx(net_socket *sock) {
+    if (sock->shared_fd) {
+        return slab_demux_update(sock);
+    }
+    return socket_update_filter(sock);
+}
 
-    ret->link_options = calloc(1, sizeof(link_options));
-    if (!ret->link_options) {
-        free(ret->ip_options);
-        free(ret);
+/* Close a socket and free everything it owns. Rings attached to the
+ * socket are left alone, they belong to whoever attached them.
+ *
+ * @param net_socket *sock -- Pointer to socket to close
+ */
+void close_socket(net_socket *sock) {
+    txsched_detach(sock);
+    pacer_detach(sock);
+    transmit_flush(sock);
+    trace_disable(sock);
+    if (((link_options *)sock->link_options)->slip_vj) {
+        link_set_slip_vj(sock, SLIP_VJ_OFF, 0);
+    }
+
+    socket_slab *slab = (socket_slab *)sock->slab;
+    if (sock->shared_fd && !slab_link_put(slab, sock)) {
+        // Last one out closes it
+        sock->shared_fd = 0;
+    }
+    raw_socket_close(sock);
+
+    if (!slab) {
+        free(sock);
+        return;
+    }
+    // Anything still charged to the socket goes with it
+    slab->mem -= sock->mem - sizeof(socket_object);
+    slab->gen[sock->slot]++;
+    slab->free[slab->free_count++] = sock->slot;
+    slab->count--;
+}
+
+/* Account memory to a socket before allocating it on the socket's behalf
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param size_t size      -- Amount of bytes about to be allocated
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOBUFS if socket would go over its limit.
+ */
+int socket_mem_charge(net_socket *sock, size_t size) {
+    if (sock->mem_limit && (sock->mem + size) > sock->mem_limit) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    sock->mem += size;
+    if (sock->slab) {
+        ((socket_slab *)sock->slab)->mem += size;
+    }
+    return 0;
+}
+
+/* Give back memory accounted with socket_mem_charge()
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param size_t size      -- Amount of bytes freed
+ */
+void socket_mem_uncharge(net_socket *sock, size_t size) {
+    sock->mem -= size;
+    if (sock->slab) {
+        ((socket_slab *)sock->slab)->mem -= size;
+    }
+}
+
+/* Limit memory a socket may own, including the socket itself
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @param size_t limit     -- Most bytes the socket may own, 0 for no limit
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOBUFS if socket already owns more.
+ */
+int socket_set_mem_limit(net_socket *sock, size_t limit) {
+    if (limit && sock->mem > limit) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    sock->mem_limit = limit;
+    return 0;
+}
+
+/* Create a slab of sockets
+ *
+ * @param unsigned max_sockets -- Most sockets open at the same time
+ * @return pointer to new slab on success or 0 on error.
+ *         set errno on error.
+ */
+socket_slab *socket_slab_create(unsigned max_sockets) {
+    if (!max_sockets || max_sockets > UINT32_MAX - SOCKET_SLAB_CHUNK) {
+        errno = EINVAL;
         return 0;
     }
-    link_options *link = (link_options *)ret->link_options;
-    link->type = type;
+    unsigned chunks = (max_sockets + SOCKET_SLAB_CHUNK - 1) / SOCKET_SLAB_CHUNK;
 
-    switch (type) {
-    case (ETH):
-        link->proto.eth_header = create_eth_hdr(smac, dmac, 0x0800);
-        break;
-    case (SLIP):
-        link->proto.slip_port = 0x02f8;
-        break;
+    socket_slab *slab = netlib_ctx_alloc(sizeof(socket_slab));
+    if (!slab) {
+        return 0;
     }
+    slab->max = max_sockets;
+    slab->entry_free = SLAB_DEMUX_END;
+    slab->free = netlib_ctx_alloc(chunks * SOCKET_SLAB_CHUNK * sizeof(uint32_t));
+    slab->gen = netlib_ctx_alloc(chunks * SOCKET_SLAB_CHUNK * sizeof(uint32_t));
+    slab->chunk = netlib_ctx_alloc(chunks * sizeof(socket_object *));
+    if (!slab->free || !slab->gen || !slab->chunk) {
+        free(slab->free);
+        free(slab->gen);
+        free(slab->chunk);
+        free(slab);
+        return 0;
+    }
+    slab->mem = sizeof(socket_slab) +
+        chunks * (SOCKET_SLAB_CHUNK * 2 * sizeof(uint32_t) + sizeof(socket_object *));
+    return slab;
+}
 
-    return ret;
+/* Close all sockets of a slab and release its memory
+ *
+ * @param socket_slab *slab -- Pointer to slab
+ */
+void socket_slab_destroy(socket_slab *slab) {
+    for (unsigned i = 0; i < slab->slots; i++) {
+        if (slab->gen[i] & 1) {
+            close_socket(&slab->chunk[i / SOCKET_SLAB_CHUNK][i % SOCKET_SLAB_CHUNK].sock);
+        }
+    }
+    for (unsigned i = 0; i < (slab->slots / SOCKET_SLAB_CHUNK); i++) {
+        free(slab->chunk[i]);
+    }
+    free(slab->links);
+    free(slab->entries);
+    free(slab->free);
+    free(slab->gen);
+    free(slab->chunk);
+    free(slab);
 }
 
+/* Open new network socket from a slab.
+ *
+ * @param socket_slab *slab   -- Slab to allocate socket from
+ * @param netlib_ctx *ctx     -- Stack instance to bind the socket to
+ * @param int family          -- AF_INET/AF_INET6/...
+ * @param int protocol        -- TCP/UDP/...
+ * @param enum LINK_TYPE type -- ETH/SLIP/PPP/..
+ * @param const uint8_t *smac -- Source Mac address
+ * @param char *iface         -- Name of network interface we're using
+ * @return socket_handle handle of the new socket on success or 0 on error.
+ *         set errno on error, ENFILE if slab is full.
+ */
+socket_handle socket_open(socket_slab *slab, netlib_ctx *ctx, int family,
+        int protocol, int type, uint8_t *smac, char *iface)
+{
+    if (slab->count == slab->max) {
+        errno = ENFILE;
+        return 0;
+    }
+    if (!slab->free_count) {
+        // Grow by a chunk, handing out its lowest slot first
+        socket_object *chunk = netlib_ctx_alloc(SOCKET_SLAB_CHUNK * sizeof(socket_object));
+        if (!chunk) {
+            return 0;
+        }
+        slab->chunk[slab->slots / SOCKET_SLAB_CHUNK] = chunk;
+        for (unsigned i = SOCKET_SLAB_CHUNK; i > 0; i--) {
+            slab->free[slab->free_count++] = slab->slots + i - 1;
+        }
+        slab->slots += SOCKET_SLAB_CHUNK;
+        slab->mem += SOCKET_SLAB_CHUNK * sizeof(socket_object);
+    }
+
+    uint32_t slot = slab->free[--slab->free_count];
+    socket_object *obj = &slab->chunk[slot / SOCKET_SLAB_CHUNK][slot % SOCKET_SLAB_CHUNK];
+    memset(obj, 0, sizeof(socket_object));
+    obj->sock.slab = slab;
+    obj->sock.slot = slot;
+
+    /* A raw socket per slab socket would run into the file descriptor
+     * limit long before the slab fills, so ethernet sockets share one.
+     */
+    int fd = -1;
+    if (type == ETH) {
+        fd = slab_link_get(slab, ctx, iface);
+        if (fd == -1) {
+            slab->free[slab->free_count++] = slot;
+            return 0;
+        }
+        obj->sock.shared_fd = 1;
+    }
+    socket_init(obj, ctx, family, protocol, type, smac, iface, fd);
+    if (obj->sock.shared_fd && slab_demux_update(&obj->sock) == -1) {
+        int err = errno;
+        slab_link_put(slab, &obj->sock);
+        slab->free[slab->free_count++] = slot;
+        errno = err;
+        return 0;
+    }
 
+    slab->gen[slot]++;
+    slab->count++;
+    return ((socket_handle)slab->gen[slot] << 32) | slot;
+}
+
+/* Receive a frame on the raw socket shared by ethernet sockets of a slab,
+ * and hand it to the socket it's for.
+ *
+ * @param socket_slab *slab -- Slab the sockets were opened from
+ * @param netlib_ctx *ctx   -- Stack instance of the sockets
+ * @param const char *iface -- Name of network interface
+ * @param void *frame       -- Pointer to buffer to receive frame into
+ * @param size_t size       -- Size of the buffer
+ * @return size_t what link_rx() returned, or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived before timeout,
+ *         ENODEV if the slab has no ethernet sockets on ctx and iface,
+ *         ENOENT if none of them could be indexed.
+ */
+size_t socket_slab_rx(socket_slab *slab, netlib_ctx *ctx, const char *iface,
+        void *frame, size_t size)
+{
+    slab_link *l = slab_link_find(slab, ctx, iface);
+    if (!l) {
+        errno = ENODEV;
+        return -1;
+    }
+    size_t len = raw_socket_receive(l->fd, frame, size);
+    if (len == (size_t)-1) {
+        return -1;
+    }
+    net_socket *sock = slab_demux(slab, l, frame, len);
+    if (!sock) {
+        errno = ENOENT;
+        return -1;
+    }
+    return link_rx(sock, frame, len);
+}
+
+/* Look up socket by its handle
+ *
+ * @param socket_slab *slab -- Slab socket was opened from
+ * @param socket_handle h   -- Handle of the socket
+ * @return pointer to socket on success or 0 on error.
+ *         set errno on error, ESTALE if socket has been closed.
+ */
+net_socket *socket_get(socket_slab *slab, socket_handle h) {
+    uint32_t slot = (uint32_t)h;
+    uint32_t gen = (uint32_t)(h >> 32);
+
+    if (slot >= slab->slots || !(gen & 1) || slab->gen[slot] != gen) {
+        errno = ESTALE;
+        return 0;
+    }
+    return &slab->chunk[slot / SOCKET_SLAB_CHUNK][slot % SOCKET_SLAB_CHUNK].sock;
+}
+
+/* Close a socket opened from a slab.
+ *
+ * @param socket_slab *slab -- Slab socket was opened from
+ * @param socket_handle h   -- Handle of the socket
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ESTALE if socket has already been closed.
+ */
+int socket_release(socket_slab *slab, socket_handle h) {
+    net_socket *sock = socket_get(slab, h);
+    if (!sock) {
+        return -1;
+    }
+    close_socket(sock);
+    return 0;
+}
+
+/* Get amount of memory used by a slab
+ *
+ * @param socket_slab *slab -- Pointer to slab
+ * @return size_t bytes in use
+ */
+size_t socket_slab_mem(socket_slab *slab) {
+    return slab->mem;
+}
+
+/* Get amount of sockets open in a slab
+ *
+ * @param socket_slab *slab -- Pointer to slab
+ * @return unsigned open sockets
+ */
+unsigned socket_slab_count(socket_slab *slab) {
+    return slab->count;
+}
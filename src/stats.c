@@ -0,0 +1,310 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-instance statistics counters */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <stats.h>
+
+#define NETLIB_STAT_NAME(name) #name,
+
+const char *const netlib_stat_names[NETLIB_STAT_COUNT] = {
+    NETLIB_STAT_LIST(NETLIB_STAT_NAME)
+};
+
+_Static_assert(sizeof(netlib_stats) >= NETLIB_STAT_COUNT * sizeof(uint64_t),
+        "netlib_stats must hold every counter");
+
+static once_flag stats_once = ONCE_FLAG_INIT;
+
+// Serialises handing out and taking back blocks
+static mtx_t stats_lock;
+
+// Segment counters of this process live in, and which of its blocks are taken
+static netlib_stats_shm *stats_region;
+static uint8_t *stats_taken;
+
+static void stats_lock_init(void) {
+    mtx_init(&stats_lock, mtx_plain);
+}
+
+/* Get size of a segment holding given amount of blocks
+ *
+ * @param unsigned slots -- Amount of blocks
+ * @return size_t size in bytes
+ */
+static inline size_t stats_size(unsigned slots) {
+    return sizeof(netlib_stats_shm) + ((size_t)slots * sizeof(netlib_stats));
+}
+
+/* Get block of counters from a segment
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment
+ * @param unsigned slot               -- Index of block
+ * @return netlib_stats * pointer to counters
+ */
+static inline netlib_stats *stats_block(const netlib_stats_shm *shm, unsigned slot) {
+    return POINTER_ADD(netlib_stats *, shm, stats_size(slot));
+}
+
+/* Set up segment for counters of this process. Called with stats_lock held.
+ *
+ * @param const char *name -- Name of shared memory segment, or 0 for
+ *                            memory private to us
+ * @param unsigned slots   -- Amount of blocks
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+static int stats_map(const char *name, unsigned slots) {
+    size_t size = stats_size(slots);
+    netlib_stats_shm *shm;
+
+    uint8_t *taken = calloc(slots, 1);
+    if (!taken) {
+        return -1;
+    }
+    if (name) {
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+        if (fd == -1) {
+            free(taken);
+            return -1;
+        }
+        if (ftruncate(fd, size) == -1) {
+            close(fd);
+            free(taken);
+            return -1;
+        }
+        shm = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    } else {
+        shm = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (shm == MAP_FAILED) {
+        free(taken);
+        return -1;
+    }
+
+    // Segment may be left over from an earlier run
+    memset(shm, 0, size);
+    shm->magic = NETLIB_STATS_MAGIC;
+    shm->version = NETLIB_STATS_VERSION;
+    shm->count = NETLIB_STAT_COUNT;
+    shm->slots = slots;
+    stats_region = shm;
+    stats_taken = taken;
+    return 0;
+}
+
+/* Initialise counters of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being set up
+ * @return int 0 on success or -1 on error.
+ */
+int stats_initialise(netlib_ctx *ctx) {
+    int slot = -1;
+
+    call_once(&stats_once, stats_lock_init);
+    mtx_lock(&stats_lock);
+    if (stats_region || stats_map(0, NETLIB_STATS_SLOTS) == 0) {
+        for (unsigned i = 0; i < stats_region->slots; i++) {
+            if (!stats_taken[i]) {
+                stats_taken[i] = 1;
+                slot = i;
+                if (i >= stats_region->used) {
+                    __atomic_store_n(&stats_region->used, i + 1, __ATOMIC_RELEASE);
+                }
+                break;
+            }
+        }
+    }
+    mtx_unlock(&stats_lock);
+
+    // Out of blocks, count anyway but nobody gets to see it
+    if (slot == -1) {
+        ctx->stats = netlib_ctx_alloc(sizeof(netlib_stats));
+        if (!ctx->stats) {
+            return -1;
+        }
+    } else {
+        ctx->stats = stats_block(stats_region, slot);
+    }
+    ctx->stats_slot = slot;
+    return 0;
+}
+
+/* Finalise counters of a stack instance
+ *
+ * @param netlib_ctx *ctx -- Pointer to instance being torn down
+ */
+void stats_finalise(netlib_ctx *ctx) {
+    if (!ctx->stats) {
+        return;
+    }
+    if (ctx->stats_slot == -1) {
+        free(ctx->stats);
+    } else {
+        mtx_lock(&stats_lock);
+        stats_taken[ctx->stats_slot] = 0;
+        mtx_unlock(&stats_lock);
+    }
+    ctx->stats = 0;
+}
+
+/* Export counters of this process as POSIX shared memory.
+ *
+ * @param const char *name -- Name of segment, NETLIB_STATS_SHM by default
+ * @param unsigned slots   -- Most stack instances alive at the same time
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, EBUSY if instances already exist.
+ */
+int netlib_stats_export(const char *name, unsigned slots) {
+    if (!name || !slots) {
+        errno = EINVAL;
+        return -1;
+    }
+    call_once(&stats_once, stats_lock_init);
+    mtx_lock(&stats_lock);
+    if (stats_region && stats_region->used) {
+        mtx_unlock(&stats_lock);
+        errno = EBUSY;
+        return -1;
+    }
+    if (stats_region) {
+        munmap(stats_region, stats_size(stats_region->slots));
+        free(stats_taken);
+        stats_region = 0;
+        stats_taken = 0;
+    }
+    int ret = stats_map(name, slots);
+    mtx_unlock(&stats_lock);
+    return ret;
+}
+
+/* Remove exported segment
+ *
+ * @param const char *name -- Name of segment
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int netlib_stats_unlink(const char *name) {
+    return shm_unlink(name);
+}
+
+/* Map counters exported by another process, read only
+ *
+ * @param const char *name -- Name of segment
+ * @return pointer to segment on success or 0 on error.
+ *         Set errno on error, EPROTO if segment has an unknown layout.
+ */
+const netlib_stats_shm *netlib_stats_attach(const char *name) {
+    struct stat st;
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return 0;
+    }
+    if ((size_t)st.st_size < sizeof(netlib_stats_shm)) {
+        close(fd);
+        errno = EPROTO;
+        return 0;
+    }
+    netlib_stats_shm *shm = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        return 0;
+    }
+    if (shm->magic != NETLIB_STATS_MAGIC || shm->version != NETLIB_STATS_VERSION ||
+            shm->count != NETLIB_STAT_COUNT ||
+            (size_t)st.st_size < stats_size(shm->slots)) {
+        munmap(shm, st.st_size);
+        errno = EPROTO;
+        return 0;
+    }
+    return shm;
+}
+
+/* Unmap segment mapped with netlib_stats_attach()
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment
+ */
+void netlib_stats_detach(const netlib_stats_shm *shm) {
+    munmap((void *)shm, stats_size(shm->slots));
+}
+
+/* Get counters of a single instance from a segment
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment, 0 for our own
+ * @param unsigned slot               -- Index of block, below shm->used
+ * @return const netlib_stats * pointer to counters, or 0 if there's no such block
+ */
+const netlib_stats *netlib_stats_slot(const netlib_stats_shm *shm, unsigned slot) {
+    if (!shm) {
+        shm = stats_region;
+    }
+    if (!shm || slot >= __atomic_load_n(&shm->used, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    return stats_block(shm, slot);
+}
+
+/* Sum up counters of every instance in a segment
+ *
+ * @param const netlib_stats_shm *shm -- Pointer to segment, 0 for our own
+ * @param netlib_stats *sum           -- Where totals are written to
+ */
+void netlib_stats_sum(const netlib_stats_shm *shm, netlib_stats *sum) {
+    uint64_t *out = (uint64_t *)sum;
+    const netlib_stats *s;
+
+    memset(sum, 0, sizeof(netlib_stats));
+    for (unsigned slot = 0; (s = netlib_stats_slot(shm, slot)); slot++) {
+        for (unsigned i = 0; i < NETLIB_STAT_COUNT; i++) {
+            out[i] += netlib_stat_get(s, i);
+        }
+    }
+}
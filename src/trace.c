@@ -0,0 +1,294 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-packet transmit latency tracing */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ctx.h>
+#include <hist.h>
+#include <socket.h>
+#include <trace.h>
+
+const char *const trace_stage_names[TRACE_STAGES] = {
+    [TRACE_UDP_IP]          = "udp_ip",
+    [TRACE_IP_LINK]         = "ip_link",
+    [TRACE_LINK_TRANSMIT]   = "link_transmit",
+    [TRACE_TRANSMIT_RETURN] = "transmit_return",
+    [TRACE_TOTAL]           = "total",
+    [TRACE_KERNEL_SCHED]    = "kernel_sched",
+    [TRACE_KERNEL_SND]      = "kernel_snd",
+    [TRACE_KERNEL_HW]       = "kernel_hw"
+};
+
+/* Send waiting for its kernel timestamps
+ *
+ * @member uint32_t id    -- Id of the first frame of the send
+ * @member uint64_t begin -- When the send started
+ */
+typedef struct {
+    uint32_t id;
+    uint64_t begin;
+} trace_pending;
+
+/* Tracing state of a socket
+ *
+ * @member uint64_t t           -- Timestamps of the send in progress, 0 for
+ *                                 points it hasn't reached
+ * @member int active           -- Send in progress is being traced
+ * @member int handed           -- First frame of the send has an id
+ * @member uint32_t next_id     -- Id the kernel gives to the next frame
+ * @member size_t mem           -- Bytes charged to the socket
+ * @member trace_pending pending -- Sends waiting for kernel timestamps, by id
+ * @member hdr_hist hist        -- Histogram per stage
+ */
+typedef struct {
+    uint64_t t[TRACE_POINTS];
+    int active;
+    int handed;
+    uint32_t next_id;
+    size_t mem;
+    trace_pending pending[TRACE_PENDING];
+    hdr_hist hist[TRACE_STAGES];
+} trace_state;
+
+/* Timestamps are taken from the realtime clock, as that's what the kernel
+ * uses for software transmit timestamps.
+ */
+static inline uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+/* Start tracing sends on a socket.
+ *
+ * @param net_socket *sock -- Pointer to socket to trace
+ * @param int hw           -- Ask the NIC for hardware timestamps as well
+ * @return int 0 on success or -1 on error.
+ *         set errno on error, ENOSYS if built without NETLIB_TRACE.
+ */
+int trace_enable(net_socket *sock, int hw) {
+#ifndef NETLIB_TRACE
+    // Trace points are compiled out, nothing would ever get recorded
+    errno = ENOSYS;
+    return -1;
+#endif
+    if (sock->trace) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Frames already sent have taken ids we don't know about
+    transmit_flush(sock);
+    if (socket_mem_charge(sock, sizeof(trace_state)) == -1) {
+        return -1;
+    }
+    trace_state *ts = netlib_ctx_alloc(sizeof(trace_state));
+    if (!ts) {
+        socket_mem_uncharge(sock, sizeof(trace_state));
+        return -1;
+    }
+    ts->mem = sizeof(trace_state);
+    for (unsigned i = 0; i < TRACE_STAGES; i++) {
+        hist_reset(&ts->hist[i]);
+    }
+    if (socket_set_tx_timestamps(sock, hw) == -1) {
+        int err = errno;
+        socket_mem_uncharge(sock, ts->mem);
+        free(ts);
+        errno = err;
+        return -1;
+    }
+    sock->trace = ts;
+    return 0;
+}
+
+/* Stop tracing a socket and release histograms
+ *
+ * @param net_socket *sock -- Pointer to socket
+ */
+void trace_disable(net_socket *sock) {
+    trace_state *ts = (trace_state *)sock->trace;
+
+    if (!ts) {
+        return;
+    }
+    socket_clear_tx_timestamps(sock);
+    sock->trace = 0;
+    socket_mem_uncharge(sock, ts->mem);
+    free(ts);
+}
+
+/* Collect transmit timestamps reported by the kernel. Timestamps of
+ * frames other than the first of a traced send are thrown away.
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ * @return unsigned amount of timestamps collected
+ */
+unsigned trace_poll(net_socket *sock) {
+    static const int stages[] = {
+        [TX_TSTAMP_SCHED] = TRACE_KERNEL_SCHED,
+        [TX_TSTAMP_SND]   = TRACE_KERNEL_SND,
+        [TX_TSTAMP_HW]    = TRACE_KERNEL_HW
+    };
+    trace_state *ts = (trace_state *)sock->trace;
+    tx_timestamp tx;
+    unsigned ret = 0;
+
+    if (!ts) {
+        return 0;
+    }
+    while (receive_tx_timestamp(sock, &tx) == 0) {
+        trace_pending *p = &ts->pending[tx.id % TRACE_PENDING];
+        // Hardware clock may not be synced, so it can seem to run behind
+        if (!p->begin || p->id != tx.id || tx.ns < p->begin) {
+            continue;
+        }
+        hist_record(&ts->hist[stages[tx.type]], tx.ns - p->begin);
+        ret++;
+    }
+    return ret;
+}
+
+/* Get histogram of a stage
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ * @param int stage        -- Refer to enum TRACE_STAGE
+ * @return pointer to histogram or 0 if socket isn't traced.
+ */
+const hdr_hist *trace_histogram(net_socket *sock, int stage) {
+    trace_state *ts = (trace_state *)sock->trace;
+
+    if (!ts || stage < 0 || stage >= TRACE_STAGES) {
+        return 0;
+    }
+    return &ts->hist[stage];
+}
+
+/* Empty all histograms of a socket
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ */
+void trace_reset(net_socket *sock) {
+    trace_state *ts = (trace_state *)sock->trace;
+
+    if (!ts) {
+        return;
+    }
+    for (unsigned i = 0; i < TRACE_STAGES; i++) {
+        hist_reset(&ts->hist[i]);
+    }
+}
+
+/* Start of a traced send
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ */
+void trace_begin(net_socket *sock) {
+    trace_state *ts = (trace_state *)sock->trace;
+
+    memset(ts->t, 0, sizeof(ts->t));
+    ts->t[TRACE_UDP] = trace_now();
+    ts->active = 1;
+    ts->handed = 0;
+}
+
+/* Send reached a point in the transmit path. Sends that aren't being
+ * traced, like ones not coming from UDP, are left alone.
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ * @param int point        -- Refer to enum TRACE_POINT
+ */
+void trace_point(net_socket *sock, int point) {
+    trace_state *ts = (trace_state *)sock->trace;
+
+    if (ts->active && !ts->t[point]) {
+        ts->t[point] = trace_now();
+    }
+}
+
+/* Record a stage if the send got through both ends of it
+ *
+ * @param trace_state *ts -- Pointer to tracing state
+ * @param int stage       -- Refer to enum TRACE_STAGE
+ * @param int from        -- Point stage starts at
+ * @param uint64_t to     -- Time stage ended, 0 if it didn't
+ */
+static inline void trace_stage(trace_state *ts, int stage, int from, uint64_t to) {
+    if (ts->t[from] && to >= ts->t[from]) {
+        hist_record(&ts->hist[stage], to - ts->t[from]);
+    }
+}
+
+/* End of a traced send
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ */
+void trace_end(net_socket *sock) {
+    trace_state *ts = (trace_state *)sock->trace;
+    uint64_t now = trace_now();
+
+    trace_stage(ts, TRACE_UDP_IP, TRACE_UDP, ts->t[TRACE_IP]);
+    trace_stage(ts, TRACE_IP_LINK, TRACE_IP, ts->t[TRACE_LINK]);
+    trace_stage(ts, TRACE_LINK_TRANSMIT, TRACE_LINK, ts->t[TRACE_TRANSMIT]);
+    trace_stage(ts, TRACE_TRANSMIT_RETURN, TRACE_TRANSMIT, ts->t[TRACE_RETURN]);
+    // Sends that failed before getting anywhere aren't worth counting
+    if (ts->t[TRACE_IP]) {
+        trace_stage(ts, TRACE_TOTAL, TRACE_UDP, now);
+    }
+    ts->active = 0;
+}
+
+/* Frame is about to be handed to the kernel. The kernel numbers frames
+ * in the order it gets them, so we do too, and remember which one is
+ * the first frame of the send in progress. Frames held back by the
+ * scheduler or pacer come through here outside of any send, and aren't
+ * matched with their kernel timestamps.
+ *
+ * @param net_socket *sock -- Pointer to traced socket
+ */
+void trace_kernel(net_socket *sock) {
+    trace_state *ts = (trace_state *)sock->trace;
+    uint32_t id = ts->next_id++;
+
+    if (ts->active && !ts->handed) {
+        trace_pending *p = &ts->pending[id % TRACE_PENDING];
+        p->id = id;
+        p->begin = ts->t[TRACE_UDP];
+        ts->handed = 1;
+    }
+}
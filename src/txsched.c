@@ -0,0 +1,333 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Strict priority and deficit round robin transmit scheduling */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctx.h>
+#include <eth.h>
+#include <ip.h>
+#include <link.h>
+#include <pacer.h>
+#include <socket.h>
+#include <txsched.h>
+
+// Frames a class holds unless configured otherwise
+#define TXSCHED_DEFAULT_LIMIT 256
+
+// Frames sent per txsched_run() unless configured otherwise
+#define TXSCHED_DEFAULT_BATCH 64
+
+// DSCP of expedited forwarding
+#define TXSCHED_DSCP_EF 46
+
+/* Frames waiting in a single class
+ *
+ * @member unsigned head     -- Oldest frame
+ * @member unsigned count    -- Amount of waiting frames
+ * @member unsigned limit    -- Amount of frames the class holds
+ * @member unsigned quantum  -- Bytes added to deficit per round
+ * @member unsigned deficit  -- Bytes the class may still send this round
+ * @member uint16_t *len     -- Size of the frame, per buffer
+ * @member uint8_t *frames   -- Frame buffers
+ */
+struct txsched_queue {
+    unsigned head;
+    unsigned count;
+    unsigned limit;
+    unsigned quantum;
+    unsigned deficit;
+    uint16_t *len;
+    uint8_t *frames;
+};
+
+/* Scheduler of a socket
+ *
+ * @member uint8_t map      -- Class of each DSCP value
+ * @member unsigned batch   -- Most frames sent per txsched_run()
+ * @member unsigned rr      -- Round robin class being served
+ * @member int fresh        -- rr hasn't been given its quantum yet
+ * @member size_t slot      -- Size of a single frame buffer
+ * @member size_t mem       -- Bytes charged to the socket for the scheduler
+ * @member struct txsched_queue q -- Queue per class
+ */
+struct txsched {
+    uint8_t map[TXSCHED_DSCP_MAX];
+    unsigned batch;
+    unsigned rr;
+    int fresh;
+    size_t slot;
+    size_t mem;
+    struct txsched_queue q[TXSCHED_CLASSES];
+};
+
+/* Pick default class of a DSCP value. Both RFC 791 precedence and the
+ * RFC 1349 TOS bits set by ipv4_socket_options are honored.
+ *
+ * @param uint8_t dscp -- DSCP value
+ * @return enum TXSCHED_CLASS class
+ */
+static enum TXSCHED_CLASS txsched_default_class(uint8_t dscp) {
+    uint8_t tos = dscp << 2;
+    uint8_t pre = tos >> 5;
+
+    if (dscp == TXSCHED_DSCP_EF || pre >= INTERNETWORK_CTRL) {
+        return TXSCHED_CONTROL;
+    }
+    if (pre >= FLASH || (tos & IPV4_TOS_LOW_DELAY)) {
+        return TXSCHED_INTERACTIVE;
+    }
+    if (pre == PRIORITY || (tos & IPV4_TOS_THROUGHPUT)) {
+        return TXSCHED_BULK;
+    }
+    return TXSCHED_BEST_EFFORT;
+}
+
+/* Release memory of a scheduler
+ *
+ * @param struct txsched *s -- Pointer to scheduler
+ */
+static void txsched_free(struct txsched *s) {
+    for (unsigned i = 0; i < TXSCHED_CLASSES; i++) {
+        free(s->q[i].len);
+        free(s->q[i].frames);
+    }
+    free(s);
+}
+
+/* Start scheduling frames sent on a socket.
+ *
+ * @param net_socket *sock          -- Pointer to socket we're working with
+ * @param const txsched_config *cfg -- Scheduler configuration
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int txsched_attach(net_socket *sock, const txsched_config *cfg) {
+    static const unsigned weight[TXSCHED_CLASSES] = {
+        [TXSCHED_INTERACTIVE] = 4,
+        [TXSCHED_BEST_EFFORT] = 2,
+        [TXSCHED_BULK]        = 1
+    };
+    link_options *link = (link_options *)sock->link_options;
+
+    if (sock->txsched) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t slot = (link->mtu + sizeof(eth_hdr) + 4 + NETLIB_CACHELINE - 1) &
+        ~(size_t)(NETLIB_CACHELINE - 1);
+    size_t mem = sizeof(struct txsched);
+    for (unsigned i = 0; i < TXSCHED_CLASSES; i++) {
+        mem += (cfg->limit[i] ? cfg->limit[i] : TXSCHED_DEFAULT_LIMIT) *
+            (sizeof(uint16_t) + slot);
+    }
+    if (socket_mem_charge(sock, mem) == -1) {
+        return -1;
+    }
+
+    struct txsched *s = netlib_ctx_alloc(sizeof(struct txsched));
+    if (!s) {
+        socket_mem_uncharge(sock, mem);
+        return -1;
+    }
+    s->mem = mem;
+    for (uint8_t dscp = 0; dscp < TXSCHED_DSCP_MAX; dscp++) {
+        s->map[dscp] = txsched_default_class(dscp);
+    }
+    s->batch = cfg->batch ? cfg->batch : TXSCHED_DEFAULT_BATCH;
+    s->rr = TXSCHED_INTERACTIVE;
+    s->fresh = 1;
+    s->slot = slot;
+
+    for (unsigned i = 0; i < TXSCHED_CLASSES; i++) {
+        struct txsched_queue *q = &s->q[i];
+        q->limit = cfg->limit[i] ? cfg->limit[i] : TXSCHED_DEFAULT_LIMIT;
+        q->quantum = cfg->quantum[i] ? cfg->quantum[i] :
+            weight[i] * (link->mtu + sizeof(eth_hdr));
+        q->len = netlib_ctx_alloc(q->limit * sizeof(uint16_t));
+        q->frames = netlib_ctx_alloc(q->limit * s->slot);
+        if (!q->len || !q->frames) {
+            socket_mem_uncharge(sock, mem);
+            txsched_free(s);
+            return -1;
+        }
+    }
+    sock->txsched = s;
+    return 0;
+}
+
+/* Stop scheduling frames sent on a socket.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ */
+void txsched_detach(net_socket *sock) {
+    if (sock->txsched) {
+        socket_mem_uncharge(sock, ((struct txsched *)sock->txsched)->mem);
+        txsched_free((struct txsched *)sock->txsched);
+        sock->txsched = 0;
+    }
+}
+
+/* Override class of a DSCP value
+ *
+ * @param net_socket *sock -- Pointer to socket with a scheduler
+ * @param uint8_t dscp     -- DSCP value, upper six bits of TOS
+ * @param unsigned cls     -- Refer to enum TXSCHED_CLASS
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+int txsched_map(net_socket *sock, uint8_t dscp, unsigned cls) {
+    struct txsched *s = (struct txsched *)sock->txsched;
+
+    if (!s || dscp >= TXSCHED_DSCP_MAX || cls >= TXSCHED_CLASSES) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->map[dscp] = cls;
+    return 0;
+}
+
+/* Queue a frame on its class.
+ *
+ * @param net_socket *sock -- Pointer to socket with a scheduler
+ * @param const void *data -- Pointer to frame, copied
+ * @param size_t len       -- Size of the frame
+ * @return size_t len on success or -1 on error.
+ *         Set errno on error, ENOBUFS if the class is full.
+ */
+size_t txsched_enqueue(net_socket *sock, const void *data, size_t len) {
+    struct txsched *s = (struct txsched *)sock->txsched;
+    const ipv4_hdr *iph = link_ipv4_hdr(sock, data, len);
+    unsigned cls = iph ? s->map[iph->tos >> 2] : TXSCHED_CONTROL;
+    struct txsched_queue *q = &s->q[cls];
+
+    if (q->count == q->limit || len > s->slot) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    unsigned tail = (q->head + q->count) % q->limit;
+    memcpy(q->frames + (tail * s->slot), data, len);
+    q->len[tail] = (uint16_t)len;
+    q->count++;
+    return len;
+}
+
+/* Send oldest frame of a class
+ *
+ * @param net_socket *sock        -- Pointer to socket we're working with
+ * @param struct txsched *s       -- Scheduler of the socket
+ * @param struct txsched_queue *q -- Class to send from
+ */
+static inline void txsched_pop(net_socket *sock, struct txsched *s,
+        struct txsched_queue *q)
+{
+    const uint8_t *frame = q->frames + (q->head * s->slot);
+
+    if (sock->pacer) {
+        pacer_enqueue(sock, frame, q->len[q->head]);
+    } else {
+        transmit_at(sock, frame, q->len[q->head], 0);
+    }
+    q->head = (q->head + 1) % q->limit;
+    q->count--;
+}
+
+/* Send a batch of waiting frames, control class first.
+ *
+ * @param net_socket *sock -- Pointer to socket we're working with
+ * @return unsigned amount of frames sent
+ */
+unsigned txsched_run(net_socket *sock) {
+    struct txsched *s = (struct txsched *)sock->txsched;
+    struct txsched_queue *q;
+    unsigned sent = 0;
+
+    if (!s) {
+        return 0;
+    }
+    q = &s->q[TXSCHED_CONTROL];
+    while (q->count && sent < s->batch) {
+        txsched_pop(sock, s, q);
+        sent++;
+    }
+
+    // Stop once every round robin class has been found empty in a row
+    unsigned idle = 0;
+    while (sent < s->batch && idle < (TXSCHED_CLASSES - 1)) {
+        q = &s->q[s->rr];
+        if (q->count) {
+            idle = 0;
+            if (s->fresh) {
+                q->deficit += q->quantum;
+                s->fresh = 0;
+            }
+            while (q->count && sent < s->batch && q->len[q->head] <= q->deficit) {
+                q->deficit -= q->len[q->head];
+                txsched_pop(sock, s, q);
+                sent++;
+            }
+            if (q->count && q->len[q->head] <= q->deficit) {
+                // Batch ran out, carry on with this class next time
+                break;
+            }
+        } else {
+            idle++;
+        }
+        if (!q->count) {
+            q->deficit = 0;
+        }
+        s->rr = (s->rr == (TXSCHED_CLASSES - 1)) ? TXSCHED_INTERACTIVE : (s->rr + 1);
+        s->fresh = 1;
+    }
+    transmit_flush(sock);
+    return sent;
+}
+
+/* Get amount of frames waiting in a class
+ *
+ * @param net_socket *sock -- Pointer to socket with a scheduler
+ * @param unsigned cls     -- Refer to enum TXSCHED_CLASS
+ * @return unsigned amount of waiting frames
+ */
+unsigned txsched_backlog(net_socket *sock, unsigned cls) {
+    struct txsched *s = (struct txsched *)sock->txsched;
+
+    if (!s || cls >= TXSCHED_CLASSES) {
+        return 0;
+    }
+    return s->q[cls].count;
+}
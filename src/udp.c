@@ -33,16 +33,30 @@
 /* Helpers for crafting udp header, and reading/writing data over udp. */
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <csum.h>
 #include <data_util.h>
 #include <ip.h>
+#include <link.h>
+#include <pacer.h>
 #include <udp.h>
 #include <socket.h>
+#include <stats.h>
+#include <trace.h>
+#include <txsched.h>
 
 /* Create udp header for user.
  *
@@ -63,16 +77,51 @@ udp_hdr *create_udp_hdr(uint16_t sport, uint16_t dport,
      * sockaddr_in->sin_port here without h aving to worry about 
      * compability issues between ipv4 and ipv6.
      */
-    ret->dst = htons(dport);
-    ret->src = htons(sport);
-    ret->len = htons(len + sizeof(udp_hdr));
-
     // TODO: UDP Checksums
-    ret->csum = htons(0x0000);
+    udp_set_hdr(ret, sport, dport, len + sizeof(udp_hdr));
 
     return ret;
 }
 
+/* UDP encapsulation node of the TX graph.
+ *
+ * @param net_socket *sock -- Pointer to socket we're sending on
+ * @param pkt_vector *v    -- Vector of payloads queued with pkt_vector_add()
+ * @return unsigned amount of datagrams left in vector
+ */
+unsigned udp_encap_vec(net_socket *sock, pkt_vector *v) {
+    for (unsigned i = 0; i < v->count; i++) {
+        pkt_desc *d = &v->desc[i];
+        if ((i + GRAPH_PREFETCH) < v->count) {
+            __builtin_prefetch(v->desc[i + GRAPH_PREFETCH].data - sizeof(udp_hdr), 1);
+        }
+        d->data -= sizeof(udp_hdr);
+        d->len += sizeof(udp_hdr);
+
+        udp_hdr *uhdr = (udp_hdr *)d->data;
+        udp_set_hdr(uhdr, d->sport, d->dport, d->len);
+        uint32_t sum = csum_add(d->src, d->dst);
+        sum = csum_add(sum, htons(IPV4_PTCL_UDP));
+        sum = csum_add(sum, htons(d->len));
+        uint16_t folded = csum_fold(csum_partial(uhdr, d->len, sum));
+        // Zero would mean we didn't compute one
+        udp_set_csum(uhdr, folded ? folded : 0xffff);
+        NETLIB_STAT_ADD(sock->ctx, udp_tx_bytes, d->len);
+    }
+    NETLIB_STAT_ADD(sock->ctx, udp_tx_packets, v->count);
+    return v->count;
+}
+
+/* Get largest UDP payload we can send to destination in a single datagram
+ *
+ * @param net_socket *sock     -- Pointer to populated net_socket structure
+ * @param uint32_t dst_addr    -- Destination IP address
+ * @return size_t maximum payload size in bytes
+ */
+size_t udp_max_payload(net_socket *sock, uint32_t dst_addr) {
+    return ipv4_path_mtu(sock, dst_addr) - sizeof(ipv4_hdr) - sizeof(udp_hdr);
+}
+
 /* Send a message over UDP to a remote host
  *
  * @param net_socket *sock     -- Pointer to populated net_socket structure
@@ -82,25 +131,435 @@ udp_hdr *create_udp_hdr(uint16_t sport, uint16_t dport,
  * @param uint16_t dport       -- UDP Port to send our data to
  * @param uint8_t *data        -- Pointer to data to transmit
  * @param size_t len           -- Amount of bytes to send
- * @return size_t bytes sent
+ * @return size_t bytes sent or -1 on error.
+ *         Set errno on error, EMSGSIZE if len exceeds udp_max_payload(),
+ *         ENOMEM if allocating the datagram fails.
  */
 size_t udp_send(net_socket *sock, uint32_t src_addr, uint32_t dst_addr,
         uint16_t sport, uint16_t dport, uint8_t *data, size_t len)
 {
+    TRACE_BEGIN(sock);
+    if (len > udp_max_payload(sock, dst_addr)) {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_errors);
+        TRACE_END(sock);
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    NETLIB_STAT_ADD(sock->ctx, alloc, 2);
     udp_hdr *uhdr  = create_udp_hdr(sport, dport, data, len);
     if (!uhdr) {
-        return 0;
+        NETLIB_STAT_INC(sock->ctx, alloc_failures);
+        TRACE_END(sock);
+        errno = ENOMEM;
+        return -1;
     }
-    void *packet = realloc(uhdr, uhdr->len);
+    void *packet = realloc(uhdr, sizeof(udp_hdr) + len);
     if (!packet) {
+        NETLIB_STAT_INC(sock->ctx, alloc_failures);
+        TRACE_END(sock);
         free(uhdr);
-        return 0;
+        errno = ENOMEM;
+        return -1;
     }
-    memcpy(POINTER_ADD(void *, uhdr, sizeof(udp_hdr)), data, len);
+    memcpy(POINTER_ADD(void *, packet, sizeof(udp_hdr)), data, len);
 
     size_t sent = ipv4_transmit_datagram(sock, src_addr, dst_addr, packet, (sizeof(udp_hdr) + len));
+    TRACE_END(sock);
+    if (sent == (size_t)-1) {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_errors);
+    } else {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_packets);
+        NETLIB_STAT_ADD(sock->ctx, udp_tx_bytes, sizeof(udp_hdr) + len);
+    }
 
     free(packet);
     return sent;
 }
 
+/* Send a message gathered from several buffers over UDP to a remote host.
+ *
+ * @param net_socket *sock        -- Pointer to populated net_socket structure
+ * @param uint32_t src_addr       -- Source IP address
+ * @param uint32_t dst_addr       -- Destination IP address
+ * @param uint16_t sport          -- UDP Port to send our data from
+ * @param uint16_t dport          -- UDP Port to send our data to
+ * @param const struct iovec *iov -- Payload pieces
+ * @param int iovcnt              -- Amount of entries in iov, at most UDP_SENDV_MAX_IOV
+ * @return size_t bytes sent or -1 on error.
+ *         Set errno on error, EMSGSIZE if payload exceeds udp_max_payload(),
+ *         EINVAL if there's too many pieces.
+ */
+size_t udp_sendv(net_socket *sock, uint32_t src_addr, uint32_t dst_addr,
+        uint16_t sport, uint16_t dport, const struct iovec *iov, int iovcnt)
+{
+    // Headers of every layer get prepended in here, back to front
+    uint8_t prefix[LINK_HEADROOM + sizeof(ipv4_hdr) + sizeof(udp_hdr)];
+    struct iovec vec[UDP_SENDV_MAX_IOV + 1];
+
+    TRACE_BEGIN(sock);
+    if (iovcnt < 0 || iovcnt > UDP_SENDV_MAX_IOV) {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_errors);
+        TRACE_END(sock);
+        errno = EINVAL;
+        return -1;
+    }
+    size_t len = iov_length(iov, iovcnt);
+    if (len > udp_max_payload(sock, dst_addr)) {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_errors);
+        TRACE_END(sock);
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    udp_hdr *uhdr = POINTER_ADD(udp_hdr *, prefix, sizeof(prefix) - sizeof(udp_hdr));
+    uint16_t ulen = (uint16_t)(sizeof(udp_hdr) + len);
+    udp_set_hdr(uhdr, sport, dport, ulen);
+
+    uint32_t sum = csum_add(src_addr, dst_addr);
+    sum = csum_add(sum, htons(IPV4_PTCL_UDP));
+    sum = csum_add(sum, htons(ulen));
+    sum = csum_partial(uhdr, sizeof(udp_hdr), sum);
+    uint16_t folded = csum_fold(csum_partial_iov(iov, iovcnt, sum));
+    // Zero would mean we didn't compute one
+    udp_set_csum(uhdr, folded ? folded : 0xffff);
+
+    vec[0].iov_base = uhdr;
+    vec[0].iov_len = sizeof(udp_hdr);
+    memcpy(&vec[1], iov, iovcnt * sizeof(struct iovec));
+
+    size_t sent = ipv4_transmitv(sock, src_addr, dst_addr, vec, iovcnt + 1);
+    TRACE_END(sock);
+    if (sent == (size_t)-1) {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_errors);
+    } else {
+        NETLIB_STAT_INC(sock->ctx, udp_tx_packets);
+        NETLIB_STAT_ADD(sock->ctx, udp_tx_bytes, ulen);
+    }
+    return sent;
+}
+
+/* Wait until departure time of the next datagram
+ *
+ * @param uint64_t when -- Monotonic time to wait for, in nanoseconds
+ */
+static void udp_pace(uint64_t when) {
+    uint64_t now = monotonic_ns();
+
+    // Sleeping is too coarse for short gaps, spin through those
+    if (when > now + 50000) {
+        uint64_t ns = when - now - 50000;
+        struct timespec ts = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+        nanosleep(&ts, 0);
+    }
+    while (monotonic_ns() < when) {
+        __builtin_ia32_pause();
+    }
+}
+
+/* Stream part of a file out as UDP datagrams.
+ *
+ * @param net_socket *sock   -- Pointer to populated net_socket structure
+ * @param int fd             -- File to send, opened for reading
+ * @param off_t off          -- Offset in file to start from
+ * @param size_t len         -- Amount of bytes to send
+ * @param size_t dgram_size  -- Payload per datagram, 0 for udp_max_payload()
+ * @param uint32_t src_addr  -- Source IP address
+ * @param uint32_t dst_addr  -- Destination IP address
+ * @param uint16_t sport     -- UDP Port to send our data from
+ * @param uint16_t dport     -- UDP Port to send our data to
+ * @param uint64_t rate_bps  -- Payload bits per second to pace datagrams to,
+ *                              0 to send as fast as we can
+ * @return size_t amount of payload bytes sent, or -1 if nothing was sent.
+ *         Set errno on error.
+ */
+size_t udp_sendfile(net_socket *sock, int fd, off_t off, size_t len,
+        size_t dgram_size, uint32_t src_addr, uint32_t dst_addr,
+        uint16_t sport, uint16_t dport, uint64_t rate_bps)
+{
+    size_t max = udp_max_payload(sock, dst_addr);
+
+    if (!dgram_size) {
+        dgram_size = max;
+    }
+    if (dgram_size > max) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    // Touching the mapping past end of file would raise SIGBUS
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return -1;
+    }
+    if (off < 0 || off > st.st_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (len > (size_t)(st.st_size - off)) {
+        len = st.st_size - off;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    // Mapping has to start at page boundary
+    off_t page = sysconf(_SC_PAGESIZE);
+    off_t start = off & ~(page - 1);
+    size_t map_len = len + (off - start);
+    uint8_t *map = mmap(0, map_len, PROT_READ, MAP_SHARED, fd, start);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    posix_madvise(map, map_len, POSIX_MADV_SEQUENTIAL);
+    posix_fadvise(fd, off, UDP_SENDFILE_WINDOW, POSIX_FADV_WILLNEED);
+
+    const uint8_t *data = map + (off - start);
+    uint64_t t0 = monotonic_ns();
+    size_t ahead = UDP_SENDFILE_WINDOW;
+    size_t sent = 0;
+    unsigned retries = 0;
+    int err = 0;
+
+    while (sent < len) {
+        size_t n = ((len - sent) < dgram_size) ? (len - sent) : dgram_size;
+        struct iovec iov = { .iov_base = (void *)(data + sent), .iov_len = n };
+
+        // Keep the next window on its way in while we send this one
+        if ((sent + n) > (ahead - (UDP_SENDFILE_WINDOW / 2)) && ahead < len) {
+            posix_fadvise(fd, off + ahead, UDP_SENDFILE_WINDOW, POSIX_FADV_WILLNEED);
+            ahead += UDP_SENDFILE_WINDOW;
+        }
+        if (rate_bps) {
+            udp_pace(t0 + (uint64_t)(((double)sent * 8e9) / (double)rate_bps));
+        }
+        if (udp_sendv(sock, src_addr, dst_addr, sport, dport, &iov, 1) == (size_t)-1) {
+            if ((errno == ENOBUFS || errno == EAGAIN || errno == EINTR) &&
+                    retries++ < UDP_SENDFILE_RETRIES) {
+                /* Queue is full. If it's ours, nobody else is going to
+                 * drain it while we're in here.
+                 */
+                if (sock->pacer) {
+                    pacer_release(sock);
+                }
+                if (sock->txsched) {
+                    txsched_run(sock);
+                }
+                sched_yield();
+                continue;
+            }
+            err = errno;
+            break;
+        }
+        retries = 0;
+        sent += n;
+    }
+
+    munmap(map, map_len);
+    if (err) {
+        errno = err;
+        return sent ? sent : (size_t)-1;
+    }
+    return sent;
+}
+
+/* Send a message over UDP to a remote host over IPv6.
+ *
+ * @param net_socket *sock     -- Pointer to populated AF_INET6 net_socket structure
+ * @param const ipv6_addr *src -- Source IP address
+ * @param const ipv6_addr *dst -- Destination IP address
+ * @param uint16_t sport       -- UDP Port to send our data from
+ * @param uint16_t dport       -- UDP Port to send our data to
+ * @param uint8_t *data        -- Pointer to data to transmit
+ * @param size_t len           -- Amount of bytes to send
+ * @return size_t bytes sent or -1 on error.
+ *         Set errno on error, EMSGSIZE if datagram doesn't fit in link MTU.
+ */
+size_t udp6_send(net_socket *sock, const ipv6_addr *src, const ipv6_addr *dst,
+        uint16_t sport, uint16_t dport, uint8_t *data, size_t len)
+{
+    ipv6_socket_options *iopts = (ipv6_socket_options *)sock->ip_options;
+    size_t ulen = sizeof(udp_hdr) + len;
+
+    if ((sizeof(ipv6_hdr) + ulen) > iopts->mtu) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    udp_hdr *uhdr = (udp_hdr *)malloc(ulen);
+    if (!uhdr) {
+        return -1;
+    }
+    udp_set_hdr(uhdr, sport, dport, (uint16_t)ulen);
+    memcpy(POINTER_ADD(void *, uhdr, sizeof(udp_hdr)), data, len);
+
+    uint32_t sum = ipv6_psd_sum(sock, src, dst);
+    sum = csum_add(sum, htonl((uint32_t)ulen));
+    sum = csum_partial(uhdr, ulen, sum);
+    uint16_t folded = csum_fold(sum);
+    // Zero means no checksum, which isn't allowed over IPv6
+    udp_set_csum(uhdr, folded ? folded : 0xffff);
+
+    size_t sent = ipv6_transmit_datagram(sock, src, dst, uhdr, ulen);
+
+    free(uhdr);
+    return sent;
+}
+
+/* Submit a datagram for the I/O thread to send.
+ *
+ * @param mpsc_ring *ring      -- Ring the I/O thread drains with udp_drain()
+ * @param uint32_t src_addr    -- Source IP address
+ * @param uint32_t dst_addr    -- Destination IP address
+ * @param uint16_t sport       -- UDP Port to send our data from
+ * @param uint16_t dport       -- UDP Port to send our data to
+ * @param const void *data     -- Pointer to data to transmit, copied into the ring
+ * @param size_t len           -- Amount of bytes to send
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error, EAGAIN if the ring is full.
+ */
+int udp_submit(mpsc_ring *ring, uint32_t src_addr, uint32_t dst_addr,
+        uint16_t sport, uint16_t dport, const void *data, size_t len)
+{
+    size_t ticket;
+
+    if (len > (ring->elem_size - sizeof(udp_desc))) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    udp_desc *d = (udp_desc *)mpsc_reserve(ring, &ticket);
+    if (!d) {
+        return -1;
+    }
+    d->src = src_addr;
+    d->dst = dst_addr;
+    d->sport = sport;
+    d->dport = dport;
+    d->len = (uint16_t)len;
+    memcpy(d->data, data, len);
+    mpsc_commit(ring, ticket);
+    return 0;
+}
+
+/* Send datagrams submitted to socket's tx_ring. I/O thread only.
+ *
+ * @param net_socket *sock -- Pointer to socket with a tx_ring
+ * @param unsigned burst   -- Maximum amount of datagrams to send
+ * @return unsigned amount of datagrams taken off the ring
+ */
+unsigned udp_drain(net_socket *sock, unsigned burst) {
+    void *elems[UDP_DRAIN_MAX];
+
+    if (burst > UDP_DRAIN_MAX) {
+        burst = UDP_DRAIN_MAX;
+    }
+    unsigned n = mpsc_peek(sock->tx_ring, elems, burst);
+    for (unsigned i = 0; i < n; i++) {
+        udp_desc *d = (udp_desc *)elems[i];
+        if ((i + 1) < n) {
+            __builtin_prefetch(elems[i + 1]);
+        }
+        // Failures are the sender's to notice, same as with lost datagrams
+        udp_send(sock, d->src, d->dst, d->sport, d->dport, d->data, d->len);
+    }
+    mpsc_release(sock->tx_ring, n);
+    return n;
+}
+
+/* Check received datagram against the socket's address and bindings.
+ * The receive filter does the same in the kernel, but SLIP links and
+ * shared raw sockets have none.
+ *
+ * @param net_socket *sock    -- Pointer to socket the datagram was received on
+ * @param const ipv4_hdr *iph -- Pointer to IPv4 header of the datagram
+ * @param uint16_t dport      -- Destination port in host byte order
+ * @return bool true if the socket accepts the datagram
+ */
+static inline bool udp_bound(net_socket *sock, const ipv4_hdr *iph, uint16_t dport) {
+    link_options *link = (link_options *)sock->link_options;
+
+    if (link->addr) {
+        uint32_t dst = ipv4_dst(iph);
+        if (dst != link->addr && dst != (link->addr | ~link->netmask) &&
+                dst != 0xffffffff) {
+            return false;
+        }
+    }
+    for (unsigned i = 0; i < sock->binding_count; i++) {
+        const socket_binding *b = &sock->bindings[i];
+        if (b->ptcl == IPV4_PTCL_UDP && (!b->port || b->port == dport)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Handle UDP datagram we've received from the IPv4 layer.
+ *
+ * @param net_socket *sock -- Pointer to socket the datagram was received on
+ * @param void *frame      -- Pointer to start of the received frame
+ * @param size_t off       -- Offset of IPv4 header from start of the frame
+ * @param size_t len       -- Size of the frame up to end of IPv4 datagram
+ * @return size_t amount of bytes consumed on success or -1 if datagram was dropped.
+ *         Set errno on error.
+ */
+size_t udp_rx(net_socket *sock, void *frame, size_t off, size_t len) {
+    ipv4_hdr *iph = POINTER_ADD(ipv4_hdr *, frame, off);
+    size_t hlen = ipv4_hlen(iph);
+    udp_hdr *uhdr = POINTER_ADD(udp_hdr *, iph, hlen);
+    size_t avail = len - off - hlen;
+
+    if (avail < sizeof(udp_hdr)) {
+        NETLIB_STAT_INC(sock->ctx, udp_rx_hdr_errors);
+        errno = EINVAL;
+        return -1;
+    }
+    size_t ulen = udp_len(uhdr);
+    if (ulen < sizeof(udp_hdr) || ulen > avail) {
+        NETLIB_STAT_INC(sock->ctx, udp_rx_hdr_errors);
+        errno = EINVAL;
+        return -1;
+    }
+    if (udp_csum(uhdr)) {
+        uint32_t sum = csum_add(ipv4_src(iph), ipv4_dst(iph));
+        sum = csum_add(sum, htons(IPV4_PTCL_UDP));
+        sum = csum_add(sum, htons(ulen));
+        if (csum_fold(csum_partial(uhdr, ulen, sum)) != 0) {
+            NETLIB_STAT_INC(sock->ctx, udp_rx_csum_errors);
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+    if (!udp_bound(sock, iph, udp_dport(uhdr))) {
+        NETLIB_STAT_INC(sock->ctx, udp_rx_not_bound);
+        errno = ECONNREFUSED;
+        return -1;
+    }
+    if (!sock->rx_ring) {
+        NETLIB_STAT_INC(sock->ctx, udp_rx_drops);
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    size_t plen = ulen - sizeof(udp_hdr);
+    if (plen > (sock->rx_ring->elem_size - sizeof(udp_desc))) {
+        NETLIB_STAT_INC(sock->ctx, udp_rx_drops);
+        errno = EMSGSIZE;
+        return -1;
+    }
+    udp_desc *d = (udp_desc *)spsc_reserve(sock->rx_ring);
+    if (!d) {
+        NETLIB_STAT_INC(sock->ctx, udp_rx_drops);
+        errno = ENOBUFS;
+        return -1;
+    }
+    d->src = ipv4_src(iph);
+    d->dst = ipv4_dst(iph);
+    d->sport = udp_sport(uhdr);
+    d->dport = udp_dport(uhdr);
+    d->len = (uint16_t)plen;
+    memcpy(d->data, POINTER_ADD(void *, uhdr, sizeof(udp_hdr)), plen);
+    spsc_commit(sock->rx_ring);
+    NETLIB_STAT_INC(sock->ctx, udp_rx_packets);
+    NETLIB_STAT_ADD(sock->ctx, udp_rx_bytes, ulen);
+    return len;
+}
@@ -0,0 +1,551 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Van Jacobson TCP/IP header compression, RFC 1144
+ *
+ * Follows the reference implementation in the RFC, including its choice
+ * of when to send a segment uncompressed so the other end can resync.
+ */
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csum.h>
+#include <data_util.h>
+#include <ip.h>
+#include <tcp.h>
+#include <vj.h>
+
+// Change mask of a compressed frame, telling which fields follow
+#define VJ_NEW_C 0x40 // Connection number
+#define VJ_NEW_I 0x20 // IP ID delta
+#define VJ_PUSH  0x10 // Segment has PSH set
+#define VJ_NEW_S 0x08 // Sequence number delta
+#define VJ_NEW_A 0x04 // Acknowledgment number delta
+#define VJ_NEW_W 0x02 // Window delta
+#define VJ_NEW_U 0x01 // Urgent pointer
+
+/* Combinations that can't happen in a real segment, and stand for the
+ * two most common cases instead: echoed terminal traffic, where both
+ * sequence and ack number move by the amount of data in the last segment,
+ * and bulk data, where just the sequence number does.
+ */
+#define VJ_SPECIAL_I  (VJ_NEW_S | VJ_NEW_W | VJ_NEW_U)
+#define VJ_SPECIAL_D  (VJ_NEW_S | VJ_NEW_A | VJ_NEW_W | VJ_NEW_U)
+#define VJ_SPECIALS   0x0f
+
+// Most bytes the change mask, slot, checksum and deltas take
+#define VJ_MAX_DELTAS 19
+
+/* Write a delta, single byte if it fits or 0 and two bytes if not. Zero
+ * is never written, as the field is left out instead.
+ *
+ * @param uint8_t *cp -- Where to write
+ * @param uint16_t v  -- Delta to write
+ * @return uint8_t * pointer to just past what was written
+ */
+static inline uint8_t *vj_encode(uint8_t *cp, uint16_t v) {
+    if (v >= 256) {
+        *cp++ = 0;
+        store_be16(cp, v);
+        return cp + 2;
+    }
+    *cp++ = (uint8_t)v;
+    return cp;
+}
+
+/* Write a value that may be zero, which then takes three bytes
+ *
+ * @param uint8_t *cp -- Where to write
+ * @param uint16_t v  -- Value to write
+ * @return uint8_t * pointer to just past what was written
+ */
+static inline uint8_t *vj_encodez(uint8_t *cp, uint16_t v) {
+    if (!v) {
+        *cp++ = 0;
+        store_be16(cp, 0);
+        return cp + 2;
+    }
+    return vj_encode(cp, v);
+}
+
+/* Read a value written by vj_encode() or vj_encodez()
+ *
+ * @param const uint8_t *cp -- Pointer to frame
+ * @param size_t len        -- Size of frame
+ * @param size_t *i         -- Offset of the value, advanced past it
+ * @param uint16_t *v       -- Where the value is written to
+ * @return int 0 on success or -1 if the frame ends first
+ */
+static inline int vj_decode(const uint8_t *cp, size_t len, size_t *i, uint16_t *v) {
+    if (*i >= len) {
+        return -1;
+    }
+    if (cp[*i]) {
+        *v = cp[(*i)++];
+        return 0;
+    }
+    if ((*i + 3) > len) {
+        return -1;
+    }
+    *v = load_be16(cp + *i + 1);
+    *i += 3;
+    return 0;
+}
+
+/* Get amount of memory a state with given amount of slots takes
+ *
+ * @param unsigned slots -- Connections remembered in each direction
+ * @return size_t bytes
+ */
+size_t vj_mem(unsigned slots) {
+    return sizeof(vj_state) + slots * (1 + 2 * sizeof(vj_slot));
+}
+
+/* Create compression state for a link
+ *
+ * @param unsigned slots -- Connections remembered in each direction
+ * @return pointer to new state on success or 0 on error.
+ *         set errno on error.
+ */
+vj_state *vj_create(unsigned slots) {
+    if (slots < 3 || slots > VJ_MAX_SLOTS) {
+        errno = EINVAL;
+        return 0;
+    }
+    vj_state *vj = calloc(1, sizeof(vj_state));
+    if (!vj) {
+        return 0;
+    }
+    vj->slots = slots;
+    vj->last_tx = -1;
+    vj->last_rx = -1;
+    // Nothing to rebuild compressed frames from until a slot is loaded
+    vj->toss = 1;
+    vj->lru = malloc(slots);
+    vj->tx = calloc(slots, sizeof(vj_slot));
+    vj->rx = calloc(slots, sizeof(vj_slot));
+    if (!vj->lru || !vj->tx || !vj->rx) {
+        vj_destroy(vj);
+        return 0;
+    }
+    for (unsigned i = 0; i < slots; i++) {
+        vj->lru[i] = (uint8_t)i;
+    }
+    return vj;
+}
+
+/* Release compression state
+ *
+ * @param vj_state *vj -- Pointer to state
+ */
+void vj_destroy(vj_state *vj) {
+    if (!vj) {
+        return;
+    }
+    free(vj->lru);
+    free(vj->tx);
+    free(vj->rx);
+    free(vj);
+}
+
+/* Find transmit slot of the connection a segment belongs to, and make it
+ * the most recently used one. If there's none, the least recently used
+ * slot is taken over.
+ *
+ * @param vj_state *vj     -- Pointer to state
+ * @param const uint8_t *ip -- Pointer to IPv4 header of the segment
+ * @param size_t iphl      -- Size of the IPv4 header
+ * @param int *found       -- Set if the connection already had a slot
+ * @return unsigned slot of the connection
+ */
+static unsigned vj_lookup(vj_state *vj, const uint8_t *ip, size_t iphl, int *found) {
+    unsigned i;
+
+    *found = 0;
+    for (i = 0; i < vj->slots; i++) {
+        const vj_slot *s = &vj->tx[vj->lru[i]];
+        // Addresses, then ports
+        if (s->hlen && !memcmp(ip + 12, s->hdr + 12, 8) &&
+                !memcmp(ip + iphl, s->hdr + ipv4_hlen((const ipv4_hdr *)s->hdr), 4)) {
+            *found = 1;
+            break;
+        }
+    }
+    if (i == vj->slots) {
+        i--;
+    }
+    uint8_t id = vj->lru[i];
+    memmove(vj->lru + 1, vj->lru, i);
+    vj->lru[0] = id;
+    return id;
+}
+
+/* Work out the changes since last header of the connection
+ *
+ * @param const vj_slot *cs -- Slot of the connection
+ * @param const uint8_t *ip -- Pointer to segment
+ * @param size_t iphl       -- Size of its IPv4 header
+ * @param size_t hlen       -- Size of its IPv4 and TCP headers
+ * @param size_t len        -- Size of the segment
+ * @param uint8_t *deltas   -- Where to write encoded changes
+ * @param size_t *n         -- Where amount of bytes in deltas is written to
+ * @return int change mask, or -1 if segment has to be sent uncompressed
+ */
+static int vj_changes(const vj_slot *cs, const uint8_t *ip, size_t iphl, size_t hlen,
+        size_t len, uint8_t *deltas, size_t *n)
+{
+    const uint8_t *oip = cs->hdr;
+    const tcp_hdr *th = (const tcp_hdr *)(ip + iphl);
+    const tcp_hdr *oth = (const tcp_hdr *)(oip + iphl);
+    uint16_t olen = ipv4_len((const ipv4_hdr *)oip);
+    uint8_t *cp = deltas;
+    int changes = 0;
+
+    // Version, header length and TOS, then fragment bits, TTL and protocol
+    if (cs->hlen != hlen || memcmp(ip, oip, 2) || memcmp(ip + 6, oip + 6, 4) ||
+            memcmp(ip + sizeof(ipv4_hdr), oip + sizeof(ipv4_hdr), iphl - sizeof(ipv4_hdr)) ||
+            memcmp(th + 1, oth + 1, hlen - iphl - sizeof(tcp_hdr))) {
+        return -1;
+    }
+
+    if (th->flags & TCP_URG) {
+        cp = vj_encodez(cp, load_be16(th->urg));
+        changes |= VJ_NEW_U;
+    } else if (load_be16(th->urg) != load_be16(oth->urg) || (oth->flags & TCP_URG)) {
+        // Special cases don't tell URG went away
+        return -1;
+    }
+    uint16_t dw = load_be16(th->win) - load_be16(oth->win);
+    if (dw) {
+        cp = vj_encode(cp, dw);
+        changes |= VJ_NEW_W;
+    }
+    uint32_t da = load_be32(th->ack) - load_be32(oth->ack);
+    if (da) {
+        if (da > 0xffff) {
+            return -1;
+        }
+        cp = vj_encode(cp, (uint16_t)da);
+        changes |= VJ_NEW_A;
+    }
+    uint32_t ds = load_be32(th->seq) - load_be32(oth->seq);
+    if (ds) {
+        if (ds > 0xffff) {
+            return -1;
+        }
+        cp = vj_encode(cp, (uint16_t)ds);
+        changes |= VJ_NEW_S;
+    }
+
+    switch (changes) {
+    case (0):
+        /* Nothing changed. Data right after a bare ack is normal for
+         * interactive traffic, anything else is likely a retransmit
+         * and goes uncompressed in case the other end lost the original.
+         */
+        if (len == olen || olen != hlen) {
+            return -1;
+        }
+        break;
+    case (VJ_SPECIAL_I):
+    case (VJ_SPECIAL_D):
+        // Would be taken for the special cases
+        return -1;
+    case (VJ_NEW_S | VJ_NEW_A):
+        if (ds == da && ds == (uint32_t)(olen - hlen)) {
+            changes = VJ_SPECIAL_I;
+            cp = deltas;
+        }
+        break;
+    case (VJ_NEW_S):
+        if (ds == (uint32_t)(olen - hlen)) {
+            changes = VJ_SPECIAL_D;
+            cp = deltas;
+        }
+        break;
+    default:
+        break;
+    }
+
+    uint16_t di = ipv4_id((const ipv4_hdr *)ip) - ipv4_id((const ipv4_hdr *)oip);
+    if (di != 1) {
+        cp = vj_encodez(cp, di);
+        changes |= VJ_NEW_I;
+    }
+    if (th->flags & TCP_PSH) {
+        changes |= VJ_PUSH;
+    }
+    *n = (size_t)(cp - deltas);
+    return changes;
+}
+
+/* Compress an IPv4 datagram for the link.
+ *
+ * @param vj_state *vj     -- Pointer to state
+ * @param const void *data -- Pointer to IPv4 datagram
+ * @param size_t len       -- Size of the datagram
+ * @param void *out        -- Where to write the frame, room for len bytes
+ * @return size_t size of the frame written to out, or 0 if the datagram
+ *         should be sent as is
+ */
+size_t vj_compress(vj_state *vj, const void *data, size_t len, void *out) {
+    const uint8_t *ip = (const uint8_t *)data;
+    const ipv4_hdr *iph = (const ipv4_hdr *)data;
+    uint8_t deltas[VJ_MAX_DELTAS];
+    uint8_t *o = (uint8_t *)out;
+    size_t n = 0;
+    int found;
+
+    if (len < (sizeof(ipv4_hdr) + sizeof(tcp_hdr)) || ipv4_version(iph) != 4 ||
+            iph->ptcl != IPV4_PTCL_TCP || ipv4_len(iph) != len ||
+            (ipv4_flags_foff(iph) & 0x3fff)) {
+        return 0;
+    }
+    size_t iphl = ipv4_hlen(iph);
+    if (iphl < sizeof(ipv4_hdr) || (len - iphl) < sizeof(tcp_hdr)) {
+        return 0;
+    }
+    const tcp_hdr *th = (const tcp_hdr *)(ip + iphl);
+    size_t hlen = iphl + tcp_hlen(th);
+    // Connection setup and teardown are rare enough to send as is
+    if (tcp_hlen(th) < sizeof(tcp_hdr) || hlen > len ||
+            (th->flags & (TCP_SYN | TCP_FIN | TCP_RST | TCP_ACK)) != TCP_ACK) {
+        return 0;
+    }
+
+    unsigned id = vj_lookup(vj, ip, iphl, &found);
+    vj_slot *cs = &vj->tx[id];
+    int changes = found ? vj_changes(cs, ip, iphl, hlen, len, deltas, &n) : -1;
+
+    memcpy(cs->hdr, ip, hlen);
+    cs->hlen = (uint8_t)hlen;
+    if (changes == -1) {
+        // Whole datagram, with the slot in place of the protocol
+        memcpy(o, ip, len);
+        o[0] = (o[0] & 0x0f) | VJ_TYPE_UNCOMPRESSED_TCP;
+        o[9] = (uint8_t)id;
+        vj->last_tx = (int)id;
+        return len;
+    }
+
+    if (vj->last_tx != (int)id) {
+        *o++ = VJ_TYPE_COMPRESSED_TCP | VJ_NEW_C | (uint8_t)changes;
+        *o++ = (uint8_t)id;
+        vj->last_tx = (int)id;
+    } else {
+        *o++ = VJ_TYPE_COMPRESSED_TCP | (uint8_t)changes;
+    }
+    // TCP checksum goes as is, it covers the data for the other end
+    memcpy(o, th->csum, 2);
+    o += 2;
+    memcpy(o, deltas, n);
+    o += n;
+    memcpy(o, ip + hlen, len - hlen);
+    return (size_t)(o - (uint8_t *)out) + (len - hlen);
+}
+
+/* Drop a received frame and wait for resync
+ *
+ * @param vj_state *vj -- Pointer to state
+ * @return size_t -1, errno set to EBADMSG
+ */
+static size_t vj_drop(vj_state *vj) {
+    vj->toss = 1;
+    errno = EBADMSG;
+    return -1;
+}
+
+/* Load receive slot from an uncompressed TCP frame
+ *
+ * @param vj_state *vj      -- Pointer to state
+ * @param const uint8_t *cp -- Pointer to frame
+ * @param size_t len        -- Size of the frame
+ * @param uint8_t *out      -- Where to write the datagram
+ * @param size_t size       -- Size of out
+ * @return size_t size of the datagram on success or -1 if the frame was dropped.
+ */
+static size_t vj_reload(vj_state *vj, const uint8_t *cp, size_t len, uint8_t *out, size_t size) {
+    if (len < (sizeof(ipv4_hdr) + sizeof(tcp_hdr))) {
+        return vj_drop(vj);
+    }
+    size_t iphl = (cp[0] & 0x0f) * 4;
+    if (iphl < sizeof(ipv4_hdr) || (len - iphl) < sizeof(tcp_hdr) || cp[9] >= vj->slots) {
+        return vj_drop(vj);
+    }
+    size_t hlen = iphl + tcp_hlen((const tcp_hdr *)(cp + iphl));
+    if (hlen < (iphl + sizeof(tcp_hdr)) || hlen > len || load_be16(cp + 2) != len) {
+        return vj_drop(vj);
+    }
+    if (len > size) {
+        errno = EMSGSIZE;
+        vj->toss = 1;
+        return -1;
+    }
+
+    memcpy(out, cp, len);
+    out[0] = (out[0] & 0x0f) | VJ_TYPE_IP;
+    out[9] = IPV4_PTCL_TCP;
+
+    vj_slot *cs = &vj->rx[cp[9]];
+    memcpy(cs->hdr, out, hlen);
+    cs->hlen = (uint8_t)hlen;
+    vj->last_rx = cp[9];
+    vj->toss = 0;
+    return len;
+}
+
+/* Rebuild the IPv4 datagram of a received TCP frame
+ *
+ * @param vj_state *vj      -- Pointer to state
+ * @param const void *frame -- Pointer to frame
+ * @param size_t len        -- Size of the frame
+ * @param void *out         -- Where to write the datagram
+ * @param size_t size       -- Size of out
+ * @return size_t size of the datagram on success or -1 if the frame was dropped.
+ *         set errno on error.
+ */
+size_t vj_uncompress(vj_state *vj, const void *frame, size_t len, void *out, size_t size) {
+    const uint8_t *cp = (const uint8_t *)frame;
+    uint8_t hdr[VJ_MAX_HDR];
+    size_t i = 1;
+    uint16_t v;
+
+    if (!len) {
+        return vj_drop(vj);
+    }
+    switch (vj_type(cp[0])) {
+    case (VJ_TYPE_UNCOMPRESSED_TCP):
+        return vj_reload(vj, cp, len, (uint8_t *)out, size);
+    case (VJ_TYPE_COMPRESSED_TCP):
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    int changes = cp[0] & 0x7f;
+    if (changes & VJ_NEW_C) {
+        if (len < 2 || cp[1] >= vj->slots) {
+            return vj_drop(vj);
+        }
+        vj->last_rx = cp[1];
+        vj->toss = 0;
+        i = 2;
+    } else if (vj->toss) {
+        errno = EBADMSG;
+        return -1;
+    }
+    vj_slot *cs = &vj->rx[vj->last_rx];
+    if (!cs->hlen || (i + 2) > len) {
+        return vj_drop(vj);
+    }
+
+    // Work on a copy, so a truncated frame leaves the slot alone
+    size_t hlen = cs->hlen;
+    memcpy(hdr, cs->hdr, hlen);
+    ipv4_hdr *iph = (ipv4_hdr *)hdr;
+    tcp_hdr *th = (tcp_hdr *)(hdr + ipv4_hlen(iph));
+    uint16_t olen = ipv4_len(iph);
+
+    memcpy(th->csum, cp + i, 2);
+    i += 2;
+    if (changes & VJ_PUSH) {
+        th->flags |= TCP_PSH;
+    } else {
+        th->flags &= ~TCP_PSH;
+    }
+
+    switch (changes & VJ_SPECIALS) {
+    case (VJ_SPECIAL_I):
+        store_be32(th->ack, load_be32(th->ack) + (olen - hlen));
+        store_be32(th->seq, load_be32(th->seq) + (olen - hlen));
+        break;
+    case (VJ_SPECIAL_D):
+        store_be32(th->seq, load_be32(th->seq) + (olen - hlen));
+        break;
+    default:
+        if (changes & VJ_NEW_U) {
+            if (vj_decode(cp, len, &i, &v) == -1) {
+                return vj_drop(vj);
+            }
+            th->flags |= TCP_URG;
+            store_be16(th->urg, v);
+        } else {
+            th->flags &= ~TCP_URG;
+        }
+        if (changes & VJ_NEW_W) {
+            if (vj_decode(cp, len, &i, &v) == -1) {
+                return vj_drop(vj);
+            }
+            store_be16(th->win, load_be16(th->win) + v);
+        }
+        if (changes & VJ_NEW_A) {
+            if (vj_decode(cp, len, &i, &v) == -1) {
+                return vj_drop(vj);
+            }
+            store_be32(th->ack, load_be32(th->ack) + v);
+        }
+        if (changes & VJ_NEW_S) {
+            if (vj_decode(cp, len, &i, &v) == -1) {
+                return vj_drop(vj);
+            }
+            store_be32(th->seq, load_be32(th->seq) + v);
+        }
+        break;
+    }
+    if (changes & VJ_NEW_I) {
+        if (vj_decode(cp, len, &i, &v) == -1) {
+            return vj_drop(vj);
+        }
+        ipv4_set_id(iph, ipv4_id(iph) + v);
+    } else {
+        ipv4_set_id(iph, ipv4_id(iph) + 1);
+    }
+
+    size_t total = hlen + (len - i);
+    if (total > 0xffff || total > size) {
+        errno = EMSGSIZE;
+        vj->toss = 1;
+        return -1;
+    }
+    ipv4_set_len(iph, (uint16_t)total);
+    ipv4_set_csum(iph, 0);
+    ipv4_set_csum(iph, csum((uint16_t *)hdr, ipv4_hlen(iph)));
+
+    memcpy(cs->hdr, hdr, hlen);
+    memcpy(out, hdr, hlen);
+    memcpy((uint8_t *)out + hlen, cp + i, len - i);
+    return total;
+}
@@ -0,0 +1,293 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Multi-worker receive and transmit over a fanout group */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <arp.h>
+#include <ctx.h>
+#include <graph.h>
+#include <pacer.h>
+#include <socket.h>
+#include <trace.h>
+#include <txsched.h>
+#include <udp.h>
+#include <worker.h>
+
+/* Worker states
+ *
+ * @member WORKER_STARTING -- Thread is setting itself up
+ * @member WORKER_RUNNING  -- Thread is in its loop
+ * @member WORKER_FAILED   -- Thread failed to set up and has exited
+ */
+enum WORKER_STATE {
+    WORKER_STARTING,
+    WORKER_RUNNING,
+    WORKER_FAILED
+};
+
+/* Tear down everything a worker owns
+ *
+ * @param worker *w -- Pointer to worker
+ */
+static void worker_cleanup(worker *w) {
+    if (w->sock) {
+        close_socket(w->sock);
+        w->sock = 0;
+    }
+    free(w->frame);
+    w->frame = 0;
+}
+
+/* Set up a worker on its own thread, so that everything it owns is
+ * allocated from memory close to its CPU.
+ *
+ * @param worker *w -- Pointer to worker
+ * @return int 0 on success or -1 on error.
+ *         Set errno on error.
+ */
+static int worker_setup(worker *w) {
+    worker_pool *pool = w->pool;
+    const worker_config *cfg = &pool->cfg;
+
+    w->ctx = netlib_ctx_create(w->cpu);
+    if (!w->ctx) {
+        return -1;
+    }
+    if (w->id) {
+        netlib_ctx_share_neighbors(w->ctx, pool->workers[0].ctx);
+    }
+    w->frame = netlib_ctx_alloc(WORKER_FRAME_SIZE);
+    if (!w->frame) {
+        return -1;
+    }
+
+    w->sock = new_socket(w->ctx, cfg->family, cfg->protocol, cfg->type,
+            cfg->smac, cfg->iface);
+    if (!w->sock) {
+        return -1;
+    }
+    if (w->sock->raw_sockfd == -1) {
+        return -1;
+    }
+    if (socket_join_fanout(w->sock, &pool->cfg.fanout_group, cfg->fanout_mode,
+                cfg->fanout_prog_fd) == -1) {
+        return -1;
+    }
+    if (socket_set_tx_queue(w->sock, cfg->tx_queue ? cfg->tx_queue :
+                WORKER_DEFAULT_TX_QUEUE) == -1) {
+        return -1;
+    }
+    if (cfg->rx_batch > WORKER_RX_BATCH_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (cfg->rx_batch && socket_set_rx_batch(w->sock, cfg->rx_batch,
+                cfg->latency_budget_us) == -1) {
+        return -1;
+    }
+    if (cfg->busy_poll && socket_set_rx_timeout(w->sock, 0) == -1) {
+        return -1;
+    }
+    if (cfg->setup && cfg->setup(w->sock, w->id, cfg->arg) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Receive whatever is waiting and pass it up the stack
+ *
+ * @param worker *w                -- Pointer to worker
+ * @param const worker_config *cfg -- Pool configuration
+ */
+static void worker_rx(worker *w, const worker_config *cfg) {
+    rx_frame frames[WORKER_RX_BATCH_MAX];
+    size_t n;
+
+    if (cfg->rx_batch) {
+        n = receive_batch(w->sock, frames, WORKER_RX_BATCH_MAX);
+    } else {
+        n = receive(w->sock, w->frame, WORKER_FRAME_SIZE);
+        frames[0].data = w->frame;
+        frames[0].len = n;
+        n = (n == (size_t)-1) ? n : 1;
+    }
+    if (n == (size_t)-1) {
+        return;
+    }
+    atomic_fetch_add_explicit(&w->rx_frames, n, memory_order_relaxed);
+    if (!cfg->rx) {
+        graph_rx(w->sock, frames, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if ((i + 1) < n) {
+            __builtin_prefetch(frames[i + 1].data);
+        }
+        cfg->rx(w->sock, frames[i].data, frames[i].len, cfg->arg);
+    }
+}
+
+/* Worker thread
+ *
+ * @param void *arg -- Pointer to worker
+ * @return int 0
+ */
+static int worker_main(void *arg) {
+    worker *w = (worker *)arg;
+    const worker_config *cfg = &w->pool->cfg;
+
+    if (worker_setup(w) == -1) {
+        w->error = errno;
+        worker_cleanup(w);
+        atomic_store_explicit(&w->state, WORKER_FAILED, memory_order_release);
+        return 0;
+    }
+    atomic_store_explicit(&w->state, WORKER_RUNNING, memory_order_release);
+
+    while (!atomic_load_explicit(&w->pool->stop, memory_order_relaxed)) {
+        worker_rx(w, cfg);
+        // Neighbor cache is shared, so only one worker runs its timers
+        if (!w->id) {
+            arp_tick(w->sock);
+        }
+        if (cfg->poll) {
+            cfg->poll(w->sock, cfg->arg);
+        }
+        if (w->sock->tx_ring) {
+            udp_drain(w->sock, WORKER_TX_BURST);
+        }
+        if (w->sock->txsched) {
+            txsched_run(w->sock);
+        }
+        if (w->sock->pacer) {
+            pacer_release(w->sock);
+        }
+        transmit_flush(w->sock);
+        TRACE_POLL(w->sock);
+    }
+    worker_cleanup(w);
+    return 0;
+}
+
+/* Wait for a worker to finish setting itself up
+ *
+ * @param worker *w -- Pointer to worker
+ * @return int 0 if worker is running or -1 if it failed.
+ *         Set errno on error.
+ */
+static int worker_wait(worker *w) {
+    int state;
+
+    while ((state = atomic_load_explicit(&w->state, memory_order_acquire)) ==
+            WORKER_STARTING) {
+        thrd_yield();
+    }
+    if (state == WORKER_FAILED) {
+        errno = w->error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Start a pool of workers.
+ *
+ * @param const worker_config *cfg -- Pool configuration
+ * @return pointer to running pool on success or 0 on error.
+ *         Set errno on error.
+ */
+worker_pool *workers_start(const worker_config *cfg) {
+    if (!cfg->workers) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    worker_pool *pool = netlib_ctx_alloc(sizeof(worker_pool));
+    if (!pool) {
+        return 0;
+    }
+    pool->cfg = *cfg;
+    pool->workers = netlib_ctx_alloc(cfg->workers * sizeof(worker));
+    if (!pool->workers) {
+        free(pool);
+        return 0;
+    }
+
+    /* Workers are started one by one. First one creates the fanout group
+     * and owns the neighbor cache, the rest join in.
+     */
+    for (unsigned i = 0; i < cfg->workers; i++) {
+        worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        w->cpu = cfg->cpus ? cfg->cpus[i] : (int)i;
+        atomic_init(&w->state, WORKER_STARTING);
+
+        if (thrd_create(&w->thread, worker_main, w) != thrd_success) {
+            errno = ENOMEM;
+            workers_stop(pool);
+            return 0;
+        }
+        pool->count++;
+        if (worker_wait(w) == -1) {
+            int err = errno;
+            workers_stop(pool);
+            errno = err;
+            return 0;
+        }
+    }
+    return pool;
+}
+
+/* Stop all workers and free the pool. Workers notice within one receive
+ * timeout.
+ *
+ * @param worker_pool *pool -- Pool to stop
+ */
+void workers_stop(worker_pool *pool) {
+    atomic_store(&pool->stop, true);
+    for (unsigned i = 0; i < pool->count; i++) {
+        thrd_join(pool->workers[i].thread, 0);
+    }
+    // Worker 0 owns the shared neighbor cache, so it goes last
+    for (unsigned i = pool->count; i-- > 0;) {
+        if (pool->workers[i].ctx) {
+            netlib_ctx_destroy(pool->workers[i].ctx);
+        }
+    }
+    free(pool->workers);
+    free(pool);
+}
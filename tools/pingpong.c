@@ -0,0 +1,434 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* UDP round-trip latency measurement
+ *
+ * Usage: netlib_pingpong -i iface -s addr/prefix (-c addr | -e) [options]
+ *   -i iface       Interface to use
+ *   -s addr/prefix Our address and subnet
+ *   -g addr        Default gateway
+ *   -c addr        Send probes to reflector at this address
+ *   -e             Reflect every datagram back to where it came from
+ *   -p port        Port of the reflector, 7 by default
+ *   -P port        Port probes are sent from, 7007 by default
+ *   -n count       Amount of probes, 10000 by default
+ *   -l size        Payload size, 64 by default
+ *   -I usec        Interval between probes, 0 to send next one right after
+ *                  a reply, the default
+ *   -w msec        How long to wait for a reply, 1000 by default
+ *   -b             Busy-poll instead of blocking in receive
+ *   -k             Use kernel UDP sockets instead of the stack, for comparison
+ *
+ * Either side can run in a network namespace at the other end of a veth
+ * pair, like:
+ *   ip netns add pp; ip link add veth0 type veth peer name veth1 netns pp
+ *   ip addr add 10.9.0.1/24 dev veth0; ip link set veth0 up
+ *   ip -n pp addr add 10.9.0.2/24 dev veth1; ip -n pp link set veth1 up
+ *   ip netns exec pp netlib_pingpong -i veth1 -s 10.9.0.2/24 -e -k
+ *   netlib_pingpong -i veth0 -s 10.9.0.3/24 -c 10.9.0.2 -b
+ * The stack needs an address of its own, as the kernel answers for the
+ * addresses it owns. A veth leaves checksums of kernel sent datagrams for
+ * hardware to fill in, so when a kernel peer talks to the stack over one,
+ * turn that off first with "ethtool -K veth1 tx off" on the kernel side.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arp.h>
+#include <ctx.h>
+#include <data_util.h>
+#include <hist.h>
+#include <ip.h>
+#include <link.h>
+#include <ring.h>
+#include <socket.h>
+#include <udp.h>
+
+#include "tool.h"
+
+// Tells our probes apart from whatever else arrives
+#define PINGPONG_MAGIC 0x70696e67
+
+// Largest payload we send
+#define PINGPONG_MAX_PAYLOAD (ETH_DEFAULT_MTU - sizeof(ipv4_hdr) - sizeof(udp_hdr))
+
+// Probes sent before measuring, to get addresses resolved and caches warm
+#define PINGPONG_WARMUP 10
+
+// How long blocking receives wait at a time, so timeouts get noticed
+#define PINGPONG_WAIT_US 10000
+
+// Datagrams the stack can hold for us
+#define PINGPONG_RING 256
+
+/* Payload of a probe
+ *
+ * @member uint32_t magic -- PINGPONG_MAGIC
+ * @member uint32_t seq   -- Sequence number of probe
+ * @member uint64_t tx_ns -- When probe was sent, only meaningful to sender
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint64_t tx_ns;
+} pingpong_probe;
+
+/* Where datagrams are sent and received through
+ *
+ * @member int fd           -- Kernel UDP socket, or -1 when using the stack
+ * @member net_socket *sock -- Socket of the stack
+ * @member uint32_t addr    -- Our address
+ * @member uint16_t port    -- Our port
+ * @member uint8_t *frame   -- Receive buffer for the stack
+ */
+typedef struct {
+    int fd;
+    net_socket *sock;
+    uint32_t addr;
+    uint16_t port;
+    uint8_t *frame;
+} pingpong_link;
+
+static volatile sig_atomic_t stop;
+
+static void pingpong_signal(int sig) {
+    stop = sig;
+}
+
+/* Send a datagram
+ *
+ * @param pingpong_link *l -- Link to send on
+ * @param const void *data -- Payload
+ * @param size_t len       -- Size of payload
+ * @param uint32_t addr    -- Destination address
+ * @param uint16_t port    -- Destination port
+ * @return int 0 on success or -1 on error.
+ */
+static int pingpong_send(pingpong_link *l, const void *data, size_t len,
+        uint32_t addr, uint16_t port)
+{
+    if (l->fd != -1) {
+        return (tool_udp_send(l->fd, data, len, addr, port) == -1) ? -1 : 0;
+    }
+    return (udp_send(l->sock, l->addr, addr, l->port, port, (uint8_t *)data, len) ==
+            (size_t)-1) ? -1 : 0;
+}
+
+/* Receive a datagram, waiting for one no longer than a receive does
+ *
+ * @param pingpong_link *l -- Link to receive on
+ * @param void *data       -- Buffer for payload
+ * @param size_t len       -- Size of buffer
+ * @param uint32_t *addr   -- Where to store source address
+ * @param uint16_t *port   -- Where to store source port
+ * @return size_t payload size on success or -1 if nothing arrived.
+ */
+static size_t pingpong_recv(pingpong_link *l, void *data, size_t len,
+        uint32_t *addr, uint16_t *port)
+{
+    void *elem;
+
+    if (l->fd != -1) {
+        return tool_udp_recv(l->fd, data, len, addr, port);
+    }
+    if (!spsc_peek(l->sock->rx_ring, &elem, 1)) {
+        // Nothing waiting, so let the stack have a look at the wire
+        size_t n = receive(l->sock, l->frame, ETH_DEFAULT_MTU + sizeof(eth_hdr));
+        if (n != (size_t)-1) {
+            link_rx(l->sock, l->frame, n);
+        }
+        arp_tick(l->sock);
+        if (!spsc_peek(l->sock->rx_ring, &elem, 1)) {
+            return -1;
+        }
+    }
+    udp_desc *d = (udp_desc *)elem;
+    size_t ret = (d->len < len) ? d->len : len;
+    memcpy(data, d->data, ret);
+    *addr = d->src;
+    *port = d->sport;
+    spsc_release(l->sock->rx_ring, 1);
+    return ret;
+}
+
+/* Reflect datagrams until interrupted
+ *
+ * @param pingpong_link *l -- Link to reflect on
+ */
+static void pingpong_reflect(pingpong_link *l) {
+    uint8_t buf[PINGPONG_MAX_PAYLOAD];
+    uint64_t count = 0;
+    uint32_t addr;
+    uint16_t port;
+
+    while (!stop) {
+        size_t n = pingpong_recv(l, buf, sizeof(buf), &addr, &port);
+        if (n != (size_t)-1 && pingpong_send(l, buf, n, addr, port) == 0) {
+            count++;
+        }
+    }
+    printf("reflected %" PRIu64 " datagrams\n", count);
+}
+
+/* Send probes and measure round trips
+ *
+ * @param pingpong_link *l -- Link to send probes on
+ * @param uint32_t dst     -- Address of reflector
+ * @param uint16_t dport   -- Port of reflector
+ * @param unsigned count   -- Amount of probes to measure
+ * @param size_t size      -- Payload size
+ * @param uint64_t interval -- Nanoseconds between probes
+ * @param uint64_t timeout -- Nanoseconds to wait for a reply
+ * @return int 0 if any replies came back, -1 otherwise
+ */
+static int pingpong_client(pingpong_link *l, uint32_t dst, uint16_t dport,
+        unsigned count, size_t size, uint64_t interval, uint64_t timeout)
+{
+    static hdr_hist rtt;
+    uint8_t buf[PINGPONG_MAX_PAYLOAD];
+    uint8_t reply[PINGPONG_MAX_PAYLOAD];
+    pingpong_probe *p = (pingpong_probe *)buf;
+    uint64_t received = 0;
+    uint64_t sent = 0;
+    uint64_t prev = 0;
+    double jitter = 0;
+
+    hist_reset(&rtt);
+    memset(buf, 0, sizeof(buf));
+    p->magic = PINGPONG_MAGIC;
+
+    for (unsigned seq = 0; seq < count + PINGPONG_WARMUP && !stop; seq++) {
+        uint64_t start = monotonic_ns();
+        p->seq = seq;
+        p->tx_ns = start;
+        if (pingpong_send(l, buf, size, dst, dport) == -1) {
+            fprintf(stderr, "send: %s\n", strerror(errno));
+            return -1;
+        }
+        sent += (seq >= PINGPONG_WARMUP);
+
+        for (;;) {
+            uint32_t addr;
+            uint16_t port;
+            size_t n = pingpong_recv(l, reply, sizeof(reply), &addr, &port);
+            uint64_t now = monotonic_ns();
+            const pingpong_probe *r = (const pingpong_probe *)reply;
+
+            // Late replies to probes we gave up on are ignored
+            if (n != (size_t)-1 && n >= sizeof(pingpong_probe) &&
+                    r->magic == PINGPONG_MAGIC && r->seq == seq) {
+                uint64_t ns = now - r->tx_ns;
+                if (seq >= PINGPONG_WARMUP) {
+                    hist_record(&rtt, ns);
+                    if (received++) {
+                        jitter += (ns > prev) ? (ns - prev) : (prev - ns);
+                    }
+                    prev = ns;
+                }
+                break;
+            }
+            if ((now - start) >= timeout || stop) {
+                break;
+            }
+        }
+        while (interval && (monotonic_ns() - start) < interval && !stop) {
+            if ((start + interval - monotonic_ns()) > 100000) {
+                usleep(50);
+            }
+        }
+    }
+
+    printf("%" PRIu64 " probes, %" PRIu64 " replies, %.2f%% lost\n", sent, received,
+            sent ? (100.0 * (sent - received)) / sent : 0.0);
+    if (!received) {
+        return -1;
+    }
+    printf("rtt min/avg/p50/p99/p99.9/max = %.2f/%.2f/%.2f/%.2f/%.2f/%.2f us, "
+            "jitter %.2f us\n",
+            rtt.min / 1e3, hist_mean(&rtt) / 1e3,
+            hist_percentile(&rtt, 50) / 1e3, hist_percentile(&rtt, 99) / 1e3,
+            hist_percentile(&rtt, 99.9) / 1e3, rtt.max / 1e3,
+            (received > 1) ? (jitter / (received - 1)) / 1e3 : 0.0);
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s -i iface -s addr/prefix (-c addr | -e) [-g addr] "
+            "[-p port] [-P port]\n\t[-n count] [-l size] [-I usec] [-w msec] [-b] [-k]\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    pingpong_link link;
+    uint8_t mac[6];
+    char *iface = 0;
+    uint32_t netmask = 0;
+    uint32_t gateway = 0;
+    uint32_t dst = 0;
+    uint32_t mask;
+    uint16_t port = 7;
+    int reflect = 0;
+    int busy = 0;
+    int kernel = 0;
+    unsigned count = 10000;
+    size_t size = 64;
+    uint64_t interval = 0;
+    uint64_t timeout = 1000000000ULL;
+    int opt;
+
+    memset(&link, 0, sizeof(link));
+    link.fd = -1;
+    link.port = 7007;
+
+    while ((opt = getopt(argc, argv, "i:s:g:c:ep:P:n:l:I:w:bk")) != -1) {
+        int ok = 1;
+        switch (opt) {
+        case ('i'):
+            iface = optarg;
+            break;
+        case ('s'):
+            ok = (tool_parse_addr(optarg, &link.addr, &netmask) == 0);
+            break;
+        case ('g'):
+            ok = (tool_parse_addr(optarg, &gateway, &mask) == 0);
+            break;
+        case ('c'):
+            ok = (tool_parse_addr(optarg, &dst, &mask) == 0);
+            break;
+        case ('e'):
+            reflect = 1;
+            break;
+        case ('p'):
+            port = (uint16_t)strtoul(optarg, 0, 10);
+            break;
+        case ('P'):
+            link.port = (uint16_t)strtoul(optarg, 0, 10);
+            break;
+        case ('n'):
+            count = (unsigned)strtoul(optarg, 0, 10);
+            break;
+        case ('l'):
+            size = strtoul(optarg, 0, 10);
+            ok = (size >= sizeof(pingpong_probe) && size <= PINGPONG_MAX_PAYLOAD);
+            break;
+        case ('I'):
+            interval = strtoull(optarg, 0, 10) * 1000;
+            break;
+        case ('w'):
+            timeout = strtoull(optarg, 0, 10) * 1000000;
+            break;
+        case ('b'):
+            busy = 1;
+            break;
+        case ('k'):
+            kernel = 1;
+            break;
+        default:
+            ok = 0;
+            break;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!iface || !link.addr || (reflect == !!dst)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (reflect) {
+        link.port = port;
+    }
+
+    signal(SIGINT, pingpong_signal);
+    signal(SIGTERM, pingpong_signal);
+
+    netlib_ctx *ctx = 0;
+    if (kernel) {
+        link.fd = tool_udp_open(link.addr, link.port, busy ? 0 : PINGPONG_WAIT_US);
+        if (link.fd == -1) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+            return 1;
+        }
+    } else {
+        if (tool_iface_mac(iface, mac) == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], iface, strerror(errno));
+            return 1;
+        }
+        ctx = netlib_ctx_create(NETLIB_CPU_ANY);
+        if (!ctx) {
+            perror(argv[0]);
+            return 1;
+        }
+        link.sock = new_socket(ctx, AF_INET, IPV4_PTCL_UDP, ETH, mac, iface);
+        link.frame = malloc(ETH_DEFAULT_MTU + sizeof(eth_hdr));
+        if (!link.sock || link.sock->raw_sockfd == -1 || !link.frame) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+            return 1;
+        }
+        link_set_ipv4(link.sock, link.addr, netmask, gateway);
+        link.sock->rx_ring = spsc_ring_create(PINGPONG_RING, UDP_DESC_SIZE(PINGPONG_MAX_PAYLOAD));
+        if (!link.sock->rx_ring ||
+                socket_bind(link.sock, IPV4_PTCL_UDP, link.port) == -1 ||
+                socket_set_rx_timeout(link.sock, busy ? 0 : PINGPONG_WAIT_US) == -1) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+            return 1;
+        }
+    }
+
+    int ret = 0;
+    if (reflect) {
+        pingpong_reflect(&link);
+    } else {
+        ret = pingpong_client(&link, dst, port, count, size, interval, timeout);
+    }
+
+    if (kernel) {
+        close(link.fd);
+    } else {
+        spsc_ring *ring = link.sock->rx_ring;
+        close_socket(link.sock);
+        spsc_ring_destroy(ring);
+        netlib_ctx_destroy(ctx);
+        free(link.frame);
+    }
+    return ret ? 1 : 0;
+}
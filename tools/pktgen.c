@@ -0,0 +1,477 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Multi-flow, rate controlled UDP traffic generator
+ *
+ * Usage: netlib_pktgen -i iface -s addr/prefix -d addr [options]
+ *   -i iface       Interface to send on
+ *   -s addr/prefix Our address and subnet
+ *   -d addr        Destination address
+ *   -g addr        Default gateway
+ *   -S count       Amount of source addresses, counting up from -s
+ *   -D count       Amount of destination addresses, counting up from -d
+ *   -p port        First source port, 9 by default
+ *   -P port        Destination port, 9 by default
+ *   -f flows       Amount of flows, 1 by default
+ *   -l size        Payload size: bytes, "imix", or "min-max" for uniformly
+ *                  random sizes. 64 by default.
+ *   -r pps         Packets per second to send, like 100k or 1.5M
+ *   -b bps         Bits per second to send, counting ethernet frames
+ *   -t threads     Amount of worker threads, 1 by default
+ *   -u             Leave worker threads unpinned, instead of on CPUs 0..t-1
+ *   -c count       Stop after this many packets, sent or failed
+ *   -T seconds     Stop after this many seconds
+ *
+ * Flow n goes from source address n % S and port p + n, to destination
+ * address n % D. Destinations need to answer ARP, or be a broadcast
+ * address. Rates are printed every second until interrupted.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ctx.h>
+#include <data_util.h>
+#include <eth.h>
+#include <ip.h>
+#include <link.h>
+#include <socket.h>
+#include <udp.h>
+#include <worker.h>
+
+#include "tool.h"
+
+// Headers in front of the payload of every frame
+#define PKTGEN_OVERHEAD (sizeof(eth_hdr) + sizeof(ipv4_hdr) + sizeof(udp_hdr))
+
+// Largest payload we send
+#define PKTGEN_MAX_PAYLOAD (ETH_DEFAULT_MTU - sizeof(ipv4_hdr) - sizeof(udp_hdr))
+
+// Most packets a worker sends per loop iteration
+#define PKTGEN_BURST 64
+
+// Falling further behind than this isn't made up for, to avoid a burst
+#define PKTGEN_MAX_LAG_NS 10000000.0
+
+/* How payload sizes are picked
+ *
+ * @member PKTGEN_FIXED  -- Every packet is the same size
+ * @member PKTGEN_IMIX   -- Simple IMIX, 64, 594 and 1518 byte frames at 7:4:1
+ * @member PKTGEN_RANDOM -- Uniformly random between min and max
+ */
+enum PKTGEN_SIZES {
+    PKTGEN_FIXED,
+    PKTGEN_IMIX,
+    PKTGEN_RANDOM
+};
+
+/* Generator configuration
+ *
+ * @member uint32_t src      -- First source address
+ * @member uint32_t netmask  -- Netmask of our subnet
+ * @member uint32_t gateway  -- Default gateway, or 0
+ * @member uint32_t dst      -- First destination address
+ * @member unsigned nsrc     -- Amount of source addresses
+ * @member unsigned ndst     -- Amount of destination addresses
+ * @member uint16_t sport    -- First source port
+ * @member uint16_t dport    -- Destination port
+ * @member unsigned flows    -- Amount of flows
+ * @member int sizes         -- Refer to enum PKTGEN_SIZES
+ * @member size_t min        -- Fixed size, or smallest random size
+ * @member size_t max        -- Largest random size
+ * @member double pps        -- Packets per second per worker, 0 for no limit
+ * @member double bps        -- Bits per second per worker, 0 for no limit
+ */
+typedef struct {
+    uint32_t src;
+    uint32_t netmask;
+    uint32_t gateway;
+    uint32_t dst;
+    unsigned nsrc;
+    unsigned ndst;
+    uint16_t sport;
+    uint16_t dport;
+    unsigned flows;
+    int sizes;
+    size_t min;
+    size_t max;
+    double pps;
+    double bps;
+} pktgen_config;
+
+/* State of a single worker. Counters are read by the main thread.
+ *
+ * @member atomic_ulong packets -- Packets sent
+ * @member atomic_ulong bytes   -- Frame bytes sent
+ * @member atomic_ulong errors  -- Packets that failed to send
+ * @member uint64_t quota       -- Packets left to send, UINT64_MAX for no limit
+ * @member double next          -- Departure time of next packet
+ * @member uint64_t rng         -- Random number generator state
+ * @member unsigned flow        -- Flow of next packet
+ * @member unsigned imix        -- Position in IMIX pattern
+ */
+typedef struct {
+    atomic_ulong packets;
+    atomic_ulong bytes;
+    atomic_ulong errors;
+    uint64_t quota;
+    double next;
+    uint64_t rng;
+    unsigned flow;
+    unsigned imix;
+} __attribute__((aligned(NETLIB_CACHELINE))) pktgen_worker;
+
+// Payloads of 64, 594 and 1518 byte frames, counting the FCS
+static const size_t pktgen_imix[] = {
+    18, 18, 548, 18, 18, 548, 18, 1472, 18, 548, 18, 548
+};
+
+static pktgen_config config;
+static pktgen_worker *workers;
+static _Thread_local pktgen_worker *self;
+static uint8_t payload[PKTGEN_MAX_PAYLOAD];
+static volatile sig_atomic_t stop;
+
+static void pktgen_signal(int sig) {
+    stop = sig;
+}
+
+/* Pick size of next payload
+ *
+ * @param const pktgen_config *cfg -- Generator configuration
+ * @param pktgen_worker *w        -- Pointer to worker
+ * @return size_t payload size
+ */
+static size_t pktgen_size(const pktgen_config *cfg, pktgen_worker *w) {
+    switch (cfg->sizes) {
+    case (PKTGEN_IMIX):
+        w->imix = (w->imix + 1) % (sizeof(pktgen_imix) / sizeof(pktgen_imix[0]));
+        return pktgen_imix[w->imix];
+    case (PKTGEN_RANDOM):
+        w->rng ^= w->rng << 13;
+        w->rng ^= w->rng >> 7;
+        w->rng ^= w->rng << 17;
+        return cfg->min + (w->rng % (cfg->max - cfg->min + 1));
+    default:
+        return cfg->min;
+    }
+}
+
+/* Set up socket of a worker, called on the worker's thread
+ *
+ * @param net_socket *sock -- Socket of the worker
+ * @param unsigned id      -- Index of the worker
+ * @param void *arg        -- Generator configuration
+ * @return int 0
+ */
+static int pktgen_setup(net_socket *sock, unsigned id, void *arg) {
+    const pktgen_config *cfg = (const pktgen_config *)arg;
+
+    self = &workers[id];
+    self->rng = (0x706b7467656eULL + id) | 1;
+    // Workers take turns with flows, so that they don't all start on the same one
+    self->flow = id;
+    self->next = (double)monotonic_ns();
+    link_set_ipv4(sock, cfg->src, cfg->netmask, cfg->gateway);
+    return 0;
+}
+
+/* Send whatever packets are due, called once per worker loop iteration
+ *
+ * @param net_socket *sock -- Socket of the worker
+ * @param void *arg        -- Generator configuration
+ */
+static void pktgen_poll(net_socket *sock, void *arg) {
+    const pktgen_config *cfg = (const pktgen_config *)arg;
+    pktgen_worker *w = self;
+    double now = (double)monotonic_ns();
+    unsigned burst = 0;
+    unsigned sent = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+
+    if (cfg->pps || cfg->bps) {
+        if ((now - w->next) > PKTGEN_MAX_LAG_NS) {
+            w->next = now;
+        }
+    }
+    while (w->quota && burst < PKTGEN_BURST && w->next <= now) {
+        unsigned flow = w->flow;
+        size_t size = pktgen_size(cfg, w);
+        uint32_t src = htonl(ntohl(cfg->src) + (flow % cfg->nsrc));
+        uint32_t dst = htonl(ntohl(cfg->dst) + (flow % cfg->ndst));
+
+        w->flow = (flow + 1) % cfg->flows;
+        if (udp_send(sock, src, dst, cfg->sport + flow, cfg->dport,
+                    payload, size) == (size_t)-1) {
+            errors++;
+        } else {
+            sent++;
+            bytes += size + PKTGEN_OVERHEAD;
+        }
+        burst++;
+        if (w->quota != UINT64_MAX) {
+            w->quota--;
+        }
+        if (cfg->bps) {
+            w->next += ((size + PKTGEN_OVERHEAD) * 8 * 1e9) / cfg->bps;
+        } else if (cfg->pps) {
+            w->next += 1e9 / cfg->pps;
+        }
+    }
+    atomic_fetch_add_explicit(&w->packets, sent, memory_order_relaxed);
+    atomic_fetch_add_explicit(&w->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&w->errors, errors, memory_order_relaxed);
+}
+
+/* Parse payload size argument
+ *
+ * @param const char *s -- Size, "imix" or "min-max"
+ * @return int 0 on success or -1 if size is invalid
+ */
+static int pktgen_parse_size(const char *s) {
+    char *end;
+
+    if (!strcmp(s, "imix")) {
+        config.sizes = PKTGEN_IMIX;
+        return 0;
+    }
+    config.min = strtoul(s, &end, 10);
+    config.max = config.min;
+    config.sizes = PKTGEN_FIXED;
+    if (*end == '-') {
+        config.max = strtoul(end + 1, &end, 10);
+        config.sizes = PKTGEN_RANDOM;
+    }
+    if (*end || config.min > config.max || config.max > PKTGEN_MAX_PAYLOAD) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Sum counters of all workers
+ *
+ * @param unsigned count   -- Amount of workers
+ * @param uint64_t *totals -- Packets, bytes and errors
+ */
+static void pktgen_totals(unsigned count, uint64_t *totals) {
+    totals[0] = totals[1] = totals[2] = 0;
+    for (unsigned i = 0; i < count; i++) {
+        totals[0] += atomic_load_explicit(&workers[i].packets, memory_order_relaxed);
+        totals[1] += atomic_load_explicit(&workers[i].bytes, memory_order_relaxed);
+        totals[2] += atomic_load_explicit(&workers[i].errors, memory_order_relaxed);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s -i iface -s addr/prefix -d addr [-g addr] [-S count] "
+            "[-D count]\n\t[-p port] [-P port] [-f flows] [-l size|imix|min-max] "
+            "[-r pps] [-b bps]\n\t[-t threads] [-u] [-c count] [-T seconds]\n", name);
+}
+
+int main(int argc, char **argv) {
+    worker_config wcfg;
+    uint8_t mac[6];
+    char *iface = 0;
+    unsigned threads = 1;
+    int unpinned = 0;
+    int *cpus = 0;
+    uint64_t count = 0;
+    unsigned seconds = 0;
+    uint32_t mask;
+    int opt;
+
+    memset(&config, 0, sizeof(config));
+    config.nsrc = config.ndst = config.flows = 1;
+    config.sport = config.dport = 9;
+    config.min = config.max = 64;
+
+    while ((opt = getopt(argc, argv, "i:s:d:g:S:D:p:P:f:l:r:b:t:uc:T:")) != -1) {
+        int ok = 1;
+        switch (opt) {
+        case ('i'):
+            iface = optarg;
+            break;
+        case ('s'):
+            ok = (tool_parse_addr(optarg, &config.src, &config.netmask) == 0);
+            break;
+        case ('d'):
+            ok = (tool_parse_addr(optarg, &config.dst, &mask) == 0);
+            break;
+        case ('g'):
+            ok = (tool_parse_addr(optarg, &config.gateway, &mask) == 0);
+            break;
+        case ('S'):
+            config.nsrc = (unsigned)strtoul(optarg, 0, 10);
+            ok = (config.nsrc > 0);
+            break;
+        case ('D'):
+            config.ndst = (unsigned)strtoul(optarg, 0, 10);
+            ok = (config.ndst > 0);
+            break;
+        case ('p'):
+            config.sport = (uint16_t)strtoul(optarg, 0, 10);
+            break;
+        case ('P'):
+            config.dport = (uint16_t)strtoul(optarg, 0, 10);
+            break;
+        case ('f'):
+            config.flows = (unsigned)strtoul(optarg, 0, 10);
+            ok = (config.flows > 0 && config.flows <= 65536);
+            break;
+        case ('l'):
+            ok = (pktgen_parse_size(optarg) == 0);
+            break;
+        case ('r'):
+            config.pps = tool_parse_rate(optarg);
+            ok = (config.pps > 0);
+            break;
+        case ('b'):
+            config.bps = tool_parse_rate(optarg);
+            ok = (config.bps > 0);
+            break;
+        case ('t'):
+            threads = (unsigned)strtoul(optarg, 0, 10);
+            ok = (threads > 0);
+            break;
+        case ('u'):
+            unpinned = 1;
+            break;
+        case ('c'):
+            count = strtoull(optarg, 0, 10);
+            break;
+        case ('T'):
+            seconds = (unsigned)strtoul(optarg, 0, 10);
+            break;
+        default:
+            ok = 0;
+            break;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!iface || !config.src || !config.dst) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (tool_iface_mac(iface, mac) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], iface, strerror(errno));
+        return 1;
+    }
+
+    workers = netlib_ctx_alloc(threads * sizeof(pktgen_worker));
+    cpus = calloc(threads, sizeof(int));
+    if (!workers || !cpus) {
+        perror(argv[0]);
+        return 1;
+    }
+    config.pps /= threads;
+    config.bps /= threads;
+    for (unsigned i = 0; i < threads; i++) {
+        workers[i].quota = count ? (count / threads) + (i < (count % threads)) : UINT64_MAX;
+        cpus[i] = unpinned ? NETLIB_CPU_ANY : (int)i;
+    }
+
+    memset(&wcfg, 0, sizeof(wcfg));
+    wcfg.family = AF_INET;
+    wcfg.protocol = IPV4_PTCL_UDP;
+    wcfg.type = ETH;
+    wcfg.smac = mac;
+    wcfg.iface = iface;
+    wcfg.workers = threads;
+    wcfg.cpus = cpus;
+    wcfg.fanout_mode = FANOUT_HASH;
+    wcfg.tx_queue = PKTGEN_BURST;
+    // Workers must never sleep in receive, or they'd miss departure times
+    wcfg.busy_poll = 1;
+    wcfg.setup = pktgen_setup;
+    wcfg.poll = pktgen_poll;
+    wcfg.arg = &config;
+
+    signal(SIGINT, pktgen_signal);
+    signal(SIGTERM, pktgen_signal);
+
+    worker_pool *pool = workers_start(&wcfg);
+    if (!pool) {
+        fprintf(stderr, "%s: starting workers: %s\n", argv[0], strerror(errno));
+        return 1;
+    }
+
+    uint64_t start = monotonic_ns();
+    uint64_t last = start;
+    uint64_t prev[3] = { 0, 0, 0 };
+    uint64_t cur[3];
+    while (!stop) {
+        uint64_t now = monotonic_ns();
+        uint64_t wait = (last + 1000000000ULL > now) ? (last + 1000000000ULL - now) : 0;
+        usleep((wait > 100000) ? 100000 : wait / 1000);
+
+        now = monotonic_ns();
+        pktgen_totals(threads, cur);
+        int done = (count && (cur[0] + cur[2]) >= count) ||
+            (seconds && (now - start) >= (uint64_t)seconds * 1000000000ULL);
+        if ((now - last) < 1000000000ULL && !done) {
+            continue;
+        }
+        double secs = (double)(now - last) / 1e9;
+        printf("%8.1fs  %12.0f pps  %10.2f Mbit/s  %" PRIu64 " errors\n",
+                (double)(now - start) / 1e9, (double)(cur[0] - prev[0]) / secs,
+                (double)(cur[1] - prev[1]) * 8 / secs / 1e6, cur[2] - prev[2]);
+        fflush(stdout);
+        memcpy(prev, cur, sizeof(prev));
+        last = now;
+        if (done) {
+            break;
+        }
+    }
+    workers_stop(pool);
+
+    double secs = (double)(monotonic_ns() - start) / 1e9;
+    pktgen_totals(threads, cur);
+    printf("total: %" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64 " errors in %.2fs, "
+            "%.0f pps, %.2f Mbit/s\n", cur[0], cur[1], cur[2], secs,
+            (double)cur[0] / secs, (double)cur[1] * 8 / secs / 1e6);
+    free(workers);
+    free(cpus);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Print statistics counters of a running netlib process
+ *
+ * Usage: netlib_stat [-a] [-p] [-s name] [-i seconds]
+ *   -a          Print counters that are zero too
+ *   -p          Print counters of each stack instance separately
+ *   -s name     Name of the shared memory segment, /netlib_stats by default
+ *   -i seconds  Keep printing how much counters grew every interval
+ *
+ * The process has to have called netlib_stats_export() first.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ctx.h>
+#include <stats.h>
+
+/* Print a set of counters
+ *
+ * @param const char *prefix     -- Printed in front of every name
+ * @param const netlib_stats *s  -- Current counters
+ * @param const netlib_stats *prev -- Counters of last interval, or 0
+ * @param unsigned interval      -- Seconds since last interval
+ * @param int all                -- Print zeroes too
+ */
+static void stat_print(const char *prefix, const netlib_stats *s,
+        const netlib_stats *prev, unsigned interval, int all)
+{
+    for (unsigned i = 0; i < NETLIB_STAT_COUNT; i++) {
+        uint64_t val = netlib_stat_get(s, i);
+        if (prev) {
+            val -= netlib_stat_get(prev, i);
+        }
+        if (!val && !all) {
+            continue;
+        }
+        if (prev) {
+            printf("%s%-28s %20" PRIu64 " %14.1f/s\n", prefix, netlib_stat_names[i],
+                    val, (double)val / interval);
+        } else {
+            printf("%s%-28s %20" PRIu64 "\n", prefix, netlib_stat_names[i], val);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *name = NETLIB_STATS_SHM;
+    unsigned interval = 0;
+    int all = 0;
+    int per_instance = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "api:s:")) != -1) {
+        switch (opt) {
+        case ('a'):
+            all = 1;
+            break;
+        case ('p'):
+            per_instance = 1;
+            break;
+        case ('i'):
+            interval = (unsigned)strtoul(optarg, 0, 10);
+            break;
+        case ('s'):
+            name = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-a] [-p] [-s name] [-i seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const netlib_stats_shm *shm = netlib_stats_attach(name);
+    if (!shm) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], name,
+                (errno == EPROTO) ? "not a netlib counter segment of this version" :
+                strerror(errno));
+        return 1;
+    }
+
+    // Previous totals, and previous counters of each instance
+    netlib_stats *prev = netlib_ctx_alloc((shm->slots + 1) * sizeof(netlib_stats));
+    netlib_stats *cur = netlib_ctx_alloc((shm->slots + 1) * sizeof(netlib_stats));
+    if (!prev || !cur) {
+        perror(argv[0]);
+        return 1;
+    }
+
+    for (int first = 1; ; first = 0) {
+        const netlib_stats *s;
+        char prefix[32];
+
+        netlib_stats_sum(shm, &cur[shm->slots]);
+        for (unsigned slot = 0; (s = netlib_stats_slot(shm, slot)); slot++) {
+            cur[slot] = *s;
+        }
+
+        if (interval && !first) {
+            printf("--\n");
+        }
+        if (per_instance) {
+            for (unsigned slot = 0; netlib_stats_slot(shm, slot); slot++) {
+                snprintf(prefix, sizeof(prefix), "%u.", slot);
+                stat_print(prefix, &cur[slot], (interval && !first) ? &prev[slot] : 0,
+                        interval, all);
+            }
+        } else {
+            stat_print("", &cur[shm->slots], (interval && !first) ? &prev[shm->slots] : 0,
+                    interval, all);
+        }
+        fflush(stdout);
+
+        if (!interval) {
+            break;
+        }
+        memcpy(prev, cur, (shm->slots + 1) * sizeof(netlib_stats));
+        sleep(interval);
+    }
+
+    free(prev);
+    free(cur);
+    netlib_stats_detach(shm);
+    return 0;
+}
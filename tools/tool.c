@@ -0,0 +1,146 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Helpers shared by the command line tools */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <data_util.h>
+
+#include "tool.h"
+
+/* Get MAC address of a network interface
+ *
+ * @param const char *iface -- Name of interface
+ * @param uint8_t *mac      -- Where to store the address, 6 bytes
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int tool_iface_mac(const char *iface, uint8_t *mac) {
+    char path[128];
+    unsigned b[6];
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/address", iface);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    int n = fscanf(f, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+    fclose(f);
+    if (n != 6) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < 6; i++) {
+        mac[i] = (uint8_t)b[i];
+    }
+    return 0;
+}
+
+/* Parse a rate like 100k, 2.5M or 10G
+ *
+ * @param const char *s -- String to parse
+ * @return double rate, or -1 if string isn't a valid rate
+ */
+double tool_parse_rate(const char *s) {
+    char *end;
+    double ret = strtod(s, &end);
+
+    if (end == s || ret < 0) {
+        return -1;
+    }
+    switch (*end) {
+    case ('k'):
+    case ('K'):
+        ret *= 1e3;
+        end++;
+        break;
+    case ('m'):
+    case ('M'):
+        ret *= 1e6;
+        end++;
+        break;
+    case ('g'):
+    case ('G'):
+        ret *= 1e9;
+        end++;
+        break;
+    }
+    return *end ? -1 : ret;
+}
+
+/* Parse IPv4 address with an optional prefix length, like 10.0.0.1/24
+ *
+ * @param const char *s     -- String to parse
+ * @param uint32_t *addr    -- Where to store the address, network byte order
+ * @param uint32_t *netmask -- Where to store the netmask, network byte
+ *                             order. /32 if there's no prefix length.
+ * @return int 0 on success or -1 if string isn't a valid address.
+ */
+int tool_parse_addr(const char *s, uint32_t *addr, uint32_t *netmask) {
+    char buf[32];
+    unsigned prefix = 32;
+    unsigned dots = 0;
+
+    if (strlen(s) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, s);
+    char *slash = strchr(buf, '/');
+    if (slash) {
+        char *end;
+        *slash = 0;
+        prefix = (unsigned)strtoul(slash + 1, &end, 10);
+        if (end == slash + 1 || *end || prefix > 32) {
+            return -1;
+        }
+    }
+    // inet_addr() takes whatever it's given, so check the form here
+    for (const char *p = buf; *p; p++) {
+        if (*p == '.') {
+            dots++;
+        } else if (*p < '0' || *p > '9') {
+            return -1;
+        }
+    }
+    if (dots != 3) {
+        return -1;
+    }
+    *addr = inet_addr(buf);
+    *netmask = prefix ? htonl(~(uint32_t)0 << (32 - prefix)) : 0;
+    return 0;
+}
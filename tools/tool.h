@@ -0,0 +1,100 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Helpers shared by the command line tools */
+#ifndef __NETLIB_TOOL_H__
+#define __NETLIB_TOOL_H__
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/* Get MAC address of a network interface
+ *
+ * @param const char *iface -- Name of interface
+ * @param uint8_t *mac      -- Where to store the address, 6 bytes
+ * @return int 0 on success or -1 on error.
+ *         set errno on error.
+ */
+int tool_iface_mac(const char *iface, uint8_t *mac);
+
+/* Parse a rate like 100k, 2.5M or 10G
+ *
+ * @param const char *s -- String to parse
+ * @return double rate, or -1 if string isn't a valid rate
+ */
+double tool_parse_rate(const char *s);
+
+/* Parse IPv4 address with an optional prefix length, like 10.0.0.1/24
+ *
+ * @param const char *s     -- String to parse
+ * @param uint32_t *addr    -- Where to store the address, network byte order
+ * @param uint32_t *netmask -- Where to store the netmask, network byte
+ *                             order. /32 if there's no prefix length.
+ * @return int 0 on success or -1 if string isn't a valid address.
+ */
+int tool_parse_addr(const char *s, uint32_t *addr, uint32_t *netmask);
+
+/* Open kernel UDP socket, to compare the stack against
+ *
+ * @param uint32_t addr -- Address to bind to, network byte order
+ * @param uint16_t port -- Port to bind to, host byte order
+ * @param unsigned usec -- How long receives wait, 0 to never block
+ * @return int socket on success or -1 on error.
+ *         set errno on error.
+ */
+int tool_udp_open(uint32_t addr, uint16_t port, unsigned usec);
+
+/* Send datagram on kernel UDP socket
+ *
+ * @param int fd           -- Socket from tool_udp_open()
+ * @param const void *data -- Payload
+ * @param size_t len       -- Size of payload
+ * @param uint32_t addr    -- Destination address, network byte order
+ * @param uint16_t port    -- Destination port, host byte order
+ * @return ssize_t bytes sent on success or -1 on error.
+ *         set errno on error.
+ */
+ssize_t tool_udp_send(int fd, const void *data, size_t len, uint32_t addr, uint16_t port);
+
+/* Receive datagram on kernel UDP socket
+ *
+ * @param int fd        -- Socket from tool_udp_open()
+ * @param void *data    -- Buffer to receive payload into
+ * @param size_t len    -- Size of buffer
+ * @param uint32_t *addr -- Where to store source address, network byte order
+ * @param uint16_t *port -- Where to store source port, host byte order
+ * @return ssize_t bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived in time.
+ */
+ssize_t tool_udp_recv(int fd, void *data, size_t len, uint32_t *addr, uint16_t *port);
+
+#endif // __NETLIB_TOOL_H__
@@ -0,0 +1,126 @@
+/*
+ BSD 3-Clause License
+ 
+ Copyright (c) 2025, k4m1 <me@k4m1.net>
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holder nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Kernel UDP sockets for the tools. Kept apart from the rest, as the
+ * system's byte order helpers clash with ours.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tool.h"
+
+/* Open kernel UDP socket, to compare the stack against
+ *
+ * @param uint32_t addr -- Address to bind to, network byte order
+ * @param uint16_t port -- Port to bind to, host byte order
+ * @param unsigned usec -- How long receives wait, 0 to never block
+ * @return int socket on success or -1 on error.
+ *         set errno on error.
+ */
+int tool_udp_open(uint32_t addr, uint16_t port, unsigned usec) {
+    struct sockaddr_in sin;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = addr;
+    sin.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    int ret;
+    if (!usec) {
+        ret = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    } else {
+        struct timeval tv = { .tv_sec = usec / 1000000, .tv_usec = usec % 1000000 };
+        ret = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    if (ret == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Send datagram on kernel UDP socket
+ *
+ * @param int fd           -- Socket from tool_udp_open()
+ * @param const void *data -- Payload
+ * @param size_t len       -- Size of payload
+ * @param uint32_t addr    -- Destination address, network byte order
+ * @param uint16_t port    -- Destination port, host byte order
+ * @return ssize_t bytes sent on success or -1 on error.
+ *         set errno on error.
+ */
+ssize_t tool_udp_send(int fd, const void *data, size_t len, uint32_t addr, uint16_t port) {
+    struct sockaddr_in sin;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = addr;
+    sin.sin_port = htons(port);
+    return sendto(fd, data, len, 0, (struct sockaddr *)&sin, sizeof(sin));
+}
+
+/* Receive datagram on kernel UDP socket
+ *
+ * @param int fd        -- Socket from tool_udp_open()
+ * @param void *data    -- Buffer to receive payload into
+ * @param size_t len    -- Size of buffer
+ * @param uint32_t *addr -- Where to store source address, network byte order
+ * @param uint16_t *port -- Where to store source port, host byte order
+ * @return ssize_t bytes received on success or -1 on error.
+ *         set errno on error, EAGAIN if nothing arrived in time.
+ */
+ssize_t tool_udp_recv(int fd, void *data, size_t len, uint32_t *addr, uint16_t *port) {
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+
+    ssize_t ret = recvfrom(fd, data, len, 0, (struct sockaddr *)&sin, &slen);
+    if (ret != -1) {
+        *addr = sin.sin_addr.s_addr;
+        *port = ntohs(sin.sin_port);
+    }
+    return ret;
+}